@@ -46,6 +46,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
 #include <map>
 #include <stdint.h>
 #include <string.h>
+#include <type_traits>
 #include "PartioAttribute.h"
 #include "PartioIterator.h"
 
@@ -54,8 +55,42 @@ namespace Partio{
 //! Opaque random access method to a single particle. No number is implied or guaranteed.
 typedef uint64_t ParticleIndex;
 
+//! Acceleration structures ParticlesDataMutable::sort() can build for neighbor queries
+enum class IndexType
+{
+    KdTree,        //!< balanced kd-tree, good for any distribution and query
+    HashGrid,      //!< uniform grid of hashed cells, fastest for fixed-radius queries on evenly spread points
+    KdTreeInPlace  //!< KdTree reading the position attribute instead of a copy of it, 4 bytes
+                   //!< per particle instead of 16, but slower to query. Positions must not be
+                   //!< written until the next sort(). Containers that cannot share their
+                   //!< positions build a KdTree.
+};
+
 class ParticlesData;
 class ParticlesDataMutable;
+class SpatialIndex;
+class SpatialIndexPtr;
+
+//! Receives the particles found by ParticlesData::forEachInBox and forEachInRadius
+class PointVisitor
+{
+public:
+    virtual ~PointVisitor() {}
+    //! Called for each particle found, with its squared distance to the
+    //! query center (0 for boxes). Returning false stops the search.
+    virtual bool visit(const ParticleIndex index,const float distanceSquared)=0;
+};
+
+//! PointVisitor calling a function object, see ParticlesData::forEachInBox
+template<class FUNC> class FunctionVisitor:public PointVisitor
+{
+public:
+    FunctionVisitor(FUNC& func):func(func) {}
+    bool visit(const ParticleIndex index,const float distanceSquared)
+    {return func(index,distanceSquared);}
+private:
+    FUNC& func;
+};
 // Particle Collection Interface
 //!  Particle Collection Interface
 /*!
@@ -75,7 +110,7 @@ public:
     virtual void release()=0;
 
     //! Number of particles in the structure.
-    virtual int numParticles() const=0;
+    virtual int64_t numParticles() const=0;
 
     //! Number of per-particle attributes.
     virtual int numAttributes() const=0;
@@ -151,25 +186,156 @@ public:
     //! Find the points within the bounding box specified.
     //! Must call sort() before using this function
     //! NOTE: points array is not pre-cleared.
-    virtual void findPoints(const float bboxMin[3],const float bboxMax[3],
-        std::vector<ParticleIndex>& points) const=0;
+    void findPoints(const float bboxMin[3],const float bboxMax[3],
+        std::vector<ParticleIndex>& points) const;
+
+    //! Calls visitor.visit() for each point within the bounding box, as it is
+    //! found and in no particular order, without allocating. Stops as soon as
+    //! visit() returns false and returns false if it did.
+    //! Must call sort() before using this function
+    bool forEachInBox(const float bboxMin[3],const float bboxMax[3],PointVisitor& visitor) const;
+
+    //! forEachInBox calling func(index,distanceSquared), which returns false to stop
+    template<class FUNC> typename std::enable_if<!std::is_base_of<PointVisitor,FUNC>::value,bool>::type
+    forEachInBox(const float bboxMin[3],const float bboxMax[3],FUNC func) const
+    {FunctionVisitor<FUNC> visitor(func);return forEachInBox(bboxMin,bboxMax,static_cast<PointVisitor&>(visitor));}
+
+    //! Find the points inside the convex volume bounded by nPlanes planes,
+    //! such as a camera frustum. Plane i is (a,b,c,d) at planes[4*i] and
+    //! points with a*x+b*y+c*z+d>=0 are on its inside.
+    //! Must call sort() before using this function
+    //! NOTE: points array is not pre-cleared.
+    void findPointsInFrustum(const float* planes,const int nPlanes,
+        std::vector<ParticleIndex>& points) const;
+
+    //! Find the points within radius of the ray from origin along direction,
+    //! up to length away from origin (pass FLT_MAX for no limit)
+    //! Must call sort() before using this function
+    //! NOTE: points array is not pre-cleared.
+    void findPointsAlongRay(const float origin[3],const float direction[3],const float radius,
+        const float length,std::vector<ParticleIndex>& points) const;
+
+    //! Find the points inside the box centered at center that extends
+    //! halfExtents[i] both ways along the orthonormal axis i stored at axes[3*i]
+    //! Must call sort() before using this function
+    //! NOTE: points array is not pre-cleared.
+    void findPointsInOrientedBox(const float center[3],const float axes[9],const float halfExtents[3],
+        std::vector<ParticleIndex>& points) const;
 
     //! Find the N nearest neighbors that are within maxRadius distance using STL types
     //! (measured in standard 2-norm). If less than N are found within the
     //! radius, the search radius is not increased.
     //! NOTE: points/pointsDistancesSquared are cleared before use.
     //! Must call sort() before using this function
-    virtual float findNPoints(const float center[3],int nPoints,const float maxRadius,
-        std::vector<ParticleIndex>& points,std::vector<float>& pointDistancesSquared) const=0;
+    float findNPoints(const float center[3],int nPoints,const float maxRadius,
+        std::vector<ParticleIndex>& points,std::vector<float>& pointDistancesSquared) const;
 
     //! Find the N nearest neighbors that are within maxRadius distance using POD types
     //! NOTE: returns the number of found points and leaves in finalRadius2 the
     //! square of the final search radius used
-    virtual int findNPoints(const float center[3],int nPoints,const float maxRadius,
-        ParticleIndex *points, float *pointDistancesSquared, float *finalRadius2) const=0;
+    int findNPoints(const float center[3],int nPoints,const float maxRadius,
+        ParticleIndex *points, float *pointDistancesSquared, float *finalRadius2) const;
+
+    //! Approximate version of the POD findNPoints for when exact neighbors are
+    //! not needed. The farthest point returned is at most (1+epsilon) times
+    //! farther than the exact nPoints-th nearest. If maxVisited is positive at
+    //! most that many leaf buckets of the KdTree are searched and the nearest
+    //! points seen until then are returned. Other indices answer exactly.
+    //! Must call sort() before using this function
+    int findNPointsApprox(const float center[3],int nPoints,const float maxRadius,const float epsilon,
+        const int maxVisited,ParticleIndex *points,float *pointDistancesSquared,float *finalRadius2) const;
+
+    //! Runs findNPoints for nQueries query points in parallel (using STL-free flat arrays)
+    //! queries holds 3 floats per query. Query q writes up to nPoints indices and squared
+    //! distances starting at outIndices+q*nPoints and outDistancesSquared+q*nPoints, and the
+    //! number found to outCounts[q]. Entries past the count are left untouched.
+    //! sortQueries processes the queries in Morton order, which helps when they are not
+    //! already spatially coherent. Must call sort() before using this function
+    void findNPointsBatch(const float* queries,int64_t nQueries,int nPoints,const float maxRadius,
+        ParticleIndex* outIndices,float* outDistancesSquared,int* outCounts,bool sortQueries=true) const;
+
+    //! findNPointsBatch warm started from an earlier result, e.g. the same particles' neighbors
+    //! on the previous frame. Query q's seeds are the seedCounts[q] particle indices starting at
+    //! seedIndices+q*nPoints. When nPoints distinct seeds are given, the search radius starts at
+    //! their farthest current distance instead of maxRadius, so most of the tree is pruned
+    //! at once while neighborhoods change little. The neighbors found are the same (up to ties)
+    //! as without seeds. seedIndices and seedCounts may be outIndices and outCounts, to update a
+    //! result in place. The seeds' positions are read by particle index, so this pays off when
+    //! nearby particles are stored near each other. Must call sort() before using this function
+    void findNPointsSeeded(const float* queries,int64_t nQueries,int nPoints,const float maxRadius,
+        const ParticleIndex* seedIndices,const int* seedCounts,ParticleIndex* outIndices,float* outDistancesSquared,
+        int* outCounts,bool sortQueries=true) const;
+
+    //! Find all points within radius of center (measured in standard 2-norm),
+    //! appending their indices and squared distances. If sorted is true the
+    //! points found by this call are ordered by increasing distance.
+    //! NOTE: points/pointDistancesSquared are not pre-cleared.
+    //! Must call sort() before using this function
+    void findPointsInRadius(const float center[3],const float radius,std::vector<ParticleIndex>& points,
+        std::vector<float>& pointDistancesSquared,bool sorted=false) const;
+
+    //! Calls visitor.visit() with each point within radius of center and its
+    //! squared distance, as it is found and in no particular order, without
+    //! allocating. Stops as soon as visit() returns false and returns false if it did.
+    //! Must call sort() before using this function
+    bool forEachInRadius(const float center[3],const float radius,PointVisitor& visitor) const;
+
+    //! forEachInRadius calling func(index,distanceSquared), which returns false to stop
+    template<class FUNC> typename std::enable_if<!std::is_base_of<PointVisitor,FUNC>::value,bool>::type
+    forEachInRadius(const float center[3],const float radius,FUNC func) const
+    {FunctionVisitor<FUNC> visitor(func);return forEachInRadius(center,radius,static_cast<PointVisitor&>(visitor));}
+
+    //! Runs findPointsInRadius for nQueries query points (3 floats each) in parallel.
+    //! Results are stored in compressed rows: query q's points and squared distances
+    //! are at [offsets[q],offsets[q+1]) in points and pointDistancesSquared, which are
+    //! resized to fit. Must call sort() before using this function
+    void findPointsInRadiusBatch(const float* queries,int64_t nQueries,const float radius,
+        std::vector<int64_t>& offsets,std::vector<ParticleIndex>& points,std::vector<float>& pointDistancesSquared,
+        bool sorted=false) const;
+
+    //! Number of points within the bounding box, counted without listing
+    //! them. The KdTree counts subtrees inside the box whole, so this takes
+    //! close to logarithmic time. Must call sort() before using this function
+    int64_t countInBox(const float bboxMin[3],const float bboxMax[3]) const;
+
+    //! Number of points within radius of center, see countInBox
+    //! Must call sort() before using this function
+    int64_t countInRadius(const float center[3],const float radius) const;
+
+    //! Sets sums to the attribute.count sums of attribute over the points
+    //! within the bounding box and returns how many there are, which gives
+    //! their mean. Takes close to logarithmic time after augmentIndex(attribute),
+    //! otherwise visits every point. Must call sort() before using this function
+    int64_t sumInBox(const ParticleAttribute& attribute,const float bboxMin[3],const float bboxMax[3],
+        double* sums) const;
+
+    //! Find the points whose sphere, of the radius given to setIndexRadius(),
+    //! overlaps the bounding box even if their center is outside it.
+    //! Must call sort() and setIndexRadius() before using this function
+    //! NOTE: points array is not pre-cleared.
+    void findOverlapping(const float bboxMin[3],const float bboxMax[3],
+        std::vector<ParticleIndex>& points) const;
+
+    //! Find the points whose sphere, of the radius given to setIndexRadius(),
+    //! overlaps the sphere of radius around center.
+    //! Must call sort() and setIndexRadius() before using this function
+    //! NOTE: points array is not pre-cleared.
+    void findOverlappingInRadius(const float center[3],const float radius,
+        std::vector<ParticleIndex>& points) const;
+
+    //! Writes the KdTree built by sort() to filename for loadIndex(). If
+    //! sourceFile (the file the particles were read from) is given, its size
+    //! and modification time are recorded so a stale index is not loaded.
+    //! Returns false on failure.
+    bool saveIndex(const char* filename,const char* sourceFile=0) const;
+
+    //! The index published by sort(), or 0 if the set cannot be indexed. The
+    //! find functions above load() a snapshot of it, which stays alive and
+    //! unchanged while they run even if another thread publishes a new one.
+    virtual SpatialIndexPtr* spatialIndex() const {return 0;}
 
     //! Produce a const iterator
-    virtual const_iterator setupConstIterator(const int index=0) const=0;
+    virtual const_iterator setupConstIterator(const int64_t index=0) const=0;
 
     //! Produce a beginning iterator for the particles
     const_iterator begin() const
@@ -241,9 +407,42 @@ public:
     virtual void setFixedIndexedStr(const FixedAttribute& attribute,int indexedStringToken,const char* str)=0;
 
     //! Preprocess the data for finding nearest neighbors by sorting into a
-    //! KD-Tree. Note: all particle pointers are invalid after this call.
+    //! KD-Tree. Particles added afterwards are found by the find functions
+    //! without sorting again, their positions may change until the next
+    //! particles are added. Other particles must not move once sorted.
+    //! May be called while other threads run the find functions, which
+    //! finish on the index they started with. So may adding particles,
+    //! which publishes a new index the same way. Those threads may then
+    //! find the added particles before their positions are set.
     virtual void sort()=0;
 
+    //! Preprocess the data for finding nearest neighbors by building the given
+    //! index. cellSize sets the HashGrid's cell size, it should be close to the
+    //! query radius and is picked from the particle density when zero. The find
+    //! functions use whichever index was built last. Sets that only have one
+    //! kind of index build it with sort().
+    virtual void sort(const IndexType,const float=0) {sort();}
+
+    //! Uses an index written by saveIndex() instead of sorting. The file is
+    //! memory mapped and queried in place. Fails if it was saved for a
+    //! different number of particles or, when sourceFile is given, if that
+    //! file changed since.
+    bool loadIndex(const char* filename,const char* sourceFile=0);
+
+    //! Stores per subtree sums of attribute in the KdTree built by sort() so
+    //! sumInBox adds up whole subtrees at once. They are a snapshot: call it
+    //! again after changing the attribute. Sorting or adding particles drops
+    //! them. Returns false if the index is not a KdTree. Queries may run
+    //! meanwhile, they use the index without the new sums until it is done.
+    bool augmentIndex(const ParticleAttribute& attribute);
+
+    //! Stores each particle's radius, read from a single component attribute
+    //! such as radius or pscale, in the KdTree built by sort(), along with the
+    //! largest radius under each node, for findOverlapping(). Like augmentIndex()
+    //! this is a snapshot that sorting or adding particles drops, and queries
+    //! may run meanwhile. Returns false if the index is not a KdTree.
+    bool setIndexRadius(const ParticleAttribute& attribute);
+
     //! Adds an attribute to the particle with the provided name, type and count
     virtual ParticleAttribute addAttribute(const char* attribute,ParticleAttributeType type,
         const int count)=0;
@@ -257,7 +456,7 @@ public:
 
     //! Add a set of particles to the particle set. Returns the offset to the
     //! first particle
-    virtual iterator addParticles(const int count)=0;
+    virtual iterator addParticles(const int64_t count)=0;
 
     //! Produce a beginning iterator for the particles
     iterator begin()
@@ -268,7 +467,7 @@ public:
     {return iterator();}
 
     //! Produce a const iterator
-    virtual iterator setupIterator(const int index=0)=0;
+    virtual iterator setupIterator(const int64_t index=0)=0;
 
 private:
     virtual void* dataInternal(const ParticleAttribute& attribute,const ParticleIndex particleIndex) const=0;
@@ -296,6 +495,20 @@ ParticlesDataMutable* clone(const ParticlesData&, bool particles, const std::map
 //! freed with p->release()
 ParticlesDataMutable* read(const char* filename,const bool verbose=true,std::ostream& errorStream=std::cerr);
 
+//! Reads a particle file into an existing particle set
+/*!
+  Meant for playback and per-frame jobs that read one frame after another.
+  existing must come from create() or read(), PartioStatic.h has an overload
+  for ParticlesStatic sets. Its particles and attributes are replaced by the
+  file's. The columns of the frame replaced are kept as spares, and the next
+  call reads into the spares whose attribute name, type and count match its
+  file, along with their indexed string tables. Reading thus alternates between
+  two sets of columns, which only grow when a file has more particles than they
+  have room for. Returns false on failure, in which case existing is left
+  unchanged.
+*/
+bool readInto(const char* filename,ParticlesDataMutable& existing,const bool verbose=true,std::ostream& errorStream=std::cerr);
+
 //! Provides read access to a particle headers (number of particles
 //! and attribute information, much cheapeer
 ParticlesInfo* readHeaders(const char* filename,const bool verbose=true,std::ostream& errorStream=std::cerr);
@@ -309,7 +522,9 @@ void write(const char* filename,const ParticlesData&,const bool forceCompressed=
   Loads a file read-only if not already in memory, otherwise returns
   already loaded item. Pointer is owned by Partio and must be released
   with p->release(); (will not be deleted if others are also holding).
-  If you want to do finding neighbors give true to sort
+  If you want to do finding neighbors give true to sort. The KdTree is then
+  loaded from filename+".kdtree" instead if that file was written with
+  saveIndex(filename+".kdtree",filename) for the file as it is now.
 */
 ParticlesData* readCached(const char* filename,const bool sort,const bool verbose=true,std::ostream& errorStream=std::cerr);
 
@@ -335,6 +550,226 @@ void print(const ParticlesData* particles);
 
 ParticlesDataMutable* computeClustering(ParticlesDataMutable* particles, const int numNeighbors,const double radiusSearch,const double radiusInside,const int connections,const double density);
 
+//! Per-particle neighbor lists in compressed row form
+/*!
+  Particle i's neighbors and their squared distances are stored at
+  [offsets[i],offsets[i+1]) in indices and distancesSquared, ordered by
+  increasing distance. offsets has numParticles()+1 entries.
+*/
+struct NeighborGraph
+{
+    std::vector<int64_t> offsets;
+    std::vector<ParticleIndex> indices;
+    std::vector<float> distancesSquared;
+
+    int64_t numNodes() const {return offsets.empty() ? 0 : int64_t(offsets.size())-1;}
+    int64_t numNeighbors(const int64_t i) const {return offsets[i+1]-offsets[i];}
+};
+
+//! Builds the graph of each particle's numNeighbors nearest particles within maxRadius
+/*!
+  The particle itself is left out of its row unless includeSelf is set.
+  Rows are computed in parallel. Must call sort() before using this function
+*/
+void buildNeighborGraph(const ParticlesData& particles,const int numNeighbors,const float maxRadius,
+    NeighborGraph& graph,const bool includeSelf=false);
+
+//! Builds the graph of all particles within radius of each particle
+/*!
+  The graph is symmetric: j is in i's row exactly when i is in j's row.
+  Each pair's distance is computed once, from cells as large as the radius,
+  and rows are ordered by distance. Must call sort() before using this
+  function, the index is searched instead for radii that need too many cells.
+*/
+void buildNeighborGraph(const ParticlesData& particles,const float radius,NeighborGraph& graph,
+    const bool includeSelf=false);
+
+//! Builds the graph of each of a's particles to its numNeighbors nearest particles of b within maxRadius
+/*!
+  Row i holds indices into b, nearest first. a and b may be the same set, in which
+  case each particle finds itself. Rows are computed in parallel. Must call sort() on b
+  before using this function
+*/
+void nearestJoin(const ParticlesData& a,const ParticlesData& b,const int numNeighbors,const float maxRadius,
+    NeighborGraph& graph);
+
+//! Neighbor queries in a space made of float attributes instead of position
+/*!
+  Each particle is the point whose coordinates are the components of the
+  indexed attributes in order, each multiplied by its axis weight, e.g.
+  position and velocity give a 6 dimensional space. Query points and boxes
+  are given in attribute units and radii and distances in the weighted space.
+  The values are copied when the index is built, so later changes to the
+  particles are not seen. Created with createAttributeIndex(), freed with
+  release().
+*/
+class AttributeIndex
+{
+protected:
+    virtual ~AttributeIndex(){}
+public:
+    //! Most components the attributes of one index may have together
+    static const int MaxDimension=9;
+
+    virtual void release()=0;
+    //! Number of axes, the total count of the indexed attributes
+    virtual int dimension() const=0;
+    //! Returns the indices of all particles whose values are inside the box [bboxMin,bboxMax]
+    virtual void findPoints(const float* bboxMin,const float* bboxMax,std::vector<ParticleIndex>& points) const=0;
+    //! Finds the nPoints nearest particles to query within maxRadius, like ParticlesData::findNPoints
+    virtual float findNPoints(const float* query,int nPoints,const float maxRadius,
+        std::vector<ParticleIndex>& points,std::vector<float>& pointDistancesSquared) const=0;
+};
+
+//! Builds an AttributeIndex over the given FLOAT or VECTOR attributes of particles
+/*!
+  weights holds one non-negative entry per axis, or is null to weight all
+  axes by one. Returns null if an attribute is not float, a weight is
+  negative or the attributes have more than MaxDimension components.
+*/
+AttributeIndex* createAttributeIndex(const ParticlesData& particles,const std::vector<ParticleAttribute>& attributes,
+    const float* weights=0);
+
+//! Level of detail hierarchy over a particle set, built by buildLodOctree()
+/*!
+  Each node of the octree stands for the particles inside its cell with one
+  representative point. Nodes are stored parent before children, the
+  children of a node are consecutive, and node 0 is the root. A node's
+  particles are points[pointBegins[i],pointEnds[i]).
+*/
+struct LodOctree
+{
+    //! The particles reordered so that those of each node are contiguous
+    std::vector<ParticleIndex> points;
+    std::vector<int64_t> pointBegins;
+    std::vector<int64_t> pointEnds;
+    //! Node i's children are [firstChild[i],firstChild[i]+childCounts[i]), leaves have none
+    std::vector<int64_t> firstChild;
+    std::vector<unsigned char> childCounts;
+    //! Mean position of the node's particles, 3 floats per node
+    std::vector<float> centers;
+    //! Radius around the center that holds the particles, with their own radii
+    std::vector<float> radii;
+    //! Means of the aggregated float attributes, weighted by each particle's
+    //! squared radius, numValues floats per node in the order given
+    int numValues;
+    std::vector<float> values;
+    //! Most common value of each aggregated INDEXEDSTR attribute, numTokens per node
+    int numTokens;
+    std::vector<int> tokens;
+
+    LodOctree():numValues(0),numTokens(0){}
+    int64_t numNodes() const {return int64_t(radii.size());}
+    int64_t count(const int64_t i) const {return pointEnds[i]-pointBegins[i];}
+
+    //! Picks the coarsest set of nodes seen from eye whose radius covers at most maxError
+    //! pixels, where pixelsPerUnit is the size in pixels of one unit at distance one. Leaves
+    //! that are still too large give their particles instead. nodes and particles are cleared.
+    void selectByError(const float eye[3],const float pixelsPerUnit,const float maxError,
+        std::vector<int64_t>& nodes,std::vector<ParticleIndex>& particles) const;
+    //! Picks at most maxPoints nodes and particles, refining the largest nodes first
+    void selectByBudget(const int64_t maxPoints,std::vector<int64_t>& nodes,std::vector<ParticleIndex>& particles) const;
+};
+
+//! Builds a LodOctree over the particles' positions in parallel
+/*!
+  attributes lists the FLOAT or VECTOR attributes to average and the
+  INDEXEDSTR attributes to keep the most common value of. radius, if given,
+  is a FLOAT attribute that grows the node radii and weights the averages,
+  otherwise particles have no size and equal weights. Cells with at most
+  leafSize particles are not split. The most common value is exact while a
+  node holds at most 16 distinct values, otherwise rare ones may be dropped
+  from its counts. Returns false if an attribute has an unsupported type.
+*/
+bool buildLodOctree(const ParticlesData& particles,const std::vector<ParticleAttribute>& attributes,
+    LodOctree& octree,const ParticleAttribute* radius=0,const int leafSize=64);
+
+//! How downsample() spreads the particles it keeps
+enum class DownsampleMode
+{
+    Voxel,      //!< one particle per grid cell of size spacing, the one nearest the cell's center
+    PoissonDisk //!< no two kept particles closer than spacing, and every dropped one within spacing of a kept one
+};
+
+//! Sets points to the indices, in increasing order, of an evenly spread subset of the particles
+/*!
+  Runs in parallel and gives the same subset for any number of threads.
+  Returns false if the particles have no position or spacing is too small
+  for their extent.
+*/
+bool downsample(const ParticlesData& particles,const DownsampleMode mode,const float spacing,
+    std::vector<ParticleIndex>& points);
+
+//! Like downsample(), with the spacing picked so that about targetCount particles are kept
+bool downsampleToCount(const ParticlesData& particles,const DownsampleMode mode,const int64_t targetCount,
+    std::vector<ParticleIndex>& points);
+
+//! Dense grid of cubic voxels for rasterize()
+/*!
+  Voxel (x,y,z) is centered at origin+((x,y,z)+0.5)*voxelSize and stored at
+  index x+resolution[0]*(y+resolution[1]*z).
+*/
+struct VoxelGrid
+{
+    float origin[3];
+    float voxelSize;
+    int resolution[3];
+
+    int64_t numVoxels() const {return int64_t(resolution[0])*resolution[1]*resolution[2];}
+};
+
+//! How far a particle spreads into the voxels around it
+enum class SplatKernel
+{
+    Nearest,   //!< the voxel containing it
+    Trilinear, //!< the 8 voxels whose centers surround it, with linear weights
+    Cubic      //!< the 64 voxels around it, with cubic B-spline weights
+};
+
+//! How the values splatted into a voxel are combined
+enum class SplatReduce
+{
+    Sum,  //!< sum of the weighted values
+    Mean, //!< weighted mean of the values
+    Max   //!< largest value of the particles touching the voxel
+};
+
+//! Splats attribute, or 1 per particle (a density) when it is null, into grid
+/*!
+  values holds attribute->count floats per voxel and is overwritten, with
+  voxels that no particle touches set to 0. Particles are binned into tiles
+  of voxels that are splatted in parallel. Returns false if the attribute
+  is not FLOAT or VECTOR or the particles have no position.
+*/
+bool rasterize(const ParticlesData& particles,const ParticleAttribute* attribute,const VoxelGrid& grid,
+    const SplatKernel kernel,const SplatReduce reduce,float* values);
+
+//! Smoothing kernels for interpolate(), each vanishing at the search radius
+//! and integrating to 1 over the ball it covers
+enum class SphKernel
+{
+    CubicSpline, //!< Monaghan's M4 cubic B-spline
+    Poly6,       //!< Mueller's (1-(r/h)^2)^3
+    WendlandC2   //!< Wendland's (1-r/h)^4 (1+4r/h)
+};
+
+//! Kernel weighted interpolation of float attributes at nQueries points (3 floats each)
+/*!
+  Each particle within radius of a query adds its value times the kernel
+  weight, times its volume attribute when one is given (mass/density for
+  SPH sums). values gets, for each query, the components of every attribute
+  one after another. With normalize, the sums are divided by the summed
+  weights (Shepard interpolation), so queries with particles in reach
+  reproduce constant attributes, and queries with none get 0. weights, when
+  not null, gets each query's summed weight, which is the SPH density when
+  volume is the mass. All attributes are gathered in a single search per
+  query, with the queries spread across threads. Returns false if an
+  attribute is not FLOAT or VECTOR or if particles were not sorted.
+*/
+bool interpolate(const ParticlesData& particles,const float* queries,const int64_t nQueries,
+    const std::vector<ParticleAttribute>& attributes,const SphKernel kernel,const float radius,float* values,
+    const ParticleAttribute* volume=0,const bool normalize=true,float* weights=0);
+
 //! Merges one particle set into another
 /*!
   Given a ParticleSetMutable, merges it with a second ParticleSet,
@@ -0,0 +1,518 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+
+/*!
+  Particle container with a schema fixed at compile time (Partio)
+  the attributes, their types and their byte offsets inside a particle record
+  are all known to the compiler, so hot loops can use the typed get<>() path
+  without attribute lookups or virtual calls
+*/
+#ifndef _PartioStatic_h_
+#define _PartioStatic_h_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <iostream>
+#include <cassert>
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+#include "Partio.h"
+
+namespace Partio{
+
+//! Describes one attribute of a compile time schema. Use PARTIO_STATIC_ATTRIBUTE
+//! to declare a named attribute type that can be used with ParticlesStatic.
+template<ParticleAttributeType ETYPE,int COUNT>
+struct StaticAttribute
+{
+    typedef typename ETYPE_TO_TYPE<ETYPE>::TYPE TYPE;
+    static constexpr ParticleAttributeType type=ETYPE;
+    static constexpr int count=COUNT;
+    static constexpr int size=static_cast<int>(sizeof(TYPE))*COUNT;
+};
+
+#define PARTIO_STATIC_ATTRIBUTE(NAME,STRING,ETYPE,COUNT) \
+    struct NAME:public Partio::StaticAttribute<ETYPE,COUNT> \
+    {static const char* name(){return STRING;}};
+
+//! Commonly used attributes for ParticlesStatic schemas
+namespace StaticAttr{
+PARTIO_STATIC_ATTRIBUTE(Position,"position",Partio::VECTOR,3)
+PARTIO_STATIC_ATTRIBUTE(Velocity,"velocity",Partio::VECTOR,3)
+PARTIO_STATIC_ATTRIBUTE(Id,"id",Partio::INT,1)
+PARTIO_STATIC_ATTRIBUTE(Radius,"radius",Partio::FLOAT,1)
+PARTIO_STATIC_ATTRIBUTE(Life,"life",Partio::FLOAT,2)
+PARTIO_STATIC_ATTRIBUTE(Color,"Cd",Partio::VECTOR,3)
+}
+
+//! Record size of a list of static attributes
+template<class... ATTRS> struct StaticLayout;
+template<> struct StaticLayout<>
+{static constexpr int size=0;};
+template<class A,class... REST> struct StaticLayout<A,REST...>
+{static constexpr int size=A::size+StaticLayout<REST...>::size;};
+
+//! Index and byte offset of attribute A inside the record of ATTRS
+template<class A,class... ATTRS> struct StaticOffset;
+template<class A,class... REST> struct StaticOffset<A,A,REST...>
+{
+    static constexpr int index=0;
+    static constexpr int offset=0;
+};
+template<class A,class B,class... REST> struct StaticOffset<A,B,REST...>
+{
+    static constexpr int index=1+StaticOffset<A,REST...>::index;
+    static constexpr int offset=B::size+StaticOffset<A,REST...>::offset;
+};
+
+// Particle Static Data
+//!  Particle container with a compile time schema
+/*!
+  The schema attributes are interleaved in one record of stride() bytes per
+  particle at constexpr offsets, and can be accessed through get<A>() with no
+  lookup or virtual dispatch. The class also implements ParticlesDataMutable
+  so readers, writers, clone(), merge() etc. keep working with it. Attributes
+  added at runtime that are not part of the schema are stored in separate
+  columns after the schema ones.
+
+  Create with new and free with p->release(). Files are read into it with
+  the readInto() overload below. Spatial queries are not supported, clone()
+  into a regular particle set to sort.
+*/
+template<class... ATTRS>
+class ParticlesStatic:public ParticlesDataMutable,
+                      public Provider
+{
+protected:
+    virtual ~ParticlesStatic()
+    {
+        free(records);
+        for(size_t i=0;i<extraData.size();i++) free(extraData[i]);
+        for(size_t i=0;i<fixedAttributeData.size();i++) free(fixedAttributeData[i]);
+    }
+public:
+    using ParticlesDataMutable::iterator;
+    using ParticlesData::const_iterator;
+
+    static constexpr int numSchemaAttributes=sizeof...(ATTRS);
+
+    ParticlesStatic()
+        :particleCount(0),allocatedCount(0),records(nullptr)
+    {
+        const char* names[]={ATTRS::name()...};
+        const ParticleAttributeType types[]={ATTRS::type...};
+        const int counts[]={ATTRS::count...};
+        const int sizes[]={ATTRS::size...};
+        int offset=0;
+        for(int i=0;i<numSchemaAttributes;i++){
+            ParticleAttribute attr;
+            attr.name=names[i];
+            attr.type=types[i];
+            attr.count=counts[i];
+            attr.attributeIndex=i;
+            attributes.push_back(attr);
+            nameToAttribute[attr.name]=i;
+            attributeOffsets.push_back(offset);
+            attributeStrides.push_back(sizes[i]);
+            attributeIndexedStrs.push_back(IndexedStrTable());
+            offset+=sizes[i];
+        }
+    }
+
+    //! Bytes per particle record of the schema attributes
+    static constexpr int stride()
+    {return StaticLayout<ATTRS...>::size;}
+
+    //! Byte offset of schema attribute A inside a particle record
+    template<class A> static constexpr int offset()
+    {return StaticOffset<A,ATTRS...>::offset;}
+
+    //! Handle of schema attribute A for use with the generic interface
+    template<class A> const ParticleAttribute& attribute() const
+    {return attributes[StaticOffset<A,ATTRS...>::index];}
+
+    //! Typed pointer to the A attribute of a particle
+    template<class A> inline typename A::TYPE* get(const ParticleIndex particleIndex)
+    {return reinterpret_cast<typename A::TYPE*>(records+particleIndex*stride()+offset<A>());}
+
+    //! Typed pointer to the A attribute of a particle
+    template<class A> inline const typename A::TYPE* get(const ParticleIndex particleIndex) const
+    {return reinterpret_cast<const typename A::TYPE*>(records+particleIndex*stride()+offset<A>());}
+
+    void release()
+    {freeCached(this);}
+
+    int64_t numParticles() const
+    {return particleCount;}
+
+    int numAttributes() const
+    {return static_cast<int>(attributes.size());}
+
+    int numFixedAttributes() const
+    {return static_cast<int>(fixedAttributes.size());}
+
+    bool attributeInfo(const char* attributeName,ParticleAttribute& attribute) const
+    {
+        std::map<std::string,int>::const_iterator it=nameToAttribute.find(attributeName);
+        if(it==nameToAttribute.end()) return false;
+        attribute=attributes[it->second];
+        return true;
+    }
+
+    bool fixedAttributeInfo(const char* attributeName,FixedAttribute& attribute) const
+    {
+        std::map<std::string,int>::const_iterator it=nameToFixedAttribute.find(attributeName);
+        if(it==nameToFixedAttribute.end()) return false;
+        attribute=fixedAttributes[it->second];
+        return true;
+    }
+
+    bool attributeInfo(const int attributeIndex,ParticleAttribute& attribute) const
+    {
+        if(attributeIndex<0 || attributeIndex>=(int)attributes.size()) return false;
+        attribute=attributes[attributeIndex];
+        return true;
+    }
+
+    bool fixedAttributeInfo(const int attributeIndex,FixedAttribute& attribute) const
+    {
+        if(attributeIndex<0 || attributeIndex>=(int)fixedAttributes.size()) return false;
+        attribute=fixedAttributes[attributeIndex];
+        return true;
+    }
+
+    void dataAsFloat(const ParticleAttribute& attribute,const int indexCount,
+        const ParticleIndex* particleIndices,const bool sorted,float* values) const
+    {
+        assert(attribute.attributeIndex>=0 && attribute.attributeIndex<(int)attributes.size());
+        if(attribute.type==FLOAT || attribute.type==VECTOR)
+            dataInternalMultiple(attribute,indexCount,particleIndices,sorted,(char*)values);
+        else if(attribute.type==INT || attribute.type==INDEXEDSTR){
+            int count=attribute.count;
+            for(int i=0;i<indexCount;i++){
+                const int* p=static_cast<const int*>(dataInternal(attribute,particleIndices[i]));
+                for(int k=0;k<count;k++) values[i*count+k]=static_cast<float>(p[k]);
+            }
+        }
+    }
+
+    int registerIndexedStr(const ParticleAttribute& attribute,const char* str)
+    {return registerStr(attributeIndexedStrs[attribute.attributeIndex],str);}
+
+    int registerFixedIndexedStr(const FixedAttribute& attribute,const char* str)
+    {return registerStr(fixedAttributeIndexedStrs[attribute.attributeIndex],str);}
+
+    void setIndexedStr(const ParticleAttribute& attribute,int indexedStringToken,const char* str)
+    {setStr(attributeIndexedStrs[attribute.attributeIndex],indexedStringToken,str);}
+
+    void setFixedIndexedStr(const FixedAttribute& attribute,int indexedStringToken,const char* str)
+    {setStr(fixedAttributeIndexedStrs[attribute.attributeIndex],indexedStringToken,str);}
+
+    int lookupIndexedStr(const ParticleAttribute& attribute,const char* str) const
+    {return lookupStr(attributeIndexedStrs[attribute.attributeIndex],str);}
+
+    int lookupFixedIndexedStr(const FixedAttribute& attribute,const char* str) const
+    {return lookupStr(fixedAttributeIndexedStrs[attribute.attributeIndex],str);}
+
+    const std::vector<std::string>& indexedStrs(const ParticleAttribute& attr) const
+    {return attributeIndexedStrs[attr.attributeIndex].strings;}
+
+    const std::vector<std::string>& fixedIndexedStrs(const FixedAttribute& attr) const
+    {return fixedAttributeIndexedStrs[attr.attributeIndex].strings;}
+
+    void sort()
+    {std::cerr<<"Partio: sort is not supported on ParticlesStatic, clone() it first"<<std::endl;}
+
+    //! Returns the schema attribute if name, type and count match it, otherwise
+    //! adds a new runtime attribute stored outside of the particle record
+    ParticleAttribute addAttribute(const char* attribute,ParticleAttributeType type,const int count)
+    {
+        std::map<std::string,int>::const_iterator it=nameToAttribute.find(attribute);
+        if(it!=nameToAttribute.end()){
+            const ParticleAttribute& existing=attributes[it->second];
+            if(it->second<numSchemaAttributes && existing.type==type && existing.count==count)
+                return existing;
+            std::cerr<<"Partio: addAttribute failed because attr '"<<attribute<<"'"<<" already exists"<<std::endl;
+            return ParticleAttribute();
+        }
+        ParticleAttribute attr;
+        attr.name=attribute;
+        attr.type=type;
+        attr.count=count;
+        attr.attributeIndex=static_cast<int>(attributes.size());
+        attributes.push_back(attr);
+        nameToAttribute[attribute]=attr.attributeIndex;
+
+        int attrStride=TypeSize(type)*count;
+        attributeOffsets.push_back(0);
+        attributeStrides.push_back(attrStride);
+        attributeIndexedStrs.push_back(IndexedStrTable());
+        extraData.push_back((char*)malloc((size_t)allocatedCount*(size_t)attrStride));
+        return attr;
+    }
+
+    FixedAttribute addFixedAttribute(const char* attribute,ParticleAttributeType type,const int count)
+    {
+        if(nameToFixedAttribute.find(attribute)!=nameToFixedAttribute.end()){
+            std::cerr<<"Partio: addFixedAttribute failed because attr '"<<attribute<<"'"<<" already exists"<<std::endl;
+            return FixedAttribute();
+        }
+        FixedAttribute attr;
+        attr.name=attribute;
+        attr.type=type;
+        attr.count=count;
+        attr.attributeIndex=static_cast<int>(fixedAttributes.size());
+        fixedAttributes.push_back(attr);
+        nameToFixedAttribute[attribute]=attr.attributeIndex;
+        fixedAttributeData.push_back((char*)malloc((size_t)TypeSize(type)*(size_t)count));
+        fixedAttributeIndexedStrs.push_back(IndexedStrTable());
+        return attr;
+    }
+
+    ParticleIndex addParticle()
+    {
+        if(allocatedCount==particleCount)
+            reserve(std::max<int64_t>(10,std::max(allocatedCount*3/2,particleCount)));
+        return particleCount++;
+    }
+
+    iterator addParticles(const int64_t countToAdd)
+    {
+        if(particleCount+countToAdd>allocatedCount) reserve(particleCount+countToAdd);
+        int64_t offset=particleCount;
+        particleCount+=countToAdd;
+        return setupIterator(offset);
+    }
+
+    //! Replaces the particles, runtime attributes and fixed attributes with
+    //! source's. Source attributes matching a schema attribute's name, type
+    //! and count are copied into the records, which keep their storage. Schema
+    //! attributes source lacks are zeroed, the other source attributes are
+    //! added at runtime, and ones that only match a schema name are skipped.
+    void assign(const ParticlesData& source)
+    {
+        for(size_t i=0;i<extraData.size();i++) free(extraData[i]);
+        extraData.clear();
+        attributes.resize(numSchemaAttributes);
+        attributeOffsets.resize(numSchemaAttributes);
+        attributeStrides.resize(numSchemaAttributes);
+        attributeIndexedStrs.assign(numSchemaAttributes,IndexedStrTable());
+        nameToAttribute.clear();
+        for(int i=0;i<numSchemaAttributes;i++) nameToAttribute[attributes[i].name]=i;
+        for(size_t i=0;i<fixedAttributeData.size();i++) free(fixedAttributeData[i]);
+        fixedAttributeData.clear();
+        fixedAttributes.clear();
+        nameToFixedAttribute.clear();
+        fixedAttributeIndexedStrs.clear();
+
+        particleCount=0;
+        if(source.numParticles()>allocatedCount) reserve(source.numParticles());
+        particleCount=source.numParticles();
+        if(particleCount) memset(records,0,(size_t)stride()*(size_t)particleCount);
+
+        FixedAttribute sourceFixed;
+        for(int i=0;i<source.numFixedAttributes();i++){
+            source.fixedAttributeInfo(i,sourceFixed);
+            FixedAttribute fixed=addFixedAttribute(sourceFixed.name.c_str(),sourceFixed.type,sourceFixed.count);
+            if(sourceFixed.type==INDEXEDSTR) fixedAttributeIndexedStrs[fixed.attributeIndex]=
+                copyStrs(source.fixedIndexedStrs(sourceFixed));
+            memcpy(fixedAttributeData[fixed.attributeIndex],source.fixedData<void>(sourceFixed),
+                (size_t)TypeSize(fixed.type)*(size_t)fixed.count);
+        }
+        ParticleAttribute sourceAttr;
+        for(int i=0;i<source.numAttributes();i++){
+            source.attributeInfo(i,sourceAttr);
+            std::map<std::string,int>::const_iterator it=nameToAttribute.find(sourceAttr.name);
+            if(it!=nameToAttribute.end() && (attributes[it->second].type!=sourceAttr.type
+                    || attributes[it->second].count!=sourceAttr.count)){
+                std::cerr<<"Partio: readInto, attribute '"<<sourceAttr.name<<"' does not match the schema"<<std::endl;
+                continue;
+            }
+            ParticleAttribute attr=addAttribute(sourceAttr.name.c_str(),sourceAttr.type,sourceAttr.count);
+            if(attr.type==INDEXEDSTR) attributeIndexedStrs[attr.attributeIndex]=copyStrs(source.indexedStrs(sourceAttr));
+            // the source may not store its particles contiguously, copy one at a time
+            const size_t bytes=attributeStrides[attr.attributeIndex];
+            for(ParticleIndex j=0;j<(ParticleIndex)particleCount;j++)
+                memcpy(dataInternal(attr,j),source.data<void>(sourceAttr,j),bytes);
+        }
+    }
+
+    iterator setupIterator(const int64_t index=0)
+    {
+        if(numParticles()==0) return iterator();
+        return iterator(this,index,numParticles()-1);
+    }
+
+    const_iterator setupConstIterator(const int64_t index=0) const
+    {
+        if(numParticles()==0) return const_iterator();
+        return const_iterator(this,index,numParticles()-1);
+    }
+
+    void setupIteratorNextBlock(ParticleIterator<false>& iterator)
+    {iterator=end();}
+
+    void setupIteratorNextBlock(ParticleIterator<true>& iterator) const
+    {iterator=ParticlesData::end();}
+
+    void setupAccessor(ParticleIterator<false>&,ParticleAccessor& accessor)
+    {setupAccessor(accessor);}
+
+    void setupAccessor(ParticleIterator<true>&,ParticleAccessor& accessor) const
+    {setupAccessor(accessor);}
+
+private:
+    void reserve(const int64_t count)
+    {
+        allocatedCount=count;
+        records=(char*)realloc(records,(size_t)stride()*(size_t)allocatedCount);
+        for(size_t i=0;i<extraData.size();i++)
+            extraData[i]=(char*)realloc(extraData[i],(size_t)attributeStrides[numSchemaAttributes+i]*(size_t)allocatedCount);
+    }
+
+    void setupAccessor(ParticleAccessor& accessor) const
+    {
+        int index=accessor.attributeIndex;
+        if(index<numSchemaAttributes){
+            accessor.stride=stride();
+            accessor.basePointer=records+attributeOffsets[index];
+        }else{
+            accessor.stride=attributeStrides[index];
+            accessor.basePointer=extraData[index-numSchemaAttributes];
+        }
+    }
+
+    void* dataInternal(const ParticleAttribute& attribute,const ParticleIndex particleIndex) const
+    {
+        int index=attribute.attributeIndex;
+        assert(index>=0 && index<(int)attributes.size());
+        if(particleIndex>=(ParticleIndex)numParticles()){
+            std::cerr<<"Invalid attempt to set particle value on index "
+                     <<particleIndex<<" in data with "<<numParticles()
+                     <<" particles."<<std::endl;
+            return nullptr;
+        }
+        if(index<numSchemaAttributes) return records+particleIndex*stride()+attributeOffsets[index];
+        return extraData[index-numSchemaAttributes]+particleIndex*attributeStrides[index];
+    }
+
+    void* fixedDataInternal(const FixedAttribute& attribute) const
+    {
+        assert(attribute.attributeIndex>=0 && attribute.attributeIndex<(int)fixedAttributes.size());
+        return fixedAttributeData[attribute.attributeIndex];
+    }
+
+    void dataInternalMultiple(const ParticleAttribute& attribute,const int indexCount,
+        const ParticleIndex* particleIndices,const bool,char* values) const
+    {
+        assert(attribute.attributeIndex>=0 && attribute.attributeIndex<(int)attributes.size());
+        int bytes=attributeStrides[attribute.attributeIndex];
+        for(int i=0;i<indexCount;i++)
+            memcpy(values+bytes*i,dataInternal(attribute,particleIndices[i]),bytes);
+    }
+
+    struct IndexedStrTable{
+        std::map<std::string,int> stringToIndex;
+        std::vector<std::string> strings;
+    };
+
+    static int registerStr(IndexedStrTable& table,const char* str)
+    {
+        std::map<std::string,int>::const_iterator it=table.stringToIndex.find(str);
+        if(it!=table.stringToIndex.end()) return it->second;
+        int newIndex=static_cast<int>(table.strings.size());
+        table.strings.push_back(str);
+        table.stringToIndex[str]=newIndex;
+        return newIndex;
+    }
+
+    //! Table with the same tokens as strings
+    static IndexedStrTable copyStrs(const std::vector<std::string>& strings)
+    {
+        IndexedStrTable table;
+        table.strings=strings;
+        for(size_t i=0;i<strings.size();i++) table.stringToIndex.insert(std::make_pair(strings[i],int(i)));
+        return table;
+    }
+
+    static int lookupStr(const IndexedStrTable& table,const char* str)
+    {
+        std::map<std::string,int>::const_iterator it=table.stringToIndex.find(str);
+        if(it!=table.stringToIndex.end()) return it->second;
+        return -1;
+    }
+
+    static void setStr(IndexedStrTable& table,int indexedStringToken,const char* str)
+    {
+        if(indexedStringToken>=int(table.strings.size()) || indexedStringToken<0) return;
+        table.stringToIndex.erase(table.strings[indexedStringToken]);
+        table.strings[indexedStringToken]=str;
+        table.stringToIndex[str]=indexedStringToken;
+    }
+
+private:
+    int64_t particleCount;
+    int64_t allocatedCount;
+    char* records; // interleaved records of the schema attributes
+    std::vector<char*> extraData; // one column per runtime added attribute
+    std::vector<ParticleAttribute> attributes;
+    std::map<std::string,int> nameToAttribute;
+    std::vector<int> attributeOffsets;
+    std::vector<int> attributeStrides;
+    std::vector<IndexedStrTable> attributeIndexedStrs;
+    std::vector<char*> fixedAttributeData;
+    std::vector<FixedAttribute> fixedAttributes;
+    std::map<std::string,int> nameToFixedAttribute;
+    std::vector<IndexedStrTable> fixedAttributeIndexedStrs;
+};
+
+//! Reads a particle file into a ParticlesStatic with assign(), so the
+//! attributes of the schema fill its records. Returns false, leaving existing
+//! unchanged, if the file cannot be read.
+template<class... ATTRS> bool
+readInto(const char* filename,ParticlesStatic<ATTRS...>& existing,const bool verbose=true,
+    std::ostream& errorStream=std::cerr)
+{
+    ParticlesDataMutable* source=read(filename,verbose,errorStream);
+    if(!source) return false;
+    existing.assign(*source);
+    source->release();
+    return true;
+}
+
+}
+#endif
@@ -0,0 +1,147 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+#include "../Partio.h"
+#include "KdTree.h"
+#include "Parallel.h"
+#include <iostream>
+#include <vector>
+
+namespace Partio{
+
+namespace{
+
+// values are copied in pieces of this many particles per thread
+const int64_t CopyGrain=4096;
+
+template<int k> class KdTreeAttributeIndex:public AttributeIndex
+{
+public:
+    KdTreeAttributeIndex(const float* points,const int64_t n,const float* weights)
+    {
+        for(int axis=0;axis<k;axis++) _weights[axis]=weights[axis];
+        _tree.setPoints(points,n);
+        _tree.sort();
+    }
+
+    void release()
+    {delete this;}
+
+    int dimension() const
+    {return k;}
+
+    void findPoints(const float* bboxMin,const float* bboxMax,std::vector<ParticleIndex>& points) const
+    {
+        BBox<k> box;
+        for(int axis=0;axis<k;axis++){
+            box.min[axis]=bboxMin[axis]*_weights[axis];
+            box.max[axis]=bboxMax[axis]*_weights[axis];
+        }
+        size_t startIndex=points.size();
+        _tree.findPoints(points,box);
+        for(size_t i=startIndex;i<points.size();i++) points[i]=_tree.id(points[i]);
+    }
+
+    float findNPoints(const float* query,int nPoints,const float maxRadius,
+        std::vector<ParticleIndex>& points,std::vector<float>& pointDistancesSquared) const
+    {
+        float p[k];
+        for(int axis=0;axis<k;axis++) p[axis]=query[axis]*_weights[axis];
+        _tree.findNPoints(points,pointDistancesSquared,p,nPoints,maxRadius);
+        for(size_t i=0;i<points.size();i++) points[i]=_tree.id(points[i]);
+        return maxRadius;
+    }
+
+private:
+    KdTree<k> _tree;
+    float _weights[k];
+};
+
+// picks the tree instantiation for a dimension known only at run time
+template<int k> AttributeIndex* makeIndex(const int dimension,const float* points,const int64_t n,const float* weights)
+{
+    if(dimension==k) return new KdTreeAttributeIndex<k>(points,n,weights);
+    return makeIndex<k+1>(dimension,points,n,weights);
+}
+
+template<> AttributeIndex* makeIndex<AttributeIndex::MaxDimension+1>(const int,const float*,const int64_t,const float*)
+{return 0;}
+
+}
+
+AttributeIndex*
+createAttributeIndex(const ParticlesData& particles,const std::vector<ParticleAttribute>& attributes,
+    const float* weights)
+{
+    int dimension=0;
+    for(size_t a=0;a<attributes.size();a++){
+        if(attributes[a].type!=FLOAT && attributes[a].type!=VECTOR){
+            std::cerr<<"Partio: createAttributeIndex attribute "<<attributes[a].name<<" is not float"<<std::endl;
+            return 0;
+        }
+        dimension+=attributes[a].count;
+    }
+    if(dimension<1 || dimension>AttributeIndex::MaxDimension){
+        std::cerr<<"Partio: createAttributeIndex needs 1 to "<<AttributeIndex::MaxDimension
+                 <<" components, got "<<dimension<<std::endl;
+        return 0;
+    }
+    std::vector<float> axisWeights(dimension,1.f);
+    if(weights){
+        for(int axis=0;axis<dimension;axis++){
+            if(weights[axis]<0){
+                std::cerr<<"Partio: createAttributeIndex weights must not be negative"<<std::endl;
+                return 0;
+            }
+            axisWeights[axis]=weights[axis];
+        }
+    }
+
+    // interleave the weighted values of each particle into one point
+    const int64_t n=particles.numParticles();
+    std::vector<float> points(n*dimension);
+    parallelFor(0,n,CopyGrain,[&](int64_t begin,int64_t end){
+        for(int64_t i=begin;i<end;i++){
+            float* p=&points[i*dimension];
+            int axis=0;
+            for(size_t a=0;a<attributes.size();a++){
+                const float* value=particles.data<float>(attributes[a],i);
+                for(int c=0;c<attributes[a].count;c++,axis++) p[axis]=value[c]*axisWeights[axis];
+            }
+        }
+    });
+    return makeIndex<1>(dimension,n ? &points[0] : 0,n,&axisWeights[0]);
+}
+
+}
@@ -0,0 +1,314 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+#ifdef PARTIO_WIN32
+#    define NOMINMAX
+#endif
+#include "../Partio.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <float.h>
+#include <iostream>
+#include <vector>
+
+namespace Partio{
+
+namespace{
+
+// particles are handed to threads in pieces of this size
+const int64_t Grain=4096;
+// bits of each cell coordinate in a cell key
+const int CellBits=21;
+const int64_t MaxCells=(int64_t(1)<<CellBits)-1;
+
+struct Positions
+{
+    std::vector<float> p;
+    float min[3],max[3];
+    int64_t size() const {return int64_t(p.size()/3);}
+};
+
+bool gatherPositions(const ParticlesData& particles,Positions& positions,const char* caller)
+{
+    ParticleAttribute posAttr;
+    if(!particles.attributeInfo("position",posAttr) || (posAttr.type!=VECTOR && posAttr.type!=FLOAT) || posAttr.count!=3){
+        std::cerr<<"Partio: "<<caller<<" needs a 3 component float position attribute"<<std::endl;
+        return false;
+    }
+    const int64_t n=particles.numParticles();
+    positions.p.resize(3*n);
+    const int chunks=static_cast<int>(std::max<int64_t>(1,std::min<int64_t>(numThreads(),n/Grain)));
+    std::vector<float> chunkBounds(6*chunks);
+    parallelChunks(chunks,[&](int chunk){
+        float* bounds=&chunkBounds[6*chunk];
+        for(int axis=0;axis<3;axis++){bounds[axis]=FLT_MAX;bounds[3+axis]=-FLT_MAX;}
+        for(int64_t i=n*chunk/chunks;i<n*(chunk+1)/chunks;i++){
+            const float* p=particles.data<float>(posAttr,i);
+            for(int axis=0;axis<3;axis++){
+                positions.p[3*i+axis]=p[axis];
+                bounds[axis]=std::min(bounds[axis],p[axis]);
+                bounds[3+axis]=std::max(bounds[3+axis],p[axis]);
+            }
+        }
+    });
+    for(int axis=0;axis<3;axis++){
+        positions.min[axis]=FLT_MAX;
+        positions.max[axis]=-FLT_MAX;
+        for(int chunk=0;chunk<chunks;chunk++){
+            positions.min[axis]=std::min(positions.min[axis],chunkBounds[6*chunk+axis]);
+            positions.max[axis]=std::max(positions.max[axis],chunkBounds[6*chunk+3+axis]);
+        }
+    }
+    return true;
+}
+
+// one candidate particle, ordered by cell and then by rank within the cell
+struct Entry
+{
+    uint64_t key;
+    uint64_t rank;
+    ParticleIndex index;
+
+    bool operator<(const Entry& other) const
+    {return key<other.key || (key==other.key && (rank<other.rank || (rank==other.rank && index<other.index)));}
+};
+
+uint64_t cellKey(const int64_t cell[3])
+{return (uint64_t(cell[0])<<(2*CellBits))|(uint64_t(cell[1])<<CellBits)|uint64_t(cell[2]);}
+
+void cellOf(const Positions& positions,const float cellSize,const int64_t i,int64_t cell[3])
+{
+    for(int axis=0;axis<3;axis++)
+        cell[axis]=std::min(MaxCells-1,int64_t((positions.p[3*i+axis]-positions.min[axis])/cellSize));
+}
+
+// mixes the bits of an index, so that candidates are tried in an order unrelated to the file order
+uint64_t scramble(uint64_t x)
+{
+    x^=x>>30;x*=0xbf58476d1ce4e5b9ULL;
+    x^=x>>27;x*=0x94d049bb133111ebULL;
+    return x^(x>>31);
+}
+
+bool checkSpacing(const Positions& positions,const float spacing,const char* caller)
+{
+    float extent=0;
+    for(int axis=0;axis<3;axis++) extent=std::max(extent,positions.max[axis]-positions.min[axis]);
+    if(!(spacing>0) || extent/spacing>=float(MaxCells-2)){
+        std::cerr<<"Partio: "<<caller<<" spacing "<<spacing<<" is too small for the particles' extent"<<std::endl;
+        return false;
+    }
+    return true;
+}
+
+void voxelSample(const Positions& positions,const float spacing,std::vector<ParticleIndex>& points)
+{
+    // the particle nearest its cell's center sorts first in the cell
+    const int64_t n=positions.size();
+    std::vector<Entry> entries(n);
+    parallelFor(0,n,Grain,[&](int64_t begin,int64_t end){
+        for(int64_t i=begin;i<end;i++){
+            int64_t cell[3];
+            cellOf(positions,spacing,i,cell);
+            float distance=0;
+            for(int axis=0;axis<3;axis++){
+                float d=positions.p[3*i+axis]-(positions.min[axis]+(cell[axis]+.5f)*spacing);
+                distance+=d*d;
+            }
+            // non-negative floats order the same as their bits
+            uint32_t bits;
+            memcpy(&bits,&distance,sizeof(bits));
+            entries[i].key=cellKey(cell);
+            entries[i].rank=bits;
+            entries[i].index=i;
+        }
+    });
+    parallelSort(entries.empty() ? 0 : &entries[0],entries.empty() ? 0 : &entries[0]+n);
+    points.clear();
+    for(int64_t i=0;i<n;i++)
+        if(i==0 || entries[i].key!=entries[i-1].key) points.push_back(entries[i].index);
+    parallelSort(points.empty() ? 0 : &points[0],points.empty() ? 0 : &points[0]+points.size());
+}
+
+void poissonSample(const Positions& positions,const float spacing,std::vector<ParticleIndex>& points)
+{
+    // with cells as large as the spacing, conflicts are only with the 26 neighboring cells
+    const int64_t n=positions.size();
+    std::vector<Entry> entries(n);
+    parallelFor(0,n,Grain,[&](int64_t begin,int64_t end){
+        for(int64_t i=begin;i<end;i++){
+            int64_t cell[3];
+            cellOf(positions,spacing,i,cell);
+            entries[i].key=cellKey(cell);
+            entries[i].rank=scramble(i);
+            entries[i].index=i;
+        }
+    });
+    parallelSort(entries.empty() ? 0 : &entries[0],entries.empty() ? 0 : &entries[0]+n);
+
+    std::vector<uint64_t> cellKeys;
+    std::vector<int64_t> cellBegins;
+    for(int64_t i=0;i<n;i++){
+        if(i>0 && entries[i].key==entries[i-1].key) continue;
+        cellKeys.push_back(entries[i].key);
+        cellBegins.push_back(i);
+    }
+    cellBegins.push_back(n);
+    const int64_t numCells=int64_t(cellKeys.size());
+
+    // cells whose coordinates agree modulo 3 never share a neighbor, so each
+    // of the 27 such classes is sampled in parallel, one class after another
+    std::vector<std::vector<int64_t> > classes(27);
+    const uint64_t mask=MaxCells;
+    for(int64_t c=0;c<numCells;c++){
+        const uint64_t key=cellKeys[c];
+        classes[((key>>(2*CellBits))&mask)%3+3*(((key>>CellBits)&mask)%3)+9*((key&mask)%3)].push_back(c);
+    }
+    std::vector<std::vector<ParticleIndex> > kept(numCells);
+    const float spacingSquared=spacing*spacing;
+    for(int k=0;k<27;k++){
+        const std::vector<int64_t>& cells=classes[k];
+        parallelForDynamic(0,int64_t(cells.size()),64,[&](int64_t begin,int64_t end){
+            std::vector<int64_t> neighbors;
+            for(int64_t c=begin;c<end;c++){
+                const int64_t cellIndex=cells[c];
+                const uint64_t key=cellKeys[cellIndex];
+                const int64_t cell[3]={int64_t((key>>(2*CellBits))&mask),int64_t((key>>CellBits)&mask),int64_t(key&mask)};
+                // the cells along the last axis have consecutive keys, so one search finds each row of three
+                neighbors.clear();
+                for(int dx=-1;dx<=1;dx++) for(int dy=-1;dy<=1;dy++){
+                    const int64_t first[3]={cell[0]+dx,cell[1]+dy,std::max<int64_t>(cell[2]-1,0)};
+                    if(first[0]<0 || first[1]<0) continue;
+                    const int64_t last[3]={first[0],first[1],cell[2]+1};
+                    const uint64_t lastKey=cellKey(last);
+                    for(std::vector<uint64_t>::const_iterator it=std::lower_bound(cellKeys.begin(),cellKeys.end(),cellKey(first));
+                        it!=cellKeys.end() && *it<=lastKey;++it) neighbors.push_back(it-cellKeys.begin());
+                }
+                for(int64_t e=cellBegins[cellIndex];e<cellBegins[cellIndex+1];e++){
+                    const float* p=&positions.p[3*entries[e].index];
+                    bool farEnough=true;
+                    for(size_t j=0;farEnough && j<neighbors.size();j++){
+                        const std::vector<ParticleIndex>& near=kept[neighbors[j]];
+                        for(size_t m=0;farEnough && m<near.size();m++){
+                            const float* q=&positions.p[3*near[m]];
+                            float d=0;
+                            for(int axis=0;axis<3;axis++) d+=(p[axis]-q[axis])*(p[axis]-q[axis]);
+                            farEnough=d>=spacingSquared;
+                        }
+                    }
+                    if(farEnough) kept[cellIndex].push_back(entries[e].index);
+                }
+            }
+        });
+    }
+
+    points.clear();
+    for(int64_t c=0;c<numCells;c++) points.insert(points.end(),kept[c].begin(),kept[c].end());
+    parallelSort(points.empty() ? 0 : &points[0],points.empty() ? 0 : &points[0]+points.size());
+}
+
+void sample(const Positions& positions,const DownsampleMode mode,const float spacing,std::vector<ParticleIndex>& points)
+{
+    if(mode==DownsampleMode::Voxel) voxelSample(positions,spacing,points);
+    else poissonSample(positions,spacing,points);
+}
+
+}
+
+bool
+downsample(const ParticlesData& particles,const DownsampleMode mode,const float spacing,
+    std::vector<ParticleIndex>& points)
+{
+    points.clear();
+    Positions positions;
+    if(!gatherPositions(particles,positions,"downsample")) return false;
+    if(positions.size()==0) return true;
+    if(!checkSpacing(positions,spacing,"downsample")) return false;
+    sample(positions,mode,spacing,points);
+    return true;
+}
+
+bool
+downsampleToCount(const ParticlesData& particles,const DownsampleMode mode,const int64_t targetCount,
+    std::vector<ParticleIndex>& points)
+{
+    points.clear();
+    Positions positions;
+    if(!gatherPositions(particles,positions,"downsampleToCount")) return false;
+    const int64_t n=positions.size();
+    if(targetCount<=0 || n==0) return true;
+    if(targetCount>=n){
+        points.resize(n);
+        for(int64_t i=0;i<n;i++) points[i]=i;
+        return true;
+    }
+
+    // the count falls off as a power of the spacing, so the spacing is solved
+    // for with secant steps on their logarithms, starting from a cube's exponent
+    float extent=0;
+    for(int axis=0;axis<3;axis++) extent=std::max(extent,positions.max[axis]-positions.min[axis]);
+    if(!(extent>0)){
+        points.push_back(0);
+        return true;
+    }
+    const double logTarget=std::log(double(targetCount));
+    const double minLogSpacing=std::log(double(extent)/(MaxCells-2))+1e-3;
+    double logSpacing=std::log(double(extent))-logTarget/3,previousLogSpacing=0,previousLogCount=0;
+    double bestError=DBL_MAX;
+    std::vector<ParticleIndex> candidate;
+    for(int iteration=0;iteration<12;iteration++){
+        logSpacing=std::max(logSpacing,minLogSpacing);
+        sample(positions,mode,float(std::exp(logSpacing)),candidate);
+        const double logCount=std::log(double(std::max<size_t>(candidate.size(),1)));
+        const double error=std::abs(double(candidate.size())-double(targetCount));
+        if(error<bestError){
+            bestError=error;
+            points.swap(candidate);
+        }
+        if(error<=.01*targetCount) break;
+        double slope=-3;
+        if(iteration>0 && logSpacing!=previousLogSpacing){
+            const double secant=(logCount-previousLogCount)/(logSpacing-previousLogSpacing);
+            if(secant<-.5) slope=std::max(secant,-6.);
+        }
+        previousLogSpacing=logSpacing;
+        previousLogCount=logCount;
+        logSpacing+=(logTarget-logCount)/slope;
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,479 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+#ifdef PARTIO_WIN32
+#    define NOMINMAX
+#endif
+#include "HashGrid.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <float.h>
+#include <iterator>
+
+namespace Partio{
+
+namespace{
+// points are handed to threads in pieces of this size
+const int64_t BuildGrain=1<<15;
+// cells aimed for per bucket when no cell size is given
+const float PointsPerCell=4;
+// grids with up to this many cells per point skip hashing
+const double DirectCellsPerPoint=2;
+}
+
+HashGrid::
+HashGrid()
+    :_cellSize(1),_invCellSize(1),_direct(true),_bits(0)
+{
+    for(int axis=0;axis<3;axis++){_min[axis]=_max[axis]=0;_dims[axis]=1;}
+    std::shared_ptr<Buckets> buckets=std::make_shared<Buckets>();
+    buckets->start.assign(2,0);
+    _buckets=buckets;
+}
+
+float HashGrid::
+cellCoord(const float x,const int axis) const
+{
+    // clamped before converting so that far away queries cannot overflow
+    float c=(x-_min[axis])*_invCellSize;
+    if(!(c>0)) return 0;
+    return std::min(c,float(_dims[axis]-1));
+}
+
+bool HashGrid::
+cellRange(const float lo[3],const float hi[3],int64_t cellLo[3],int64_t cellHi[3]) const
+{
+    for(int axis=0;axis<3;axis++){
+        if(hi[axis]<_min[axis] || lo[axis]>_max[axis]) return false;
+        cellLo[axis]=static_cast<int64_t>(cellCoord(lo[axis],axis));
+        cellHi[axis]=static_cast<int64_t>(cellCoord(hi[axis],axis));
+    }
+    return true;
+}
+
+uint64_t HashGrid::
+bucket(const int64_t x,const int64_t y,const int64_t z) const
+{
+    uint64_t key=uint64_t(x)+uint64_t(_dims[0])*(uint64_t(y)+uint64_t(_dims[1])*uint64_t(z));
+    if(_direct) return key;
+    // Fibonacci hashing, the top bits of the product are well mixed
+    return (key*0x9E3779B97F4A7C15ULL)>>(64-_bits);
+}
+
+void HashGrid::
+build(const float* p,int64_t n,size_t stride,float cellSize)
+{
+    const char* data=reinterpret_cast<const char*>(p);
+    auto point=[data,stride](int64_t i){return reinterpret_cast<const float*>(data+i*stride);};
+
+    // bounds of the points, one box per thread
+    const int chunks=static_cast<int>(std::max<int64_t>(1,std::min<int64_t>(numThreads(),n/BuildGrain)));
+    std::vector<float> chunkBounds(6*chunks);
+    parallelChunks(chunks,[&](int chunk){
+        float* bounds=&chunkBounds[6*chunk];
+        for(int axis=0;axis<3;axis++){bounds[axis]=FLT_MAX;bounds[3+axis]=-FLT_MAX;}
+        for(int64_t i=n*chunk/chunks;i<n*(chunk+1)/chunks;i++){
+            const float* pt=point(i);
+            for(int axis=0;axis<3;axis++){
+                bounds[axis]=std::min(bounds[axis],pt[axis]);
+                bounds[3+axis]=std::max(bounds[3+axis],pt[axis]);
+            }
+        }
+    });
+    for(int axis=0;axis<3;axis++){
+        _min[axis]=FLT_MAX;_max[axis]=-FLT_MAX;
+        for(int chunk=0;chunk<chunks;chunk++){
+            _min[axis]=std::min(_min[axis],chunkBounds[6*chunk+axis]);
+            _max[axis]=std::max(_max[axis],chunkBounds[6*chunk+3+axis]);
+        }
+        if(n==0) _min[axis]=_max[axis]=0;
+    }
+
+    if(!(cellSize>0)){
+        // size cells by the measure of the axes the points actually spread along
+        float extent=0;
+        for(int axis=0;axis<3;axis++) extent=std::max(extent,_max[axis]-_min[axis]);
+        double measure=1;int spread=0;
+        for(int axis=0;axis<3;axis++)
+            if(_max[axis]-_min[axis]>extent*1e-6f){measure*=_max[axis]-_min[axis];spread++;}
+        cellSize=spread && n ? float(std::pow(measure*PointsPerCell/n,1./spread)) : 1.f;
+        if(!(cellSize>0)) cellSize=1;
+    }
+    _cellSize=cellSize;
+    _invCellSize=1/cellSize;
+
+    double cells=1;
+    for(int axis=0;axis<3;axis++){
+        // capped so that keys stay well inside 64 bits
+        float count=std::min((_max[axis]-_min[axis])*_invCellSize,float(1<<20));
+        _dims[axis]=static_cast<int64_t>(count)+1;
+        cells*=double(_dims[axis]);
+    }
+    uint64_t tableSize;
+    _direct=cells<=std::max(DirectCellsPerPoint*n,1.);
+    if(_direct){
+        _bits=0;
+        tableSize=static_cast<uint64_t>(cells);
+    }else{
+        for(_bits=1;(uint64_t(1)<<_bits)<uint64_t(n);_bits++);
+        tableSize=uint64_t(1)<<_bits;
+    }
+
+    // counting sort of the points by bucket
+    auto pointBucket=[&](int64_t i){
+        const float* pt=point(i);
+        return bucket(static_cast<int64_t>(cellCoord(pt[0],0)),static_cast<int64_t>(cellCoord(pt[1],1)),
+            static_cast<int64_t>(cellCoord(pt[2],2)));
+    };
+    std::vector<std::atomic<int64_t> > cursor(tableSize);
+    parallelFor(0,tableSize,BuildGrain,[&](int64_t begin,int64_t end){
+        for(int64_t b=begin;b<end;b++) cursor[b].store(0,std::memory_order_relaxed);
+    });
+    parallelFor(0,n,BuildGrain,[&](int64_t begin,int64_t end){
+        for(int64_t i=begin;i<end;i++) cursor[pointBucket(i)].fetch_add(1,std::memory_order_relaxed);
+    });
+    std::shared_ptr<Buckets> buckets=std::make_shared<Buckets>();
+    buckets->start.resize(tableSize+1);
+    buckets->start[0]=0;
+    for(uint64_t b=0;b<tableSize;b++){
+        buckets->start[b+1]=buckets->start[b]+cursor[b].load(std::memory_order_relaxed);
+        cursor[b].store(buckets->start[b],std::memory_order_relaxed);
+    }
+    buckets->ids.resize(n);
+    parallelFor(0,n,BuildGrain,[&](int64_t begin,int64_t end){
+        for(int64_t i=begin;i<end;i++) buckets->ids[cursor[pointBucket(i)].fetch_add(1,std::memory_order_relaxed)]=i;
+    });
+    std::vector<std::atomic<int64_t> >().swap(cursor);
+
+    // threads filled buckets in no particular order, sort them so results are repeatable
+    parallelFor(0,tableSize,BuildGrain,[&](int64_t begin,int64_t end){
+        for(int64_t b=begin;b<end;b++)
+            if(buckets->start[b+1]-buckets->start[b]>1)
+                std::sort(buckets->ids.begin()+buckets->start[b],buckets->ids.begin()+buckets->start[b+1]);
+    });
+    for(int axis=0;axis<3;axis++) buckets->coords[axis].resize(n);
+    parallelFor(0,n,BuildGrain,[&](int64_t begin,int64_t end){
+        for(int64_t i=begin;i<end;i++){
+            const float* pt=point(buckets->ids[i]);
+            for(int axis=0;axis<3;axis++) buckets->coords[axis][i]=pt[axis];
+        }
+    });
+    _buckets=buckets;
+    setIndexed(n);
+}
+
+int64_t HashGrid::
+appendedLimit() const
+{
+    return std::max<int64_t>(1024,indexedCount()/4);
+}
+
+void HashGrid::
+indexAppended()
+{
+    // rebuilding is linear, so doing it when the points grow by a fraction stays amortized
+    const int64_t n=numPoints();
+    std::vector<float> positions(3*n);
+    parallelFor(0,indexedCount(),BuildGrain,[&](int64_t begin,int64_t end){
+        for(int64_t i=begin;i<end;i++)
+            for(int axis=0;axis<3;axis++) positions[3*_buckets->ids[i]+axis]=_buckets->coords[axis][i];
+    });
+    forEachAppended([&](int64_t i,const float* p){
+        std::copy(p,p+3,&positions[3*i]);
+        return true;
+    });
+    build(n ? &positions[0] : 0,n,sizeof(float)*3,_cellSize);
+}
+
+template<class FUNC> bool HashGrid::
+forEachRange(const int64_t cellLo[3],const int64_t cellHi[3],const FUNC& func) const
+{
+    if(_direct){
+        // rows of cells along x are stored one after the other
+        for(int64_t z=cellLo[2];z<=cellHi[2];z++)
+            for(int64_t y=cellLo[1];y<=cellHi[1];y++)
+                if(!func(_buckets->start[bucket(cellLo[0],y,z)],_buckets->start[bucket(cellHi[0],y,z)+1])) return false;
+        return true;
+    }
+    double cells=1;
+    for(int axis=0;axis<3;axis++) cells*=double(cellHi[axis]-cellLo[axis]+1);
+    if(cells>=double(_buckets->start.size()-1)){
+        // covers at least as many cells as there are buckets, just test everything
+        return func(0,static_cast<int64_t>(_buckets->ids.size()));
+    }
+    // hashed cells can share buckets, visit each once
+    std::vector<uint64_t> buckets;
+    for(int64_t z=cellLo[2];z<=cellHi[2];z++)
+        for(int64_t y=cellLo[1];y<=cellHi[1];y++)
+            for(int64_t x=cellLo[0];x<=cellHi[0];x++)
+                buckets.push_back(bucket(x,y,z));
+    std::sort(buckets.begin(),buckets.end());
+    buckets.erase(std::unique(buckets.begin(),buckets.end()),buckets.end());
+    for(size_t b=0;b<buckets.size();b++)
+        if(!func(_buckets->start[buckets[b]],_buckets->start[buckets[b]+1])) return false;
+    return true;
+}
+
+void HashGrid::
+orderQueries(const float* queries,int64_t nQueries,std::vector<uint64_t>& order) const
+{
+    // by bucket, so queries in the same cell run together
+    std::vector<std::pair<uint64_t,uint64_t> > keys(nQueries);
+    parallelFor(0,nQueries,BuildGrain,[&](int64_t begin,int64_t end){
+        for(int64_t q=begin;q<end;q++){
+            const float* p=queries+3*q;
+            keys[q]=std::make_pair(bucket(static_cast<int64_t>(cellCoord(p[0],0)),static_cast<int64_t>(cellCoord(p[1],1)),
+                static_cast<int64_t>(cellCoord(p[2],2))),uint64_t(q));
+        }
+    });
+    std::sort(keys.begin(),keys.end());
+    order.resize(nQueries);
+    for(int64_t q=0;q<nQueries;q++) order[q]=keys[q].second;
+}
+
+void HashGrid::
+findPoints(const float bboxMin[3],const float bboxMax[3],std::vector<ParticleIndex>& points) const
+{
+    int64_t cellLo[3],cellHi[3];
+    if(cellRange(bboxMin,bboxMax,cellLo,cellHi)) forEachRange(cellLo,cellHi,[&](int64_t begin,int64_t end){
+        for(int64_t i=begin;i<end;i++){
+            bool inside=true;
+            for(int axis=0;axis<3;axis++)
+                inside=inside && _buckets->coords[axis][i]>=bboxMin[axis] && _buckets->coords[axis][i]<=bboxMax[axis];
+            if(inside) points.push_back(_buckets->ids[i]);
+        }
+        return true;
+    });
+    findAppendedPoints(bboxMin,bboxMax,points);
+}
+
+int64_t HashGrid::
+countInRegion(const QueryRegion& region) const
+{
+    float lo[3],hi[3];
+    region.bounds(lo,hi);
+    int64_t cellLo[3],cellHi[3],count=0;
+    if(cellRange(lo,hi,cellLo,cellHi)) forEachRange(cellLo,cellHi,[&](int64_t begin,int64_t end){
+        unsigned char inside[64];
+        for(int64_t chunk=begin;chunk<end;chunk+=64){
+            const int n=int(std::min<int64_t>(64,end-chunk));
+            const float* coords[3]={&_buckets->coords[0][chunk],&_buckets->coords[1][chunk],&_buckets->coords[2][chunk]};
+            region.contains(coords,n,inside);
+            for(int i=0;i<n;i++) count+=inside[i];
+        }
+        return true;
+    });
+    return count+countAppendedInRegion(region);
+}
+
+bool HashGrid::
+forEachInBox(const float bboxMin[3],const float bboxMax[3],PointVisitor& visitor) const
+{
+    int64_t cellLo[3],cellHi[3];
+    if(cellRange(bboxMin,bboxMax,cellLo,cellHi) && !forEachRange(cellLo,cellHi,[&](int64_t begin,int64_t end){
+        for(int64_t i=begin;i<end;i++){
+            bool inside=true;
+            for(int axis=0;axis<3;axis++)
+                inside=inside && _buckets->coords[axis][i]>=bboxMin[axis] && _buckets->coords[axis][i]<=bboxMax[axis];
+            if(inside && !visitor.visit(_buckets->ids[i],0)) return false;
+        }
+        return true;
+    })) return false;
+    return visitAppendedInBox(bboxMin,bboxMax,visitor);
+}
+
+void HashGrid::
+findPointsInRegion(const QueryRegion& region,std::vector<ParticleIndex>& points) const
+{
+    float lo[3],hi[3];
+    region.bounds(lo,hi);
+    int64_t cellLo[3],cellHi[3];
+    if(cellRange(lo,hi,cellLo,cellHi)) forEachRange(cellLo,cellHi,[&](int64_t begin,int64_t end){
+        // bucket points are contiguous, test them in batches
+        unsigned char inside[64];
+        for(int64_t chunk=begin;chunk<end;chunk+=64){
+            const int n=int(std::min<int64_t>(64,end-chunk));
+            const float* coords[3]={&_buckets->coords[0][chunk],&_buckets->coords[1][chunk],&_buckets->coords[2][chunk]};
+            region.contains(coords,n,inside);
+            for(int i=0;i<n;i++) if(inside[i]) points.push_back(_buckets->ids[chunk+i]);
+        }
+        return true;
+    });
+    findAppendedPointsInRegion(region,points);
+}
+
+void HashGrid::
+findPointsInRadius(const float center[3],const float radius,std::vector<ParticleIndex>& points,
+    std::vector<float>& pointDistancesSquared,bool sorted) const
+{
+    const float radiusSquared=radius*radius;
+    const float lo[3]={center[0]-radius,center[1]-radius,center[2]-radius};
+    const float hi[3]={center[0]+radius,center[1]+radius,center[2]+radius};
+    if(!(radius>=0)) return;
+    const size_t startIndex=points.size();
+    int64_t cellLo[3],cellHi[3];
+    if(cellRange(lo,hi,cellLo,cellHi)) forEachRange(cellLo,cellHi,[&](int64_t begin,int64_t end){
+        for(int64_t i=begin;i<end;i++){
+            float distanceSquared=0;
+            for(int axis=0;axis<3;axis++){
+                float d=_buckets->coords[axis][i]-center[axis];
+                distanceSquared+=d*d;
+            }
+            if(distanceSquared<=radiusSquared){
+                points.push_back(_buckets->ids[i]);
+                pointDistancesSquared.push_back(distanceSquared);
+            }
+        }
+        return true;
+    });
+    findAppendedPointsInRadius(center,radiusSquared,points,pointDistancesSquared);
+    if(sorted && points.size()-startIndex>1)
+        sortByDistance(&points[startIndex],&pointDistancesSquared[startIndex],points.size()-startIndex);
+}
+
+bool HashGrid::
+forEachInRadius(const float center[3],const float radius,PointVisitor& visitor) const
+{
+    const float radiusSquared=radius*radius;
+    const float lo[3]={center[0]-radius,center[1]-radius,center[2]-radius};
+    const float hi[3]={center[0]+radius,center[1]+radius,center[2]+radius};
+    if(!(radius>=0)) return true;
+    int64_t cellLo[3],cellHi[3];
+    if(cellRange(lo,hi,cellLo,cellHi) && !forEachRange(cellLo,cellHi,[&](int64_t begin,int64_t end){
+        for(int64_t i=begin;i<end;i++){
+            float distanceSquared=0;
+            for(int axis=0;axis<3;axis++){
+                float d=_buckets->coords[axis][i]-center[axis];
+                distanceSquared+=d*d;
+            }
+            if(distanceSquared<=radiusSquared && !visitor.visit(_buckets->ids[i],distanceSquared)) return false;
+        }
+        return true;
+    })) return false;
+    return visitAppendedInRadius(center,radiusSquared,visitor);
+}
+
+int HashGrid::
+findNPoints(const float center[3],int nPoints,const float maxRadius,
+    ParticleIndex* points,float* pointDistancesSquared,float* finalRadius2) const
+{
+    if(nPoints<1) return 0;
+    float maxRadiusSquared=maxRadius*maxRadius;
+    int found=0;
+    if(!_buckets->ids.empty()) findNPointsInCells(center,nPoints,points,pointDistancesSquared,found,maxRadiusSquared);
+    findAppendedNPoints(center,nPoints,points,pointDistancesSquared,found,maxRadiusSquared);
+    *finalRadius2=maxRadiusSquared;
+    return found;
+}
+
+void HashGrid::
+findNPointsInCells(const float center[3],int nPoints,ParticleIndex* points,float* pointDistancesSquared,
+    int& found,float& maxRadiusSquared) const
+{
+    // searches rings of cells around the center's cell until no cell outside
+    // them can hold anything closer than what has been found
+    int64_t centerCell[3];
+    for(int axis=0;axis<3;axis++) centerCell[axis]=static_cast<int64_t>(cellCoord(center[axis],axis));
+    // cell bounds are computed differently than cell membership, allow for the rounding
+    float slack=_cellSize*float(std::max(_dims[0],std::max(_dims[1],_dims[2])));
+    for(int axis=0;axis<3;axis++) slack=std::max(slack,std::abs(_min[axis])+std::abs(center[axis]));
+    slack*=1e-6f;
+
+    auto scan=[&](int64_t begin,int64_t end){
+        for(int64_t i=begin;i<end;i++){
+            float distanceSquared=0;
+            for(int axis=0;axis<3;axis++){
+                float d=_buckets->coords[axis][i]-center[axis];
+                distanceSquared+=d*d;
+            }
+            insertNearest(_buckets->ids[i],distanceSquared,nPoints,points,pointDistancesSquared,found,maxRadiusSquared);
+        }
+    };
+    std::vector<uint64_t> ring,visited,merged;
+    // cells x0 to x1 of a row, scanned at once when direct and collected to share buckets otherwise
+    auto row=[&](int64_t x0,int64_t x1,int64_t y,int64_t z){
+        if(_direct) scan(_buckets->start[bucket(x0,y,z)],_buckets->start[bucket(x1,y,z)+1]);
+        else for(int64_t x=x0;x<=x1;x++) ring.push_back(bucket(x,y,z));
+    };
+    for(int64_t r=0;;r++){
+        int64_t cellLo[3],cellHi[3];
+        bool coversGrid=true;
+        for(int axis=0;axis<3;axis++){
+            cellLo[axis]=std::max<int64_t>(centerCell[axis]-r,0);
+            cellHi[axis]=std::min<int64_t>(centerCell[axis]+r,_dims[axis]-1);
+            coversGrid=coversGrid && centerCell[axis]-r<=0 && centerCell[axis]+r>=_dims[axis]-1;
+        }
+
+        // the cells on the surface of the block, rows along x are whole unless inside the block
+        ring.clear();
+        for(int64_t z=cellLo[2];z<=cellHi[2];z++){
+            for(int64_t y=cellLo[1];y<=cellHi[1];y++){
+                if(std::abs(z-centerCell[2])==r || std::abs(y-centerCell[1])==r){
+                    row(cellLo[0],cellHi[0],y,z);
+                }else{
+                    if(centerCell[0]-r>=0) row(centerCell[0]-r,centerCell[0]-r,y,z);
+                    if(r>0 && centerCell[0]+r<_dims[0]) row(centerCell[0]+r,centerCell[0]+r,y,z);
+                }
+            }
+        }
+        if(!_direct){
+            // hashed cells can share buckets with each other and with earlier rings
+            std::sort(ring.begin(),ring.end());
+            ring.erase(std::unique(ring.begin(),ring.end()),ring.end());
+            merged.clear();
+            std::set_difference(ring.begin(),ring.end(),visited.begin(),visited.end(),std::back_inserter(merged));
+            ring.swap(merged);
+            merged.clear();
+            std::merge(visited.begin(),visited.end(),ring.begin(),ring.end(),std::back_inserter(merged));
+            visited.swap(merged);
+            for(size_t b=0;b<ring.size();b++) scan(_buckets->start[ring[b]],_buckets->start[ring[b]+1]);
+        }
+        if(coversGrid) break;
+
+        // nearest any point outside the block can be, sides at the grid's edge have none
+        float outside=FLT_MAX;
+        for(int axis=0;axis<3;axis++){
+            if(centerCell[axis]-r>0)
+                outside=std::min(outside,center[axis]-(_min[axis]+(centerCell[axis]-r)*_cellSize));
+            if(centerCell[axis]+r<_dims[axis]-1)
+                outside=std::min(outside,_min[axis]+(centerCell[axis]+r+1)*_cellSize-center[axis]);
+        }
+        outside-=slack;
+        if(outside>0 && outside*outside>=maxRadiusSquared) break;
+    }
+}
+
+}
@@ -0,0 +1,111 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+#ifndef _HashGrid_h_
+#define _HashGrid_h_
+
+#include "SpatialIndex.h"
+
+namespace Partio{
+
+//! Uniform grid of cells hashed into a table of buckets
+/*!
+  Points are counting sorted by bucket, so each bucket's points are
+  contiguous. A query visits the buckets of the cells it overlaps and tests
+  every point in them, so cells that share a bucket only cost extra tests.
+  When the grid has few enough cells every cell gets its own bucket.
+  Fixed-radius queries on evenly spread points are faster than on a KdTree,
+  as long as the cell size is close to the query radius. Appended points
+  are taken in by rebuilding the grid, once they add up to a quarter of it.
+*/
+class HashGrid:public SpatialIndex
+{
+public:
+    HashGrid();
+
+    //! Buckets the n points read from p+i*stride bytes into cells of cellSize.
+    //! A cellSize of zero or less picks one that puts a few points in each cell.
+    //! The points are only used during the call
+    void build(const float* p,int64_t n,size_t stride,float cellSize);
+    float cellSize() const {return _cellSize;}
+
+    using SpatialIndex::findNPoints;
+    void findPoints(const float bboxMin[3],const float bboxMax[3],std::vector<ParticleIndex>& points) const;
+    int findNPoints(const float center[3],int nPoints,const float maxRadius,
+        ParticleIndex* points,float* pointDistancesSquared,float* finalRadius2) const;
+    void findPointsInRadius(const float center[3],const float radius,std::vector<ParticleIndex>& points,
+        std::vector<float>& pointDistancesSquared,bool sorted) const;
+    //! Tests the points of every cell in the region's bounds, which for
+    //! unbounded regions such as frustums means the whole grid
+    void findPointsInRegion(const QueryRegion& region,std::vector<ParticleIndex>& points) const;
+    //! Like the other queries these collect the buckets of hashed cells to
+    //! visit each once, so only grids with a bucket per cell never allocate
+    bool forEachInBox(const float bboxMin[3],const float bboxMax[3],PointVisitor& visitor) const;
+    bool forEachInRadius(const float center[3],const float radius,PointVisitor& visitor) const;
+    int64_t countInRegion(const QueryRegion& region) const;
+
+protected:
+    SpatialIndex* clone() const {return new HashGrid(*this);}
+    void indexAppended();
+    int64_t appendedLimit() const;
+    void orderQueries(const float* queries,int64_t nQueries,std::vector<uint64_t>& order) const;
+
+private:
+    float cellCoord(const float x,const int axis) const;
+    bool cellRange(const float lo[3],const float hi[3],int64_t cellLo[3],int64_t cellHi[3]) const;
+    uint64_t bucket(const int64_t x,const int64_t y,const int64_t z) const;
+    void findNPointsInCells(const float center[3],int nPoints,ParticleIndex* points,float* pointDistancesSquared,
+        int& found,float& maxRadiusSquared) const;
+    //! Calls func(begin,end) with the point ranges of the buckets of the cells
+    //! until it returns false, and returns false if it did
+    template<class FUNC> bool forEachRange(const int64_t cellLo[3],const int64_t cellHi[3],const FUNC& func) const;
+
+    struct Buckets
+    {
+        std::vector<int64_t> start; // bucket b's points are [start[b],start[b+1])
+        std::vector<float> coords[3]; // in bucket order
+        std::vector<ParticleIndex> ids; // in bucket order
+    };
+
+    float _min[3],_max[3];
+    float _cellSize,_invCellSize;
+    int64_t _dims[3];
+    bool _direct;
+    int _bits;
+    // copies share the buckets, build() replaces them whole
+    std::shared_ptr<const Buckets> _buckets;
+};
+
+}
+#endif
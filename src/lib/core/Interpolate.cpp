@@ -0,0 +1,152 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+#ifdef PARTIO_WIN32
+#    define NOMINMAX
+#endif
+#include "../Partio.h"
+#include "Parallel.h"
+#include "SpatialIndex.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+namespace Partio{
+
+namespace{
+
+// queries are handed to threads in pieces of this size
+const int64_t Grain=256;
+const float Pi=3.14159265358979f;
+
+// factor making the kernel integrate to 1 over a ball of the given radius
+float kernelScale(const SphKernel kernel,const float radius)
+{
+    const float volume=radius*radius*radius;
+    switch(kernel){
+        case SphKernel::CubicSpline: return 8/(Pi*volume);
+        case SphKernel::Poly6: return 315/(64*Pi*volume);
+        default: return 21/(2*Pi*volume);
+    }
+}
+
+// unscaled kernel at squared distance over squared radius q2, which is at most 1
+float kernelShape(const SphKernel kernel,const float q2)
+{
+    switch(kernel){
+        case SphKernel::CubicSpline:{
+            const float q=std::sqrt(q2);
+            if(q<=.5f) return 1-6*q2+6*q2*q;
+            const float s=1-q;
+            return 2*s*s*s;
+        }
+        case SphKernel::Poly6:{
+            const float s=1-q2;
+            return s*s*s;
+        }
+        default:{
+            const float q=std::sqrt(q2),s=1-q;
+            return s*s*s*s*(1+4*q);
+        }
+    }
+}
+
+}
+
+bool
+interpolate(const ParticlesData& particles,const float* queries,const int64_t nQueries,
+    const std::vector<ParticleAttribute>& attributes,const SphKernel kernel,const float radius,float* values,
+    const ParticleAttribute* volume,const bool normalize,float* weights)
+{
+    int components=0;
+    for(size_t a=0;a<attributes.size();a++){
+        if(attributes[a].type!=VECTOR && attributes[a].type!=FLOAT){
+            std::cerr<<"Partio: interpolate can only interpolate float attributes, not "<<attributes[a].name<<std::endl;
+            return false;
+        }
+        components+=attributes[a].count;
+    }
+    if(volume && ((volume->type!=VECTOR && volume->type!=FLOAT) || volume->count!=1)){
+        std::cerr<<"Partio: interpolate needs a 1 component float volume attribute, not "<<volume->name<<std::endl;
+        return false;
+    }
+    if(!(radius>0)){
+        std::cerr<<"Partio: interpolate needs a positive radius"<<std::endl;
+        return false;
+    }
+    // every query runs on the same snapshot of the index
+    SpatialIndexPtr* published=particles.spatialIndex();
+    std::shared_ptr<SpatialIndex> index=published ? published->load() : nullptr;
+    if(!index){
+        std::cerr<<"Partio: interpolate without first calling sort()"<<std::endl;
+        return false;
+    }
+    const float scale=kernelScale(kernel,radius),invRadius2=1/(radius*radius);
+    const int numAttributes=int(attributes.size());
+
+    parallelForDynamic(0,nQueries,Grain,[&](int64_t begin,int64_t end){
+        std::vector<float> sums(components);
+        for(int64_t q=begin;q<end;q++){
+            std::fill(sums.begin(),sums.end(),0.f);
+            float weightSum=0;
+            auto add=[&](const ParticleIndex particle,const float distanceSquared){
+                const float q2=distanceSquared*invRadius2;
+                if(q2>=1) return true;
+                float weight=kernelShape(kernel,q2);
+                if(volume) weight*=*particles.data<float>(*volume,particle);
+                weightSum+=weight;
+                float* sum=sums.empty() ? 0 : &sums[0];
+                for(int a=0;a<numAttributes;a++){
+                    const float* value=particles.data<float>(attributes[a],particle);
+                    for(int k=0;k<attributes[a].count;k++) sum[k]+=weight*value[k];
+                    sum+=attributes[a].count;
+                }
+                return true;
+            };
+            FunctionVisitor<decltype(add)> visitor(add);
+            index->forEachInRadius(queries+3*q,radius,visitor);
+            float* out=values+q*components;
+            if(normalize){
+                const float invWeight=weightSum!=0 ? 1/weightSum : 0;
+                for(int k=0;k<components;k++) out[k]=sums[k]*invWeight;
+            }
+            else for(int k=0;k<components;k++) out[k]=sums[k]*scale;
+            if(weights) weights[q]=weightSum*scale;
+        }
+    });
+    return true;
+}
+
+}
@@ -39,6 +39,9 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
 #elif defined(__GNUC__)
 #include <ext/numeric>
 #endif
+#include <thread>
+#include <ostream>
+#include "Parallel.h"
 
 namespace Partio
 {
@@ -64,7 +67,9 @@ namespace Partio
 #include <vector>
 #include <float.h>
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <stdint.h>
 
 template <int k> class BBox
 {
@@ -163,7 +168,7 @@ inline float buildHeap(uint64_t *result, float *distance_squared,int heap_size)
 }
 
 // Inserts smaller element into heap (does not check so caller must)
-inline float insertToHeap(uint64_t *result,float*distance_squared,int heap_size,int new_id,float new_distance_squared)
+inline float insertToHeap(uint64_t *result,float*distance_squared,int heap_size,uint64_t new_id,float new_distance_squared)
 {
     assert(new_distance_squared<distance_squared[0]);
     int current_parent=0;
@@ -194,48 +199,179 @@ template <int k> class KdTree
     struct NearestQuery
     {
         NearestQuery(uint64_t *result,float *distanceSquared,const float pquery_in[k],
-                      int maxPoints,float maxRadiusSquared)
+                      int maxPoints,float maxRadiusSquared,float epsilon,int64_t maxVisited)
             :result(result),distanceSquared(distanceSquared),maxPoints(maxPoints),
-             foundPoints(0),maxRadiusSquared(maxRadiusSquared)
+             foundPoints(0),maxRadiusSquared(maxRadiusSquared),pruneScale((1+epsilon)*(1+epsilon)),
+             visitsLeft(maxVisited>0 ? maxVisited : INT64_MAX)
 
         {for(int i=0;i<k;i++) pquery[i]=pquery_in[i];}
 
+        // caller must check pDistanceSquared<maxRadiusSquared
+        void insert(uint64_t n,float pDistanceSquared)
+        {
+            if(foundPoints<maxPoints){
+                // TODO: we could do the remapping here, but we do it at the end before returning teh result
+                result[foundPoints]=n;
+                distanceSquared[foundPoints]=pDistanceSquared;
+                foundPoints++;
+                if(foundPoints==maxPoints)
+                    maxRadiusSquared=buildHeap(result,distanceSquared,foundPoints);
+            }else // already have heap, find somebody to throw out
+                maxRadiusSquared=insertToHeap(result,distanceSquared,foundPoints,n,pDistanceSquared);
+        }
+
         uint64_t *result;
         float *distanceSquared;
         float pquery[k];
         int maxPoints;
         int foundPoints;
         float maxRadiusSquared;
+        // subtrees are skipped unless their axis distance squared is below maxRadiusSquared/pruneScale
+        float pruneScale;
+        // leaf buckets that may still be searched
+        int64_t visitsLeft;
     };
 
  public:
+    //! Subtrees of at most this many points are leaf buckets. They are left
+    //! unsorted and searched by testing all of their points at once.
+    static const int LeafSize = 32;
+
     KdTree();
     ~KdTree();
-    int size() const { return static_cast<int>(_points.size()); }
+    int64_t size() const { return _size; }
     const BBox<k>& bbox() const { return _bbox; }
-    const float* point(int i) const { return _points[i].p; }
-    uint64_t id(int i) const { return _ids[i]; }
-    void setPoints(const float* p, int n);
+    float coord(int64_t i, int axis) const { return _pointData ? pointById(id(i))[axis] : _coordData[axis][i]; }
+    uint64_t id(int64_t i) const { return _wideIds ? _idData64[i] : _idData32[i]; }
+    void setPoints(const float* p, int64_t n);
+    //! Builds over the caller's positions without copying them. Point i is
+    //! read from p+i*stride bytes, and the memory must stay valid and
+    //! unchanged while the tree is in use, or until detachPoints().
+    void referencePoints(const float* p, int64_t n, size_t stride=sizeof(float)*k);
+    //! Copies referenced points into the tree, after which the caller's array is no longer used
+    void detachPoints();
     void sort();
+    //! Writes a sorted tree in the layout view() uses, with referenced points
+    //! gathered into coordinates. Returns false if it cannot.
+    bool save(std::ostream& out) const;
+    //! Uses a tree written by save() in place, e.g. from a memory mapped
+    //! file. data must be 8 byte aligned and stay valid while the tree is in
+    //! use. Returns the number of bytes the tree took, 0 if data is invalid.
+    //! The ids are not checked, see idsInRange().
+    size_t view(const char* data, size_t bytes);
+    //! Whether every id is below size(), as they are unless a viewed file is corrupt
+    bool idsInRange() const;
     void findPoints(std::vector<uint64_t>& points, const BBox<k>& bbox) const;
+    //! Calls visit(treeIndex) for each point inside bbox until it returns
+    //! false. Returns false if the visit was stopped that way.
+    template <class Visitor> bool forEachInBox(const BBox<k>& bbox, const Visitor& visit) const;
+    //! Calls visit(treeIndex, distanceSquared) for each point within radius
+    //! of p until it returns false. Returns false if the visit was stopped.
+    template <class Visitor> bool forEachInRadius(const float p[k], float radius, const Visitor& visit) const;
+    //! Appends the tree indices of the points inside region. Its
+    //! classify(min, max) tells whether a box is outside (< 0), inside (> 0)
+    //! or neither, and contains(coords, n, inside) tests a bucket of points.
+    template <class Region> void findPointsInRegion(std::vector<uint64_t>& result, const Region& region) const;
+    //! Calls visit(begin, end) with ranges of tree indices whose points are
+    //! all inside region, until it returns false. A subtree's points are
+    //! contiguous, so a subtree found inside is passed as a single range and
+    //! counts or prefix sums over tree order aggregate it in constant time.
+    //! Returns false if the visit was stopped.
+    template <class Region, class Visitor> bool forEachRangeInRegion(const Region& region, const Visitor& visit) const;
+    //! Sets maxima[n], for each node n, to the largest of values (given in
+    //! tree order) over the subtree rooted at n. A leaf bucket's maximum is
+    //! stored at its first point, the entries of its other points are unset.
+    void subtreeMaxima(const float* values, float* maxima) const;
+    //! Calls visit(treeIndex) for each point whose sphere of radius
+    //! radii[treeIndex] touches shape until it returns false. Returns false if
+    //! the visit was stopped. shape.distance(min, max) is the distance from
+    //! the shape to a box (or point when min == max), zero where they overlap,
+    //! and maxRadii holds the subtreeMaxima() of radii.
+    template <class Shape, class Visitor> bool forEachOverlapping(const Shape& shape, const float* radii,
+								  const float* maxRadii, const Visitor& visit) const;
     float findNPoints(std::vector<uint64_t>& result,std::vector<float>& distanceSquared,
         const float p[k],int nPoints,float maxRadius) const;
+    //! With epsilon > 0 subtrees whose points can only be less than (1+epsilon)
+    //! times closer than the current farthest result are skipped, so that
+    //! result is at most (1+epsilon) times farther than the exact one. With
+    //! maxVisited > 0 at most that many leaf buckets are searched and the
+    //! nearest points found until then are returned.
     int findNPoints(uint64_t *result,float *distanceSquared, float *finalSearchRadius2,
-                    const float p[k], int nPoints, float maxRadius) const;
+                    const float p[k], int nPoints, float maxRadius,
+                    float epsilon=0, int64_t maxVisited=0) const;
+    //! Runs findNPoints for nQueries points stored k floats apart, in
+    //! parallel. Query q writes up to nPoints ids (not tree indices) and
+    //! distances starting at q*nPoints, and its count to counts[q].
+    //! sortQueries runs them in Morton order to keep nearby queries together.
+    void findNPointsBatch(const float* queries, int64_t nQueries, int nPoints, float maxRadius,
+                          uint64_t* result, float* distanceSquared, int* counts, bool sortQueries) const;
+    //! Appends the tree indices and squared distances of all points within
+    //! radius of p, ordered by distance if sorted is set
+    void findPointsInRadius(std::vector<uint64_t>& result, std::vector<float>& distanceSquared,
+                            const float p[k], float radius, bool sorted) const;
+    //! Runs findPointsInRadius for nQueries points stored k floats apart, in
+    //! parallel. Results are ids (not tree indices) in compressed rows: query
+    //! q's are at [offsets[q], offsets[q+1]).
+    void findPointsInRadiusBatch(const float* queries, int64_t nQueries, float radius,
+                                 std::vector<int64_t>& offsets, std::vector<uint64_t>& result,
+                                 std::vector<float>& distanceSquared, bool sorted) const;
 
 
  private:
-    void sortSubtree(int n, int count, int j);
+    // subtrees at least this large are handed to another thread
+    static const int64_t ParallelSubtreeSize = 1<<15;
+    // ranges at least this large are partitioned by all of a subtree's threads
+    static const int64_t ParallelPartitionSize = 1<<20;
+    // batches of queries are handed to threads in pieces of this size
+    static const int64_t BatchGrain = 256;
+    // smaller batches are not worth ordering
+    static const int64_t MortonSortSize = 4096;
+
+    // save() layout: this header, the k coordinate arrays, then the ids,
+    // each starting at a multiple of 8 bytes
+    struct SavedHeader
+    {
+	uint32_t magic, dimension;
+	int64_t size;
+	uint32_t wideIds, leafSize;
+	float min[k], max[k];
+    };
+    static const uint32_t SavedMagic = 0x5444504b; // "KPDT"
+    static size_t savedPadding(size_t bytes) { return (8-bytes%8)%8; }
+    void setDataPointers();
+    // trees point into their own arrays, so copies would share them
+    KdTree(const KdTree&);
+    KdTree& operator=(const KdTree&);
+
+    const float* pointById(uint64_t id) const
+    { return reinterpret_cast<const float*>(_pointData + id*_pointStride); }
+    void assignIds(int64_t n);
+    void mortonOrder(const float* queries, int64_t nQueries, std::vector<uint64_t>& order) const;
+    void copyCoords();
+    template <class ID> void sortSubtree(ID* ids, int64_t n, int64_t count, int j, int threads);
+    template <class ID> void partitionParallel(ID* ids, int64_t begin, int64_t nth, int64_t end, int j, int threads);
     struct ComparePointsById {
-	float* points;
-	ComparePointsById(float* p) : points(p) {}
-	bool operator() (uint64_t a, uint64_t b) { return points[a*k] < points[b*k]; }
+	const KdTree* tree;
+	int j;
+	ComparePointsById(const KdTree* tree, int j) : tree(tree), j(j) {}
+	bool operator() (uint64_t a, uint64_t b) { return tree->pointById(a)[j] < tree->pointById(b)[j]; }
     };
-    void findPoints(std::vector<uint64_t>& result, const BBox<k>& bbox,
-		    int n, int size, int j) const;
-    void findNPoints(NearestQuery& query,int n,int size,int j) const;
+    void leafCoords(int64_t n, int64_t size, float buffer[k][LeafSize], const float* coords[k]) const;
+    template <class Visitor> bool forEachInBox(const BBox<k>& bbox, const Visitor& visit,
+					       int64_t n, int64_t size, int j) const;
+    void findNPoints(NearestQuery& query,int64_t n,int64_t size,int j) const;
+    float subtreeMaxima(const float* values, float* maxima, int64_t n, int64_t size) const;
+    template <class Shape, class Visitor> bool forEachOverlapping(const Shape& shape, const float* radii,
+								  const float* maxRadii, const Visitor& visit,
+								  BBox<k>& cell, int64_t n, int64_t size, int j) const;
+    template <class Region, class Visitor> bool forEachRangeInRegion(const Region& region, const Visitor& visit,
+								     BBox<k>& cell, int64_t n, int64_t size, int j) const;
+    template <class Visitor> bool forEachInRadius(const float p[k], float radiusSquared, const Visitor& visit,
+						  float offset[k], float cellDistanceSquared,
+						  int64_t n, int64_t size, int j) const;
+    static void sortByDistance(uint64_t* result, float* distanceSquared, size_t count);
 
-    static inline void ComputeSubtreeSizes(int size, int& left, int& right)
+    static inline void ComputeSubtreeSizes(int64_t size, int64_t& left, int64_t& right)
     {
 	// if (size+1) is a power of two, then subtree is balanced
 	bool balanced = ((size+1) & size) == 0;
@@ -251,23 +387,40 @@ template <int k> class KdTree
 	else {
 	    // left subtree size = (smallest power of 2 > half size)-1
 	    int i = 0;
-	    for (int c = size; c != 1; c >>= 1) i++;
-	    left = (1<<i)-1;
+	    for (int64_t c = size; c != 1; c >>= 1) i++;
+	    left = (int64_t(1)<<i)-1;
 	    right = size - left - 1;
 	}
     }
 
     BBox<k> _bbox;
     struct Point { float p[k]; };
+    // copy of the points given to setPoints, only kept until sort()
     std::vector<Point> _points;
-    std::vector<uint64_t> _ids;
+    // points by id while building, or the caller's points when referencing them
+    const char* _pointData;
+    size_t _pointStride;
+    // copied coordinates in tree order, one array per axis. Padded by
+    // LeafSize so whole buckets can be loaded from anywhere in the tree.
+    std::vector<float> _coords[k];
+    // ids only need 64 bits for trees of 2^32 points or more
+    std::vector<uint32_t> _ids32;
+    std::vector<uint64_t> _ids64;
+    // what queries read, the arrays above or a tree given to view()
+    const float* _coordData[k];
+    const uint32_t* _idData32;
+    const uint64_t* _idData64;
+    bool _wideIds;
+    int64_t _size;
     bool _sorted;
 };
 
 template <int k>
 KdTree<k>::KdTree()
-    : _sorted(0)
-{}
+    : _pointData(0), _pointStride(0), _idData32(0), _idData64(0), _wideIds(0), _size(0), _sorted(0)
+{
+    for (int axis = 0; axis < k; axis++) _coordData[axis] = 0;
+}
 
 template <int k>
 KdTree<k>::~KdTree()
@@ -275,29 +428,67 @@ KdTree<k>::~KdTree()
 
 // TODO: this should take an array of ids in
 template <int k>
-void KdTree<k>::setPoints(const float* p, int n)
+void KdTree<k>::setPoints(const float* p, int64_t n)
 {
     // copy points
     _points.resize(n);
-    memcpy(&_points[0], p, sizeof(Point)*n);
+    if (n) memcpy(&_points[0], p, sizeof(Point)*n);
+    _pointData = n ? reinterpret_cast<const char*>(&_points[0]) : 0;
+    _pointStride = sizeof(Point);
+    assignIds(n);
+}
+
+template <int k>
+void KdTree<k>::referencePoints(const float* p, int64_t n, size_t stride)
+{
+    std::vector<Point>().swap(_points);
+    _pointData = reinterpret_cast<const char*>(p);
+    _pointStride = stride;
+    assignIds(n);
+}
+
+template <int k>
+void KdTree<k>::assignIds(int64_t n)
+{
+    _size = n;
+    for (int axis = 0; axis < k; axis++) std::vector<float>().swap(_coords[axis]);
 
     // compute bbox
     if (n) {
-	_bbox.set(p);
-	for (int i = 1; i < n; i++)
-	    _bbox.grow(_points[i].p);
+	_bbox.set(pointById(0));
+	for (int64_t i = 1; i < n; i++)
+	    _bbox.grow(pointById(i));
     } else _bbox.clear();
 
     // assign sequential ids
-    _ids.resize(n);
+    _wideIds = uint64_t(n) > uint64_t(UINT32_MAX);
+    std::vector<uint32_t>().swap(_ids32);
+    std::vector<uint64_t>().swap(_ids64);
+    if (_wideIds) {
+	_ids64.resize(n);
+#if defined(__clang__) && defined(_LIBCPP_VERSION) || defined(_MSC_VER)
+	std::iota(_ids64.begin(), _ids64.end(), 0);
+#elif defined(__GNUC__)
+	__gnu_cxx::iota(_ids64.begin(), _ids64.end(), 0);
+#endif
+    } else {
+	_ids32.resize(n);
 #if defined(__clang__) && defined(_LIBCPP_VERSION) || defined(_MSC_VER)
-    std::iota(_ids.begin(), _ids.end(), 0);
+	std::iota(_ids32.begin(), _ids32.end(), 0);
 #elif defined(__GNUC__)
-    __gnu_cxx::iota(_ids.begin(), _ids.end(), 0);
+	__gnu_cxx::iota(_ids32.begin(), _ids32.end(), 0);
 #endif
-//    _ids.reserve(n);
-//    while ((int)_ids.size() < n) _ids.push_back(_ids.size());
+    }
     _sorted = 0;
+    setDataPointers();
+}
+
+template <int k>
+void KdTree<k>::setDataPointers()
+{
+    for (int axis = 0; axis < k; axis++) _coordData[axis] = _coords[axis].empty() ? 0 : &_coords[axis][0];
+    _idData32 = _ids32.empty() ? 0 : &_ids32[0];
+    _idData64 = _ids64.empty() ? 0 : &_ids64[0];
 }
 
 template <int k>
@@ -307,31 +498,137 @@ void KdTree<k>::sort()
     _sorted = 1;
 
     // reorder ids to sort points
-    int np = static_cast<int>(_points.size());
+    int64_t np = _size;
     if (!np) return;
-    if (np > 1) sortSubtree(0, np, 0);
+    if (np > 1) {
+	if (_wideIds) sortSubtree(&_ids64[0], 0, np, 0, numThreads());
+	else sortSubtree(&_ids32[0], 0, np, 0, numThreads());
+    }
+    if (!_points.empty()) copyCoords();
+}
+
+template <int k>
+void KdTree<k>::detachPoints()
+{
+    if (_pointData && _points.empty() && _sorted) copyCoords();
+}
 
-    // reorder points to match id order
-    std::vector<Point> newpoints(np);
-    for (int i = 0; i < np; i++)
-	newpoints[i] = _points[static_cast<unsigned int>(_ids[i])];
-    std::swap(_points, newpoints);
+// gathers the points into per-axis arrays in tree order and stops using _pointData
+template <int k>
+void KdTree<k>::copyCoords()
+{
+    for (int axis = 0; axis < k; axis++) _coords[axis].assign(_size+LeafSize, 0.f);
+    parallelFor(0, _size, ParallelSubtreeSize, [&](int64_t begin, int64_t end) {
+	for (int64_t i = begin; i < end; i++) {
+	    const float* p = pointById(id(i));
+	    for (int axis = 0; axis < k; axis++) _coords[axis][i] = p[axis];
+	}
+    });
+    std::vector<Point>().swap(_points);
+    _pointData = 0;
+    setDataPointers();
 }
 
 template <int k>
-void KdTree<k>::sortSubtree(int n, int size, int j)
+bool KdTree<k>::save(std::ostream& out) const
 {
-    int left, right; ComputeSubtreeSizes(size, left, right);
+    if (!_sorted) return false;
+    SavedHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = SavedMagic;
+    header.dimension = k;
+    header.size = _size;
+    header.wideIds = _wideIds;
+    header.leafSize = LeafSize;
+    for (int axis = 0; axis < k; axis++) {
+	header.min[axis] = _bbox.min[axis];
+	header.max[axis] = _bbox.max[axis];
+    }
+    const char zeros[8] = {};
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(zeros, savedPadding(sizeof(header)));
+    if (!_size) return bool(out);
+    const size_t coordBytes = sizeof(float)*(_size+LeafSize);
+    std::vector<float> gathered;
+    for (int axis = 0; axis < k; axis++) {
+	const float* coords = _coordData[axis];
+	if (_pointData) {
+	    gathered.assign(_size+LeafSize, 0.f);
+	    for (int64_t i = 0; i < _size; i++) gathered[i] = pointById(id(i))[axis];
+	    coords = &gathered[0];
+	}
+	out.write(reinterpret_cast<const char*>(coords), coordBytes);
+	out.write(zeros, savedPadding(coordBytes));
+    }
+    const size_t idBytes = (_wideIds ? sizeof(uint64_t) : sizeof(uint32_t))*_size;
+    out.write(_wideIds ? reinterpret_cast<const char*>(_idData64) : reinterpret_cast<const char*>(_idData32), idBytes);
+    out.write(zeros, savedPadding(idBytes));
+    return bool(out);
+}
+
+template <int k>
+size_t KdTree<k>::view(const char* data, size_t bytes)
+{
+    size_t used = sizeof(SavedHeader)+savedPadding(sizeof(SavedHeader));
+    if (bytes < used) return 0;
+    const SavedHeader& header = *reinterpret_cast<const SavedHeader*>(data);
+    if (header.magic != SavedMagic || header.dimension != k || header.leafSize != LeafSize || header.size < 0)
+	return 0;
+    // a size the data cannot hold would overflow the sizes below
+    if (uint64_t(header.size) > bytes/sizeof(float)) return 0;
+    const size_t coordBytes = header.size ? sizeof(float)*(header.size+LeafSize) : 0;
+    const size_t idBytes = (header.wideIds ? sizeof(uint64_t) : sizeof(uint32_t))*header.size;
+    const size_t coordsAt = used, idsAt = coordsAt+k*(coordBytes+savedPadding(coordBytes));
+    used = idsAt+idBytes+savedPadding(idBytes);
+    if (bytes < used) return 0;
+
+    std::vector<Point>().swap(_points);
+    for (int axis = 0; axis < k; axis++) std::vector<float>().swap(_coords[axis]);
+    std::vector<uint32_t>().swap(_ids32);
+    std::vector<uint64_t>().swap(_ids64);
+    _pointData = 0;
+    _size = header.size;
+    _wideIds = header.wideIds != 0;
+    _sorted = 1;
+    for (int axis = 0; axis < k; axis++) {
+	_bbox.min[axis] = header.min[axis];
+	_bbox.max[axis] = header.max[axis];
+	_coordData[axis] = _size ? reinterpret_cast<const float*>(data+coordsAt+axis*(coordBytes+savedPadding(coordBytes))) : 0;
+    }
+    _idData32 = _wideIds || !_size ? 0 : reinterpret_cast<const uint32_t*>(data+idsAt);
+    _idData64 = _wideIds && _size ? reinterpret_cast<const uint64_t*>(data+idsAt) : 0;
+    return used;
+}
+
+template <int k>
+bool KdTree<k>::idsInRange() const
+{
+    std::atomic<bool> inRange(true);
+    parallelFor(0, _size, ParallelSubtreeSize, [&](int64_t begin, int64_t end) {
+	for (int64_t i = begin; i < end && inRange; i++)
+	    if (id(i) >= uint64_t(_size)) inRange = false;
+    });
+    return inRange;
+}
+
+template <int k> template <class ID>
+void KdTree<k>::sortSubtree(ID* ids, int64_t n, int64_t size, int j, int threads)
+{
+    // leaf buckets are searched exhaustively so their order does not matter
+    if (size <= LeafSize) return;
+
+    int64_t left, right; ComputeSubtreeSizes(size, left, right);
 
     // partition range [n, n+size) along axis j into two subranges:
     //   [n, n+leftSize+1) and [n+leftSize+1, n+size)
-    std::nth_element(&_ids[n], &_ids[n+left], &_ids[n+size],
-		     ComparePointsById(&_points[0].p[j]));
+    if (threads > 1 && size >= ParallelPartitionSize)
+	partitionParallel(ids, n, n+left, n+size, j, threads);
+    else
+	std::nth_element(ids+n, ids+n+left, ids+n+size, ComparePointsById(this, j));
     // move median value (nth element) to front as root node of subtree
-    std::swap(_ids[n], _ids[n+left]);
+    std::swap(ids[n], ids[n+left]);
 
     // sort left and right subtrees using next discriminant
-    if (left <= 1) return;
 #ifdef _MSC_VER  
     #pragma warning (push)  
     #pragma warning (disable : 4127)  // suppress the warning due to the constant k being tested at runtime, an alternative would be to specialize the template class for k = 0
@@ -340,9 +637,94 @@ void KdTree<k>::sortSubtree(int n, int size, int j)
 #ifdef _MSC_VER  
     #pragma warning (pop)  
 #endif  
-    sortSubtree(n+1, left, j);
-    if (right <= 1) return;
-    sortSubtree(n+left+1, right, j);
+    // the subtrees are disjoint ranges of ids, so they can be built concurrently
+    if (threads > 1 && right >= ParallelSubtreeSize) {
+	int rightThreads = threads/2;
+	std::thread rightTask(&KdTree<k>::sortSubtree<ID>, this, ids, n+left+1, right, j, rightThreads);
+	sortSubtree(ids, n+1, left, j, threads-rightThreads);
+	rightTask.join();
+	return;
+    }
+    sortSubtree(ids, n+1, left, j, 1);
+    sortSubtree(ids, n+left+1, right, j, 1);
+}
+
+// Parallel equivalent of nth_element over ids[begin,end) along axis j.
+// Each pass splits the range three ways around a sampled pivot, with the
+// threads counting and then scattering their own slices, and keeps the part
+// that holds nth until it is small enough for std::nth_element.
+template <int k> template <class ID>
+void KdTree<k>::partitionParallel(ID* ids, int64_t begin, int64_t nth, int64_t end, int j, int threads)
+{
+    std::vector<ID> scratch(end-begin);
+    std::vector<int64_t> less(threads), equal(threads);
+
+    while (end-begin >= ParallelPartitionSize) {
+	// median of a strided sample is a good enough pivot
+	const int samples = 63;
+	float sample[samples];
+	int64_t step = (end-begin)/samples;
+	for (int i = 0; i < samples; i++) sample[i] = pointById(ids[begin+i*step])[j];
+	std::nth_element(sample, sample+samples/2, sample+samples);
+	const float pivot = sample[samples/2];
+
+	const int64_t chunkSize = (end-begin+threads-1)/threads;
+	parallelChunks(threads, [&](int chunk) {
+	    int64_t chunkBegin = std::min(end, begin+chunk*chunkSize), chunkEnd = std::min(end, chunkBegin+chunkSize);
+	    int64_t l = 0, e = 0;
+	    for (int64_t i = chunkBegin; i < chunkEnd; i++) {
+		float c = pointById(ids[i])[j];
+		if (c < pivot) l++;
+		else if (c == pivot) e++;
+	    }
+	    less[chunk] = l; equal[chunk] = e;
+	});
+
+	int64_t lessTotal = 0, equalTotal = 0;
+	for (int t = 0; t < threads; t++) { lessTotal += less[t]; equalTotal += equal[t]; }
+	parallelChunks(threads, [&](int chunk) {
+	    int64_t chunkBegin = std::min(end, begin+chunk*chunkSize), chunkEnd = std::min(end, chunkBegin+chunkSize);
+	    // output offsets of this chunk within each of the three parts
+	    int64_t l = 0, e = lessTotal, g = lessTotal+equalTotal;
+	    for (int t = 0; t < chunk; t++) {
+		int64_t before = std::min(end, begin+t*chunkSize), after = std::min(end, before+chunkSize);
+		l += less[t]; e += equal[t]; g += (after-before)-less[t]-equal[t];
+	    }
+	    for (int64_t i = chunkBegin; i < chunkEnd; i++) {
+		ID id = ids[i];
+		float c = pointById(id)[j];
+		if (c < pivot) scratch[l++] = id;
+		else if (c == pivot) scratch[e++] = id;
+		else scratch[g++] = id;
+	    }
+	});
+	parallelFor(begin, end, ParallelSubtreeSize, [&](int64_t b, int64_t e) {
+	    memcpy(ids+b, &scratch[b-begin], sizeof(ID)*(e-b));
+	});
+
+	int64_t lessEnd = begin+lessTotal, equalEnd = lessEnd+equalTotal;
+	if (nth < lessEnd) end = lessEnd;
+	else if (nth < equalEnd) return;
+	else begin = equalEnd;
+    }
+    std::nth_element(ids+begin, ids+nth, ids+end, ComparePointsById(this, j));
+}
+
+// Points coords at LeafSize coordinates per axis starting at node n. Copied
+// coordinates are used in place, referenced points are gathered into buffer
+// with the unused tail zeroed.
+template <int k>
+void KdTree<k>::leafCoords(int64_t n, int64_t size, float buffer[k][LeafSize], const float* coords[k]) const
+{
+    if (!_pointData) {
+	for (int axis = 0; axis < k; axis++) coords[axis] = _coordData[axis]+n;
+	return;
+    }
+    for (int64_t i = 0; i < LeafSize; i++) {
+	const float* p = i < size ? pointById(id(n+i)) : 0;
+	for (int axis = 0; axis < k; axis++) buffer[axis][i] = p ? p[axis] : 0.f;
+    }
+    for (int axis = 0; axis < k; axis++) coords[axis] = buffer[axis];
 }
 
 
@@ -362,37 +744,58 @@ float KdTree<k>::findNPoints(std::vector<uint64_t>& result,
 
 template <int k>
 int KdTree<k>::findNPoints(uint64_t *result, float *distanceSquared, float *finalSearchRadius2,
-                           const float p[k],int nPoints,float maxRadius) const
+                           const float p[k],int nPoints,float maxRadius,
+                           float epsilon,int64_t maxVisited) const
 {
     float radius_squared=maxRadius*maxRadius;
 
     if (!size() || !_sorted || nPoints<1) return 0;
 
-    NearestQuery query(result,distanceSquared,p,nPoints,radius_squared);
+    NearestQuery query(result,distanceSquared,p,nPoints,radius_squared,epsilon,maxVisited);
     findNPoints(query,0,size(),0);
     *finalSearchRadius2=query.maxRadiusSquared;
     return query.foundPoints;
 }
 
 template<int k>
-void KdTree<k>::findNPoints(typename KdTree<k>::NearestQuery& query,int n,int size,int j) const
+void KdTree<k>::findNPoints(typename KdTree<k>::NearestQuery& query,int64_t n,int64_t size,int j) const
 {
-    const float* p=&_points[n].p[0];
+    if(size<=LeafSize){
+        if(query.visitsLeft<=0) return;
+        query.visitsLeft--;
+        // distances to the whole bucket in one vectorizable pass, then the heap
+        float buffer[k][LeafSize];
+        const float* coords[k];
+        leafCoords(n,size,buffer,coords);
+        float pDistanceSquared[LeafSize]={};
+        for(int axis=0;axis<k;axis++){
+            const float* c=coords[axis];
+            const float q=query.pquery[axis];
+            for(int i=0;i<LeafSize;i++){
+                float tmp=c[i]-q;
+                pDistanceSquared[i]+=tmp*tmp;
+            }
+        }
+        for(int i=0;i<size;i++)
+            if(pDistanceSquared[i]<query.maxRadiusSquared) query.insert(n+i,pDistanceSquared[i]);
+        return;
+    }
+
+    float p[k];
+    for(int axis=0;axis<k;axis++) p[axis]=coord(n,axis);
 
-    if(size>1){
-        float axis_distance=query.pquery[j]-p[j];
-        int left,right;ComputeSubtreeSizes(size,left,right);
-        int nextj=(j+1)%k;
+    float axis_distance=query.pquery[j]-p[j];
+    int64_t left,right;ComputeSubtreeSizes(size,left,right);
+    int nextj=(j+1)%k;
 
-        if(axis_distance>0){ // visit right definitely, and left if within distance
-            if(right) findNPoints(query,n+left+1,right,nextj);
-            if(axis_distance*axis_distance<query.maxRadiusSquared)
-                findNPoints(query,n+1,left,nextj);
-        }else{ // visit left definitely, and right if within distance
+    if(axis_distance>0){ // visit right definitely, and left if within distance
+        if(right) findNPoints(query,n+left+1,right,nextj);
+        if(axis_distance*axis_distance*query.pruneScale<query.maxRadiusSquared)
             findNPoints(query,n+1,left,nextj);
-            if(right && axis_distance*axis_distance<query.maxRadiusSquared)
-                findNPoints(query,n+left+1,right,nextj);
-        }
+    }else{ // visit left definitely, and right if within distance
+        findNPoints(query,n+1,left,nextj);
+        if(right && axis_distance*axis_distance*query.pruneScale<query.maxRadiusSquared)
+            findNPoints(query,n+left+1,right,nextj);
     }
 
     // Compute squared distance for this entry
@@ -403,47 +806,371 @@ void KdTree<k>::findNPoints(typename KdTree<k>::NearestQuery& query,int n,int si
         pDistanceSquared+=tmp*tmp;
     }
 
-    if(pDistanceSquared<query.maxRadiusSquared){
-        if(query.foundPoints<query.maxPoints){
-            // TODO: we could do the remapping here, but we do it at the end before returning teh result
-            query.result[query.foundPoints]=n;
-            query.distanceSquared[query.foundPoints] = pDistanceSquared;
-            query.foundPoints++;
-            if(query.foundPoints==query.maxPoints)
-                query.maxRadiusSquared=buildHeap(query.result,query.distanceSquared,query.foundPoints);
-        }else // already have heap, find somebody to throw out
-            query.maxRadiusSquared=insertToHeap(query.result,query.distanceSquared,query.foundPoints,n,pDistanceSquared);
+    if(pDistanceSquared<query.maxRadiusSquared) query.insert(n,pDistanceSquared);
+}
+
+template <int k>
+void KdTree<k>::findNPointsBatch(const float* queries, int64_t nQueries, int nPoints, float maxRadius,
+                                 uint64_t* result, float* distanceSquared, int* counts, bool sortQueries) const
+{
+    std::vector<uint64_t> order;
+    if (sortQueries && nQueries >= MortonSortSize) mortonOrder(queries, nQueries, order);
+
+    parallelForDynamic(0, nQueries, BatchGrain, [&](int64_t begin, int64_t end) {
+	float finalRadius2;
+	for (int64_t i = begin; i < end; i++) {
+	    int64_t q = order.empty() ? i : static_cast<int64_t>(order[i]);
+	    uint64_t* ids = result+q*nPoints;
+	    int found = findNPoints(ids, distanceSquared+q*nPoints, &finalRadius2, queries+q*k, nPoints, maxRadius);
+	    for (int f = 0; f < found; f++) ids[f] = id(ids[f]);
+	    counts[q] = found;
+	}
+    });
+}
+
+// Orders queries along a Z-order curve over the tree's bounding box
+template <int k>
+void KdTree<k>::mortonOrder(const float* queries, int64_t nQueries, std::vector<uint64_t>& order) const
+{
+    const int bits = 63/k;
+    const float cells = float((uint64_t(1)<<bits)-1);
+    float scale[k];
+    for (int axis = 0; axis < k; axis++) {
+	float extent = _bbox.max[axis]-_bbox.min[axis];
+	scale[axis] = extent > 0 ? cells/extent : 0.f;
     }
+
+    std::vector<std::pair<uint64_t,uint64_t> > codes(nQueries);
+    parallelFor(0, nQueries, BatchGrain, [&](int64_t begin, int64_t end) {
+	for (int64_t q = begin; q < end; q++) {
+	    uint64_t cell[k];
+	    for (int axis = 0; axis < k; axis++) {
+		float c = (queries[q*k+axis]-_bbox.min[axis])*scale[axis];
+		cell[axis] = c <= 0 ? 0 : c >= cells ? uint64_t(cells) : uint64_t(c);
+	    }
+	    uint64_t code = 0;
+	    for (int bit = bits-1; bit >= 0; bit--)
+		for (int axis = 0; axis < k; axis++)
+		    code = (code<<1) | ((cell[axis]>>bit)&1);
+	    codes[q] = std::make_pair(code, uint64_t(q));
+	}
+    });
+    std::sort(codes.begin(), codes.end());
+    order.resize(nQueries);
+    for (int64_t q = 0; q < nQueries; q++) order[q] = codes[q].second;
 }
 
 template <int k>
 void KdTree<k>::findPoints(std::vector<uint64_t>& result, const BBox<k>& bbox) const
 {
-    if (!size() || !_sorted) return;
-    if (!bbox.intersects(_bbox)) return;
-    findPoints(result, bbox, 0, size(), 0);
+    forEachInBox(bbox, [&](uint64_t i) { result.push_back(i); return true; });
 }
 
-template <int k>
-void KdTree<k>::findPoints(std::vector<uint64_t>& result, const BBox<k>& bbox,
-			   int n, int size, int j) const
+template <int k> template <class Visitor>
+bool KdTree<k>::forEachInBox(const BBox<k>& bbox, const Visitor& visit) const
 {
-    // check point at n for inclusion
-    const float* p = &_points[n].p[0];
-    if (bbox.inside(p))
-	result.push_back(n);
+    if (!size() || !_sorted) return true;
+    if (!bbox.intersects(_bbox)) return true;
+    return forEachInBox(bbox, visit, 0, size(), 0);
+}
 
-    if (size == 1) return;
+template <int k> template <class Visitor>
+bool KdTree<k>::forEachInBox(const BBox<k>& bbox, const Visitor& visit,
+			     int64_t n, int64_t size, int j) const
+{
+    if (size <= LeafSize) {
+	// box test for the whole bucket in one vectorizable pass
+	float buffer[k][LeafSize];
+	const float* coords[k];
+	leafCoords(n, size, buffer, coords);
+	int inside[LeafSize];
+	for (int i = 0; i < LeafSize; i++) inside[i] = 1;
+	for (int axis = 0; axis < k; axis++) {
+	    const float* c = coords[axis];
+	    const float lo = bbox.min[axis], hi = bbox.max[axis];
+	    for (int i = 0; i < LeafSize; i++)
+		inside[i] &= (c[i] >= lo) & (c[i] <= hi);
+	}
+	for (int i = 0; i < size; i++)
+	    if (inside[i] && !visit(uint64_t(n+i))) return false;
+	return true;
+    }
+
+    // check point at n for inclusion
+    float p[k];
+    for (int axis = 0; axis < k; axis++) p[axis] = coord(n, axis);
+    if (bbox.inside(p) && !visit(uint64_t(n))) return false;
 
     // visit left subtree
-    int left, right; ComputeSubtreeSizes(size, left, right);
+    int64_t left, right; ComputeSubtreeSizes(size, left, right);
     int nextj = (k > 1)? (j+1)%k : j;
-    if (p[j] >= bbox.min[j])
-	findPoints(result, bbox, n+1, left, nextj);
+    if (p[j] >= bbox.min[j] && !forEachInBox(bbox, visit, n+1, left, nextj)) return false;
 
     // visit right subtree
-    if (right && p[j] <= bbox.max[j])
-	findPoints(result, bbox, n+left+1, right, nextj);
+    if (right && p[j] <= bbox.max[j]) return forEachInBox(bbox, visit, n+left+1, right, nextj);
+    return true;
+}
+
+template <int k> template <class Region>
+void KdTree<k>::findPointsInRegion(std::vector<uint64_t>& result, const Region& region) const
+{
+    forEachRangeInRegion(region, [&](int64_t begin, int64_t end) {
+	for (int64_t i = begin; i < end; i++) result.push_back(i);
+	return true;
+    });
+}
+
+template <int k> template <class Region, class Visitor>
+bool KdTree<k>::forEachRangeInRegion(const Region& region, const Visitor& visit) const
+{
+    if (!size() || !_sorted) return true;
+    BBox<k> cell = _bbox;
+    return forEachRangeInRegion(region, visit, cell, 0, size(), 0);
+}
+
+// cell bounds the subtree's points and is narrowed at each split, so whole
+// subtrees are skipped or taken without testing their points
+template <int k> template <class Region, class Visitor>
+bool KdTree<k>::forEachRangeInRegion(const Region& region, const Visitor& visit,
+				     BBox<k>& cell, int64_t n, int64_t size, int j) const
+{
+    int relation = region.classify(cell.min, cell.max);
+    if (relation < 0) return true;
+    if (relation > 0) return visit(n, n+size);
+
+    if (size <= LeafSize) {
+	float buffer[k][LeafSize];
+	const float* coords[k];
+	leafCoords(n, size, buffer, coords);
+	unsigned char inside[LeafSize];
+	region.contains(coords, int(size), inside);
+	for (int i = 0; i < size; i++)
+	    if (inside[i] && !visit(n+i, n+i+1)) return false;
+	return true;
+    }
+
+    float p[k];
+    const float* coords[k];
+    for (int axis = 0; axis < k; axis++) {
+	p[axis] = coord(n, axis);
+	coords[axis] = &p[axis];
+    }
+    unsigned char inside;
+    region.contains(coords, 1, &inside);
+    if (inside && !visit(n, n+1)) return false;
+
+    int64_t left, right; ComputeSubtreeSizes(size, left, right);
+    int nextj = (k > 1)? (j+1)%k : j;
+    const float split = p[j];
+    float saved = cell.max[j];
+    cell.max[j] = std::min(saved, split);
+    bool finished = forEachRangeInRegion(region, visit, cell, n+1, left, nextj);
+    cell.max[j] = saved;
+    if (finished && right) {
+	saved = cell.min[j];
+	cell.min[j] = std::max(saved, split);
+	finished = forEachRangeInRegion(region, visit, cell, n+left+1, right, nextj);
+	cell.min[j] = saved;
+    }
+    return finished;
+}
+
+template <int k>
+void KdTree<k>::subtreeMaxima(const float* values, float* maxima) const
+{
+    if (size()) subtreeMaxima(values, maxima, 0, size());
+}
+
+template <int k>
+float KdTree<k>::subtreeMaxima(const float* values, float* maxima, int64_t n, int64_t size) const
+{
+    float maximum = values[n];
+    if (size <= LeafSize) {
+	for (int64_t i = n+1; i < n+size; i++) maximum = std::max(maximum, values[i]);
+    } else {
+	int64_t left, right; ComputeSubtreeSizes(size, left, right);
+	maximum = std::max(maximum, subtreeMaxima(values, maxima, n+1, left));
+	if (right) maximum = std::max(maximum, subtreeMaxima(values, maxima, n+left+1, right));
+    }
+    maxima[n] = maximum;
+    return maximum;
+}
+
+template <int k> template <class Shape, class Visitor>
+bool KdTree<k>::forEachOverlapping(const Shape& shape, const float* radii, const float* maxRadii,
+				   const Visitor& visit) const
+{
+    if (!size() || !_sorted) return true;
+    BBox<k> cell = _bbox;
+    return forEachOverlapping(shape, radii, maxRadii, visit, cell, 0, size(), 0);
+}
+
+// cell bounds the subtree's centers, so none of its spheres reach the shape
+// when the cell is farther away than the largest of their radii
+template <int k> template <class Shape, class Visitor>
+bool KdTree<k>::forEachOverlapping(const Shape& shape, const float* radii, const float* maxRadii,
+				   const Visitor& visit, BBox<k>& cell, int64_t n, int64_t size, int j) const
+{
+    if (shape.distance(cell.min, cell.max) > maxRadii[n]) return true;
+
+    float p[k];
+    if (size <= LeafSize) {
+	for (int64_t i = n; i < n+size; i++) {
+	    for (int axis = 0; axis < k; axis++) p[axis] = coord(i, axis);
+	    if (shape.distance(p, p) <= radii[i] && !visit(uint64_t(i))) return false;
+	}
+	return true;
+    }
+
+    for (int axis = 0; axis < k; axis++) p[axis] = coord(n, axis);
+    if (shape.distance(p, p) <= radii[n] && !visit(uint64_t(n))) return false;
+
+    int64_t left, right; ComputeSubtreeSizes(size, left, right);
+    int nextj = (k > 1)? (j+1)%k : j;
+    const float split = p[j];
+    float saved = cell.max[j];
+    cell.max[j] = std::min(saved, split);
+    bool finished = forEachOverlapping(shape, radii, maxRadii, visit, cell, n+1, left, nextj);
+    cell.max[j] = saved;
+    if (finished && right) {
+	saved = cell.min[j];
+	cell.min[j] = std::max(saved, split);
+	finished = forEachOverlapping(shape, radii, maxRadii, visit, cell, n+left+1, right, nextj);
+	cell.min[j] = saved;
+    }
+    return finished;
+}
+
+template <int k>
+void KdTree<k>::findPointsInRadius(std::vector<uint64_t>& result, std::vector<float>& distanceSquared,
+                                   const float p[k], float radius, bool sorted) const
+{
+    size_t start = result.size();
+    forEachInRadius(p, radius, [&](uint64_t i, float d) {
+	result.push_back(i);
+	distanceSquared.push_back(d);
+	return true;
+    });
+    if (sorted && result.size() > start)
+	sortByDistance(&result[start], &distanceSquared[start], result.size()-start);
+}
+
+template <int k> template <class Visitor>
+bool KdTree<k>::forEachInRadius(const float p[k], float radius, const Visitor& visit) const
+{
+    if (!size() || !_sorted || radius < 0) return true;
+    float offset[k];
+    for (int axis = 0; axis < k; axis++) offset[axis] = 0;
+    return forEachInRadius(p, radius*radius, visit, offset, 0, 0, size(), 0);
+}
+
+// offset holds the per axis distance from p to the cell of the subtree at n
+// and cellDistanceSquared its squared length, so whole cells farther than
+// the radius are skipped rather than just half spaces.
+template <int k> template <class Visitor>
+bool KdTree<k>::forEachInRadius(const float p[k], float radiusSquared, const Visitor& visit,
+				float offset[k], float cellDistanceSquared,
+				int64_t n, int64_t size, int j) const
+{
+    if (size <= LeafSize) {
+	float buffer[k][LeafSize];
+	const float* coords[k];
+	leafCoords(n, size, buffer, coords);
+	float pDistanceSquared[LeafSize] = {};
+	for (int axis = 0; axis < k; axis++) {
+	    const float* c = coords[axis];
+	    const float q = p[axis];
+	    for (int i = 0; i < LeafSize; i++) {
+		float tmp = c[i]-q;
+		pDistanceSquared[i] += tmp*tmp;
+	    }
+	}
+	for (int i = 0; i < size; i++)
+	    if (pDistanceSquared[i] <= radiusSquared && !visit(uint64_t(n+i), pDistanceSquared[i])) return false;
+	return true;
+    }
+
+    float point[k];
+    float pDistanceSquared = 0;
+    for (int axis = 0; axis < k; axis++) {
+	point[axis] = coord(n, axis);
+	float tmp = point[axis]-p[axis];
+	pDistanceSquared += tmp*tmp;
+    }
+    if (pDistanceSquared <= radiusSquared && !visit(uint64_t(n), pDistanceSquared)) return false;
+
+    int64_t left, right; ComputeSubtreeSizes(size, left, right);
+    int nextj = (k > 1)? (j+1)%k : j;
+    float axisDistance = p[j]-point[j];
+    int64_t nearN = axisDistance > 0 ? n+left+1 : n+1, nearSize = axisDistance > 0 ? right : left;
+    int64_t farN = axisDistance > 0 ? n+1 : n+left+1, farSize = axisDistance > 0 ? left : right;
+
+    // the near child shares this cell's distance
+    if (nearSize && !forEachInRadius(p, radiusSquared, visit, offset, cellDistanceSquared, nearN, nearSize, nextj))
+	return false;
+    if (!farSize) return true;
+
+    // the far child's cell is at least axisDistance away along j
+    float oldOffset = offset[j];
+    float farCellDistanceSquared = cellDistanceSquared - oldOffset*oldOffset + axisDistance*axisDistance;
+    if (farCellDistanceSquared > radiusSquared) return true;
+    offset[j] = axisDistance;
+    bool finished = forEachInRadius(p, radiusSquared, visit, offset, farCellDistanceSquared, farN, farSize, nextj);
+    offset[j] = oldOffset;
+    return finished;
+}
+
+template <int k>
+void KdTree<k>::sortByDistance(uint64_t* result, float* distanceSquared, size_t count)
+{
+    std::vector<std::pair<float,uint64_t> > pairs(count);
+    for (size_t i = 0; i < count; i++) pairs[i] = std::make_pair(distanceSquared[i], result[i]);
+    std::sort(pairs.begin(), pairs.end());
+    for (size_t i = 0; i < count; i++) {
+	distanceSquared[i] = pairs[i].first;
+	result[i] = pairs[i].second;
+    }
+}
+
+template <int k>
+void KdTree<k>::findPointsInRadiusBatch(const float* queries, int64_t nQueries, float radius,
+                                        std::vector<int64_t>& offsets, std::vector<uint64_t>& result,
+                                        std::vector<float>& distanceSquared, bool sorted) const
+{
+    // each block of queries collects its rows separately, then they are concatenated
+    struct Block {
+	std::vector<int64_t> counts;
+	std::vector<uint64_t> result;
+	std::vector<float> distanceSquared;
+    };
+    std::vector<Block> blocks((nQueries+BatchGrain-1)/BatchGrain);
+    parallelForDynamic(0, nQueries, BatchGrain, [&](int64_t begin, int64_t end) {
+	Block& block = blocks[begin/BatchGrain];
+	block.counts.resize(end-begin);
+	for (int64_t q = begin; q < end; q++) {
+	    size_t start = block.result.size();
+	    findPointsInRadius(block.result, block.distanceSquared, queries+q*k, radius, sorted);
+	    for (size_t i = start; i < block.result.size(); i++) block.result[i] = id(block.result[i]);
+	    block.counts[q-begin] = static_cast<int64_t>(block.result.size()-start);
+	}
+    });
+
+    offsets.resize(nQueries+1);
+    offsets[0] = 0;
+    std::vector<int64_t> blockStart(blocks.size());
+    for (size_t b = 0, q = 0; b < blocks.size(); b++) {
+	blockStart[b] = offsets[q];
+	for (size_t i = 0; i < blocks[b].counts.size(); i++, q++) offsets[q+1] = offsets[q]+blocks[b].counts[i];
+    }
+    result.resize(offsets[nQueries]);
+    distanceSquared.resize(offsets[nQueries]);
+    parallelFor(0, static_cast<int64_t>(blocks.size()), 1, [&](int64_t begin, int64_t end) {
+	for (int64_t b = begin; b < end; b++) {
+	    if (blocks[b].result.empty()) continue;
+	    memcpy(&result[blockStart[b]], &blocks[b].result[0], sizeof(uint64_t)*blocks[b].result.size());
+	    memcpy(&distanceSquared[blockStart[b]], &blocks[b].distanceSquared[0], sizeof(float)*blocks[b].distanceSquared.size());
+	}
+    });
 }
 
 }
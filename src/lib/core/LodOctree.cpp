@@ -0,0 +1,371 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+#ifdef PARTIO_WIN32
+#    define NOMINMAX
+#endif
+#include "../Partio.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <float.h>
+#include <iostream>
+#include <queue>
+#include <utility>
+#include <vector>
+
+namespace Partio{
+
+namespace{
+
+// particles and nodes are handed to threads in pieces of this size
+const int64_t Grain=4096;
+// octree levels, as many as 64 bit Morton codes hold for 3 axes
+const int MortonBits=21;
+// most distinct INDEXEDSTR values counted per node
+const size_t MaxTokenCounts=16;
+
+typedef std::vector<std::pair<int,int64_t> > TokenCounts;
+
+// keeps the MaxTokenCounts most common values, sorted by value for merging
+void truncateCounts(TokenCounts& counts)
+{
+    if(counts.size()<=MaxTokenCounts) return;
+    std::nth_element(counts.begin(),counts.begin()+MaxTokenCounts,counts.end(),
+        [](const std::pair<int,int64_t>& a,const std::pair<int,int64_t>& b){
+            return a.second>b.second || (a.second==b.second && a.first<b.first);});
+    counts.resize(MaxTokenCounts);
+    std::sort(counts.begin(),counts.end());
+}
+
+int dominantToken(const TokenCounts& counts)
+{
+    int token=-1;
+    int64_t best=0;
+    for(size_t i=0;i<counts.size();i++)
+        if(counts[i].second>best){
+            best=counts[i].second;
+            token=counts[i].first;
+        }
+    return token;
+}
+
+}
+
+bool
+buildLodOctree(const ParticlesData& particles,const std::vector<ParticleAttribute>& attributes,
+    LodOctree& octree,const ParticleAttribute* radius,const int leafSize)
+{
+    octree=LodOctree();
+    ParticleAttribute posAttr;
+    if(!particles.attributeInfo("position",posAttr) || (posAttr.type!=VECTOR && posAttr.type!=FLOAT) || posAttr.count!=3){
+        std::cerr<<"Partio: buildLodOctree needs a 3 component float position attribute"<<std::endl;
+        return false;
+    }
+    if(radius && (radius->type!=FLOAT || radius->count!=1)){
+        std::cerr<<"Partio: buildLodOctree radius "<<radius->name<<" is not a single float"<<std::endl;
+        return false;
+    }
+    std::vector<ParticleAttribute> floatAttrs,tokenAttrs;
+    for(size_t a=0;a<attributes.size();a++){
+        if(attributes[a].type==FLOAT || attributes[a].type==VECTOR){
+            floatAttrs.push_back(attributes[a]);
+            octree.numValues+=attributes[a].count;
+        }else if(attributes[a].type==INDEXEDSTR && attributes[a].count==1) tokenAttrs.push_back(attributes[a]);
+        else{
+            std::cerr<<"Partio: buildLodOctree cannot aggregate attribute "<<attributes[a].name<<std::endl;
+            return false;
+        }
+    }
+    octree.numTokens=int(tokenAttrs.size());
+    const int64_t n=particles.numParticles();
+    if(n==0) return true;
+
+    // bounding cube of the positions, so that cells are cubes too
+    const int chunks=static_cast<int>(std::max<int64_t>(1,std::min<int64_t>(numThreads(),n/Grain)));
+    std::vector<float> chunkBounds(6*chunks);
+    parallelChunks(chunks,[&](int chunk){
+        float* bounds=&chunkBounds[6*chunk];
+        for(int axis=0;axis<3;axis++){bounds[axis]=FLT_MAX;bounds[3+axis]=-FLT_MAX;}
+        for(int64_t i=n*chunk/chunks;i<n*(chunk+1)/chunks;i++){
+            const float* p=particles.data<float>(posAttr,i);
+            for(int axis=0;axis<3;axis++){
+                bounds[axis]=std::min(bounds[axis],p[axis]);
+                bounds[3+axis]=std::max(bounds[3+axis],p[axis]);
+            }
+        }
+    });
+    float bboxMin[3],extent=0;
+    for(int axis=0;axis<3;axis++){
+        float lo=FLT_MAX,hi=-FLT_MAX;
+        for(int chunk=0;chunk<chunks;chunk++){
+            lo=std::min(lo,chunkBounds[6*chunk+axis]);
+            hi=std::max(hi,chunkBounds[6*chunk+3+axis]);
+        }
+        bboxMin[axis]=lo;
+        extent=std::max(extent,hi-lo);
+    }
+
+    // sorting by Morton code makes the particles of every octree cell contiguous
+    const float cells=float((uint64_t(1)<<MortonBits)-1);
+    const float scale=extent>0 ? cells/extent : 0.f;
+    std::vector<std::pair<uint64_t,ParticleIndex> > codes(n);
+    parallelFor(0,n,Grain,[&](int64_t begin,int64_t end){
+        for(int64_t i=begin;i<end;i++){
+            const float* p=particles.data<float>(posAttr,i);
+            uint64_t cell[3];
+            for(int axis=0;axis<3;axis++){
+                float c=(p[axis]-bboxMin[axis])*scale;
+                cell[axis]=c<=0 ? 0 : c>=cells ? uint64_t(cells) : uint64_t(c);
+            }
+            uint64_t code=0;
+            for(int bit=MortonBits-1;bit>=0;bit--)
+                for(int axis=0;axis<3;axis++) code=(code<<1)|((cell[axis]>>bit)&1);
+            codes[i]=std::make_pair(code,ParticleIndex(i));
+        }
+    });
+    parallelSort(&codes[0],&codes[0]+n);
+    octree.points.resize(n);
+    parallelFor(0,n,Grain,[&](int64_t begin,int64_t end){
+        for(int64_t i=begin;i<end;i++) octree.points[i]=codes[i].second;
+    });
+
+    // nodes are made a level at a time, each splitting its range by the next 3 bits of the codes
+    std::vector<int64_t> levelStarts(1,0);
+    octree.pointBegins.push_back(0);
+    octree.pointEnds.push_back(n);
+    for(int level=0;;level++){
+        const int64_t begin=levelStarts[level],end=int64_t(octree.pointBegins.size());
+        if(begin==end) break;
+        levelStarts.push_back(end);
+        std::vector<int64_t> splits(9*(end-begin));
+        std::vector<unsigned char> counts(end-begin,0);
+        parallelFor(begin,end,Grain,[&](int64_t nodeBegin,int64_t nodeEnd){
+            for(int64_t node=nodeBegin;node<nodeEnd;node++){
+                const int64_t first=octree.pointBegins[node],last=octree.pointEnds[node];
+                if(last-first<=leafSize || level==MortonBits) continue;
+                const int shift=3*(MortonBits-1-level);
+                int64_t* split=&splits[9*(node-begin)];
+                for(int digit=0;digit<8;digit++)
+                    split[digit]=std::lower_bound(codes.begin()+first,codes.begin()+last,digit,
+                        [shift](const std::pair<uint64_t,ParticleIndex>& c,int d){return int((c.first>>shift)&7)<d;})
+                        -codes.begin();
+                split[8]=last;
+                for(int digit=0;digit<8;digit++) counts[node-begin]+=split[digit]<split[digit+1];
+            }
+        });
+        octree.firstChild.resize(end);
+        octree.childCounts.resize(end);
+        int64_t next=end;
+        for(int64_t node=begin;node<end;node++){
+            octree.firstChild[node]=next;
+            octree.childCounts[node]=counts[node-begin];
+            next+=counts[node-begin];
+        }
+        octree.pointBegins.resize(next);
+        octree.pointEnds.resize(next);
+        parallelFor(begin,end,Grain,[&](int64_t nodeBegin,int64_t nodeEnd){
+            for(int64_t node=nodeBegin;node<nodeEnd;node++){
+                if(!octree.childCounts[node]) continue;
+                const int64_t* split=&splits[9*(node-begin)];
+                int64_t child=octree.firstChild[node];
+                for(int digit=0;digit<8;digit++){
+                    if(split[digit]==split[digit+1]) continue;
+                    octree.pointBegins[child]=split[digit];
+                    octree.pointEnds[child]=split[digit+1];
+                    child++;
+                }
+            }
+        });
+    }
+    std::vector<std::pair<uint64_t,ParticleIndex> >().swap(codes);
+
+    // aggregate from the deepest level up, leaves from their particles and
+    // other nodes from their children
+    const int64_t numNodes=int64_t(octree.pointBegins.size());
+    const int numValues=octree.numValues,numTokens=octree.numTokens;
+    octree.centers.resize(3*numNodes);
+    octree.radii.resize(numNodes);
+    octree.values.resize(numValues*numNodes);
+    octree.tokens.resize(numTokens*numNodes);
+    std::vector<double> weights(numNodes);
+    std::vector<TokenCounts> tokenCounts(numTokens*numNodes);
+    for(int level=int(levelStarts.size())-2;level>=0;level--){
+        parallelFor(levelStarts[level],levelStarts[level+1],Grain/64,[&](int64_t nodeBegin,int64_t nodeEnd){
+            std::vector<double> sums(3+numValues),plainSums(numValues);
+            for(int64_t node=nodeBegin;node<nodeEnd;node++){
+                std::fill(sums.begin(),sums.end(),0.);
+                std::fill(plainSums.begin(),plainSums.end(),0.);
+                double weight=0;
+                float* center=&octree.centers[3*node];
+                float* value=numValues ? &octree.values[numValues*node] : 0;
+                float& nodeRadius=octree.radii[node];
+                nodeRadius=0;
+                const int64_t first=octree.firstChild[node],children=octree.childCounts[node];
+                if(children){
+                    for(int64_t c=first;c<first+children;c++){
+                        const double count=double(octree.count(c));
+                        for(int axis=0;axis<3;axis++) sums[axis]+=count*octree.centers[3*c+axis];
+                        for(int v=0;v<numValues;v++){
+                            sums[3+v]+=weights[c]*octree.values[numValues*c+v];
+                            plainSums[v]+=count*octree.values[numValues*c+v];
+                        }
+                        weight+=weights[c];
+                    }
+                }else{
+                    for(int64_t i=octree.pointBegins[node];i<octree.pointEnds[node];i++){
+                        const ParticleIndex index=octree.points[i];
+                        const float* p=particles.data<float>(posAttr,index);
+                        for(int axis=0;axis<3;axis++) sums[axis]+=p[axis];
+                        const float r=radius ? particles.data<float>(*radius,index)[0] : 1.f;
+                        int v=0;
+                        for(size_t a=0;a<floatAttrs.size();a++){
+                            const float* data=particles.data<float>(floatAttrs[a],index);
+                            for(int c=0;c<floatAttrs[a].count;c++,v++){
+                                sums[3+v]+=double(r)*r*data[c];
+                                plainSums[v]+=data[c];
+                            }
+                        }
+                        weight+=double(r)*r;
+                    }
+                }
+                // particles without size leave only the unweighted means to use
+                const double count=double(octree.count(node));
+                for(int axis=0;axis<3;axis++) center[axis]=float(sums[axis]/count);
+                for(int v=0;v<numValues;v++) value[v]=float(weight>0 ? sums[3+v]/weight : plainSums[v]/count);
+                weights[node]=weight;
+
+                if(children){
+                    for(int64_t c=first;c<first+children;c++){
+                        float d=0;
+                        for(int axis=0;axis<3;axis++) d+=(octree.centers[3*c+axis]-center[axis])*(octree.centers[3*c+axis]-center[axis]);
+                        nodeRadius=std::max(nodeRadius,std::sqrt(d)+octree.radii[c]);
+                    }
+                }else{
+                    for(int64_t i=octree.pointBegins[node];i<octree.pointEnds[node];i++){
+                        const ParticleIndex index=octree.points[i];
+                        const float* p=particles.data<float>(posAttr,index);
+                        float d=0;
+                        for(int axis=0;axis<3;axis++) d+=(p[axis]-center[axis])*(p[axis]-center[axis]);
+                        nodeRadius=std::max(nodeRadius,std::sqrt(d)+(radius ? particles.data<float>(*radius,index)[0] : 0.f));
+                    }
+                }
+
+                for(int t=0;t<numTokens;t++){
+                    TokenCounts& counts=tokenCounts[numTokens*node+t];
+                    if(children){
+                        for(int64_t c=first;c<first+children;c++){
+                            TokenCounts& childCounts=tokenCounts[numTokens*c+t];
+                            TokenCounts merged;
+                            merged.reserve(counts.size()+childCounts.size());
+                            size_t i=0,j=0;
+                            while(i<counts.size() || j<childCounts.size()){
+                                if(j==childCounts.size() || (i<counts.size() && counts[i].first<childCounts[j].first))
+                                    merged.push_back(counts[i++]);
+                                else if(i==counts.size() || childCounts[j].first<counts[i].first)
+                                    merged.push_back(childCounts[j++]);
+                                else{
+                                    merged.push_back(std::make_pair(counts[i].first,counts[i].second+childCounts[j].second));
+                                    i++;j++;
+                                }
+                            }
+                            counts.swap(merged);
+                            TokenCounts().swap(childCounts);
+                        }
+                    }else{
+                        std::vector<int> leafTokens;
+                        for(int64_t i=octree.pointBegins[node];i<octree.pointEnds[node];i++)
+                            leafTokens.push_back(particles.data<int>(tokenAttrs[t],octree.points[i])[0]);
+                        std::sort(leafTokens.begin(),leafTokens.end());
+                        for(size_t i=0;i<leafTokens.size();i++){
+                            if(counts.empty() || counts.back().first!=leafTokens[i]) counts.push_back(std::make_pair(leafTokens[i],0));
+                            counts.back().second++;
+                        }
+                    }
+                    truncateCounts(counts);
+                    octree.tokens[numTokens*node+t]=dominantToken(counts);
+                }
+            }
+        });
+    }
+    return true;
+}
+
+void LodOctree::
+selectByError(const float eye[3],const float pixelsPerUnit,const float maxError,
+    std::vector<int64_t>& nodes,std::vector<ParticleIndex>& particles) const
+{
+    nodes.clear();
+    particles.clear();
+    if(radii.empty()) return;
+    std::vector<int64_t> stack(1,0);
+    while(!stack.empty()){
+        const int64_t node=stack.back();
+        stack.pop_back();
+        float d=0;
+        for(int axis=0;axis<3;axis++) d+=(centers[3*node+axis]-eye[axis])*(centers[3*node+axis]-eye[axis]);
+        // the nearest the node's particles can be to the eye
+        const float distance=std::sqrt(d)-radii[node];
+        if(distance>0 && radii[node]*pixelsPerUnit<=maxError*distance) nodes.push_back(node);
+        else if(childCounts[node])
+            for(int64_t c=firstChild[node]+childCounts[node]-1;c>=firstChild[node];c--) stack.push_back(c);
+        else particles.insert(particles.end(),points.begin()+pointBegins[node],points.begin()+pointEnds[node]);
+    }
+}
+
+void LodOctree::
+selectByBudget(const int64_t maxPoints,std::vector<int64_t>& nodes,std::vector<ParticleIndex>& particles) const
+{
+    nodes.clear();
+    particles.clear();
+    if(radii.empty() || maxPoints<1) return;
+    // refines the largest node until the next one would not fit, so all nodes kept are of similar size
+    std::priority_queue<std::pair<float,int64_t> > queue;
+    queue.push(std::make_pair(radii[0],int64_t(0)));
+    int64_t total=1;
+    while(!queue.empty()){
+        const int64_t node=queue.top().second;
+        const int64_t extra=(childCounts[node] ? int64_t(childCounts[node]) : count(node))-1;
+        if(queue.top().first<=0 || total+extra>maxPoints) break;
+        queue.pop();
+        total+=extra;
+        if(childCounts[node])
+            for(int64_t c=firstChild[node];c<firstChild[node]+childCounts[node];c++) queue.push(std::make_pair(radii[c],c));
+        else particles.insert(particles.end(),points.begin()+pointBegins[node],points.begin()+pointEnds[node]);
+    }
+    for(;!queue.empty();queue.pop()) nodes.push_back(queue.top().second);
+    std::sort(nodes.begin(),nodes.end());
+}
+
+}
@@ -0,0 +1,357 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+#ifdef PARTIO_WIN32
+#    define NOMINMAX
+#endif
+#include "../Partio.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <float.h>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+namespace Partio{
+
+namespace{
+
+// rows are handed to threads in pieces of this size
+const int64_t RowGrain=1024;
+
+bool gatherPositions(const ParticlesData& particles,std::vector<float>& positions,const char* caller)
+{
+    ParticleAttribute posAttr;
+    if(!particles.attributeInfo("position",posAttr) || (posAttr.type!=VECTOR && posAttr.type!=FLOAT) || posAttr.count!=3){
+        std::cerr<<"Partio: "<<caller<<" needs a 3 component float position attribute"<<std::endl;
+        return false;
+    }
+    const int64_t n=particles.numParticles();
+    positions.resize(3*n);
+    parallelFor(0,n,RowGrain,[&](int64_t begin,int64_t end){
+        for(int64_t i=begin;i<end;i++){
+            const float* p=particles.data<float>(posAttr,i);
+            std::copy(p,p+3,&positions[3*i]);
+        }
+    });
+    return true;
+}
+
+// fills offsets from per row counts (stored in offsets[1..n]) and sizes the neighbor arrays
+void finishOffsets(NeighborGraph& graph)
+{
+    graph.offsets[0]=0;
+    for(size_t i=1;i<graph.offsets.size();i++) graph.offsets[i]+=graph.offsets[i-1];
+    graph.indices.resize(graph.offsets.back());
+    graph.distancesSquared.resize(graph.offsets.back());
+}
+
+// finds the numNeighbors nearest points of target around each position and packs them as rows of graph,
+// leaving out a point whose index matches its row when skipSelf is set
+void nearestRows(const ParticlesData& target,std::vector<float>& positions,const int numNeighbors,
+    const float maxRadius,const bool skipSelf,const bool sortQueries,NeighborGraph& graph)
+{
+    const int64_t n=positions.size()/3;
+    graph.offsets.assign(n+1,0);
+    if(numNeighbors<=0 || n==0) return;
+
+    // ask for one more point so the particle itself can be dropped from its row
+    const int queryCount=skipSelf ? numNeighbors+1 : numNeighbors;
+    std::vector<ParticleIndex> found(n*queryCount);
+    std::vector<float> foundDistSq(n*queryCount);
+    std::vector<int> foundCounts(n,0);
+    target.findNPointsBatch(&positions[0],n,queryCount,maxRadius,&found[0],&foundDistSq[0],&foundCounts[0],sortQueries);
+    std::vector<float>().swap(positions);
+
+    // order each row by distance (ties by index) and trim it to numNeighbors
+    parallelFor(0,n,RowGrain,[&](int64_t begin,int64_t end){
+        std::vector<std::pair<float,ParticleIndex> > row;
+        for(int64_t i=begin;i<end;i++){
+            ParticleIndex* indices=&found[i*queryCount];
+            float* distSq=&foundDistSq[i*queryCount];
+            row.clear();
+            for(int j=0;j<foundCounts[i];j++)
+                if(!skipSelf || indices[j]!=ParticleIndex(i)) row.push_back(std::make_pair(distSq[j],indices[j]));
+            std::sort(row.begin(),row.end());
+            const int count=std::min(static_cast<int>(row.size()),numNeighbors);
+            for(int j=0;j<count;j++){
+                distSq[j]=row[j].first;
+                indices[j]=row[j].second;
+            }
+            graph.offsets[i+1]=count;
+        }
+    });
+
+    finishOffsets(graph);
+    parallelFor(0,n,RowGrain,[&](int64_t begin,int64_t end){
+        for(int64_t i=begin;i<end;i++){
+            const int64_t count=graph.offsets[i+1]-graph.offsets[i];
+            std::copy(&found[i*queryCount],&found[i*queryCount]+count,graph.indices.begin()+graph.offsets[i]);
+            std::copy(&foundDistSq[i*queryCount],&foundDistSq[i*queryCount]+count,graph.distancesSquared.begin()+graph.offsets[i]);
+        }
+    });
+}
+
+
+// bits of each cell coordinate in a cell key, z lowest
+const int CellBits=21;
+const int64_t MaxCells=(int64_t(1)<<CellBits)-1;
+
+uint64_t cellKey(const int64_t x,const int64_t y,const int64_t z)
+{return (uint64_t(x)<<(2*CellBits))|(uint64_t(y)<<CellBits)|uint64_t(z);}
+
+struct CellEntry
+{
+    uint64_t key;
+    ParticleIndex index;
+
+    bool operator<(const CellEntry& other) const
+    {return key<other.key || (key==other.key && index<other.index);}
+};
+
+struct Pair
+{
+    ParticleIndex a,b;
+    float distanceSquared;
+};
+
+// rows of all points within radius found with one radius query per particle
+void radiusRowsByQuery(const ParticlesData& particles,std::vector<float>& positions,const float radius,
+    const bool includeSelf,NeighborGraph& graph)
+{
+    const int64_t n=particles.numParticles();
+    particles.findPointsInRadiusBatch(&positions[0],n,radius,graph.offsets,graph.indices,graph.distancesSquared,true);
+    if(includeSelf) return;
+
+    // drop each particle from its own row
+    std::vector<int64_t> offsets(n+1,0);
+    parallelFor(0,n,RowGrain,[&](int64_t begin,int64_t end){
+        for(int64_t i=begin;i<end;i++){
+            int64_t count=0;
+            for(int64_t j=graph.offsets[i];j<graph.offsets[i+1];j++)
+                if(graph.indices[j]!=ParticleIndex(i)) count++;
+            offsets[i+1]=count;
+        }
+    });
+    NeighborGraph result;
+    result.offsets.swap(offsets);
+    finishOffsets(result);
+    parallelFor(0,n,RowGrain,[&](int64_t begin,int64_t end){
+        for(int64_t i=begin;i<end;i++){
+            int64_t out=result.offsets[i];
+            for(int64_t j=graph.offsets[i];j<graph.offsets[i+1];j++){
+                if(graph.indices[j]==ParticleIndex(i)) continue;
+                result.indices[out]=graph.indices[j];
+                result.distancesSquared[out]=graph.distancesSquared[j];
+                out++;
+            }
+        }
+    });
+    std::swap(graph.offsets,result.offsets);
+    std::swap(graph.indices,result.indices);
+    std::swap(graph.distancesSquared,result.distancesSquared);
+}
+
+// rows of all points within radius, testing each pair once: the points are
+// binned into cells as large as the radius and each cell is only compared
+// with itself and the 13 neighbors of its forward half shell. Returns false
+// if the points span too many cells.
+bool radiusRowsByPairs(const std::vector<float>& positions,const float radius,const bool includeSelf,
+    NeighborGraph& graph)
+{
+    const int64_t n=positions.size()/3;
+    float min[3],max[3];
+    for(int axis=0;axis<3;axis++){min[axis]=FLT_MAX;max[axis]=-FLT_MAX;}
+    for(int64_t i=0;i<n;i++)
+        for(int axis=0;axis<3;axis++){
+            min[axis]=std::min(min[axis],positions[3*i+axis]);
+            max[axis]=std::max(max[axis],positions[3*i+axis]);
+        }
+    // a little larger than the radius, so rounding never puts a pair two cells apart
+    const float cellSize=radius*1.0001f;
+    for(int axis=0;axis<3;axis++)
+        if(!(radius>0) || !((max[axis]-min[axis])/cellSize<float(MaxCells-2))) return false;
+
+    std::vector<CellEntry> entries(n);
+    parallelFor(0,n,RowGrain,[&](int64_t begin,int64_t end){
+        for(int64_t i=begin;i<end;i++){
+            int64_t cell[3];
+            for(int axis=0;axis<3;axis++) cell[axis]=int64_t((positions[3*i+axis]-min[axis])/cellSize);
+            entries[i].key=cellKey(cell[0],cell[1],cell[2]);
+            entries[i].index=i;
+        }
+    });
+    parallelSort(entries.empty() ? 0 : &entries[0],entries.empty() ? 0 : &entries[0]+n);
+    std::vector<uint64_t> cellKeys;
+    std::vector<int64_t> cellBegins;
+    std::vector<float> sorted(3*n);
+    for(int64_t i=0;i<n;i++){
+        std::copy(&positions[3*entries[i].index],&positions[3*entries[i].index]+3,&sorted[3*i]);
+        if(i>0 && entries[i].key==entries[i-1].key) continue;
+        cellKeys.push_back(entries[i].key);
+        cellBegins.push_back(i);
+    }
+    cellBegins.push_back(n);
+    const int64_t numCells=int64_t(cellKeys.size());
+
+    const float radiusSquared=radius*radius;
+    const int chunks=static_cast<int>(std::max<int64_t>(1,std::min<int64_t>(numThreads(),numCells)));
+    std::vector<std::vector<Pair> > chunkPairs(chunks);
+    parallelChunks(chunks,[&](int chunk){
+        std::vector<Pair>& pairs=chunkPairs[chunk];
+        const uint64_t mask=MaxCells;
+        // tests the points of cell c against those in [first,last) of the sorted order
+        auto testPoints=[&](const int64_t c,const int64_t first,const int64_t last,const bool sameCell){
+            for(int64_t i=cellBegins[c];i<cellBegins[c+1];i++){
+                const float* p=&sorted[3*i];
+                for(int64_t j=sameCell ? i+1 : first;j<last;j++){
+                    const float* q=&sorted[3*j];
+                    float distanceSquared=0;
+                    for(int axis=0;axis<3;axis++){
+                        const float d=q[axis]-p[axis];
+                        distanceSquared+=d*d;
+                    }
+                    if(distanceSquared<=radiusSquared)
+                        pairs.push_back(Pair{entries[i].index,entries[j].index,distanceSquared});
+                }
+            }
+        };
+        for(int64_t c=numCells*chunk/chunks;c<numCells*(chunk+1)/chunks;c++){
+            const uint64_t key=cellKeys[c];
+            const int64_t x=int64_t(key>>(2*CellBits)),y=int64_t((key>>CellBits)&mask),z=int64_t(key&mask);
+            testPoints(c,cellBegins[c],cellBegins[c+1],true);
+            // the rows of cells (x,y,z-1..z+1) are consecutive keys, so each is one
+            // range, and all of the half shell sorts after c
+            const int rows[5][2]={{0,0},{0,1},{1,-1},{1,0},{1,1}};
+            for(int r=0;r<5;r++){
+                const int64_t nx=x+rows[r][0],ny=y+rows[r][1];
+                if(ny<0) continue;
+                const int64_t z0=r==0 ? z+1 : std::max<int64_t>(z-1,0);
+                const uint64_t low=cellKey(nx,ny,z0),high=cellKey(nx,ny,z+1);
+                const int64_t first=int64_t(std::lower_bound(cellKeys.begin()+c+1,cellKeys.end(),low)-cellKeys.begin());
+                int64_t last=first;
+                while(last<numCells && cellKeys[last]<=high) last++;
+                if(last>first) testPoints(c,cellBegins[first],cellBegins[last],false);
+            }
+        }
+    });
+
+    // each pair lands in both of its rows, then rows are ordered by distance and index
+    graph.offsets.assign(n+1,0);
+    for(int chunk=0;chunk<chunks;chunk++)
+        for(size_t p=0;p<chunkPairs[chunk].size();p++){
+            graph.offsets[chunkPairs[chunk][p].a+1]++;
+            graph.offsets[chunkPairs[chunk][p].b+1]++;
+        }
+    if(includeSelf)
+        for(int64_t i=0;i<n;i++) graph.offsets[i+1]++;
+    finishOffsets(graph);
+    std::vector<int64_t> cursors(graph.offsets.begin(),graph.offsets.end()-1);
+    if(includeSelf)
+        for(int64_t i=0;i<n;i++){
+            graph.indices[cursors[i]]=i;
+            graph.distancesSquared[cursors[i]++]=0;
+        }
+    for(int chunk=0;chunk<chunks;chunk++){
+        for(size_t p=0;p<chunkPairs[chunk].size();p++){
+            const Pair& pair=chunkPairs[chunk][p];
+            graph.indices[cursors[pair.a]]=pair.b;
+            graph.distancesSquared[cursors[pair.a]++]=pair.distanceSquared;
+            graph.indices[cursors[pair.b]]=pair.a;
+            graph.distancesSquared[cursors[pair.b]++]=pair.distanceSquared;
+        }
+        std::vector<Pair>().swap(chunkPairs[chunk]);
+    }
+    parallelFor(0,n,RowGrain,[&](int64_t begin,int64_t end){
+        std::vector<std::pair<float,ParticleIndex> > row;
+        for(int64_t i=begin;i<end;i++){
+            row.clear();
+            for(int64_t j=graph.offsets[i];j<graph.offsets[i+1];j++)
+                row.push_back(std::make_pair(graph.distancesSquared[j],graph.indices[j]));
+            std::sort(row.begin(),row.end());
+            for(size_t j=0;j<row.size();j++){
+                graph.distancesSquared[graph.offsets[i]+j]=row[j].first;
+                graph.indices[graph.offsets[i]+j]=row[j].second;
+            }
+        }
+    });
+    return true;
+}
+
+}
+
+void
+buildNeighborGraph(const ParticlesData& particles,const int numNeighbors,const float maxRadius,
+    NeighborGraph& graph,const bool includeSelf)
+{
+    graph.offsets.assign(1,0);
+    graph.indices.clear();
+    graph.distancesSquared.clear();
+    std::vector<float> positions;
+    if(!gatherPositions(particles,positions,"buildNeighborGraph")) return;
+    nearestRows(particles,positions,numNeighbors,maxRadius,!includeSelf,false,graph);
+}
+
+void
+nearestJoin(const ParticlesData& a,const ParticlesData& b,const int numNeighbors,const float maxRadius,
+    NeighborGraph& graph)
+{
+    graph.offsets.assign(1,0);
+    graph.indices.clear();
+    graph.distancesSquared.clear();
+    std::vector<float> positions;
+    if(!gatherPositions(a,positions,"nearestJoin")) return;
+    // a's particles come in no particular order relative to b's tree, so let the batch
+    // walk them in Morton order to keep neighboring queries on the same branches
+    nearestRows(b,positions,numNeighbors,maxRadius,false,true,graph);
+}
+
+void
+buildNeighborGraph(const ParticlesData& particles,const float radius,NeighborGraph& graph,
+    const bool includeSelf)
+{
+    graph.offsets.assign(1,0);
+    graph.indices.clear();
+    graph.distancesSquared.clear();
+    std::vector<float> positions;
+    if(!gatherPositions(particles,positions,"buildNeighborGraph")) return;
+    if(particles.numParticles()==0) return;
+
+    // the pairs' distances are computed like the radius queries do, so either
+    // way j is in i's row exactly when i is in j's row
+    if(!radiusRowsByPairs(positions,radius,includeSelf,graph))
+        radiusRowsByQuery(particles,positions,radius,includeSelf,graph);
+}
+
+}
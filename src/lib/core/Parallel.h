@@ -0,0 +1,143 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+#ifndef _Parallel_h_
+#define _Parallel_h_
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+namespace Partio
+{
+
+//! Number of threads used by parallel algorithms. Defaults to the hardware
+//! concurrency, the PARTIO_NUM_THREADS environment variable overrides it.
+inline int numThreads()
+{
+    static const int threads=[](){
+        const char* env=getenv("PARTIO_NUM_THREADS");
+        int count=env ? atoi(env) : 0;
+        if(count<=0) count=static_cast<int>(std::thread::hardware_concurrency());
+        return std::max(count,1);
+    }();
+    return threads;
+}
+
+//! Runs func(chunk) for every chunk in [0,chunks), each on its own thread.
+//! Chunk 0 runs on the calling thread.
+template<class FUNC> void parallelChunks(const int chunks,const FUNC& func)
+{
+    if(chunks<=1){
+        if(chunks==1) func(0);
+        return;
+    }
+    std::vector<std::thread> workers;
+    workers.reserve(chunks-1);
+    for(int chunk=1;chunk<chunks;chunk++) workers.emplace_back([&func,chunk](){func(chunk);});
+    func(0);
+    for(size_t i=0;i<workers.size();i++) workers[i].join();
+}
+
+//! Calls func(chunkBegin,chunkEnd) on contiguous pieces of [begin,end). No more
+//! than one piece per grain elements is made, so small ranges stay on the
+//! calling thread.
+template<class FUNC> void parallelFor(const int64_t begin,const int64_t end,const int64_t grain,const FUNC& func)
+{
+    const int64_t count=end-begin;
+    if(count<=0) return;
+    const int chunks=static_cast<int>(std::max<int64_t>(1,std::min<int64_t>(numThreads(),count/std::max<int64_t>(grain,1))));
+    const int64_t chunkSize=(count+chunks-1)/chunks;
+    parallelChunks(chunks,[&](int chunk){
+        int64_t chunkBegin=begin+chunk*chunkSize;
+        int64_t chunkEnd=std::min(end,chunkBegin+chunkSize);
+        if(chunkBegin<chunkEnd) func(chunkBegin,chunkEnd);
+    });
+}
+
+//! Like parallelFor, but threads take grain sized pieces as they finish
+//! the previous one. Use it when the cost per element varies a lot.
+template<class FUNC> void parallelForDynamic(const int64_t begin,const int64_t end,const int64_t grain,const FUNC& func)
+{
+    const int64_t count=end-begin;
+    if(count<=0) return;
+    const int64_t step=std::max<int64_t>(grain,1);
+    const int chunks=static_cast<int>(std::min<int64_t>(numThreads(),(count+step-1)/step));
+    std::atomic<int64_t> next(begin);
+    parallelChunks(chunks,[&](int){
+        for(;;){
+            int64_t chunkBegin=next.fetch_add(step);
+            if(chunkBegin>=end) break;
+            func(chunkBegin,std::min(end,chunkBegin+step));
+        }
+    });
+}
+
+//! std::sort over [begin,end) with pieces sorted on their own threads and then
+//! merged pairwise, also in parallel
+template<class T> void parallelSort(T* begin,T* end)
+{
+    const int64_t count=end-begin;
+    const int64_t grain=1<<16;
+    int pieces=static_cast<int>(std::max<int64_t>(1,std::min<int64_t>(numThreads(),count/grain)));
+    if(pieces<=1){
+        std::sort(begin,end);
+        return;
+    }
+    std::vector<int64_t> bounds(pieces+1);
+    for(int i=0;i<=pieces;i++) bounds[i]=count*i/pieces;
+    parallelChunks(pieces,[&](int piece){std::sort(begin+bounds[piece],begin+bounds[piece+1]);});
+
+    // each round merges neighboring pairs of sorted runs into the other buffer
+    std::vector<T> scratch(count);
+    T* from=begin;
+    T* to=&scratch[0];
+    while(pieces>1){
+        const int pairs=(pieces+1)/2;
+        parallelChunks(pairs,[&](int pair){
+            const int64_t first=bounds[2*pair],middle=bounds[std::min(2*pair+1,pieces)],last=bounds[std::min(2*pair+2,pieces)];
+            std::merge(from+first,from+middle,from+middle,from+last,to+first);
+        });
+        for(int i=0;i<=pairs;i++) bounds[i]=bounds[std::min(2*i,pieces)];
+        pieces=pairs;
+        std::swap(from,to);
+    }
+    if(from!=begin) std::copy(from,from+count,begin);
+}
+
+}
+#endif
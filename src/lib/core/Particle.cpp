@@ -201,7 +201,7 @@ print(const ParticlesData* particles)
                   << " count=" << attr.count << std::endl;
     }
 
-    int numToPrint=std::min(10,particles->numParticles());
+    int numToPrint=static_cast<int>(std::min<int64_t>(10,particles->numParticles()));
     std::cout<<"num to print "<<numToPrint<<std::endl;
 
     ParticlesData::const_iterator it=particles->begin(),end=particles->end();
@@ -297,8 +297,9 @@ double hash(int n, double* args)
 }
 
 struct IdAndIndex {
-    IdAndIndex(int id, int index) : _id(id), _index(index) {}
-    int _id, _index;
+    IdAndIndex(int id, ParticleIndex index) : _id(id), _index(index) {}
+    int _id;
+    ParticleIndex _index;
     bool operator<(const IdAndIndex &other) const {
         return _id < other._id;
     }
@@ -306,7 +307,7 @@ struct IdAndIndex {
 
 template<class T> T smoothstep(T t){return (3.-2.*t)*t*t;}
 
-void addClusterAttribute(ParticlesDataMutable* cluster, ParticleAttribute& clusterAttribute, const ParticlesDataMutable* particle, const int index, const ParticleAttribute& attribute, const int neighborIndex, const std::vector<std::pair<ParticleIndex,float> >& indexAndInterp)
+void addClusterAttribute(ParticlesDataMutable* cluster, ParticleAttribute& clusterAttribute, const ParticlesDataMutable* particle, const ParticleIndex index, const ParticleAttribute& attribute, const ParticleIndex neighborIndex, const std::vector<std::pair<ParticleIndex,float> >& indexAndInterp)
 {
     switch(attribute.type){
     case Partio::VECTOR:
@@ -381,7 +382,14 @@ computeClustering(ParticlesDataMutable* particles, const int numNeighbors,const
     }
     particles->sort();
     ParticleAttribute clusterIdAttr = cluster->addAttribute("clusterId", Partio::INT, 1);
-    for (int index=0; index<particles->numParticles(); index++) {
+
+    // every particle's neighbors (itself included) are found up front in parallel
+    NeighborGraph graph;
+    buildNeighborGraph(*particles, numNeighbors, radiusSearch, graph, true);
+    for (int64_t index=0; index<particles->numParticles(); index++) {
+        const ParticleIndex* points = graph.indices.data() + graph.offsets[index];
+        const int pointCount = static_cast<int>(graph.numNeighbors(index));
+
         const float* center=particles->data<float>(posAttr,index);
         Vec3 position(center[0], center[1], center[2]);
         int id = particles->data<int>(idAttr,index)[0];
@@ -390,14 +398,10 @@ computeClustering(ParticlesDataMutable* particles, const int numNeighbors,const
         double innerRadius = .01 * radius * radiusSearch;
         double invRadius = 1 / (radiusSearch - innerRadius);
 
-        std::vector<Partio::ParticleIndex> points;
-        std::vector<float> distSq;
-        particles->findNPoints(center, numNeighbors, radiusSearch, points, distSq);
-
         std::vector<IdAndIndex> idAndIndex;
-        idAndIndex.reserve(points.size());
+        idAndIndex.reserve(pointCount + 1);
         idAndIndex.push_back(IdAndIndex(id, 0));
-        for (unsigned int i = 0; i < points.size(); i++) {
+        for (int i = 0; i < pointCount; i++) {
             const int pointid = particles->data<int>(idAttr,points[i])[0];
             if (pointid != id) idAndIndex.push_back(IdAndIndex(pointid, points[i]));
         }
@@ -473,7 +477,7 @@ void merge(ParticlesDataMutable& base, const ParticlesData& delta, const std::st
     // Build a map from the identifier value to the particle index
     // and locate the identifier attribute in the base.
     // This assumes unique identifiers per particle.
-    std::unordered_map<std::pair<int,int>,int,IntPairHash> idToParticleIndex;
+    std::unordered_map<std::pair<int,int>,ParticleIndex,IntPairHash> idToParticleIndex;
     ParticleAttribute baseIdAttr0;
     bool baseHasIdentifier0 = base.attributeInfo(identifier0.c_str(), baseIdAttr0);
     baseHasIdentifier0 = baseHasIdentifier0 ? baseIdAttr0.type == INT : false;
@@ -481,7 +485,7 @@ void merge(ParticlesDataMutable& base, const ParticlesData& delta, const std::st
     bool baseHasIdentifier1 = base.attributeInfo(identifier1.c_str(), baseIdAttr1);
     baseHasIdentifier1 = baseHasIdentifier1 ? baseIdAttr1.type == INT : false;
     if (baseHasIdentifier0 || baseHasIdentifier1) {
-        for (int i=0; i<base.numParticles(); i++) {
+        for (int64_t i=0; i<base.numParticles(); i++) {
             idToParticleIndex[std::make_pair(baseHasIdentifier0 ? base.data<int>(baseIdAttr0,i)[0] : 0,
                                              baseHasIdentifier1 ? base.data<int>(baseIdAttr1,i)[0] : 0)] = i;
         }
@@ -519,7 +523,7 @@ void merge(ParticlesDataMutable& base, const ParticlesData& delta, const std::st
             attrs.emplace_back(AttributePair<ParticleAttribute>({std::move(baseAttr), std::move(deltaAttr)}));
 
             // Set the attribute to a default value in the base particle set
-            for (int p=0; p<base.numParticles(); ++p) {
+            for (int64_t p=0; p<base.numParticles(); ++p) {
                 base.set(baseAttr, p, empty);
             }
         }
@@ -583,10 +587,10 @@ void merge(ParticlesDataMutable& base, const ParticlesData& delta, const std::st
     bool hasIdentifier = (baseHasIdentifier0 && deltaHasIdentifier0) || (baseHasIdentifier1 && deltaHasIdentifier1);
     // just append if there are mismatched attributes
     hasIdentifier = hasIdentifier && !((baseHasIdentifier0 ^ deltaHasIdentifier0) || (baseHasIdentifier1 ^ deltaHasIdentifier1));
-    for (int i=0; i<delta.numParticles(); ++i) {
+    for (int64_t i=0; i<delta.numParticles(); ++i) {
 
         // Grab index into base particle set - either existing or new
-        int index(-1);
+        int64_t index(-1);
         if (hasIdentifier) {
             std::pair<int,int> idValue = std::make_pair(deltaHasIdentifier0 ? delta.data<int>(deltaIdAttr0, i)[0] : 0,
                                                         deltaHasIdentifier1 ? delta.data<int>(deltaIdAttr1, i)[0] : 0);
@@ -34,6 +34,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
 */
 #include <iostream>
 #include <cassert>
+#include <string>
+#include <sys/stat.h>
 #include "Mutex.h"
 #include "../Partio.h"
 
@@ -43,6 +45,15 @@ namespace Partio{
 namespace
 {
     static PartioMutex mutex;
+
+    // loads the index saved next to the file if it is still valid, otherwise sorts
+    void sortCached(ParticlesDataMutable& particles,const char* filename)
+    {
+        std::string indexFilename=std::string(filename)+".kdtree";
+        struct stat info;
+        if(stat(indexFilename.c_str(),&info)==0 && particles.loadIndex(indexFilename.c_str(),filename)) return;
+        particles.sort();
+    }
 }
     
 // cached read write
@@ -61,7 +72,7 @@ ParticlesData* readCached(const char* filename,const bool sort,const bool verbos
     }else{
         ParticlesDataMutable* p_rw=read(filename,verbose);
         if(p_rw){
-            if(sort) p_rw->sort();
+            if(sort) sortCached(*p_rw,filename);
             p=p_rw;
             cachedParticles[filename]=p;
             cachedParticlesCount[p]=1;
@@ -57,7 +57,7 @@ release()
     delete this;
 }
 
-int ParticleHeaders::
+int64_t ParticleHeaders::
 numParticles() const
 {
     return particleCount;
@@ -119,7 +119,6 @@ sort()
     assert(false);
 }
 
-
 int ParticleHeaders::
 registerIndexedStr(const ParticleAttribute&, const char*)
 {
@@ -164,27 +163,6 @@ fixedIndexedStrs(const FixedAttribute& attr) const
     return dummy;
 }
 
-void ParticleHeaders::
-findPoints(const float[3],const float[3],std::vector<ParticleIndex>&) const
-{
-    assert(false);
-}
-
-float ParticleHeaders::
-findNPoints(const float[3],const int,const float,std::vector<ParticleIndex>&,std::vector<float>&) const
-{
-    assert(false);
-    return 0;
-}
-
-int ParticleHeaders::
-findNPoints(const float[3],int,const float, ParticleIndex *,
-    float *, float *) const
-{
-    assert(false);
-    return 0;
-}
-
 ParticleAttribute ParticleHeaders::
 addAttribute(const char* attribute,ParticleAttributeType type,const int count)
 {
@@ -222,7 +200,7 @@ addParticle()
 }
 
 ParticlesDataMutable::iterator ParticleHeaders::
-addParticles(const int countToAdd)
+addParticles(const int64_t countToAdd)
 {
     particleCount+=countToAdd;
     return iterator();
@@ -48,7 +48,7 @@ protected:
 
     int numAttributes() const;
     int numFixedAttributes() const;
-    int numParticles() const;
+    int64_t numParticles() const;
     bool attributeInfo(const char* attributeName,ParticleAttribute& attribute) const;
     bool fixedAttributeInfo(const char* attributeName,FixedAttribute& attribute) const;
     bool attributeInfo(const int attributeInfo,ParticleAttribute& attribute) const;
@@ -68,23 +68,18 @@ protected:
 
     void sort();
 
-    void findPoints(const float bboxMin[3],const float bboxMax[3],std::vector<ParticleIndex>& points) const;
-    float findNPoints(const float center[3],int nPoints,const float maxRadius,
-        std::vector<ParticleIndex>& points,std::vector<float>& pointDistancesSquared) const;
-    int findNPoints(const float center[3],int nPoints,const float maxRadius,
-        ParticleIndex *points, float *pointDistancesSquared, float *finalRadius2) const;
     ParticlesDataMutable* computeClustering(const int numNeighbors,const double radiusSearch,const double radiusInside,const int connections,const double density)
     {assert(false); return nullptr;}
 
     ParticleAttribute addAttribute(const char* attribute,ParticleAttributeType type,const int count);
     FixedAttribute addFixedAttribute(const char* attribute,ParticleAttributeType type,const int count);
     ParticleIndex addParticle();
-    iterator addParticles(const int count);
+    iterator addParticles(const int64_t count);
 
-    const_iterator setupConstIterator(const int index=0) const
+    const_iterator setupConstIterator(const int64_t index=0) const
     {return const_iterator();}
 
-    iterator setupIterator(const int index=0)
+    iterator setupIterator(const int64_t index=0)
     {return iterator();}
 
 private:
@@ -94,7 +89,7 @@ private:
         const ParticleIndex* particleIndices,const bool sorted,char* values) const;
 
 private:
-    int particleCount;
+    int64_t particleCount;
     std::vector<ParticleAttribute> attributes;
     std::map<std::string,int> nameToAttribute;
     std::vector<FixedAttribute> fixedAttributes;
@@ -0,0 +1,306 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+#ifdef PARTIO_WIN32
+#    define NOMINMAX
+#endif
+#include "../Partio.h"
+#include "SpatialIndex.h"
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+namespace Partio{
+
+namespace{
+
+// the snapshot a query runs on, or null after telling why there is none
+std::shared_ptr<SpatialIndex> queryIndex(const ParticlesData& particles,const char* query)
+{
+    SpatialIndexPtr* published=particles.spatialIndex();
+    if(!published){
+        std::cerr<<"Partio: "<<query<<" is not supported by this particle set"<<std::endl;
+        return nullptr;
+    }
+    std::shared_ptr<SpatialIndex> index=published->load();
+    if(!index) std::cerr<<"Partio: "<<query<<" without first calling sort()"<<std::endl;
+    return index;
+}
+
+// the values of attribute as floats in particle order, a block at a time
+std::vector<float> gatherAsFloat(const ParticlesData& particles,const ParticleAttribute& attribute)
+{
+    const int blockSize=4096;
+    const int64_t count=particles.numParticles();
+    std::vector<float> values(count*attribute.count);
+    std::vector<ParticleIndex> block(blockSize);
+    for(int64_t first=0;first<count;first+=blockSize){
+        const int n=static_cast<int>(std::min<int64_t>(blockSize,count-first));
+        for(int i=0;i<n;i++) block[i]=first+i;
+        particles.dataAsFloat(attribute,n,&block[0],true,&values[first*attribute.count]);
+    }
+    return values;
+}
+
+}
+
+void ParticlesData::
+findPoints(const float bboxMin[3],const float bboxMax[3],std::vector<ParticleIndex>& points) const
+{
+    std::shared_ptr<SpatialIndex> index=queryIndex(*this,"findPoints");
+    if(index) index->findPoints(bboxMin,bboxMax,points);
+}
+
+bool ParticlesData::
+forEachInBox(const float bboxMin[3],const float bboxMax[3],PointVisitor& visitor) const
+{
+    std::shared_ptr<SpatialIndex> index=queryIndex(*this,"forEachInBox");
+    return !index || index->forEachInBox(bboxMin,bboxMax,visitor);
+}
+
+void ParticlesData::
+findPointsInFrustum(const float* planes,const int nPlanes,std::vector<ParticleIndex>& points) const
+{
+    std::shared_ptr<SpatialIndex> index=queryIndex(*this,"findPointsInFrustum");
+    if(index) index->findPointsInRegion(FrustumRegion(planes,nPlanes),points);
+}
+
+void ParticlesData::
+findPointsAlongRay(const float origin[3],const float direction[3],const float radius,
+    const float length,std::vector<ParticleIndex>& points) const
+{
+    std::shared_ptr<SpatialIndex> index=queryIndex(*this,"findPointsAlongRay");
+    if(index) index->findPointsInRegion(CapsuleRegion(origin,direction,radius,length),points);
+}
+
+void ParticlesData::
+findPointsInOrientedBox(const float center[3],const float axes[9],const float halfExtents[3],
+    std::vector<ParticleIndex>& points) const
+{
+    std::shared_ptr<SpatialIndex> index=queryIndex(*this,"findPointsInOrientedBox");
+    if(index) index->findPointsInRegion(OrientedBoxRegion(center,axes,halfExtents),points);
+}
+
+float ParticlesData::
+findNPoints(const float center[3],const int nPoints,const float maxRadius,std::vector<ParticleIndex>& points,
+    std::vector<float>& pointDistancesSquared) const
+{
+    std::shared_ptr<SpatialIndex> index=queryIndex(*this,"findNPoints");
+    if(index) return index->findNPoints(center,nPoints,maxRadius,points,pointDistancesSquared);
+    points.clear();
+    pointDistancesSquared.clear();
+    return 0;
+}
+
+int ParticlesData::
+findNPoints(const float center[3],int nPoints,const float maxRadius, ParticleIndex *points,
+    float *pointDistancesSquared, float *finalRadius2) const
+{
+    std::shared_ptr<SpatialIndex> index=queryIndex(*this,"findNPoints");
+    if(!index) return 0;
+    return index->findNPoints(center,nPoints,maxRadius,points,pointDistancesSquared,finalRadius2);
+}
+
+int ParticlesData::
+findNPointsApprox(const float center[3],int nPoints,const float maxRadius,const float epsilon,
+    const int maxVisited,ParticleIndex *points,float *pointDistancesSquared,float *finalRadius2) const
+{
+    std::shared_ptr<SpatialIndex> index=queryIndex(*this,"findNPointsApprox");
+    if(!index) return 0;
+    return index->findNPointsApprox(center,nPoints,maxRadius,epsilon,maxVisited,points,pointDistancesSquared,finalRadius2);
+}
+
+void ParticlesData::
+findNPointsBatch(const float* queries,int64_t nQueries,int nPoints,const float maxRadius,
+    ParticleIndex* outIndices,float* outDistancesSquared,int* outCounts,bool sortQueries) const
+{
+    std::shared_ptr<SpatialIndex> index=queryIndex(*this,"findNPointsBatch");
+    if(index) index->findNPointsBatch(queries,nQueries,nPoints,maxRadius,outIndices,outDistancesSquared,outCounts,sortQueries);
+    else std::fill(outCounts,outCounts+nQueries,0);
+}
+
+void ParticlesData::
+findNPointsSeeded(const float* queries,int64_t nQueries,int nPoints,const float maxRadius,
+    const ParticleIndex* seedIndices,const int* seedCounts,ParticleIndex* outIndices,float* outDistancesSquared,
+    int* outCounts,bool sortQueries) const
+{
+    std::shared_ptr<SpatialIndex> index=queryIndex(*this,"findNPointsSeeded");
+    if(index) index->findNPointsSeeded(queries,nQueries,nPoints,maxRadius,seedIndices,seedCounts,*this,
+        outIndices,outDistancesSquared,outCounts,sortQueries);
+    else std::fill(outCounts,outCounts+nQueries,0);
+}
+
+void ParticlesData::
+findPointsInRadius(const float center[3],const float radius,std::vector<ParticleIndex>& points,
+    std::vector<float>& pointDistancesSquared,bool sorted) const
+{
+    std::shared_ptr<SpatialIndex> index=queryIndex(*this,"findPointsInRadius");
+    if(index) index->findPointsInRadius(center,radius,points,pointDistancesSquared,sorted);
+}
+
+bool ParticlesData::
+forEachInRadius(const float center[3],const float radius,PointVisitor& visitor) const
+{
+    std::shared_ptr<SpatialIndex> index=queryIndex(*this,"forEachInRadius");
+    return !index || index->forEachInRadius(center,radius,visitor);
+}
+
+void ParticlesData::
+findPointsInRadiusBatch(const float* queries,int64_t nQueries,const float radius,std::vector<int64_t>& offsets,
+    std::vector<ParticleIndex>& points,std::vector<float>& pointDistancesSquared,bool sorted) const
+{
+    std::shared_ptr<SpatialIndex> index=queryIndex(*this,"findPointsInRadiusBatch");
+    if(index){
+        index->findPointsInRadiusBatch(queries,nQueries,radius,offsets,points,pointDistancesSquared,sorted);
+        return;
+    }
+    offsets.assign(nQueries+1,0);
+    points.clear();
+    pointDistancesSquared.clear();
+}
+
+void ParticlesData::
+findOverlapping(const float bboxMin[3],const float bboxMax[3],std::vector<ParticleIndex>& points) const
+{
+    std::shared_ptr<SpatialIndex> index=queryIndex(*this,"findOverlapping");
+    if(index && !index->findOverlapping(bboxMin,bboxMax,points))
+        std::cerr<<"Partio: findOverlapping without first calling setIndexRadius()"<<std::endl;
+}
+
+void ParticlesData::
+findOverlappingInRadius(const float center[3],const float radius,std::vector<ParticleIndex>& points) const
+{
+    std::shared_ptr<SpatialIndex> index=queryIndex(*this,"findOverlappingInRadius");
+    if(index && !index->findOverlappingInRadius(center,radius,points))
+        std::cerr<<"Partio: findOverlappingInRadius without first calling setIndexRadius()"<<std::endl;
+}
+
+int64_t ParticlesData::
+countInBox(const float bboxMin[3],const float bboxMax[3]) const
+{
+    std::shared_ptr<SpatialIndex> index=queryIndex(*this,"countInBox");
+    return index ? index->countInRegion(BoxRegion(bboxMin,bboxMax)) : 0;
+}
+
+int64_t ParticlesData::
+countInRadius(const float center[3],const float radius) const
+{
+    std::shared_ptr<SpatialIndex> index=queryIndex(*this,"countInRadius");
+    return index ? index->countInRegion(SphereRegion(center,radius)) : 0;
+}
+
+int64_t ParticlesData::
+sumInBox(const ParticleAttribute& attribute,const float bboxMin[3],const float bboxMax[3],double* sums) const
+{
+    std::shared_ptr<SpatialIndex> index=queryIndex(*this,"sumInBox");
+    if(!index) return 0;
+
+    int64_t count=index->sumInRegion(BoxRegion(bboxMin,bboxMax),attribute.name.c_str(),sums);
+    if(count>=0) return count;
+
+    // not augmented, add up the points one by one
+    for(int c=0;c<attribute.count;c++) sums[c]=0;
+    count=0;
+    std::vector<float> value(attribute.count);
+    auto add=[&](ParticleIndex i,float){
+        dataAsFloat(attribute,1,&i,true,&value[0]);
+        for(int c=0;c<attribute.count;c++) sums[c]+=value[c];
+        count++;
+        return true;
+    };
+    FunctionVisitor<decltype(add)> visitor(add);
+    index->forEachInBox(bboxMin,bboxMax,visitor);
+    return count;
+}
+
+bool ParticlesData::
+saveIndex(const char* filename,const char* sourceFile) const
+{
+    std::shared_ptr<SpatialIndex> index=queryIndex(*this,"saveIndex");
+    return index && index->save(filename,sourceFile);
+}
+
+bool ParticlesDataMutable::
+loadIndex(const char* filename,const char* sourceFile)
+{
+    SpatialIndexPtr* published=spatialIndex();
+    if(!published){
+        std::cerr<<"Partio: loadIndex is not supported by this particle set"<<std::endl;
+        return false;
+    }
+    ParticleAttribute attr;
+    if(!attributeInfo("position",attr) || attr.type!=VECTOR || attr.count!=3){
+        std::cerr<<"Partio: loadIndex, particles have no position vector attribute"<<std::endl;
+        return false;
+    }
+    KdTreeIndex* index=KdTreeIndex::load(filename,*this,attr,sourceFile);
+    if(!index) return false;
+    published->store(std::shared_ptr<SpatialIndex>(index));
+    return true;
+}
+
+bool ParticlesDataMutable::
+augmentIndex(const ParticleAttribute& attribute)
+{
+    std::shared_ptr<SpatialIndex> index=queryIndex(*this,"augmentIndex");
+    if(!index) return false;
+
+    // queries already running keep the index they loaded
+    std::vector<float> values=gatherAsFloat(*this,attribute);
+    if(spatialIndex()->update([&](const SpatialIndex& current){
+        return current.augmented(attribute.name.c_str(),values.empty() ? 0 : &values[0],attribute.count);}))
+        return true;
+    std::cerr<<"Partio: augmentIndex needs the KdTree index"<<std::endl;
+    return false;
+}
+
+bool ParticlesDataMutable::
+setIndexRadius(const ParticleAttribute& attribute)
+{
+    std::shared_ptr<SpatialIndex> index=queryIndex(*this,"setIndexRadius");
+    if(!index) return false;
+    if(attribute.count!=1){
+        std::cerr<<"Partio: setIndexRadius, attribute "<<attribute.name<<" has more than one component"<<std::endl;
+        return false;
+    }
+
+    std::vector<float> radii=gatherAsFloat(*this,attribute);
+    if(spatialIndex()->update([&](const SpatialIndex& current){
+        return current.withRadii(radii.empty() ? 0 : &radii[0]);}))
+        return true;
+    std::cerr<<"Partio: setIndexRadius needs the KdTree index"<<std::endl;
+    return false;
+}
+
+}
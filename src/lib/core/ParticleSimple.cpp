@@ -44,23 +44,25 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
 #include <cassert>
 #include <iostream>
 
-#include "KdTree.h"
+#include "SpatialIndex.h"
+#include "HashGrid.h"
 
 
 using namespace Partio;
 
 ParticlesSimple::
 ParticlesSimple()
-    :particleCount(0),allocatedCount(0),kdtree(nullptr)
+    :particleCount(0),allocatedCount(0)
 {
 }
 
 ParticlesSimple::
 ~ParticlesSimple()
 {
+    detachIndex();
     for(unsigned int i=0;i<attributeData.size();i++) free(attributeData[i]);
     for(unsigned int i=0;i<fixedAttributeData.size();i++) free(fixedAttributeData[i]);
-    delete kdtree;
+    freeRecycled();
 }
 
 void ParticlesSimple::
@@ -69,7 +71,7 @@ release()
     freeCached(this);
 }
 
-int ParticlesSimple::
+int64_t ParticlesSimple::
 numParticles() const
 {
     return particleCount;
@@ -127,6 +129,12 @@ fixedAttributeInfo(const char* attributeName,FixedAttribute& attribute) const
 
 void ParticlesSimple::
 sort()
+{
+    sort(IndexType::KdTree);
+}
+
+void ParticlesSimple::
+sort(const IndexType type,const float cellSize)
 {
     ParticleAttribute attr;
     bool foundPosition=attributeInfo("position",attr);
@@ -140,71 +148,40 @@ sort()
 
     const ParticleIndex baseParticleIndex=0;
     const float* data=this->data<float>(attr,baseParticleIndex); // contiguous assumption used here
-    KdTree<3>* kdtree_temp=new KdTree<3>();
-    kdtree_temp->setPoints(data,numParticles());
-    kdtree_temp->sort();
-
-    kdtree_mutex.lock();
-    // TODO: this is not threadsafe!
-    if(kdtree) delete kdtree;
-    kdtree=kdtree_temp;
-    kdtree_mutex.unlock();
-}
-
-void ParticlesSimple::
-findPoints(const float bboxMin[3],const float bboxMax[3],std::vector<ParticleIndex>& points) const
-{
-    if(!kdtree){
-        std::cerr<<"Partio: findPoints without first calling sort()"<<std::endl;
-        return;
+    SpatialIndex* index_temp;
+    if(type==IndexType::HashGrid){
+        HashGrid* grid=new HashGrid();
+        grid->build(data,numParticles(),sizeof(float)*3,cellSize);
+        index_temp=grid;
+    }else{
+        KdTreeIndex* kdtree=new KdTreeIndex();
+        kdtree->build(data,numParticles(),sizeof(float)*3,type==IndexType::KdTreeInPlace);
+        index_temp=kdtree;
     }
 
-    BBox<3> box(bboxMin);box.grow(bboxMax);
-
-    int startIndex=static_cast<int>(points.size());
-    kdtree->findPoints(points,box);
-    // remap points found in findPoints to original index space
-    for(unsigned int i=startIndex;i<points.size();i++){
-        points[i]=kdtree->id(static_cast<int>(points[i]));
-    }
+    // queries already running keep the old index alive until they finish
+    index_temp->setPositionAttribute(attr.attributeIndex);
+    publishedIndex.store(std::shared_ptr<SpatialIndex>(index_temp));
 }
 
-float ParticlesSimple::
-findNPoints(const float center[3],const int nPoints,const float maxRadius,std::vector<ParticleIndex>& points,
-    std::vector<float>& pointDistancesSquared) const
+void ParticlesSimple::
+detachIndex()
 {
-    if(!kdtree){
-        std::cerr<<"Partio: findNPoints without first calling sort()"<<std::endl;
-        return 0;
-    }
-
-    //assert(sizeof(ParticleIndex)==sizeof(uint64_t));
-    //std::vector<uint64_t>& rawPoints=points;
-    float maxDistance=kdtree->findNPoints(points,pointDistancesSquared,center,nPoints,maxRadius);
-    // remap all points since findNPoints clears array
-    for(unsigned int i=0;i<points.size();i++){
-        ParticleIndex index=kdtree->id(static_cast<int>(points[i]));
-        points[i]=index;
-    }
-    return maxDistance;
+    // the index reads the positions of the particles added last, and a KdTreeInPlace all of
+    // them, from the position column, which is about to move. Queries may still hold it.
+    std::shared_ptr<SpatialIndex> index=publishedIndex.load();
+    if(index) index->detachPoints();
 }
 
-int ParticlesSimple::
-findNPoints(const float center[3],int nPoints,const float maxRadius, ParticleIndex *points,
-    float *pointDistancesSquared, float *finalRadius2) const
+void ParticlesSimple::
+updateIndex()
 {
-    if(!kdtree){
-        std::cerr<<"Partio: findNPoints without first calling sort()"<<std::endl;
-        return 0;
-    }
-
-    int count = kdtree->findNPoints (points, pointDistancesSquared, finalRadius2, center, nPoints, maxRadius);
-    // remap all points since findNPoints clears array
-    for(int i=0; i < count; i++){
-        ParticleIndex index = kdtree->id(static_cast<int>(points[i]));
-        points[i]=index;
-    }
-    return count;
+    // particles added since sort() are searched from the position column. Queries still running
+    // on the published index keep it, the copy replaces it.
+    publishedIndex.update([this](const SpatialIndex& index){
+        return index.appended(reinterpret_cast<const float*>(attributeData[index.positionAttribute()]),
+            sizeof(float)*3,particleCount);
+    });
 }
 
 ParticleAttribute ParticlesSimple::
@@ -225,10 +202,21 @@ addAttribute(const char* attribute,ParticleAttributeType type,const int count)
 
     int stride=TypeSize(type)*count;
     attributeStrides.push_back(stride);
-    char* dataPointer=(char*)malloc((size_t)allocatedCount*(size_t)stride);
+    char* dataPointer=0;
+    attributeIndexedStrs.push_back(IndexedStrTable());
+    std::map<std::string,RecycledAttribute>::iterator recycled=recycledAttributes.find(attribute);
+    if(recycled!=recycledAttributes.end()){
+        if(recycled->second.type==type && recycled->second.count==count){
+            dataPointer=recycled->second.data;
+            if(recycled->second.allocated<allocatedCount)
+                dataPointer=(char*)realloc(dataPointer,(size_t)allocatedCount*(size_t)stride);
+            std::swap(attributeIndexedStrs.back(),recycled->second.strs);
+        }else free(recycled->second.data);
+        recycledAttributes.erase(recycled);
+    }
+    if(!dataPointer) dataPointer=(char*)malloc((size_t)allocatedCount*(size_t)stride);
     attributeData.push_back(dataPointer);
     attributeOffsets.push_back(dataPointer-(char*)0);
-    attributeIndexedStrs.push_back(IndexedStrTable());
 
     return attr;
 }
@@ -257,11 +245,89 @@ addFixedAttribute(const char* attribute,ParticleAttributeType type,const int cou
     return attr;
 }
 
+void ParticlesSimple::
+recycleInto(ParticlesSimple& target)
+{
+    detachIndex();
+    for(unsigned int i=0;i<attributes.size();i++){
+        RecycledAttribute recycled;
+        recycled.type=attributes[i].type;
+        recycled.count=attributes[i].count;
+        recycled.allocated=allocatedCount;
+        recycled.data=attributeData[i];
+        // the whole string table is kept, the next file likely registers the same strings
+        std::swap(recycled.strs,attributeIndexedStrs[i]);
+        recycled.strs.recycled=recycled.strs.strings.size();
+        std::map<std::string,RecycledAttribute>::iterator existing=target.recycledAttributes.find(attributes[i].name);
+        if(existing!=target.recycledAttributes.end()) free(existing->second.data);
+        std::swap(target.recycledAttributes[attributes[i].name],recycled);
+    }
+    for(std::map<std::string,RecycledAttribute>::iterator i=recycledAttributes.begin();i!=recycledAttributes.end();++i){
+        if(target.recycledAttributes.find(i->first)==target.recycledAttributes.end()) std::swap(target.recycledAttributes[i->first],i->second);
+        else free(i->second.data);
+    }
+    recycledAttributes.clear();
+    attributeData.clear();
+    attributeOffsets.clear();
+    attributeIndexedStrs.clear();
+    attributes.clear();
+    attributeStrides.clear();
+    nameToAttribute.clear();
+    for(unsigned int i=0;i<fixedAttributeData.size();i++) free(fixedAttributeData[i]);
+    fixedAttributeData.clear();
+    fixedAttributeIndexedStrs.clear();
+    fixedAttributes.clear();
+    nameToFixedAttribute.clear();
+    particleCount=0;
+    allocatedCount=0;
+    publishedIndex.store(nullptr);
+}
+
+void ParticlesSimple::
+lendRecycled(ParticlesSimple& target)
+{
+    target.freeRecycled();
+    target.recycledAttributes.swap(recycledAttributes);
+    // room for as many particles as the columns had, so adding them does not shrink the columns
+    for(std::map<std::string,RecycledAttribute>::iterator i=target.recycledAttributes.begin();
+        i!=target.recycledAttributes.end();++i)
+        target.allocatedCount=std::max(target.allocatedCount,i->second.allocated);
+}
+
+void ParticlesSimple::
+freeRecycled()
+{
+    for(std::map<std::string,RecycledAttribute>::iterator i=recycledAttributes.begin();i!=recycledAttributes.end();++i)
+        free(i->second.data);
+    recycledAttributes.clear();
+    for(unsigned int i=0;i<attributeIndexedStrs.size();i++) dropRecycledStrs(attributeIndexedStrs[i]);
+}
+
+void ParticlesSimple::
+swap(ParticlesSimple& other)
+{
+    std::swap(particleCount,other.particleCount);
+    std::swap(allocatedCount,other.allocatedCount);
+    attributeData.swap(other.attributeData);
+    attributeOffsets.swap(other.attributeOffsets);
+    attributeIndexedStrs.swap(other.attributeIndexedStrs);
+    recycledAttributes.swap(other.recycledAttributes);
+    attributes.swap(other.attributes);
+    attributeStrides.swap(other.attributeStrides);
+    nameToAttribute.swap(other.nameToAttribute);
+    fixedAttributeData.swap(other.fixedAttributeData);
+    fixedAttributeIndexedStrs.swap(other.fixedAttributeIndexedStrs);
+    fixedAttributes.swap(other.fixedAttributes);
+    nameToFixedAttribute.swap(other.nameToFixedAttribute);
+    publishedIndex.swap(other.publishedIndex);
+}
+
 ParticleIndex ParticlesSimple::
 addParticle()
 {
     if(allocatedCount==particleCount){
-        allocatedCount=std::max(10,std::max(allocatedCount*3/2,particleCount));
+        detachIndex();
+        allocatedCount=std::max<int64_t>(10,std::max(allocatedCount*3/2,particleCount));
         for(unsigned int i=0;i<attributes.size();i++) {
             char *memory = (char*)realloc(attributeData[i],(size_t)attributeStrides[i]*(size_t)allocatedCount);
             if(memory){
@@ -271,34 +337,37 @@ addParticle()
     }
     ParticleIndex index=particleCount;
     particleCount++;
+    updateIndex();
     return index;
 }
 
 ParticlesDataMutable::iterator ParticlesSimple::
-addParticles(const int countToAdd)
+addParticles(const int64_t countToAdd)
 {
     if(particleCount+countToAdd>allocatedCount){
-        // TODO: this should follow 2/3 rule
-        allocatedCount=allocatedCount+countToAdd;
+        // grow geometrically so that adding small batches stays amortized
+        detachIndex();
+        allocatedCount=std::max(allocatedCount*3/2,particleCount+countToAdd);
         for(unsigned int i=0;i<attributes.size();i++){
             attributeData[i]=(char*)realloc(attributeData[i],(size_t)attributeStrides[i]*(size_t)allocatedCount);
             attributeOffsets[i]=attributeData[i]-(char*)0;
         }
     }
-    int offset=particleCount;
+    int64_t offset=particleCount;
     particleCount+=countToAdd;
+    updateIndex();
     return setupIterator(offset);
 }
 
 ParticlesDataMutable::iterator ParticlesSimple::
-setupIterator(const int index)
+setupIterator(const int64_t index)
 {
     if(numParticles()==0) return ParticlesDataMutable::iterator();
     return ParticlesDataMutable::iterator(this,index,numParticles()-1);
 }
 
 ParticlesData::const_iterator ParticlesSimple::
-setupConstIterator(const int index) const
+setupConstIterator(const int64_t index) const
 {
     if(numParticles()==0) return ParticlesDataMutable::const_iterator();
     return ParticlesData::const_iterator(this,index,numParticles()-1);
@@ -379,11 +448,18 @@ dataAsFloat(const ParticleAttribute& attribute,const int indexCount,
 }
 
 int ParticlesSimple::
-registerIndexedStr(const ParticleAttribute& attribute,const char* str)
+registerStr(IndexedStrTable& table,const char* str)
 {
-    IndexedStrTable& table=attributeIndexedStrs[attribute.attributeIndex];
+    const size_t registered=table.strings.size()-table.recycled;
     std::map<std::string,int>::const_iterator it=table.stringToIndex.find(str);
-    if(it!=table.stringToIndex.end()) return it->second;
+    if(it!=table.stringToIndex.end() && size_t(it->second)<registered) return it->second;
+    if(table.recycled){
+        if(table.strings[registered]==str){
+            table.recycled--;
+            return static_cast<int>(registered);
+        }
+        dropRecycledStrs(table);
+    }
     int newIndex=static_cast<int>(table.strings.size());
     table.strings.push_back(str);
     table.stringToIndex[str]=newIndex;
@@ -391,33 +467,43 @@ registerIndexedStr(const ParticleAttribute& attribute,const char* str)
 }
 
 int ParticlesSimple::
-registerFixedIndexedStr(const FixedAttribute& attribute,const char* str)
+lookupStr(const IndexedStrTable& table,const char* str)
 {
-    IndexedStrTable& table=fixedAttributeIndexedStrs[attribute.attributeIndex];
     std::map<std::string,int>::const_iterator it=table.stringToIndex.find(str);
-    if(it!=table.stringToIndex.end()) return it->second;
-    int newIndex=table.strings.size();
-    table.strings.push_back(str);
-    table.stringToIndex[str]=newIndex;
-    return newIndex;
+    if(it!=table.stringToIndex.end() && size_t(it->second)<table.strings.size()-table.recycled) return it->second;
+    return -1;
+}
+
+void ParticlesSimple::
+dropRecycledStrs(IndexedStrTable& table)
+{
+    for(size_t i=table.strings.size()-table.recycled;i<table.strings.size();i++) table.stringToIndex.erase(table.strings[i]);
+    table.strings.resize(table.strings.size()-table.recycled);
+    table.recycled=0;
+}
+
+int ParticlesSimple::
+registerIndexedStr(const ParticleAttribute& attribute,const char* str)
+{
+    return registerStr(attributeIndexedStrs[attribute.attributeIndex],str);
+}
+
+int ParticlesSimple::
+registerFixedIndexedStr(const FixedAttribute& attribute,const char* str)
+{
+    return registerStr(fixedAttributeIndexedStrs[attribute.attributeIndex],str);
 }
 
 int ParticlesSimple::
 lookupIndexedStr(Partio::ParticleAttribute const &attribute, char const *str) const
 {
-    const IndexedStrTable& table=attributeIndexedStrs[attribute.attributeIndex];
-    std::map<std::string,int>::const_iterator it=table.stringToIndex.find(str);
-    if(it!=table.stringToIndex.end()) return it->second;
-    return -1;
+    return lookupStr(attributeIndexedStrs[attribute.attributeIndex],str);
 }
 
 int ParticlesSimple::
 lookupFixedIndexedStr(Partio::FixedAttribute const &attribute, char const *str) const
 {
-    const IndexedStrTable& table=fixedAttributeIndexedStrs[attribute.attributeIndex];
-    std::map<std::string,int>::const_iterator it=table.stringToIndex.find(str);
-    if(it!=table.stringToIndex.end()) return it->second;
-    return -1;
+    return lookupStr(fixedAttributeIndexedStrs[attribute.attributeIndex],str);
 }
 
 const std::vector<std::string>& ParticlesSimple::
@@ -436,6 +522,7 @@ fixedIndexedStrs(const FixedAttribute& attr) const
 
 void ParticlesSimple::setIndexedStr(const ParticleAttribute& attribute,int indexedStringToken,const char* str){
     IndexedStrTable& table=attributeIndexedStrs[attribute.attributeIndex];
+    dropRecycledStrs(table);
     if(indexedStringToken >= int(table.strings.size()) || indexedStringToken < 0) return;
     table.stringToIndex.erase(table.stringToIndex.find(table.strings[indexedStringToken]));
     table.strings[indexedStringToken] = str;
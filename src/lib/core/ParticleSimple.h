@@ -36,13 +36,11 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
 #include <vector>
 #include <map>
 #include <set>
-#include "Mutex.h"
 #include "../Partio.h"
+#include "SpatialIndex.h"
 
 namespace Partio{
 
-template<int d> class KdTree;
-
 class ParticlesSimple:public ParticlesDataMutable,
                       public Provider
 {
@@ -58,7 +56,7 @@ public:
 
     int numAttributes() const;
     int numFixedAttributes() const;
-    int numParticles() const;
+    int64_t numParticles() const;
     bool attributeInfo(const char* attributeName,ParticleAttribute& attribute) const;
     bool fixedAttributeInfo(const char* attributeName,FixedAttribute& attribute) const;
     bool attributeInfo(const int attributeInfo,ParticleAttribute& attribute) const;
@@ -74,41 +72,66 @@ public:
     const std::vector<std::string>& indexedStrs(const ParticleAttribute& attr) const;
     const std::vector<std::string>& fixedIndexedStrs(const FixedAttribute& attr) const;
     void sort();
-    void findPoints(const float bboxMin[3],const float bboxMax[3],std::vector<ParticleIndex>& points) const;
-    float findNPoints(const float center[3],int nPoints,const float maxRadius,
-        std::vector<ParticleIndex>& points,std::vector<float>& pointDistancesSquared) const;
-    int findNPoints(const float center[3],int nPoints,const float maxRadius,
-        ParticleIndex *points, float *pointDistancesSquared, float *finalRadius2) const;
+    void sort(const IndexType type,const float cellSize=0);
+    SpatialIndexPtr* spatialIndex() const {return &publishedIndex;}
     ParticlesDataMutable* computeClustering(const int numNeighbors,const double radiusSearch,const double radiusInside,const int connections,const double density);
 
     ParticleAttribute addAttribute(const char* attribute,ParticleAttributeType type,const int count);
     FixedAttribute addFixedAttribute(const char* attribute,ParticleAttributeType type,const int count);
     ParticleIndex addParticle();
-    iterator addParticles(const int count);
+    iterator addParticles(const int64_t count);
 
 
-    iterator setupIterator(const int index=0);
-    const_iterator setupConstIterator(const int index=0) const;
+    iterator setupIterator(const int64_t index=0);
+    const_iterator setupConstIterator(const int64_t index=0) const;
     void setupIteratorNextBlock(Partio::ParticleIterator<false>& iterator);
     void setupIteratorNextBlock(Partio::ParticleIterator<true>& iterator) const;
     void setupAccessor(Partio::ParticleIterator<false>& iterator,ParticleAccessor& accessor);
     void setupAccessor(Partio::ParticleIterator<true>& iterator,ParticleAccessor& accessor) const;
+
+    //! Moves this set's attribute columns and recycle pool into target's recycle pool, and
+    //! leaves this set empty. Attributes later added to target with a matching name, type and
+    //! count take over the column (and its indexed string table) instead of allocating a new one.
+    void recycleInto(ParticlesSimple& target);
+    //! Moves only the recycle pool into target's, for target to fill from
+    void lendRecycled(ParticlesSimple& target);
+    //! Frees recycled columns that no attribute claimed, and the recycled strings that were
+    //! not registered again
+    void freeRecycled();
+    //! Exchanges particles and attributes with other
+    void swap(ParticlesSimple& other);
 private:
     void* dataInternal(const ParticleAttribute& attribute,const ParticleIndex particleIndex) const;
     void* fixedDataInternal(const FixedAttribute& attribute) const;
     void dataInternalMultiple(const ParticleAttribute& attribute,const int indexCount,
         const ParticleIndex* particleIndices,const bool sorted,char* values) const;
+    void updateIndex();
+    void detachIndex();
 
 private:
-    int particleCount;
-    int allocatedCount;
+    int64_t particleCount;
+    int64_t allocatedCount;
     std::vector<char*> attributeData; // Inside is data of appropriate type
     std::vector<size_t> attributeOffsets; // Inside is data of appropriate type
     struct IndexedStrTable{
         std::map<std::string,int> stringToIndex; // TODO: this should be a hash table unordered_map
         std::vector<std::string> strings;
+        size_t recycled=0; // the last strings are left from a recycled table until registered again
     };
+    //! Token of str, registering it if needed. A recycled table's strings are reused as
+    //! long as they are registered again in the same order.
+    static int registerStr(IndexedStrTable& table,const char* str);
+    static int lookupStr(const IndexedStrTable& table,const char* str);
+    static void dropRecycledStrs(IndexedStrTable& table);
     std::vector<IndexedStrTable> attributeIndexedStrs;
+    struct RecycledAttribute{
+        ParticleAttributeType type;
+        int count;
+        int64_t allocated;
+        char* data;
+        IndexedStrTable strs;
+    };
+    std::map<std::string,RecycledAttribute> recycledAttributes;
     std::vector<ParticleAttribute> attributes;
     std::vector<int> attributeStrides;
     std::map<std::string,int> nameToAttribute;
@@ -117,8 +140,7 @@ private:
     std::vector<FixedAttribute> fixedAttributes;
     std::map<std::string,int> nameToFixedAttribute;
 
-    PartioMutex kdtree_mutex;
-    KdTree<3>* kdtree;
+    mutable SpatialIndexPtr publishedIndex; // handed out by the const spatialIndex(), it is atomic
 };
 
 }
@@ -43,23 +43,24 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
 #include <cassert>
 #include <iostream>
 
-#include "KdTree.h"
+#include "SpatialIndex.h"
+#include "HashGrid.h"
 
 
 using namespace Partio;
 
 ParticlesSimpleInterleave::
 ParticlesSimpleInterleave()
-    :particleCount(0),allocatedCount(0),data(nullptr),fixedData(nullptr),stride(0),kdtree(nullptr)
+    :particleCount(0),allocatedCount(0),data(nullptr),fixedData(nullptr),stride(0)
 {
 }
 
 ParticlesSimpleInterleave::
 ~ParticlesSimpleInterleave()
 {
+    detachIndex();
     free(data);
     free(fixedData);
-    delete kdtree;
 }
 
 void ParticlesSimpleInterleave::
@@ -69,7 +70,7 @@ release()
 }
 
 
-int ParticlesSimpleInterleave::
+int64_t ParticlesSimpleInterleave::
 numParticles() const
 {
     return particleCount;
@@ -128,7 +129,12 @@ fixedAttributeInfo(const char* attributeName,FixedAttribute& attribute) const
 void ParticlesSimpleInterleave::
 sort()
 {
-#if 0
+    sort(IndexType::KdTree);
+}
+
+void ParticlesSimpleInterleave::
+sort(const IndexType type,const float cellSize)
+{
     ParticleAttribute attr;
     bool foundPosition=attributeInfo("position",attr);
     if(!foundPosition){
@@ -139,64 +145,42 @@ sort()
         return;
     }
 
-    const float* data=this->data<float>(attr,0); // contiguous assumption used here
-    KdTree<3>* kdtree_temp=new KdTree<3>();
-    kdtree_temp->setPoints(data,numParticles());
-    kdtree_temp->sort();
-
-    kdtree_mutex.lock();
-    // TODO: this is not threadsafe!
-    if(kdtree) delete kdtree;
-    kdtree=kdtree_temp;
-    kdtree_mutex.unlock();
-#endif
-}
-
-void ParticlesSimpleInterleave::
-findPoints(const float[3],const float[3],std::vector<ParticleIndex>&) const
-{
-#if 0
-    if(!kdtree){
-        std::cerr<<"Partio: findPoints without first calling sort()"<<std::endl;
-        return;
+    // the index reads the positions strided through the records directly
+    SpatialIndex* index_temp;
+    if(type==IndexType::HashGrid){
+        HashGrid* grid=new HashGrid();
+        grid->build(numParticles() ? static_cast<const float*>(dataInternal(attr,0)) : 0,numParticles(),stride,cellSize);
+        index_temp=grid;
+    }else{
+        KdTreeIndex* kdtree=new KdTreeIndex();
+        kdtree->build(numParticles() ? static_cast<const float*>(dataInternal(attr,0)) : 0,numParticles(),stride);
+        index_temp=kdtree;
     }
 
-    BBox<3> box(bboxMin);box.grow(bboxMax);
-
-    int startIndex=points.size();
-    kdtree->findPoints(points,box);
-    // remap points found in findPoints to original index spac
-    for(unsigned int i=startIndex;i<points.size();i++) points[i]=kdtree->id(points[i]);
-#endif
+    // queries already running keep the old index alive until they finish
+    index_temp->setPositionAttribute(attr.attributeIndex);
+    publishedIndex.store(std::shared_ptr<SpatialIndex>(index_temp));
 }
 
-float ParticlesSimpleInterleave::
-findNPoints(const float[3],const int,const float,std::vector<ParticleIndex>&,
-    std::vector<float>&) const
+void ParticlesSimpleInterleave::
+detachIndex()
 {
-#if 0
-    if(!kdtree){
-        std::cerr<<"Partio: findNPoints without first calling sort()"<<std::endl;
-        return 0;
-    }
-
-    float maxDistance=kdtree->findNPoints(points,pointDistancesSquared,center,nPoints,maxRadius);
-    // remap all points since findNPoints clears array
-    for(unsigned int i=0;i<points.size();i++) points[i]=kdtree->id(points[i]);
-    return maxDistance;
-#endif
-    return 0;
+    // queries may still hold the index, which reads the records of the particles added last
+    std::shared_ptr<SpatialIndex> index=publishedIndex.load();
+    if(index) index->detachPoints();
 }
 
-int ParticlesSimpleInterleave::
-findNPoints(const float[3], int, const float, ParticleIndex *,
-    float *, float *) const
+void ParticlesSimpleInterleave::
+updateIndex()
 {
-    // TODO: I guess they don't support this lookup here
-    return 0;
+    // particles added since sort() are searched from the records. Queries still running on the
+    // published index keep it, the copy replaces it.
+    publishedIndex.update([this](const SpatialIndex& index){
+        return index.appended(reinterpret_cast<const float*>(data+attributeOffsets[index.positionAttribute()]),stride,
+            particleCount);
+    });
 }
 
-
 ParticleAttribute ParticlesSimpleInterleave::
 addAttribute(const char* attribute,ParticleAttributeType type,const int count)
 {
@@ -220,12 +204,13 @@ addAttribute(const char* attribute,ParticleAttributeType type,const int count)
     if(data){
         char* ptrNew=newData;
         char* ptrOld=data;
-        for(int i=0;i<particleCount;i++){
+        for(int64_t i=0;i<particleCount;i++){
             memcpy(ptrNew,ptrOld,oldStride);
             ptrNew+=newStride;
             ptrOld+=oldStride;
         }
     }
+    detachIndex();
     free(data);
     data=newData;
     stride=newStride;
@@ -258,7 +243,7 @@ addFixedAttribute(const char* attribute,ParticleAttributeType type,const int cou
     if(fixedData){
         char* ptrNew=newData;
         char* ptrOld=fixedData;
-        for(int i=0;i<particleCount;i++){
+        for(int64_t i=0;i<particleCount;i++){
             memcpy(ptrNew,ptrOld,oldStride);
             ptrNew+=newStride;
             ptrOld+=oldStride;
@@ -277,34 +262,39 @@ ParticleIndex ParticlesSimpleInterleave::
 addParticle()
 {
     if(allocatedCount==particleCount){
-        allocatedCount=std::max(10,std::max(allocatedCount*3/2,particleCount));
+        allocatedCount=std::max<int64_t>(10,std::max(allocatedCount*3/2,particleCount));
+        detachIndex();
         data=(char*)realloc(data,(size_t)stride*(size_t)allocatedCount);
     }
-    return particleCount++;
+    ParticleIndex index=particleCount++;
+    updateIndex();
+    return index;
 }
 
 ParticlesDataMutable::iterator ParticlesSimpleInterleave::
-addParticles(const int countToAdd)
+addParticles(const int64_t countToAdd)
 {
     if(particleCount+countToAdd>allocatedCount){
         while(allocatedCount<particleCount+countToAdd)
-            allocatedCount=std::max(10,std::max(allocatedCount*3/2,particleCount));
+            allocatedCount=std::max<int64_t>(10,std::max(allocatedCount*3/2,particleCount));
+        detachIndex();
         data=(char*)realloc(data,(size_t)stride*(size_t)allocatedCount);
     }
-    int offset=particleCount;
+    int64_t offset=particleCount;
     particleCount+=countToAdd;
+    updateIndex();
     return setupIterator(offset);
 }
 
 ParticlesDataMutable::iterator ParticlesSimpleInterleave::
-setupIterator(const int index)
+setupIterator(const int64_t index)
 {
     if(numParticles()==0) return ParticlesDataMutable::iterator();
     return ParticlesDataMutable::iterator(this,index,numParticles()-1);
 }
 
 ParticlesData::const_iterator ParticlesSimpleInterleave::
-setupConstIterator(const int index) const
+setupConstIterator(const int64_t index) const
 {
     if(numParticles()==0) return ParticlesDataMutable::const_iterator();
     return ParticlesData::const_iterator(this,index,numParticles()-1);
@@ -350,33 +340,32 @@ fixedDataInternal(const FixedAttribute& attribute) const
 }
 
 void ParticlesSimpleInterleave::
-dataInternalMultiple(const ParticleAttribute&,const int,const ParticleIndex*,const bool,char*) const
+dataInternalMultiple(const ParticleAttribute& attribute,const int indexCount,
+    const ParticleIndex* particleIndices,const bool,char* values) const
 {
-#if 0
     assert(attribute.attributeIndex>=0 && attribute.attributeIndex<(int)attributes.size());
 
-    char* base=attributeData[attribute.attributeIndex];
-    int bytes=attributeStrides[attribute.attributeIndex];
+    char* base=data+attributeOffsets[attribute.attributeIndex];
+    int bytes=TypeSize(attribute.type)*attribute.count;
     for(int i=0;i<indexCount;i++)
-        memcpy(values+bytes*i,base+particleIndices[i]*bytes,bytes);
-#endif
+        memcpy(values+bytes*i,base+particleIndices[i]*stride,bytes);
 }
 
 void ParticlesSimpleInterleave::
-dataAsFloat(const ParticleAttribute&,const int,
-    const ParticleIndex*,const bool,float*) const
+dataAsFloat(const ParticleAttribute& attribute,const int indexCount,
+    const ParticleIndex* particleIndices,const bool sorted,float* values) const
 {
-#if 0
     assert(attribute.attributeIndex>=0 && attribute.attributeIndex<(int)attributes.size());
 
     if(attribute.type==FLOAT || attribute.type==VECTOR) dataInternalMultiple(attribute,indexCount,particleIndices,sorted,(char*)values);
-    else if(attribute.type==INT){
-        char* attrrawbase=attributeData[attribute.attributeIndex];
-        int* attrbase=(int*)attrrawbase;
+    else if(attribute.type==INT || attribute.type==INDEXEDSTR){
+        char* base=data+attributeOffsets[attribute.attributeIndex];
         int count=attribute.count;
-        for(int i=0;i<indexCount;i++) for(int k=0;k<count;k++) values[i*count+k]=(int)attrbase[particleIndices[i]*count+k];
+        for(int i=0;i<indexCount;i++){
+            const int* attrbase=(const int*)(base+particleIndices[i]*stride);
+            for(int k=0;k<count;k++) values[i*count+k]=static_cast<float>(attrbase[k]);
+        }
     }
-#endif
 }
 
 
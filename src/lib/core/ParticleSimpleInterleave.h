@@ -38,13 +38,11 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
 #include <string>
 #include <vector>
 #include <map>
-#include "Mutex.h"
 #include "../Partio.h"
+#include "SpatialIndex.h"
 
 namespace Partio{
 
-template<int d> class KdTree;
-
 class ParticlesSimpleInterleave:public ParticlesDataMutable,
                       public Provider
 {
@@ -60,7 +58,7 @@ public:
 
     int numAttributes() const;
     int numFixedAttributes() const;
-    int numParticles() const;
+    int64_t numParticles() const;
     bool attributeInfo(const char* attributeName,ParticleAttribute& attribute) const;
     bool fixedAttributeInfo(const char* attributeName,FixedAttribute& attribute) const;
     bool attributeInfo(const int attributeInfo,ParticleAttribute& attribute) const;
@@ -78,22 +76,19 @@ public:
     const std::vector<std::string>& fixedIndexedStrs(const FixedAttribute& attr) const;
 
     void sort();
-    void findPoints(const float bboxMin[3],const float bboxMax[3],std::vector<ParticleIndex>& points) const;
-    float findNPoints(const float center[3],int nPoints,const float maxRadius,
-        std::vector<ParticleIndex>& points,std::vector<float>& pointDistancesSquared) const;
-    int findNPoints(const float center[3],int nPoints,const float maxRadius,
-        ParticleIndex *points, float *pointDistancesSquared, float *finalRadius2) const;
+    void sort(const IndexType type,const float cellSize=0);
+    SpatialIndexPtr* spatialIndex() const {return &publishedIndex;}
     ParticlesDataMutable* computeClustering(const int numNeighbors,const double radiusSearch,const double radiusInside,const int connections,const double density)
     { assert(false);  return nullptr; }
 
     ParticleAttribute addAttribute(const char* attribute,ParticleAttributeType type,const int count);
     FixedAttribute addFixedAttribute(const char* attribute,ParticleAttributeType type,const int count);
     ParticleIndex addParticle();
-    iterator addParticles(const int count);
+    iterator addParticles(const int64_t count);
 
 
-    iterator setupIterator(const int index=0);
-    const_iterator setupConstIterator(const int index=0) const;
+    iterator setupIterator(const int64_t index=0);
+    const_iterator setupConstIterator(const int64_t index=0) const;
     void setupIteratorNextBlock(Partio::ParticleIterator<false>& iterator);
     void setupIteratorNextBlock(Partio::ParticleIterator<true>& iterator) const;
     void setupAccessor(Partio::ParticleIterator<false>& iterator,ParticleAccessor& accessor);
@@ -103,10 +98,12 @@ private:
     void* fixedDataInternal(const FixedAttribute& attribute) const;
     void dataInternalMultiple(const ParticleAttribute& attribute,const int indexCount,
         const ParticleIndex* particleIndices,const bool sorted,char* values) const;
+    void updateIndex();
+    void detachIndex();
 
 private:
-    int particleCount;
-    int allocatedCount;
+    int64_t particleCount;
+    int64_t allocatedCount;
     char* data;
     char* fixedData;
     int stride;
@@ -123,8 +120,7 @@ private:
     std::vector<FixedAttribute> fixedAttributes;
     std::map<std::string,int> nameToFixedAttribute;
 
-    PartioMutex kdtree_mutex;
-    KdTree<3>* kdtree;
+    mutable SpatialIndexPtr publishedIndex; // handed out by the const spatialIndex(), it is atomic
 };
 
 }
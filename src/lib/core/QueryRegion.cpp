@@ -0,0 +1,303 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+#include "QueryRegion.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace Partio{
+
+bool QueryRegion::
+contains(const float p[3]) const
+{
+    const float* coords[3]={&p[0],&p[1],&p[2]};
+    unsigned char inside;
+    contains(coords,1,&inside);
+    return inside!=0;
+}
+
+bool QueryRegion::
+cornersInside(const float min[3],const float max[3]) const
+{
+    float corners[3][8];
+    for(int c=0;c<8;c++)
+        for(int axis=0;axis<3;axis++) corners[axis][c]=(c>>axis)&1 ? max[axis] : min[axis];
+    const float* coords[3]={corners[0],corners[1],corners[2]};
+    unsigned char inside[8];
+    contains(coords,8,inside);
+    for(int c=0;c<8;c++) if(!inside[c]) return false;
+    return true;
+}
+
+BoxRegion::
+BoxRegion(const float min[3],const float max[3])
+{
+    for(int axis=0;axis<3;axis++){
+        _min[axis]=min[axis];
+        _max[axis]=max[axis];
+    }
+}
+
+void BoxRegion::
+bounds(float min[3],float max[3]) const
+{
+    for(int axis=0;axis<3;axis++){
+        min[axis]=_min[axis];
+        max[axis]=_max[axis];
+    }
+}
+
+QueryRegion::Relation BoxRegion::
+classify(const float min[3],const float max[3]) const
+{
+    bool inside=true;
+    for(int axis=0;axis<3;axis++){
+        if(max[axis]<_min[axis] || min[axis]>_max[axis]) return Outside;
+        inside=inside && min[axis]>=_min[axis] && max[axis]<=_max[axis];
+    }
+    return inside ? Inside : Partial;
+}
+
+void BoxRegion::
+contains(const float* const coords[3],int n,unsigned char* inside) const
+{
+    for(int i=0;i<n;i++) inside[i]=1;
+    for(int axis=0;axis<3;axis++)
+        for(int i=0;i<n;i++) inside[i]&=coords[axis][i]>=_min[axis] && coords[axis][i]<=_max[axis];
+}
+
+SphereRegion::
+SphereRegion(const float center[3],float radius)
+    :_radius(radius)
+{
+    for(int axis=0;axis<3;axis++) _center[axis]=center[axis];
+}
+
+void SphereRegion::
+bounds(float min[3],float max[3]) const
+{
+    for(int axis=0;axis<3;axis++){
+        min[axis]=_center[axis]-_radius;
+        max[axis]=_center[axis]+_radius;
+    }
+}
+
+QueryRegion::Relation SphereRegion::
+classify(const float min[3],const float max[3]) const
+{
+    if(!(_radius>=0)) return Outside;
+    float nearestSquared=0;
+    for(int axis=0;axis<3;axis++){
+        float d=std::max(min[axis]-_center[axis],std::max(_center[axis]-max[axis],0.f));
+        nearestSquared+=d*d;
+    }
+    if(nearestSquared>_radius*_radius) return Outside;
+    return cornersInside(min,max) ? Inside : Partial;
+}
+
+void SphereRegion::
+contains(const float* const coords[3],int n,unsigned char* inside) const
+{
+    const float radiusSquared=_radius*_radius;
+    for(int i=0;i<n;i++){
+        float distanceSquared=0;
+        for(int axis=0;axis<3;axis++){
+            float d=coords[axis][i]-_center[axis];
+            distanceSquared+=d*d;
+        }
+        inside[i]=distanceSquared<=radiusSquared;
+    }
+}
+
+FrustumRegion::
+FrustumRegion(const float* planes,int nPlanes)
+    :_planes(planes),_nPlanes(nPlanes)
+{}
+
+void FrustumRegion::
+bounds(float min[3],float max[3]) const
+{
+    for(int axis=0;axis<3;axis++){
+        min[axis]=-FLT_MAX;
+        max[axis]=FLT_MAX;
+    }
+}
+
+QueryRegion::Relation FrustumRegion::
+classify(const float min[3],const float max[3]) const
+{
+    // the box is outside if its corner farthest along a plane's normal is
+    // behind it, and inside if its nearest corner is in front of all of them
+    bool inside=true;
+    for(int i=0;i<_nPlanes;i++){
+        const float* plane=_planes+4*i;
+        float farthest=plane[3],nearest=plane[3];
+        for(int axis=0;axis<3;axis++){
+            farthest+=plane[axis]*(plane[axis]>0 ? max[axis] : min[axis]);
+            nearest+=plane[axis]*(plane[axis]>0 ? min[axis] : max[axis]);
+        }
+        if(farthest<0) return Outside;
+        inside=inside && nearest>=0;
+    }
+    return inside ? Inside : Partial;
+}
+
+void FrustumRegion::
+contains(const float* const coords[3],int n,unsigned char* inside) const
+{
+    for(int i=0;i<n;i++) inside[i]=1;
+    for(int p=0;p<_nPlanes;p++){
+        const float* plane=_planes+4*p;
+        for(int i=0;i<n;i++)
+            inside[i]&=plane[0]*coords[0][i]+plane[1]*coords[1][i]+plane[2]*coords[2][i]+plane[3]>=0;
+    }
+}
+
+CapsuleRegion::
+CapsuleRegion(const float origin[3],const float direction[3],float radius,float length)
+    :_radius(radius),_length(std::max(length,0.f))
+{
+    float norm=std::sqrt(direction[0]*direction[0]+direction[1]*direction[1]+direction[2]*direction[2]);
+    for(int axis=0;axis<3;axis++){
+        _origin[axis]=origin[axis];
+        _direction[axis]=norm>0 ? direction[axis]/norm : 0;
+    }
+}
+
+void CapsuleRegion::
+bounds(float min[3],float max[3]) const
+{
+    for(int axis=0;axis<3;axis++){
+        float end=_origin[axis]+_direction[axis]*_length;
+        min[axis]=std::min(_origin[axis],end)-_radius;
+        max[axis]=std::max(_origin[axis],end)+_radius;
+    }
+}
+
+QueryRegion::Relation CapsuleRegion::
+classify(const float min[3],const float max[3]) const
+{
+    // every point of the capsule is within radius of the segment along each
+    // axis, so it misses the box if the segment misses the box grown by radius
+    float t0=0,t1=_length;
+    for(int axis=0;axis<3;axis++){
+        const float lo=min[axis]-_radius-_origin[axis],hi=max[axis]+_radius-_origin[axis];
+        if(_direction[axis]==0){
+            if(lo>0 || hi<0) return Outside;
+            continue;
+        }
+        float enter=lo/_direction[axis],exit=hi/_direction[axis];
+        if(enter>exit) std::swap(enter,exit);
+        t0=std::max(t0,enter);
+        t1=std::min(t1,exit);
+        if(t0>t1) return Outside;
+    }
+    return cornersInside(min,max) ? Inside : Partial;
+}
+
+void CapsuleRegion::
+contains(const float* const coords[3],int n,unsigned char* inside) const
+{
+    const float radiusSquared=_radius*_radius;
+    for(int i=0;i<n;i++){
+        float offset[3],t=0;
+        for(int axis=0;axis<3;axis++){
+            offset[axis]=coords[axis][i]-_origin[axis];
+            t+=offset[axis]*_direction[axis];
+        }
+        t=std::min(std::max(t,0.f),_length);
+        float distanceSquared=0;
+        for(int axis=0;axis<3;axis++){
+            float d=offset[axis]-t*_direction[axis];
+            distanceSquared+=d*d;
+        }
+        inside[i]=distanceSquared<=radiusSquared;
+    }
+}
+
+OrientedBoxRegion::
+OrientedBoxRegion(const float center[3],const float axes[9],const float halfExtents[3])
+{
+    for(int i=0;i<3;i++){
+        _center[i]=center[i];
+        _halfExtents[i]=halfExtents[i];
+        for(int axis=0;axis<3;axis++) _axes[i][axis]=axes[3*i+axis];
+    }
+}
+
+void OrientedBoxRegion::
+bounds(float min[3],float max[3]) const
+{
+    for(int axis=0;axis<3;axis++){
+        float extent=0;
+        for(int i=0;i<3;i++) extent+=std::fabs(_axes[i][axis])*_halfExtents[i];
+        min[axis]=_center[axis]-extent;
+        max[axis]=_center[axis]+extent;
+    }
+}
+
+QueryRegion::Relation OrientedBoxRegion::
+classify(const float min[3],const float max[3]) const
+{
+    // separating axis test on the world axes and the box's own axes, the
+    // cross product axes are skipped since Partial is always safe
+    float lo[3],hi[3];
+    bounds(lo,hi);
+    for(int axis=0;axis<3;axis++)
+        if(max[axis]<lo[axis] || min[axis]>hi[axis]) return Outside;
+    for(int i=0;i<3;i++){
+        float center=0,extent=0;
+        for(int axis=0;axis<3;axis++){
+            center+=_axes[i][axis]*((min[axis]+max[axis])*.5f-_center[axis]);
+            extent+=std::fabs(_axes[i][axis])*(max[axis]-min[axis])*.5f;
+        }
+        if(std::fabs(center)>_halfExtents[i]+extent) return Outside;
+    }
+    return cornersInside(min,max) ? Inside : Partial;
+}
+
+void OrientedBoxRegion::
+contains(const float* const coords[3],int n,unsigned char* inside) const
+{
+    for(int i=0;i<n;i++) inside[i]=1;
+    for(int a=0;a<3;a++){
+        const float* u=_axes[a];
+        const float offset=u[0]*_center[0]+u[1]*_center[1]+u[2]*_center[2];
+        for(int i=0;i<n;i++)
+            inside[i]&=std::fabs(u[0]*coords[0][i]+u[1]*coords[1][i]+u[2]*coords[2][i]-offset)<=_halfExtents[a];
+    }
+}
+
+}
@@ -0,0 +1,148 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+#ifndef _QueryRegion_h_
+#define _QueryRegion_h_
+
+namespace Partio{
+
+//! Convex volume searched by SpatialIndex::findPointsInRegion
+/*!
+  Indices prune with classify() on the boxes bounding their subtrees or
+  cells, and test the remaining points a batch at a time with contains().
+*/
+class QueryRegion
+{
+public:
+    enum Relation{Outside=-1,Partial=0,Inside=1};
+
+    virtual ~QueryRegion(){}
+
+    //! Box around the region, may be infinite
+    virtual void bounds(float min[3],float max[3]) const=0;
+    //! Where the box [min,max] lies relative to the region. Partial is always
+    //! a safe answer, it only costs testing the box's points.
+    virtual Relation classify(const float min[3],const float max[3]) const=0;
+    //! Sets inside[i] for the n points (coords[0][i],coords[1][i],coords[2][i])
+    virtual void contains(const float* const coords[3],int n,unsigned char* inside) const=0;
+
+    //! Single point version of contains
+    bool contains(const float p[3]) const;
+
+protected:
+    //! Inside if all corners of the box are, which holds for convex regions
+    bool cornersInside(const float min[3],const float max[3]) const;
+};
+
+//! Axis aligned box from min to max, bounds included
+class BoxRegion:public QueryRegion
+{
+public:
+    BoxRegion(const float min[3],const float max[3]);
+
+    void bounds(float min[3],float max[3]) const;
+    Relation classify(const float min[3],const float max[3]) const;
+    using QueryRegion::contains;
+    void contains(const float* const coords[3],int n,unsigned char* inside) const;
+
+private:
+    float _min[3],_max[3];
+};
+
+//! Points within radius of center
+class SphereRegion:public QueryRegion
+{
+public:
+    SphereRegion(const float center[3],float radius);
+
+    void bounds(float min[3],float max[3]) const;
+    Relation classify(const float min[3],const float max[3]) const;
+    using QueryRegion::contains;
+    void contains(const float* const coords[3],int n,unsigned char* inside) const;
+
+private:
+    float _center[3];
+    float _radius;
+};
+
+//! Intersection of the half spaces a*x+b*y+c*z+d>=0 of nPlanes planes (a,b,c,d)
+class FrustumRegion:public QueryRegion
+{
+public:
+    FrustumRegion(const float* planes,int nPlanes);
+
+    void bounds(float min[3],float max[3]) const;
+    Relation classify(const float min[3],const float max[3]) const;
+    using QueryRegion::contains;
+    void contains(const float* const coords[3],int n,unsigned char* inside) const;
+
+private:
+    const float* _planes;
+    int _nPlanes;
+};
+
+//! Points within radius of the segment from origin to origin+length*direction
+class CapsuleRegion:public QueryRegion
+{
+public:
+    CapsuleRegion(const float origin[3],const float direction[3],float radius,float length);
+
+    void bounds(float min[3],float max[3]) const;
+    Relation classify(const float min[3],const float max[3]) const;
+    using QueryRegion::contains;
+    void contains(const float* const coords[3],int n,unsigned char* inside) const;
+
+private:
+    float _origin[3],_direction[3]; // direction is normalized
+    float _radius,_length;
+};
+
+//! Box of the given half extents along three orthonormal axes, centered at center
+class OrientedBoxRegion:public QueryRegion
+{
+public:
+    //! axes holds the three axes one after another
+    OrientedBoxRegion(const float center[3],const float axes[9],const float halfExtents[3]);
+
+    void bounds(float min[3],float max[3]) const;
+    Relation classify(const float min[3],const float max[3]) const;
+    using QueryRegion::contains;
+    void contains(const float* const coords[3],int n,unsigned char* inside) const;
+
+private:
+    float _center[3],_axes[3][3],_halfExtents[3];
+};
+
+}
+#endif
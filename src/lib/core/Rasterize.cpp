@@ -0,0 +1,246 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+#ifdef PARTIO_WIN32
+#    define NOMINMAX
+#endif
+#include "../Partio.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+namespace Partio{
+
+namespace{
+
+// particles are handed to threads in pieces of this size
+const int64_t Grain=4096;
+// voxels along each side of a tile
+const int TileSize=16;
+// voxels a splat reaches past the tile holding its particle, and the size of
+// a tile's buffer including them
+const int Apron=2;
+const int Padded=TileSize+2*Apron;
+
+// weights of the voxels first, first+1,... along one axis for grid coordinate g,
+// where voxel centers are at integer coordinates
+int splatWeights(const SplatKernel kernel,const float g,int& first,float weights[4])
+{
+    const float base=std::floor(g),t=g-base;
+    switch(kernel){
+        case SplatKernel::Nearest:
+            first=int(std::floor(g+.5f));
+            weights[0]=1;
+            return 1;
+        case SplatKernel::Trilinear:
+            first=int(base);
+            weights[0]=1-t;
+            weights[1]=t;
+            return 2;
+        default:{
+            // uniform cubic B-spline
+            const float s=1-t;
+            first=int(base)-1;
+            weights[0]=s*s*s/6;
+            weights[1]=(3*t*t*t-6*t*t+4)/6;
+            weights[2]=(3*s*s*s-6*s*s+4)/6;
+            weights[3]=t*t*t/6;
+            return 4;
+        }
+    }
+}
+
+}
+
+bool
+rasterize(const ParticlesData& particles,const ParticleAttribute* attribute,const VoxelGrid& grid,
+    const SplatKernel kernel,const SplatReduce reduce,float* values)
+{
+    ParticleAttribute posAttr;
+    if(!particles.attributeInfo("position",posAttr) || (posAttr.type!=VECTOR && posAttr.type!=FLOAT) || posAttr.count!=3){
+        std::cerr<<"Partio: rasterize needs a 3 component float position attribute"<<std::endl;
+        return false;
+    }
+    if(attribute && attribute->type!=VECTOR && attribute->type!=FLOAT){
+        std::cerr<<"Partio: rasterize can only splat float attributes, not "<<attribute->name<<std::endl;
+        return false;
+    }
+    const int* res=grid.resolution;
+    if(res[0]<=0 || res[1]<=0 || res[2]<=0 || !(grid.voxelSize>0) || !values){
+        std::cerr<<"Partio: rasterize given an empty grid"<<std::endl;
+        return false;
+    }
+    const int count=attribute ? attribute->count : 1;
+    const int64_t numVoxels=grid.numVoxels();
+    const bool weighted=reduce!=SplatReduce::Sum;
+    std::vector<float> weights(weighted ? numVoxels : 0);
+    parallelFor(0,numVoxels,Grain*16,[&](int64_t begin,int64_t end){
+        std::fill(values+begin*count,values+end*count,0.f);
+    });
+
+    // bin the particles by the tile holding the voxel below them, dropping
+    // those too far outside the grid to touch it
+    int tiles[3];
+    for(int axis=0;axis<3;axis++) tiles[axis]=(res[axis]+TileSize-1)/TileSize;
+    const int64_t numTiles=int64_t(tiles[0])*tiles[1]*tiles[2];
+    const int64_t n=particles.numParticles();
+    std::vector<int64_t> tileOf(n);
+    parallelFor(0,n,Grain,[&](int64_t begin,int64_t end){
+        for(int64_t i=begin;i<end;i++){
+            const float* p=particles.data<float>(posAttr,i);
+            int64_t tile=0;
+            for(int axis=2;axis>=0;axis--){
+                const float g=(p[axis]-grid.origin[axis])/grid.voxelSize-.5f;
+                if(!(g>=-Apron && g<res[axis]+Apron)){tile=numTiles;break;}
+                tile=tile*tiles[axis]+std::min(std::max(int(std::floor(g)),0),res[axis]-1)/TileSize;
+            }
+            tileOf[i]=tile;
+        }
+    });
+    // counting sort by tile, keeping the particle order within each tile; each
+    // chunk counts into its own row of tiles, so there are few chunks for large grids
+    const int chunks=static_cast<int>(std::max<int64_t>(1,std::min<int64_t>(numThreads(),std::min(n/Grain,n/(numTiles+1)))));
+    std::vector<int64_t> chunkCounts(int64_t(chunks)*(numTiles+1),0);
+    parallelChunks(chunks,[&](int chunk){
+        int64_t* counts=&chunkCounts[chunk*(numTiles+1)];
+        for(int64_t i=n*chunk/chunks;i<n*(chunk+1)/chunks;i++) counts[tileOf[i]]++;
+    });
+    std::vector<int64_t> tileBegins(numTiles+1);
+    int64_t offset=0;
+    for(int64_t tile=0;tile<=numTiles;tile++){
+        tileBegins[tile]=offset;
+        for(int chunk=0;chunk<chunks;chunk++){
+            int64_t& count=chunkCounts[chunk*(numTiles+1)+tile];
+            const int64_t next=offset+count;
+            count=offset;
+            offset=next;
+        }
+    }
+    std::vector<ParticleIndex> order(n);
+    parallelChunks(chunks,[&](int chunk){
+        int64_t* offsets=&chunkCounts[chunk*(numTiles+1)];
+        for(int64_t i=n*chunk/chunks;i<n*(chunk+1)/chunks;i++) order[offsets[tileOf[i]]++]=i;
+    });
+
+    // the buffers of tiles two apart never overlap, so each of the 8 classes of
+    // tiles with the same coordinate parities is splatted in parallel, one class
+    // after another, and merged straight into the grid
+    std::vector<std::vector<int64_t> > classes(8);
+    for(int64_t tile=0;tile<numTiles;tile++){
+        if(tileBegins[tile]==tileBegins[tile+1]) continue;
+        const int64_t tx=tile%tiles[0],ty=tile/tiles[0]%tiles[1],tz=tile/tiles[0]/tiles[1];
+        classes[tx%2+2*(ty%2)+4*(tz%2)].push_back(tile);
+    }
+
+    for(int c=0;c<8;c++){
+        const std::vector<int64_t>& tileList=classes[c];
+        parallelForDynamic(0,int64_t(tileList.size()),1,[&](int64_t begin,int64_t end){
+            std::vector<float> localValues(Padded*Padded*Padded*count),localWeights(Padded*Padded*Padded);
+            for(int64_t t=begin;t<end;t++){
+                const int64_t tile=tileList[t];
+                const int tileCoords[3]={int(tile%tiles[0]),int(tile/tiles[0]%tiles[1]),int(tile/tiles[0]/tiles[1])};
+                int lower[3],upper[3];
+                for(int axis=0;axis<3;axis++){
+                    lower[axis]=std::max(0,tileCoords[axis]*TileSize-Apron);
+                    upper[axis]=std::min(res[axis],(tileCoords[axis]+1)*TileSize+Apron);
+                }
+                std::fill(localValues.begin(),localValues.end(),0.f);
+                std::fill(localWeights.begin(),localWeights.end(),0.f);
+
+                for(int64_t b=tileBegins[tile];b<tileBegins[tile+1];b++){
+                    const ParticleIndex i=order[b];
+                    const float* p=particles.data<float>(posAttr,i);
+                    const float one=1;
+                    const float* value=attribute ? particles.data<float>(*attribute,i) : &one;
+                    int start[3],size[3];
+                    float w[3][4];
+                    for(int axis=0;axis<3;axis++)
+                        size[axis]=splatWeights(kernel,(p[axis]-grid.origin[axis])/grid.voxelSize-.5f,start[axis],w[axis]);
+                    for(int z=0;z<size[2];z++){
+                        const int vz=start[2]+z;
+                        if(vz<lower[2] || vz>=upper[2]) continue;
+                        for(int y=0;y<size[1];y++){
+                            const int vy=start[1]+y;
+                            if(vy<lower[1] || vy>=upper[1]) continue;
+                            for(int x=0;x<size[0];x++){
+                                const int vx=start[0]+x;
+                                const float weight=w[0][x]*w[1][y]*w[2][z];
+                                if(vx<lower[0] || vx>=upper[0] || weight<=0) continue;
+                                const int local=(vx-lower[0])+Padded*((vy-lower[1])+Padded*(vz-lower[2]));
+                                float* accum=&localValues[local*count];
+                                if(reduce!=SplatReduce::Max)
+                                    for(int k=0;k<count;k++) accum[k]+=weight*value[k];
+                                else if(localWeights[local]==0)
+                                    std::copy(value,value+count,accum);
+                                else
+                                    for(int k=0;k<count;k++) accum[k]=std::max(accum[k],value[k]);
+                                localWeights[local]+=weight;
+                            }
+                        }
+                    }
+                }
+
+                for(int vz=lower[2];vz<upper[2];vz++)
+                    for(int vy=lower[1];vy<upper[1];vy++)
+                        for(int vx=lower[0];vx<upper[0];vx++){
+                            const int local=(vx-lower[0])+Padded*((vy-lower[1])+Padded*(vz-lower[2]));
+                            if(localWeights[local]==0) continue;
+                            const int64_t voxel=vx+res[0]*(vy+int64_t(res[1])*vz);
+                            const float* accum=&localValues[local*count];
+                            float* target=values+voxel*count;
+                            if(reduce!=SplatReduce::Max)
+                                for(int k=0;k<count;k++) target[k]+=accum[k];
+                            else if(weights[voxel]==0)
+                                std::copy(accum,accum+count,target);
+                            else
+                                for(int k=0;k<count;k++) target[k]=std::max(target[k],accum[k]);
+                            if(weighted) weights[voxel]+=localWeights[local];
+                        }
+            }
+        });
+    }
+
+    if(reduce==SplatReduce::Mean){
+        parallelFor(0,numVoxels,Grain*16,[&](int64_t begin,int64_t end){
+            for(int64_t voxel=begin;voxel<end;voxel++)
+                if(weights[voxel]>0)
+                    for(int k=0;k<count;k++) values[voxel*count+k]/=weights[voxel];
+        });
+    }
+    return true;
+}
+
+}
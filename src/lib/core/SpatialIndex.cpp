@@ -0,0 +1,869 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+#include "SpatialIndex.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <sys/stat.h>
+#ifdef PARTIO_WIN32
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace Partio{
+
+namespace{
+// batches of queries are handed to threads in pieces of this size
+const int64_t BatchGrain=256;
+// smaller batches are not worth ordering
+const int64_t OrderQueriesSize=4096;
+// appended points are put in their own tree once this many accumulate
+const int64_t AppendedRunSize=1024;
+
+// start of files written by KdTreeIndex::save, followed by each run's first
+// particle (an int64_t) and tree. Everything stays 8 byte aligned.
+struct IndexFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t runs;
+    int64_t indexedCount,count;
+    int64_t sourceSize,sourceTime; // zero when saved without a source file
+};
+const char IndexFileMagic[8]={'P','I','N','D','E','X','\r','\n'};
+const uint32_t IndexFileVersion=1;
+
+// distances from a box (or point) to the findOverlapping query shapes
+struct BoxShape
+{
+    const float* min;
+    const float* max;
+    float distance(const float lo[3],const float hi[3]) const
+    {
+        float distanceSquared=0;
+        for(int axis=0;axis<3;axis++){
+            float d=std::max(std::max(min[axis]-hi[axis],lo[axis]-max[axis]),0.f);
+            distanceSquared+=d*d;
+        }
+        return std::sqrt(distanceSquared);
+    }
+};
+
+struct SphereShape
+{
+    const float* center;
+    float radius;
+    float distance(const float lo[3],const float hi[3]) const
+    {
+        float distanceSquared=0;
+        for(int axis=0;axis<3;axis++){
+            float d=std::max(std::max(lo[axis]-center[axis],center[axis]-hi[axis]),0.f);
+            distanceSquared+=d*d;
+        }
+        return std::max(std::sqrt(distanceSquared)-radius,0.f);
+    }
+};
+
+bool sourceStamp(const char* filename,int64_t& size,int64_t& time)
+{
+    struct stat info;
+    if(stat(filename,&info)!=0) return false;
+    size=info.st_size;
+    time=info.st_mtime;
+    return true;
+}
+
+const char* mapFile(const char* filename,size_t& bytes)
+{
+#ifdef PARTIO_WIN32
+    std::ifstream in(filename,std::ios::binary|std::ios::ate);
+    if(!in) return 0;
+    bytes=size_t(in.tellg());
+    char* data=new char[bytes+1];
+    in.seekg(0);
+    if(!in.read(data,bytes)){
+        delete[] data;
+        return 0;
+    }
+    return data;
+#else
+    int fd=open(filename,O_RDONLY);
+    if(fd<0) return 0;
+    void* data=MAP_FAILED;
+    struct stat info;
+    if(fstat(fd,&info)==0 && info.st_size>0){
+        bytes=info.st_size;
+        data=mmap(0,bytes,PROT_READ,MAP_SHARED,fd,0);
+    }
+    close(fd);
+    return data==MAP_FAILED?0:static_cast<const char*>(data);
+#endif
+}
+
+void unmapFile(const char* data,size_t bytes)
+{
+#ifdef PARTIO_WIN32
+    (void)bytes;
+    delete[] data;
+#else
+    munmap(const_cast<char*>(data),bytes);
+#endif
+}
+}
+
+SpatialIndex::
+SpatialIndex()
+    :_indexedCount(0),_count(0),_positionAttribute(-1)
+{}
+
+SpatialIndex::AppendedBatch::
+AppendedBatch(int64_t first,int64_t count,const char* data,size_t stride)
+    :first(first),count(count),data(data),stride(stride),copied(data==0)
+{}
+
+void SpatialIndex::AppendedBatch::
+copy()
+{
+    if(copied.load(std::memory_order_acquire)) return;
+    std::unique_lock<std::shared_timed_mutex> lock(reading);
+    if(!data) return;
+    positions.resize(3*count);
+    for(int64_t i=0;i<count;i++){
+        const float* p=reinterpret_cast<const float*>(data+i*stride);
+        std::copy(p,p+3,&positions[3*i]);
+    }
+    data=0;
+    copied.store(true,std::memory_order_release);
+}
+
+SpatialIndex* SpatialIndex::
+appended(const float* p,size_t stride,int64_t n) const
+{
+    SpatialIndex* index=clone();
+    index->appendPoints(p,stride,n);
+    return index;
+}
+
+void SpatialIndex::
+appendPoints(const float* p,size_t stride,int64_t n)
+{
+    if(n<=_count) return;
+    // the points added before have their positions by now, copy them out of the set
+    if(!_appended.empty()) _appended.back()->copy();
+    if(_count-_indexedCount>=appendedLimit()) indexAllAppended();
+    // like KdTreeIndex's runs, a batch is merged with the one before it once it grows to half its size
+    while(_appended.size()>1 && 2*_appended.back()->count>=_appended[_appended.size()-2]->count){
+        const AppendedBatch& before=*_appended[_appended.size()-2];
+        const AppendedBatch& last=*_appended.back();
+        std::shared_ptr<AppendedBatch> merged=std::make_shared<AppendedBatch>(before.first,before.count+last.count,
+            static_cast<const char*>(0),0);
+        merged->positions.reserve(3*merged->count);
+        merged->positions.insert(merged->positions.end(),before.positions.begin(),before.positions.end());
+        merged->positions.insert(merged->positions.end(),last.positions.begin(),last.positions.end());
+        _appended.pop_back();
+        _appended.back()=merged;
+    }
+    _appended.push_back(std::make_shared<AppendedBatch>(_count,n-_count,reinterpret_cast<const char*>(p)+_count*stride,
+        stride));
+    _count=n;
+}
+
+void SpatialIndex::
+indexAllAppended()
+{
+    if(!hasAppended()) return;
+    indexAppended();
+    _appended.clear();
+    _indexedCount=_count;
+}
+
+void SpatialIndex::
+detachPoints()
+{
+    if(!_appended.empty()) _appended.back()->copy();
+}
+
+void SpatialIndex::
+findAppendedPoints(const float bboxMin[3],const float bboxMax[3],std::vector<ParticleIndex>& points) const
+{
+    forEachAppended([&](int64_t i,const float* p){
+        bool inside=true;
+        for(int axis=0;axis<3;axis++) inside=inside && p[axis]>=bboxMin[axis] && p[axis]<=bboxMax[axis];
+        if(inside) points.push_back(i);
+        return true;
+    });
+}
+
+void SpatialIndex::
+findAppendedPointsInRegion(const QueryRegion& region,std::vector<ParticleIndex>& points) const
+{
+    forEachAppended([&](int64_t i,const float* p){
+        if(region.contains(p)) points.push_back(i);
+        return true;
+    });
+}
+
+void SpatialIndex::
+findAppendedPointsInRadius(const float center[3],const float radiusSquared,std::vector<ParticleIndex>& points,
+    std::vector<float>& pointDistancesSquared) const
+{
+    forEachAppended([&](int64_t i,const float* p){
+        float distanceSquared=0;
+        for(int axis=0;axis<3;axis++) distanceSquared+=(p[axis]-center[axis])*(p[axis]-center[axis]);
+        if(distanceSquared<=radiusSquared){
+            points.push_back(i);
+            pointDistancesSquared.push_back(distanceSquared);
+        }
+        return true;
+    });
+}
+
+void SpatialIndex::
+findAppendedNPoints(const float center[3],int nPoints,ParticleIndex* points,float* pointDistancesSquared,
+    int& found,float& maxRadiusSquared) const
+{
+    forEachAppended([&](int64_t i,const float* p){
+        float distanceSquared=0;
+        for(int axis=0;axis<3;axis++) distanceSquared+=(p[axis]-center[axis])*(p[axis]-center[axis]);
+        insertNearest(i,distanceSquared,nPoints,points,pointDistancesSquared,found,maxRadiusSquared);
+        return true;
+    });
+}
+
+bool SpatialIndex::
+visitAppendedInBox(const float bboxMin[3],const float bboxMax[3],PointVisitor& visitor) const
+{
+    return forEachAppended([&](int64_t i,const float* p){
+        bool inside=true;
+        for(int axis=0;axis<3;axis++) inside=inside && p[axis]>=bboxMin[axis] && p[axis]<=bboxMax[axis];
+        return !inside || visitor.visit(i,0);
+    });
+}
+
+bool SpatialIndex::
+visitAppendedInRadius(const float center[3],const float radiusSquared,PointVisitor& visitor) const
+{
+    return forEachAppended([&](int64_t i,const float* p){
+        float distanceSquared=0;
+        for(int axis=0;axis<3;axis++) distanceSquared+=(p[axis]-center[axis])*(p[axis]-center[axis]);
+        return distanceSquared>radiusSquared || visitor.visit(i,distanceSquared);
+    });
+}
+
+int64_t SpatialIndex::
+countAppendedInRegion(const QueryRegion& region) const
+{
+    int64_t count=0;
+    forEachAppended([&](int64_t,const float* p){
+        if(region.contains(p)) count++;
+        return true;
+    });
+    return count;
+}
+
+void SpatialIndex::
+sortByDistance(ParticleIndex* points,float* pointDistancesSquared,size_t count)
+{
+    std::vector<std::pair<float,ParticleIndex> > order(count);
+    for(size_t i=0;i<count;i++) order[i]=std::make_pair(pointDistancesSquared[i],points[i]);
+    std::sort(order.begin(),order.end());
+    for(size_t i=0;i<count;i++){
+        pointDistancesSquared[i]=order[i].first;
+        points[i]=order[i].second;
+    }
+}
+
+float SpatialIndex::
+findNPoints(const float center[3],int nPoints,const float maxRadius,
+    std::vector<ParticleIndex>& points,std::vector<float>& pointDistancesSquared) const
+{
+    points.resize(std::max(nPoints,0));
+    pointDistancesSquared.resize(std::max(nPoints,0));
+    float finalRadius2=maxRadius*maxRadius;
+    int count=points.empty() ? 0 : findNPoints(center,nPoints,maxRadius,&points[0],&pointDistancesSquared[0],&finalRadius2);
+    points.resize(count);
+    pointDistancesSquared.resize(count);
+    return maxRadius;
+}
+
+void SpatialIndex::
+findNPointsBatch(const float* queries,int64_t nQueries,int nPoints,const float maxRadius,
+    ParticleIndex* outIndices,float* outDistancesSquared,int* outCounts,bool sortQueries) const
+{
+    std::vector<uint64_t> order;
+    if(sortQueries && nQueries>=OrderQueriesSize) orderQueries(queries,nQueries,order);
+
+    parallelForDynamic(0,nQueries,BatchGrain,[&](int64_t begin,int64_t end){
+        float finalRadius2;
+        for(int64_t i=begin;i<end;i++){
+            int64_t q=order.empty() ? i : static_cast<int64_t>(order[i]);
+            outCounts[q]=findNPoints(queries+3*q,nPoints,maxRadius,outIndices+q*nPoints,outDistancesSquared+q*nPoints,&finalRadius2);
+        }
+    });
+}
+
+void SpatialIndex::
+findNPointsSeeded(const float* queries,int64_t nQueries,int nPoints,const float maxRadius,
+    const ParticleIndex* seedIndices,const int* seedCounts,const ParticlesData& particles,
+    ParticleIndex* outIndices,float* outDistancesSquared,int* outCounts,bool sortQueries) const
+{
+    std::vector<uint64_t> order;
+    if(sortQueries && nQueries>=OrderQueriesSize) orderQueries(queries,nQueries,order);
+
+    ParticleAttribute position;
+    particles.attributeInfo(_positionAttribute,position);
+    parallelForDynamic(0,nQueries,BatchGrain,[&](int64_t begin,int64_t end){
+        std::vector<ParticleIndex> seeds(std::max(nPoints,0));
+        float finalRadius2;
+        for(int64_t i=begin;i<end;i++){
+            int64_t q=order.empty() ? i : static_cast<int64_t>(order[i]);
+            const float* center=queries+3*q;
+            // copy the seeds first since the results may overwrite them
+            int count=0;
+            for(int s=0;s<std::min(seedCounts[q],nPoints);s++){
+                ParticleIndex seed=seedIndices[q*nPoints+s];
+                if(seed<ParticleIndex(_count)) seeds[count++]=seed;
+            }
+            std::sort(seeds.begin(),seeds.begin()+count);
+            count=int(std::unique(seeds.begin(),seeds.begin()+count)-seeds.begin());
+
+            // nPoints points lie within the farthest seed, so the nearest ones do too. The
+            // radius is padded since findNPoints only keeps points strictly inside it.
+            float radius=maxRadius;
+            if(count==nPoints){
+                float farthest=0;
+                for(int s=0;s<count;s++){
+                    const float* p=particles.data<float>(position,seeds[s]);
+                    float distanceSquared=0;
+                    for(int axis=0;axis<3;axis++) distanceSquared+=(p[axis]-center[axis])*(p[axis]-center[axis]);
+                    farthest=std::max(farthest,distanceSquared);
+                }
+                if(farthest>0) radius=std::min(radius,std::sqrt(farthest)*1.0001f);
+            }
+            outCounts[q]=findNPoints(center,nPoints,radius,outIndices+q*nPoints,outDistancesSquared+q*nPoints,&finalRadius2);
+        }
+    });
+}
+
+void SpatialIndex::
+findPointsInRadiusBatch(const float* queries,int64_t nQueries,const float radius,
+    std::vector<int64_t>& offsets,std::vector<ParticleIndex>& points,std::vector<float>& pointDistancesSquared,
+    bool sorted) const
+{
+    std::vector<uint64_t> order;
+    if(nQueries>=OrderQueriesSize) orderQueries(queries,nQueries,order);
+
+    // each block of queries collects its rows separately, then they are copied into place
+    struct Block{
+        std::vector<ParticleIndex> points;
+        std::vector<float> distancesSquared;
+    };
+    std::vector<Block> blocks((nQueries+BatchGrain-1)/BatchGrain);
+    offsets.assign(nQueries+1,0);
+    parallelForDynamic(0,nQueries,BatchGrain,[&](int64_t begin,int64_t end){
+        Block& block=blocks[begin/BatchGrain];
+        for(int64_t i=begin;i<end;i++){
+            int64_t q=order.empty() ? i : static_cast<int64_t>(order[i]);
+            size_t start=block.points.size();
+            findPointsInRadius(queries+3*q,radius,block.points,block.distancesSquared,sorted);
+            offsets[q+1]=static_cast<int64_t>(block.points.size()-start);
+        }
+    });
+
+    for(int64_t q=0;q<nQueries;q++) offsets[q+1]+=offsets[q];
+    points.resize(offsets[nQueries]);
+    pointDistancesSquared.resize(offsets[nQueries]);
+    parallelFor(0,static_cast<int64_t>(blocks.size()),1,[&](int64_t begin,int64_t end){
+        for(int64_t b=begin;b<end;b++){
+            size_t start=0;
+            for(int64_t i=b*BatchGrain;i<std::min(nQueries,(b+1)*BatchGrain);i++){
+                int64_t q=order.empty() ? i : static_cast<int64_t>(order[i]);
+                size_t count=static_cast<size_t>(offsets[q+1]-offsets[q]);
+                std::copy(blocks[b].points.begin()+start,blocks[b].points.begin()+start+count,points.begin()+offsets[q]);
+                std::copy(blocks[b].distancesSquared.begin()+start,blocks[b].distancesSquared.begin()+start+count,
+                    pointDistancesSquared.begin()+offsets[q]);
+                start+=count;
+            }
+        }
+    });
+}
+
+bool SpatialIndex::
+save(const char*,const char*) const
+{
+    std::cerr<<"Partio: saveIndex is only supported for the KdTree index"<<std::endl;
+    return false;
+}
+
+KdTreeIndex::
+KdTreeIndex()
+{
+    _runs.push_back(std::make_shared<Run>());
+    _runs[0]->first=0;
+}
+
+void KdTreeIndex::
+build(const float* p,int64_t n,size_t stride,bool inPlace)
+{
+    // build over the caller's points in place, the tree only copies them once they are in tree order
+    KdTree<3>& tree=_runs[0]->tree;
+    tree.referencePoints(p,n,stride);
+    tree.sort();
+    if(!inPlace) tree.detachPoints();
+    setIndexed(n);
+}
+
+void KdTreeIndex::
+detachPoints()
+{
+    SpatialIndex::detachPoints();
+    for(size_t r=0;r<_runs.size();r++) _runs[r]->tree.detachPoints();
+}
+
+bool KdTreeIndex::
+save(const char* filename,const char* sourceFile) const
+{
+    IndexFileHeader header;
+    memset(&header,0,sizeof(header));
+    memcpy(header.magic,IndexFileMagic,sizeof(header.magic));
+    header.version=IndexFileVersion;
+    header.runs=uint32_t(_runs.size());
+    header.indexedCount=indexedCount();
+    header.count=numPoints();
+    if(sourceFile && !sourceStamp(sourceFile,header.sourceSize,header.sourceTime)){
+        std::cerr<<"Partio: saveIndex, failed to stat "<<sourceFile<<std::endl;
+        return false;
+    }
+
+    // other processes may be loading filename, so replace it in one step
+    std::ostringstream temporary;
+    temporary<<filename<<".tmp"<<getpid();
+    bool ok;
+    {
+        std::ofstream out(temporary.str().c_str(),std::ios::out|std::ios::binary);
+        ok=bool(out);
+        if(ok) out.write(reinterpret_cast<const char*>(&header),sizeof(header));
+        for(size_t r=0;ok && r<_runs.size();r++){
+            out.write(reinterpret_cast<const char*>(&_runs[r]->first),sizeof(int64_t));
+            ok=_runs[r]->tree.save(out);
+        }
+        out.close();
+        ok=ok && bool(out);
+    }
+#ifdef PARTIO_WIN32
+    if(ok) std::remove(filename);
+#endif
+    if(ok) ok=std::rename(temporary.str().c_str(),filename)==0;
+    if(!ok){
+        std::remove(temporary.str().c_str());
+        std::cerr<<"Partio: saveIndex, failed to write "<<filename<<std::endl;
+    }
+    return ok;
+}
+
+KdTreeIndex* KdTreeIndex::
+load(const char* filename,const ParticlesData& particles,const ParticleAttribute& position,const char* sourceFile)
+{
+    const int64_t count=particles.numParticles();
+    size_t bytes=0;
+    const char* data=mapFile(filename,bytes);
+    if(!data){
+        std::cerr<<"Partio: loadIndex, failed to open "<<filename<<std::endl;
+        return 0;
+    }
+
+    const char* error=0;
+    IndexFileHeader header;
+    int64_t sourceSize=0,sourceTime=0;
+    if(bytes<sizeof(header)) error="is not an index file";
+    else{
+        memcpy(&header,data,sizeof(header));
+        if(memcmp(header.magic,IndexFileMagic,sizeof(header.magic))!=0) error="is not an index file";
+        else if(header.version!=IndexFileVersion || header.runs<1) error="has an unsupported version";
+        else if(header.count!=count) error="was saved for a different number of particles";
+        else if(sourceFile && (!sourceStamp(sourceFile,sourceSize,sourceTime)
+                || sourceSize!=header.sourceSize || sourceTime!=header.sourceTime))
+            error="is out of date";
+    }
+    if(error){
+        unmapFile(data,bytes);
+        std::cerr<<"Partio: loadIndex, "<<filename<<" "<<error<<std::endl;
+        return 0;
+    }
+
+    KdTreeIndex* index=new KdTreeIndex();
+    index->_mapped=std::shared_ptr<const char>(data,[bytes](const char* p){unmapFile(p,bytes);});
+    index->_runs.clear();
+    size_t offset=sizeof(header);
+    int64_t end=0;
+    for(uint32_t r=0;r<header.runs;r++){
+        std::shared_ptr<Run> run=std::make_shared<Run>();
+        index->_runs.push_back(run);
+        size_t used=0;
+        if(offset+sizeof(int64_t)<=bytes){
+            memcpy(&run->first,data+offset,sizeof(int64_t));
+            used=run->tree.view(data+offset+sizeof(int64_t),bytes-offset-sizeof(int64_t));
+        }
+        // runs must cover consecutive particles, and their ids index per particle arrays
+        if(!used || run->first!=end || !run->tree.idsInRange()){
+            delete index;
+            std::cerr<<"Partio: loadIndex, "<<filename<<" is truncated or corrupt"<<std::endl;
+            return 0;
+        }
+        offset+=sizeof(int64_t)+used;
+        end+=run->tree.size();
+    }
+    if(end!=header.indexedCount || end>count){
+        delete index;
+        std::cerr<<"Partio: loadIndex, "<<filename<<" is truncated or corrupt"<<std::endl;
+        return 0;
+    }
+    // the points saved as appended are indexed from the particles now
+    if(end<count){
+        const int blockSize=4096;
+        std::vector<float> positions(3*(count-end));
+        std::vector<ParticleIndex> block(blockSize);
+        for(int64_t first=end;first<count;first+=blockSize){
+            const int n=static_cast<int>(std::min<int64_t>(blockSize,count-first));
+            for(int i=0;i<n;i++) block[i]=first+i;
+            particles.dataAsFloat(position,n,&block[0],true,&positions[3*(first-end)]);
+        }
+        index->addRun(end,&positions[0],count-end);
+    }
+    index->setIndexed(count);
+    index->setPositionAttribute(position.attributeIndex);
+    return index;
+}
+
+int64_t KdTreeIndex::
+appendedLimit() const
+{
+    return AppendedRunSize;
+}
+
+void KdTreeIndex::
+indexAppended()
+{
+    _sums.clear();
+    _radii.reset();
+    const int64_t first=indexedCount(),count=numPoints()-indexedCount();
+    std::vector<float> positions(3*count);
+    forEachAppended([&](int64_t i,const float* p){
+        std::copy(p,p+3,&positions[3*(i-first)]);
+        return true;
+    });
+    addRun(first,&positions[0],count);
+}
+
+void KdTreeIndex::
+addRun(int64_t first,const float* positions,int64_t count)
+{
+    std::shared_ptr<Run> run=std::make_shared<Run>();
+    run->first=first;
+    run->tree.setPoints(positions,count);
+    run->tree.sort();
+    _runs.push_back(run);
+    while(_runs.size()>1 && 2*_runs.back()->tree.size()>=_runs[_runs.size()-2]->tree.size()) mergeLastRuns();
+}
+
+void KdTreeIndex::
+mergeLastRuns()
+{
+    // the two runs cover consecutive particles, gather them back in particle order
+    std::shared_ptr<Run> last=_runs.back();_runs.pop_back();
+    std::shared_ptr<Run> run=_runs.back();
+    const int64_t count=run->tree.size()+last->tree.size();
+    std::vector<float> positions(3*count);
+    const Run* sources[2]={run.get(),last.get()};
+    for(int s=0;s<2;s++){
+        const Run& source=*sources[s];
+        const int64_t offset=source.first-run->first;
+        parallelFor(0,source.tree.size(),1<<15,[&](int64_t begin,int64_t end){
+            for(int64_t i=begin;i<end;i++){
+                float* p=&positions[3*(offset+source.tree.id(i))];
+                for(int axis=0;axis<3;axis++) p[axis]=source.tree.coord(i,axis);
+            }
+        });
+    }
+    std::shared_ptr<Run> merged=std::make_shared<Run>();
+    merged->first=run->first;
+    merged->tree.setPoints(&positions[0],count);
+    merged->tree.sort();
+    _runs.back()=merged;
+}
+
+void KdTreeIndex::
+findPoints(const float bboxMin[3],const float bboxMax[3],std::vector<ParticleIndex>& points) const
+{
+    BBox<3> box(bboxMin);box.grow(bboxMax);
+
+    for(size_t r=0;r<_runs.size();r++){
+        const Run& run=*_runs[r];
+        size_t startIndex=points.size();
+        run.tree.findPoints(points,box);
+        // remap points found in findPoints to original index space
+        for(size_t i=startIndex;i<points.size();i++) points[i]=run.first+run.tree.id(points[i]);
+    }
+    findAppendedPoints(bboxMin,bboxMax,points);
+}
+
+void KdTreeIndex::
+findPointsInRegion(const QueryRegion& region,std::vector<ParticleIndex>& points) const
+{
+    for(size_t r=0;r<_runs.size();r++){
+        const Run& run=*_runs[r];
+        size_t startIndex=points.size();
+        run.tree.findPointsInRegion(points,region);
+        for(size_t i=startIndex;i<points.size();i++) points[i]=run.first+run.tree.id(points[i]);
+    }
+    findAppendedPointsInRegion(region,points);
+}
+
+bool KdTreeIndex::
+forEachInBox(const float bboxMin[3],const float bboxMax[3],PointVisitor& visitor) const
+{
+    BBox<3> box(bboxMin);box.grow(bboxMax);
+
+    for(size_t r=0;r<_runs.size();r++){
+        const Run& run=*_runs[r];
+        if(!run.tree.forEachInBox(box,[&](uint64_t i){return visitor.visit(run.first+run.tree.id(i),0);}))
+            return false;
+    }
+    return visitAppendedInBox(bboxMin,bboxMax,visitor);
+}
+
+bool KdTreeIndex::
+forEachInRadius(const float center[3],const float radius,PointVisitor& visitor) const
+{
+    for(size_t r=0;r<_runs.size();r++){
+        const Run& run=*_runs[r];
+        if(!run.tree.forEachInRadius(center,radius,[&](uint64_t i,float distanceSquared){
+            return visitor.visit(run.first+run.tree.id(i),distanceSquared);}))
+            return false;
+    }
+    return visitAppendedInRadius(center,radius*radius,visitor);
+}
+
+int64_t KdTreeIndex::
+countInRegion(const QueryRegion& region) const
+{
+    int64_t count=0;
+    for(size_t r=0;r<_runs.size();r++){
+        _runs[r]->tree.forEachRangeInRegion(region,[&](int64_t begin,int64_t end){
+            count+=end-begin;
+            return true;
+        });
+    }
+    return count+countAppendedInRegion(region);
+}
+
+SpatialIndex* KdTreeIndex::
+augmented(const char* name,const float* values,int count) const
+{
+    if(count<1) return 0;
+    KdTreeIndex* index=new KdTreeIndex(*this);
+    index->indexAllAppended();
+    std::shared_ptr<Sums> sums=std::make_shared<Sums>();
+    sums->count=count;
+    sums->prefix.resize(index->_runs.size());
+    for(size_t r=0;r<index->_runs.size();r++){
+        const Run& run=*index->_runs[r];
+        std::vector<double>& prefix=sums->prefix[r];
+        prefix.assign((run.tree.size()+1)*count,0);
+        for(int64_t i=0;i<run.tree.size();i++){
+            const float* value=values+(run.first+run.tree.id(i))*count;
+            for(int c=0;c<count;c++) prefix[(i+1)*count+c]=prefix[i*count+c]+value[c];
+        }
+    }
+    index->_sums[name]=sums;
+    return index;
+}
+
+int64_t KdTreeIndex::
+sumInRegion(const QueryRegion& region,const char* name,double* sums) const
+{
+    std::map<std::string,std::shared_ptr<const Sums> >::const_iterator it=_sums.find(name);
+    if(it==_sums.end() || hasAppended()) return -1;
+    const Sums& stored=*it->second;
+    const int count=stored.count;
+    for(int c=0;c<count;c++) sums[c]=0;
+    int64_t found=0;
+    for(size_t r=0;r<_runs.size();r++){
+        const std::vector<double>& prefix=stored.prefix[r];
+        _runs[r]->tree.forEachRangeInRegion(region,[&](int64_t begin,int64_t end){
+            found+=end-begin;
+            for(int c=0;c<count;c++) sums[c]+=prefix[end*count+c]-prefix[begin*count+c];
+            return true;
+        });
+    }
+    return found;
+}
+
+bool KdTreeIndex::
+hasRadii() const
+{
+    return _radii && !hasAppended();
+}
+
+SpatialIndex* KdTreeIndex::
+withRadii(const float* radii) const
+{
+    KdTreeIndex* index=new KdTreeIndex(*this);
+    index->indexAllAppended();
+    std::shared_ptr<Radii> stored=std::make_shared<Radii>();
+    stored->radii.resize(index->_runs.size());
+    stored->maxRadii.resize(index->_runs.size());
+    for(size_t r=0;r<index->_runs.size();r++){
+        const Run& run=*index->_runs[r];
+        std::vector<float>& runRadii=stored->radii[r];
+        runRadii.resize(run.tree.size());
+        stored->maxRadii[r].resize(run.tree.size());
+        for(int64_t i=0;i<run.tree.size();i++) runRadii[i]=radii[run.first+run.tree.id(i)];
+        run.tree.subtreeMaxima(runRadii.data(),stored->maxRadii[r].data());
+    }
+    index->_radii=stored;
+    return index;
+}
+
+bool KdTreeIndex::
+findOverlapping(const float bboxMin[3],const float bboxMax[3],std::vector<ParticleIndex>& points) const
+{
+    if(!hasRadii()) return false;
+    const BoxShape box={bboxMin,bboxMax};
+    for(size_t r=0;r<_runs.size();r++){
+        const Run& run=*_runs[r];
+        run.tree.forEachOverlapping(box,_radii->radii[r].data(),_radii->maxRadii[r].data(),[&](uint64_t i){
+            points.push_back(run.first+run.tree.id(i));
+            return true;
+        });
+    }
+    return true;
+}
+
+bool KdTreeIndex::
+findOverlappingInRadius(const float center[3],const float radius,std::vector<ParticleIndex>& points) const
+{
+    if(!hasRadii()) return false;
+    const SphereShape sphere={center,radius};
+    for(size_t r=0;r<_runs.size();r++){
+        const Run& run=*_runs[r];
+        run.tree.forEachOverlapping(sphere,_radii->radii[r].data(),_radii->maxRadii[r].data(),[&](uint64_t i){
+            points.push_back(run.first+run.tree.id(i));
+            return true;
+        });
+    }
+    return true;
+}
+
+int KdTreeIndex::
+findNPoints(const float center[3],int nPoints,const float maxRadius,
+    ParticleIndex* points,float* pointDistancesSquared,float* finalRadius2) const
+{
+    return findNPointsApprox(center,nPoints,maxRadius,0,0,points,pointDistancesSquared,finalRadius2);
+}
+
+int KdTreeIndex::
+findNPointsApprox(const float center[3],int nPoints,const float maxRadius,const float epsilon,
+    const int maxVisited,ParticleIndex* points,float* pointDistancesSquared,float* finalRadius2) const
+{
+    if(nPoints<1) return 0;
+    float maxRadiusSquared=maxRadius*maxRadius;
+    int found=_runs[0]->tree.findNPoints(points,pointDistancesSquared,&maxRadiusSquared,center,nPoints,maxRadius,
+        epsilon,maxVisited);
+    for(int i=0;i<found;i++) points[i]=_runs[0]->tree.id(points[i]);
+
+    if(_runs.size()>1){
+        // later runs only need to look as far as the current farthest point, the
+        // radius is padded since insertNearest makes the exact comparison
+        std::vector<ParticleIndex> runPoints(nPoints);
+        std::vector<float> runDistancesSquared(nPoints);
+        for(size_t r=1;r<_runs.size();r++){
+            const Run& run=*_runs[r];
+            float runRadius2;
+            int runFound=run.tree.findNPoints(&runPoints[0],&runDistancesSquared[0],&runRadius2,center,nPoints,
+                std::sqrt(maxRadiusSquared)*1.0001f,epsilon,maxVisited);
+            for(int i=0;i<runFound;i++)
+                insertNearest(run.first+run.tree.id(runPoints[i]),runDistancesSquared[i],nPoints,points,
+                    pointDistancesSquared,found,maxRadiusSquared);
+        }
+    }
+    findAppendedNPoints(center,nPoints,points,pointDistancesSquared,found,maxRadiusSquared);
+    *finalRadius2=maxRadiusSquared;
+    return found;
+}
+
+void KdTreeIndex::
+findPointsInRadius(const float center[3],const float radius,std::vector<ParticleIndex>& points,
+    std::vector<float>& pointDistancesSquared,bool sorted) const
+{
+    size_t startIndex=points.size();
+    for(size_t r=0;r<_runs.size();r++){
+        const Run& run=*_runs[r];
+        size_t runStart=points.size();
+        run.tree.findPointsInRadius(points,pointDistancesSquared,center,radius,sorted && single());
+        for(size_t i=runStart;i<points.size();i++) points[i]=run.first+run.tree.id(points[i]);
+    }
+    findAppendedPointsInRadius(center,radius*radius,points,pointDistancesSquared);
+    if(sorted && !single() && points.size()>startIndex)
+        sortByDistance(&points[startIndex],&pointDistancesSquared[startIndex],points.size()-startIndex);
+}
+
+void KdTreeIndex::
+findNPointsBatch(const float* queries,int64_t nQueries,int nPoints,const float maxRadius,
+    ParticleIndex* outIndices,float* outDistancesSquared,int* outCounts,bool sortQueries) const
+{
+    if(single()) _runs[0]->tree.findNPointsBatch(queries,nQueries,nPoints,maxRadius,outIndices,outDistancesSquared,outCounts,sortQueries);
+    else SpatialIndex::findNPointsBatch(queries,nQueries,nPoints,maxRadius,outIndices,outDistancesSquared,outCounts,sortQueries);
+}
+
+void KdTreeIndex::
+findPointsInRadiusBatch(const float* queries,int64_t nQueries,const float radius,
+    std::vector<int64_t>& offsets,std::vector<ParticleIndex>& points,std::vector<float>& pointDistancesSquared,
+    bool sorted) const
+{
+    if(single()) _runs[0]->tree.findPointsInRadiusBatch(queries,nQueries,radius,offsets,points,pointDistancesSquared,sorted);
+    else SpatialIndex::findPointsInRadiusBatch(queries,nQueries,radius,offsets,points,pointDistancesSquared,sorted);
+}
+
+}
@@ -0,0 +1,374 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+#ifndef _SpatialIndex_h_
+#define _SpatialIndex_h_
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "../Partio.h"
+#include "KdTree.h"
+#include "QueryRegion.h"
+
+namespace Partio{
+
+//! Acceleration structure behind the particle set's neighbor queries
+/*!
+  All queries take and return particle indices (never internal orders), with
+  the same semantics as the ParticlesData methods of the same name. The
+  batched queries default to running the single queries in parallel, in the
+  order given by orderQueries().
+
+  An index is not changed once published. Particles appended to the set
+  after it was built make a new index with appended(), which shares the
+  built parts with this one. They are searched by brute force until enough
+  accumulate, and then the copy indexes them with indexAppended(). The
+  particles added last are read from the set's memory until the next
+  appended() or detachPoints() copies them, so an index never reads memory
+  the set has moved or freed, even in queries still running on it.
+*/
+class SpatialIndex
+{
+public:
+    SpatialIndex();
+    virtual ~SpatialIndex(){}
+
+    virtual void findPoints(const float bboxMin[3],const float bboxMax[3],std::vector<ParticleIndex>& points) const=0;
+    virtual int findNPoints(const float center[3],int nPoints,const float maxRadius,
+        ParticleIndex* points,float* pointDistancesSquared,float* finalRadius2) const=0;
+    virtual void findPointsInRadius(const float center[3],const float radius,std::vector<ParticleIndex>& points,
+        std::vector<float>& pointDistancesSquared,bool sorted) const=0;
+    //! Appends the points inside region
+    virtual void findPointsInRegion(const QueryRegion& region,std::vector<ParticleIndex>& points) const=0;
+    virtual bool forEachInBox(const float bboxMin[3],const float bboxMax[3],PointVisitor& visitor) const=0;
+    virtual bool forEachInRadius(const float center[3],const float radius,PointVisitor& visitor) const=0;
+    //! Number of points inside region
+    virtual int64_t countInRegion(const QueryRegion& region) const=0;
+
+    //! Returns a new index that also keeps per subtree sums of the values of
+    //! attribute name, count floats per point starting at values+i*count, for
+    //! sumInRegion. This index is left unchanged for the queries still using
+    //! it. Returns 0 if the index cannot aggregate, only KdTreeIndex does.
+    virtual SpatialIndex* augmented(const char*,const float*,int) const {return 0;}
+    //! Sets the count sums of name's values over the points inside region
+    //! and returns how many there are, or -1 without sums for name
+    virtual int64_t sumInRegion(const QueryRegion&,const char*,double*) const {return -1;}
+
+    //! Returns a new index that also keeps the radius of each point,
+    //! radii[i], for the findOverlapping queries, leaving this one unchanged.
+    //! Returns 0 if the index cannot, only KdTreeIndex does.
+    virtual SpatialIndex* withRadii(const float*) const {return 0;}
+    //! Appends the points whose sphere touches the box, or returns false without radii
+    virtual bool findOverlapping(const float[3],const float[3],std::vector<ParticleIndex>&) const {return false;}
+    //! Appends the points whose sphere touches the sphere of radius around
+    //! center, or returns false without radii
+    virtual bool findOverlappingInRadius(const float[3],const float,std::vector<ParticleIndex>&) const {return false;}
+
+    float findNPoints(const float center[3],int nPoints,const float maxRadius,
+        std::vector<ParticleIndex>& points,std::vector<float>& pointDistancesSquared) const;
+    //! Indices without an approximate search answer exactly
+    virtual int findNPointsApprox(const float center[3],int nPoints,const float maxRadius,const float epsilon,
+        const int maxVisited,ParticleIndex* points,float* pointDistancesSquared,float* finalRadius2) const
+    {return findNPoints(center,nPoints,maxRadius,points,pointDistancesSquared,finalRadius2);}
+    virtual void findNPointsBatch(const float* queries,int64_t nQueries,int nPoints,const float maxRadius,
+        ParticleIndex* outIndices,float* outDistancesSquared,int* outCounts,bool sortQueries) const;
+    //! findNPointsBatch starting each query's radius from its seeds, whose
+    //! current positions are read from the positionAttribute() of particles
+    void findNPointsSeeded(const float* queries,int64_t nQueries,int nPoints,const float maxRadius,
+        const ParticleIndex* seedIndices,const int* seedCounts,const ParticlesData& particles,
+        ParticleIndex* outIndices,float* outDistancesSquared,int* outCounts,bool sortQueries) const;
+    virtual void findPointsInRadiusBatch(const float* queries,int64_t nQueries,const float radius,
+        std::vector<int64_t>& offsets,std::vector<ParticleIndex>& points,std::vector<float>& pointDistancesSquared,
+        bool sorted) const;
+
+    //! Number of points queries search, indexed or appended
+    int64_t numPoints() const {return _count;}
+    //! Returns a new index for the set now holding n points, point i read
+    //! from p+i*stride bytes, leaving this one unchanged for the queries
+    //! still using it. The points appended before this call are copied, and
+    //! indexed in the copy if enough of them accumulated. The new ones, whose
+    //! positions may not be set yet, are read in place when queried.
+    SpatialIndex* appended(const float* p,size_t stride,int64_t n) const;
+
+    //! Writes the index to filename, see ParticlesData::saveIndex. Only
+    //! implemented by KdTreeIndex.
+    virtual bool save(const char* filename,const char* sourceFile) const;
+
+    //! Copies any points the index reads in place, so their memory may be
+    //! freed or moved. Must be called before that happens. Queries may run
+    //! meanwhile, the copy waits for the ones reading the points in place.
+    virtual void detachPoints();
+
+    //! Attribute index of the positions the index searches. Set by the
+    //! ParticlesData before it publishes the index and never changed after,
+    //! so queries read it from their snapshot without locking.
+    int positionAttribute() const {return _positionAttribute;}
+    void setPositionAttribute(int attributeIndex) {_positionAttribute=attributeIndex;}
+
+protected:
+    //! Copy for appended() to change, sharing whatever it does not
+    virtual SpatialIndex* clone() const=0;
+    //! Fills order with a permutation of the queries that keeps nearby ones
+    //! together, or leaves it empty when their given order is as good
+    virtual void orderQueries(const float*,int64_t,std::vector<uint64_t>&) const {}
+    //! Adds points [indexedCount(),numPoints()) to the index, read with forEachAppended()
+    virtual void indexAppended()=0;
+    //! Appended points are indexed once at least this many have accumulated
+    virtual int64_t appendedLimit() const=0;
+
+    //! Called by implementations once their build covers the first n points
+    void setIndexed(int64_t n) {_appended.clear();_indexedCount=_count=n;}
+    //! Indexes the appended points now, however few
+    void indexAllAppended();
+    int64_t indexedCount() const {return _indexedCount;}
+    bool hasAppended() const {return _count>_indexedCount;}
+    //! Calls func(i,p) with each appended point i and its position p until
+    //! it returns false, and returns false if it did
+    template<class FUNC> bool forEachAppended(const FUNC& func) const;
+
+    //! Brute force versions of the queries over the appended points
+    void findAppendedPoints(const float bboxMin[3],const float bboxMax[3],std::vector<ParticleIndex>& points) const;
+    void findAppendedPointsInRegion(const QueryRegion& region,std::vector<ParticleIndex>& points) const;
+    void findAppendedPointsInRadius(const float center[3],const float radiusSquared,std::vector<ParticleIndex>& points,
+        std::vector<float>& pointDistancesSquared) const;
+    void findAppendedNPoints(const float center[3],int nPoints,ParticleIndex* points,float* pointDistancesSquared,
+        int& found,float& maxRadiusSquared) const;
+    bool visitAppendedInBox(const float bboxMin[3],const float bboxMax[3],PointVisitor& visitor) const;
+    bool visitAppendedInRadius(const float center[3],const float radiusSquared,PointVisitor& visitor) const;
+    int64_t countAppendedInRegion(const QueryRegion& region) const;
+
+    //! Adds a point to a findNPoints result of found points, keeping it a heap once full
+    static void insertNearest(ParticleIndex id,float distanceSquared,int nPoints,ParticleIndex* points,
+        float* pointDistancesSquared,int& found,float& maxRadiusSquared)
+    {
+        if(!(distanceSquared<maxRadiusSquared)) return;
+        if(found<nPoints){
+            points[found]=id;
+            pointDistancesSquared[found]=distanceSquared;
+            found++;
+            if(found==nPoints) maxRadiusSquared=buildHeap(points,pointDistancesSquared,found);
+        }else maxRadiusSquared=insertToHeap(points,pointDistancesSquared,found,id,distanceSquared);
+    }
+    static void sortByDistance(ParticleIndex* points,float* pointDistancesSquared,size_t count);
+
+private:
+    void appendPoints(const float* p,size_t stride,int64_t n);
+
+    //! Points [first,first+count) appended in one call. Only the last batch
+    //! reads the set's memory, until copy() moves its points into positions.
+    struct AppendedBatch
+    {
+        int64_t first,count;
+        const char* data; // point i is at data+i*stride, 0 once copied
+        size_t stride;
+        std::vector<float> positions;
+        std::atomic<bool> copied;
+        std::shared_timed_mutex reading; // held shared by queries reading data, which copy() waits for
+        AppendedBatch(int64_t first,int64_t count,const char* data,size_t stride);
+        void copy();
+    };
+
+    // Copies share the batches, only the last one's copy() changes them.
+    // They cover [_indexedCount,_count), sizes decreasing.
+    std::vector<std::shared_ptr<AppendedBatch> > _appended;
+    int64_t _indexedCount;
+    int64_t _count;
+    int _positionAttribute;
+};
+
+template<class FUNC> bool SpatialIndex::
+forEachAppended(const FUNC& func) const
+{
+    for(size_t b=0;b<_appended.size();b++){
+        AppendedBatch& batch=*_appended[b];
+        if(!batch.copied.load(std::memory_order_acquire)){
+            std::shared_lock<std::shared_timed_mutex> lock(batch.reading);
+            if(batch.data){
+                for(int64_t i=0;i<batch.count;i++)
+                    if(!func(batch.first+i,reinterpret_cast<const float*>(batch.data+i*batch.stride))) return false;
+                continue;
+            }
+        }
+        for(int64_t i=0;i<batch.count;i++)
+            if(!func(batch.first+i,&batch.positions[3*i])) return false;
+    }
+    return true;
+}
+
+//! SpatialIndex over balanced KdTrees, the default built by sort()
+/*!
+  Appended points are indexed in runs of consecutive particles, each with
+  its own tree. Like a log-structured merge tree, a run is merged with the
+  one before it whenever it grows to half that one's size, so every point is
+  rebuilt O(log n) times and the number of trees stays logarithmic.
+*/
+class KdTreeIndex:public SpatialIndex
+{
+public:
+    KdTreeIndex();
+
+    //! Builds over the n points read from p+i*stride bytes, which are only
+    //! used during the call unless inPlace. Then the first tree keeps reading
+    //! them until detachPoints().
+    void build(const float* p,int64_t n,size_t stride,bool inPlace=false);
+    void detachPoints();
+
+    bool save(const char* filename,const char* sourceFile) const;
+    //! Memory maps a file written by save() and queries the trees in place.
+    //! Returns 0, after printing why, unless it was saved for as many points
+    //! as particles has and sourceFile (if given) has not changed since.
+    //! Points that were appended when it was saved are indexed from position.
+    static KdTreeIndex* load(const char* filename,const ParticlesData& particles,const ParticleAttribute& position,
+        const char* sourceFile);
+
+    using SpatialIndex::findNPoints;
+    void findPoints(const float bboxMin[3],const float bboxMax[3],std::vector<ParticleIndex>& points) const;
+    int findNPoints(const float center[3],int nPoints,const float maxRadius,
+        ParticleIndex* points,float* pointDistancesSquared,float* finalRadius2) const;
+    int findNPointsApprox(const float center[3],int nPoints,const float maxRadius,const float epsilon,
+        const int maxVisited,ParticleIndex* points,float* pointDistancesSquared,float* finalRadius2) const;
+    void findPointsInRadius(const float center[3],const float radius,std::vector<ParticleIndex>& points,
+        std::vector<float>& pointDistancesSquared,bool sorted) const;
+    void findPointsInRegion(const QueryRegion& region,std::vector<ParticleIndex>& points) const;
+    bool forEachInBox(const float bboxMin[3],const float bboxMax[3],PointVisitor& visitor) const;
+    bool forEachInRadius(const float center[3],const float radius,PointVisitor& visitor) const;
+    int64_t countInRegion(const QueryRegion& region) const;
+    //! Prefix sums of the values in each tree's order, so a subtree inside
+    //! the region is summed from the two ends of its range. Points appended
+    //! later drop the sums. The copy shares the trees with this index.
+    SpatialIndex* augmented(const char* name,const float* values,int count) const;
+    int64_t sumInRegion(const QueryRegion& region,const char* name,double* sums) const;
+    //! Like the sums the radii are dropped by appended points
+    SpatialIndex* withRadii(const float* radii) const;
+    bool findOverlapping(const float bboxMin[3],const float bboxMax[3],std::vector<ParticleIndex>& points) const;
+    bool findOverlappingInRadius(const float center[3],const float radius,std::vector<ParticleIndex>& points) const;
+    void findNPointsBatch(const float* queries,int64_t nQueries,int nPoints,const float maxRadius,
+        ParticleIndex* outIndices,float* outDistancesSquared,int* outCounts,bool sortQueries) const;
+    void findPointsInRadiusBatch(const float* queries,int64_t nQueries,const float radius,
+        std::vector<int64_t>& offsets,std::vector<ParticleIndex>& points,std::vector<float>& pointDistancesSquared,
+        bool sorted) const;
+
+protected:
+    SpatialIndex* clone() const {return new KdTreeIndex(*this);}
+    void indexAppended();
+    int64_t appendedLimit() const;
+
+private:
+    struct Run
+    {
+        int64_t first; // the tree's ids are relative to this particle
+        KdTree<3> tree;
+    };
+    struct Radii
+    {
+        std::vector<std::vector<float> > radii,maxRadii; // per run, in tree order, see withRadii
+    };
+    //! A single tree over everything, the batched queries can go straight to it
+    bool single() const {return _runs.size()==1 && !hasAppended();}
+    bool hasRadii() const;
+    //! Indexes the count points read from positions as particles first onwards
+    void addRun(int64_t first,const float* positions,int64_t count);
+    void mergeLastRuns();
+
+    struct Sums
+    {
+        int count;
+        std::vector<std::vector<double> > prefix; // per run, count sums of each tree index's predecessors
+    };
+    // Copies share the file and the runs, which only detachPoints() changes
+    // once built. Appending and merging make new runs, and the sums and
+    // radii are replaced whole. The file is
+    // declared first so the runs reading it are destroyed before it.
+    std::shared_ptr<const char> _mapped; // file the loaded trees point into
+    std::vector<std::shared_ptr<Run> > _runs; // consecutive particle ranges, sizes decreasing
+    std::map<std::string,std::shared_ptr<const Sums> > _sums;
+    std::shared_ptr<const Radii> _radii;
+};
+
+//! The particle set's current index, replaced atomically by sort()
+/*!
+  Queries load() a reference to the index, so one replaced while they run
+  stays alive until they finish, and queries starting after store() see the
+  new one. Adding particles, augmentIndex() and setIndexRadius() publish a
+  changed copy of the index with update().
+*/
+class SpatialIndexPtr
+{
+public:
+    //! replace() stores index only if expected is still the current one, in one atomic step
+#ifdef __cpp_lib_atomic_shared_ptr
+    std::shared_ptr<SpatialIndex> load() const {return _index.load();}
+    void store(std::shared_ptr<SpatialIndex> index) {_index.store(std::move(index));}
+    bool replace(std::shared_ptr<SpatialIndex> expected,std::shared_ptr<SpatialIndex> index)
+    {return _index.compare_exchange_strong(expected,std::move(index));}
+#else
+    std::shared_ptr<SpatialIndex> load() const {return std::atomic_load(&_index);}
+    void store(std::shared_ptr<SpatialIndex> index) {std::atomic_store(&_index,std::move(index));}
+    bool replace(std::shared_ptr<SpatialIndex> expected,std::shared_ptr<SpatialIndex> index)
+    {return std::atomic_compare_exchange_strong(&_index,&expected,std::move(index));}
+#endif
+    //! Publishes update(index) in place of the current index. An index
+    //! published meanwhile by another thread is updated in turn instead of
+    //! being overwritten. Returns false, publishing nothing, if there is no
+    //! index or update returns 0 for it.
+    template<class UPDATE> bool update(const UPDATE& update)
+    {
+        std::shared_ptr<SpatialIndex> index=load();
+        while(index){
+            std::shared_ptr<SpatialIndex> updated(update(*index));
+            if(!updated) return false;
+            if(replace(index,updated)) return true;
+            index=load();
+        }
+        return false;
+    }
+
+    //! Not atomic, only for exchanging the indices of two particle sets
+    void swap(SpatialIndexPtr& other) {std::shared_ptr<SpatialIndex> index=load();store(other.load());other.store(index);}
+
+private:
+#ifdef __cpp_lib_atomic_shared_ptr
+    std::atomic<std::shared_ptr<SpatialIndex> > _index;
+#else
+    std::shared_ptr<SpatialIndex> _index;
+#endif
+};
+
+}
+#endif
@@ -36,6 +36,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
 #include "PartioEndian.h"
 #include "../core/ParticleHeaders.h"
 #include "io.h"
+#include "readers.h"
+#include <climits>
 
 namespace Partio
 {
@@ -184,7 +186,7 @@ bool skipPrimitives(int nPoints, int nPrims, int nPrimAttrib, istream* input,std
     return true;
 }
 
-ParticlesDataMutable* readBGEO(const char* filename,const bool headersOnly,std::ostream* errorStream)
+ParticlesDataMutable* readBGEO(const char* filename,const bool headersOnly,std::ostream* errorStream,ParticlesDataMutable* reuse)
 {
     unique_ptr<istream> input(io::unzip(filename));
     if(!*input){
@@ -225,11 +227,15 @@ ParticlesDataMutable* readBGEO(const char* filename,const bool headersOnly,std::
         if(errorStream) *errorStream<<"Partio: BGEO must be version 5"<<endl;
         return 0;
     }
+    if(nPoints<0){
+        if(errorStream) *errorStream<<"Partio: BGEO has invalid point count "<<nPoints<<endl;
+        return 0;
+    }
 
     // Allocate a simple particle with the appropriate number of points
     ParticlesDataMutable* simple=0;
     if(headersOnly) simple=new ParticleHeaders;
-    else simple=create();
+    else simple=createForRead(reuse);
 
     simple->addParticles(nPoints);
 
@@ -245,7 +251,7 @@ ParticlesDataMutable* readBGEO(const char* filename,const bool headersOnly,std::
     getAttributes(particleSize, attrOffsets, attrHandles, accessors, nPointAttrib, input.get(), simple, headersOnly, errorStream);
 
     if(headersOnly) {
-        skip(input.get(),nPoints*particleSize*sizeof(int));
+        skip(input.get(),(size_t)nPoints*particleSize*sizeof(int));
     } else {
         // Read the points
         int *buffer=new int[particleSize];
@@ -301,6 +307,11 @@ ParticlesDataMutable* readBGEO(const char* filename,const bool headersOnly,std::
 
 bool writeBGEO(const char* filename,const ParticlesData& p,const bool compressed,std::ostream* errorStream)
 {
+    if(p.numParticles()>INT_MAX){
+        if(errorStream) *errorStream<<"Partio: BGEO can not store more than "<<INT_MAX<<" particles"<<endl;
+        return false;
+    }
+
     unique_ptr<ostream> output(io::write(filename, compressed));
     if(!*output){
         if(errorStream) *errorStream <<"Partio Unable to open file "<<filename<<endl;
@@ -310,7 +321,7 @@ bool writeBGEO(const char* filename,const ParticlesData& p,const bool compressed
     int magic=((((('B'<<8)|'g')<<8)|'e')<<8)|'o';
     char versionChar='V';
     int version=5;
-    int nPoints=p.numParticles();
+    int nPoints=static_cast<int>(p.numParticles());
     int nPrims=0;
     int nPointGroups=0;
     int nPrimGroups=0;
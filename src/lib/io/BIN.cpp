@@ -39,6 +39,8 @@ Modifications from: github user: redpawfx (redpawFX@gmail.com)  and Luma Picture
 */
 #include "../core/ParticleHeaders.h"
 #include "io.h"
+#include "readers.h"
+#include <climits>
 
 namespace Partio{
 
@@ -82,7 +84,7 @@ typedef struct{
 } BIN_HEADERV6;
 
 
-ParticlesDataMutable* readBIN(const char* filename, const bool headersOnly,std::ostream* errorStream){
+ParticlesDataMutable* readBIN(const char* filename, const bool headersOnly,std::ostream* errorStream,ParticlesDataMutable* reuse){
 
     unique_ptr<istream> input(io::read(filename));
     if(!*input){
@@ -111,9 +113,13 @@ ParticlesDataMutable* readBIN(const char* filename, const bool headersOnly,std::
         if(errorStream) *errorStream<< "Partio: Magic number '" << hex<<  header.verificationCode << "' of '" << filename << "' doesn't match BIN magic '" << BIN_MAGIC << "'" << endl;
         return 0;
     }
+    if(header.numParticles<0){
+        if(errorStream) *errorStream<< "Partio: BIN has invalid particle count " << header.numParticles << endl;
+        return 0;
+    }
 
 
-    ParticlesDataMutable* simple = headersOnly ? new ParticleHeaders: create();
+    ParticlesDataMutable* simple = headersOnly ? new ParticleHeaders: createForRead(reuse);
     simple->addParticles(header.numParticles);
 
     ParticleAttribute posAttr;
@@ -153,7 +159,7 @@ ParticlesDataMutable* readBIN(const char* filename, const bool headersOnly,std::
 
     if (!headersOnly)
     {
-        for(int partIndex = 0; partIndex < simple->numParticles(); partIndex++)
+        for(int64_t partIndex = 0; partIndex < simple->numParticles(); partIndex++)
         {
 
             float position[3] = {0.0,0.0,0.0};
@@ -268,6 +274,11 @@ ParticlesDataMutable* readBIN(const char* filename, const bool headersOnly,std::
 
 bool writeBIN(const char* filename,const ParticlesData& p,const bool /*compressed*/,std::ostream* errorStream)
 {
+    if(p.numParticles()>INT_MAX){
+        if(errorStream) *errorStream<<"Partio: BIN can not store more than "<<INT_MAX<<" particles"<<endl;
+        return false;
+    }
+
     unique_ptr<ostream> output(io::write(filename));
     if (!*output) {
         if(errorStream) *errorStream<<"Partio Unable to open file "<<filename<<endl;
@@ -291,7 +302,7 @@ bool writeBIN(const char* filename,const ParticlesData& p,const bool /*compresse
     header.version =  11; // version (11 is most current)
     header.frameNumber =  1; // frame number
     header.elapsedSimulationTime = 0.0416666f; //   time elapsed (in seconds)
-    header.numParticles = p.numParticles(); // number of particles
+    header.numParticles = static_cast<int>(p.numParticles()); // number of particles
     header.radius = 0.1f; // radius of emitter
     header.pressure[0] = 1.0; // max, min, and avg pressure
     header.pressure[1] = 1.0;
@@ -338,7 +349,7 @@ bool writeBIN(const char* filename,const ParticlesData& p,const bool /*compresse
     for(int i=0; i <= 2; i++)
         output->write ((const char *) &header.emitterScale[i], sizeof(float));
 
-    for (int particles = 0; particles < p.numParticles(); particles++)
+    for (int64_t particles = 0; particles < p.numParticles(); particles++)
     {
         // set defaults for stuff that is not exported...
         float position[3] = {0.0,0.0,0.0};
@@ -35,6 +35,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
 
 #include "../core/ParticleHeaders.h"
 #include "io.h"
+#include "readers.h"
 
 namespace Partio
 {
@@ -99,18 +100,19 @@ string scanString(istream& input)
     return string(buf);
 }
 
-ParticlesDataMutable* readGEO(const char* filename,const bool headersOnly,std::ostream* errorStream)
+ParticlesDataMutable* readGEO(const char* filename,const bool headersOnly,std::ostream* errorStream,ParticlesDataMutable* reuse)
 {
     unique_ptr<istream> input(io::unzip(filename));
     if(!*input){
         if(errorStream) *errorStream<<"Partio: Can't open particle data file: "<<filename<<endl;
         return 0;
     }
-    int NPoints=0, NPointAttrib=0;
+    int64_t NPoints=0;
+    int NPointAttrib=0;
 
     ParticlesDataMutable* simple=0;
     if(headersOnly) simple=new ParticleHeaders;
-    else simple=create();
+    else simple=createForRead(reuse);
 
     // read NPoints and NPointAttrib
     string word;
@@ -306,7 +308,7 @@ bool writeGEO(const char* filename,const ParticlesData& p,const bool compressed,
     *output<<"PrimitiveAttrib"<<endl;
     *output<<"generator 1 index 1 papi"<<endl;
     *output<<"Part "<<p.numParticles();
-    for(int i=0;i<p.numParticles();i++)
+    for(int64_t i=0;i<p.numParticles();i++)
         *output<<" "<<i;
     *output<<" [0]\nbeginExtra"<<endl;
     *output<<"endExtra"<<endl;
@@ -40,6 +40,7 @@ Modifications from: github user: redpawfx (redpawFX@gmail.com)  and Luma Picture
 #include "../core/ParticleHeaders.h"
 #include "PartioEndian.h" // read/write big-endian file
 #include "io.h"
+#include "readers.h"
 
 namespace Partio
 {
@@ -122,7 +123,7 @@ bool IsStringInCharArray(std::string target, char** list){
 static const int MC_MAGIC = ((((('F'<<8)|'O')<<8)|'R')<<8)|'4';
 static const int HEADER_SIZE = 56;
 
-ParticlesDataMutable* readMC(const char* filename, const bool headersOnly,std::ostream* errorStream){
+ParticlesDataMutable* readMC(const char* filename, const bool headersOnly,std::ostream* errorStream,ParticlesDataMutable* reuse){
 
     std::unique_ptr<std::istream> input(io::unzip(filename));
     if(!*input){
@@ -158,12 +159,12 @@ ParticlesDataMutable* readMC(const char* filename, const bool headersOnly,std::o
         simple = new ParticleHeaders;
     }
     else{
-        simple=create();
+        simple=createForRead(reuse);
     }
 
-    int numParticles = 0;
+    int64_t numParticles = 0;
     input->read(tag, 4); // MYCH
-    while(((int)input->tellg()-HEADER_SIZE) < blockSize){
+    while(((std::streamoff)input->tellg()-HEADER_SIZE) < blockSize){
         Attribute_Header attrHeader;
         ReadAttrHeader(*input, attrHeader);
 
@@ -172,22 +173,22 @@ ParticlesDataMutable* readMC(const char* filename, const bool headersOnly,std::o
         }
 
         if(attrHeader.blocksize/sizeof(double) == 1){ // for who ?
-            input->seekg((int)input->tellg() + attrHeader.blocksize);
+            input->seekg((std::streamoff)input->tellg() + attrHeader.blocksize);
             continue;
         }
 #if 0 // TODO: if we ever put back attributes re-enable this
         if(attributes && (IsStringInCharArray(attrHeader.name, attributes)==false)){
-            input->seekg((int)input->tellg() + attrHeader.blocksize);
+            input->seekg((std::streamoff)input->tellg() + attrHeader.blocksize);
             continue;
         }
 #endif
 
         if(attrHeader.type == std::string("FVCA")){
-            input->seekg((int)input->tellg() + attrHeader.blocksize);
+            input->seekg((std::streamoff)input->tellg() + attrHeader.blocksize);
             simple->addAttribute(attrHeader.name.c_str(), VECTOR, 3);
         }
         else if(attrHeader.type == std::string("DBLA")){
-			input->seekg((int)input->tellg() + attrHeader.blocksize);
+			input->seekg((std::streamoff)input->tellg() + attrHeader.blocksize);
 			if(attrHeader.name == "id"){
 				simple->addAttribute(attrHeader.name.c_str(), INT, 1);
 			}
@@ -197,7 +198,7 @@ ParticlesDataMutable* readMC(const char* filename, const bool headersOnly,std::o
         }
         else
 		{
-            input->seekg((int)input->tellg() + attrHeader.blocksize);
+            input->seekg((std::streamoff)input->tellg() + attrHeader.blocksize);
             if(errorStream) *errorStream << "Partio: Attribute '" << attrHeader.name << " " << attrHeader.type << "' cannot map type" << std::endl;
         }
     }
@@ -210,18 +211,18 @@ ParticlesDataMutable* readMC(const char* filename, const bool headersOnly,std::o
     //cout << "==============================================================" << endl;
     input->seekg(HEADER_SIZE);
     input->read(tag, 4); // MYCH
-    while((int)input->tellg()-HEADER_SIZE < blockSize){
+    while((std::streamoff)input->tellg()-HEADER_SIZE < blockSize){
         Attribute_Header attrHeader;
         ReadAttrHeader(*input, attrHeader);
 
         if(attrHeader.blocksize/sizeof(double) == 1){ // for who ?
-            input->seekg((int)input->tellg() + attrHeader.blocksize);
+            input->seekg((std::streamoff)input->tellg() + attrHeader.blocksize);
             continue;
         }
 
         ParticleAttribute attrHandle;
         if(simple->attributeInfo(attrHeader.name.c_str(), attrHandle) == false){
-            input->seekg((int)input->tellg() + attrHeader.blocksize);
+            input->seekg((std::streamoff)input->tellg() + attrHeader.blocksize);
             continue;
         }
 
@@ -233,7 +234,7 @@ ParticlesDataMutable* readMC(const char* filename, const bool headersOnly,std::o
         if (attrHeader.type == std::string("DBLA")){
 			if  (attrHeader.name == "id")
 			{
-				for (int i = 0; i < simple->numParticles(); i++)
+				for (int64_t i = 0; i < simple->numParticles(); i++)
 				{
                 double tmp;
                 read<BIGEND>(*input, tmp);
@@ -242,7 +243,7 @@ ParticlesDataMutable* readMC(const char* filename, const bool headersOnly,std::o
 				}
 			}
 			else{
-				for (int i = 0; i < simple->numParticles(); i++){
+				for (int64_t i = 0; i < simple->numParticles(); i++){
 					double tmp;
 					read<BIGEND>(*input, tmp);
 					float* data = simple->dataWrite<float>(attrHandle, i);
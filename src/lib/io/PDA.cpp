@@ -34,6 +34,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
 */
 #include "../core/ParticleHeaders.h"
 #include "io.h"
+#include "readers.h"
 
 namespace Partio
 {
@@ -42,7 +43,7 @@ using namespace std;
 
 // TODO: convert this to use iterators like the rest of the readers/writers
 
-ParticlesDataMutable* readPDA(const char* filename,const bool headersOnly,std::ostream* errorStream)
+ParticlesDataMutable* readPDA(const char* filename,const bool headersOnly,std::ostream* errorStream,ParticlesDataMutable* reuse)
 {
     unique_ptr<istream> input(io::unzip(filename));
     if(!*input){
@@ -52,7 +53,7 @@ ParticlesDataMutable* readPDA(const char* filename,const bool headersOnly,std::o
 
     ParticlesDataMutable* simple=0;
     if(headersOnly) simple=new ParticleHeaders;
-    else simple=create();
+    else simple=createForRead(reuse);
 
     // read NPoints and NPointAttrib
     string word;
@@ -89,7 +90,7 @@ ParticlesDataMutable* readPDA(const char* filename,const bool headersOnly,std::o
         index++;
     }
 
-    unsigned int num=0;
+    uint64_t num=0;
     if(input->good()){
         *input>>num;
         simple->addParticles(num);
@@ -111,7 +112,7 @@ ParticlesDataMutable* readPDA(const char* filename,const bool headersOnly,std::o
 
     // Read actual particle data
     if(!input->good()){simple->release();return 0;}
-    for(unsigned int particleIndex=0;input->good() && particleIndex<num; particleIndex++) {
+    for(uint64_t particleIndex=0;input->good() && particleIndex<num; particleIndex++) {
         for(unsigned int attrIndex=0;attrIndex<attrs.size();attrIndex++){
             if(attrs[attrIndex].type==Partio::INT){
                 int* data=simple->dataWrite<int>(attrs[attrIndex],particleIndex);
@@ -163,7 +164,7 @@ bool writePDA(const char* filename,const ParticlesData& p,const bool compressed,
     *output<<"NUMBER_OF_PARTICLES: "<<p.numParticles()<<endl;
     *output<<"BEGIN DATA"<<endl;
 
-    for(int particleIndex=0;particleIndex<p.numParticles();particleIndex++){
+    for(int64_t particleIndex=0;particleIndex<p.numParticles();particleIndex++){
         for(unsigned int attrIndex=0;attrIndex<attrs.size();attrIndex++){
             if(attrs[attrIndex].type==Partio::INT || attrs[attrIndex].type==Partio::INDEXEDSTR){
                 const int* data=p.data<int>(attrs[attrIndex],particleIndex);
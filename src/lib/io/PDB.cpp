@@ -40,6 +40,8 @@ namespace PDB{
 #include "pdb.h"
 }
 #include "io.h"
+#include "readers.h"
+#include <climits>
 
 namespace Partio
 {
@@ -81,7 +83,7 @@ string GetString(istream& input,bool& error)
 }
 
 
-template<int bits> ParticlesDataMutable* readPDBHelper(const char* filename,const bool headersOnly,std::ostream* errorStream)
+template<int bits> ParticlesDataMutable* readPDBHelper(const char* filename,const bool headersOnly,std::ostream* errorStream,ParticlesDataMutable* reuse)
 {
     unique_ptr<istream> input(io::unzip(filename));
     if(!*input){
@@ -92,7 +94,7 @@ template<int bits> ParticlesDataMutable* readPDBHelper(const char* filename,cons
     // Use simple particle since we don't have optimized storage.
     ParticlesDataMutable* simple=0;
     if(headersOnly) simple=new ParticleHeaders;
-    else simple=create();
+    else simple=createForRead(reuse);
 
     // Read header and add as many particles as found
     typename PDB_POLICY<bits>::HEADER header;
@@ -128,14 +130,14 @@ template<int bits> ParticlesDataMutable* readPDBHelper(const char* filename,cons
             case PDB_LONG: type=INT;break;
             default: type=NONE;break;
         }
-        int size=header.data_size*channelData.datasize;
+        int64_t size=(int64_t)header.data_size*channelData.datasize;
 
         // Read data or skip if we haven't found appropriate type handle
         if(type==NONE){
             char buf[1024];
-            int toSkip=size;
+            int64_t toSkip=size;
             while(toSkip>0){
-                input->read(buf,min(toSkip,1024));
+                input->read(buf,min<int64_t>(toSkip,1024));
                 toSkip-=1024;
             }
             if(errorStream) *errorStream<<"Partio: Attribute '"<<name<<"' cannot map type"<<endl;
@@ -144,9 +146,9 @@ template<int bits> ParticlesDataMutable* readPDBHelper(const char* filename,cons
             ParticleAttribute attrHandle=simple->addAttribute(name.c_str(),type,count);
             if(headersOnly){
                 char buf[1024];
-                int toSkip=size;
+                int64_t toSkip=size;
                 while(toSkip>0){
-                    input->read(buf,min(toSkip,1024));
+                    input->read(buf,min<int64_t>(toSkip,1024));
                     toSkip-=1024;
                 }
             }else{
@@ -166,6 +168,11 @@ template<int bits> ParticlesDataMutable* readPDBHelper(const char* filename,cons
 template<int bits>
 bool writePDBHelper(const char* filename,const ParticlesData& p,const bool compressed,std::ostream* errorStream)
 {
+    if(p.numParticles()>UINT_MAX){
+        if(errorStream) *errorStream<<"Partio: PDB can not store more than "<<UINT_MAX<<" particles"<<endl;
+        return false;
+    }
+
     unique_ptr<ostream> output(io::write(filename, compressed));
     if(!*output){
         if(errorStream) *errorStream<<"Partio Unable to open file "<<filename<<endl;
@@ -178,7 +185,7 @@ bool writePDBHelper(const char* filename,const ParticlesData& p,const bool compr
     h32.swap=1;
     h32.version=1.0;
     h32.time=0.0;
-    h32.data_size=p.numParticles();
+    h32.data_size=static_cast<unsigned>(p.numParticles());
     h32.num_data=p.numAttributes();
     for(int k=0;k<32;k++) h32.padding[k]=0;
     h32.data=0;
@@ -222,7 +229,7 @@ bool writePDBHelper(const char* filename,const ParticlesData& p,const bool compr
         output->write(attr.name.c_str(),attr.name.length()*sizeof(char)+1);
         data_header.type=channel.type;
         data_header.datasize=attr.count*sizeof(float);
-        data_header.blocksize=p.numParticles();
+        data_header.blocksize=static_cast<unsigned>(p.numParticles());
         data_header.num_blocks=1;
         data_header.block=0;
         output->write((char*)&data_header,sizeof(data_header));
@@ -238,11 +245,11 @@ bool writePDBHelper(const char* filename,const ParticlesData& p,const bool compr
     return true;
 }
 
-ParticlesDataMutable* readPDB32(const char* filename,const bool headersOnly,std::ostream* errorStream)
-{return readPDBHelper<32>(filename,headersOnly,errorStream);}
+ParticlesDataMutable* readPDB32(const char* filename,const bool headersOnly,std::ostream* errorStream,ParticlesDataMutable* reuse)
+{return readPDBHelper<32>(filename,headersOnly,errorStream,reuse);}
 
-ParticlesDataMutable* readPDB64(const char* filename,const bool headersOnly,std::ostream* errorStream)
-{return readPDBHelper<64>(filename,headersOnly,errorStream);}
+ParticlesDataMutable* readPDB64(const char* filename,const bool headersOnly,std::ostream* errorStream,ParticlesDataMutable* reuse)
+{return readPDBHelper<64>(filename,headersOnly,errorStream,reuse);}
 
 bool writePDB32(const char* filename,const ParticlesData& p,const bool compressed,std::ostream* errorStream)
 {return writePDBHelper<32>(filename,p,compressed,errorStream);}
@@ -250,7 +257,7 @@ bool writePDB32(const char* filename,const ParticlesData& p,const bool compresse
 bool writePDB64(const char* filename,const ParticlesData& p,const bool compressed,std::ostream* errorStream)
 {return writePDBHelper<64>(filename,p,compressed,errorStream);}
 
-ParticlesDataMutable* readPDB(const char* filename,const bool headersOnly,std::ostream* errorStream)
+ParticlesDataMutable* readPDB(const char* filename,const bool headersOnly,std::ostream* errorStream,ParticlesDataMutable* reuse)
 {
     unique_ptr<istream> input(io::unzip(filename));
     if(!*input){
@@ -270,9 +277,9 @@ ParticlesDataMutable* readPDB(const char* filename,const bool headersOnly,std::o
     input->read((char*)&channelIOHeader,sizeof(channelIOHeader));
     //cout<<"we got channel io as "<<int(channelIOHeader.type)<<" swap is "<<channelIOHeader.swap<<endl;
     if(channelIOHeader.type > 5  || channelIOHeader.type < 0 || (channelIOHeader.swap != 1 && channelIOHeader.swap != 0)){
-        return readPDBHelper<32>(filename,headersOnly,errorStream);
+        return readPDBHelper<32>(filename,headersOnly,errorStream,reuse);
     }else{
-        return readPDBHelper<64>(filename,headersOnly,errorStream);
+        return readPDBHelper<64>(filename,headersOnly,errorStream,reuse);
     }
 }
 
@@ -41,6 +41,8 @@ Modifications from: github user: redpawfx (redpawFX@gmail.com)  and Luma Picture
 #include "../core/ParticleHeaders.h"
 #include "PartioEndian.h"
 #include "io.h"
+#include "readers.h"
+#include <climits>
 
 namespace {
 std::string readName(std::istream& input){
@@ -70,7 +72,7 @@ typedef struct{
     int numAttrs;
 } PDC_HEADER;
 
-ParticlesDataMutable* readPDC(const char* filename, const bool headersOnly,std::ostream* errorStream){
+ParticlesDataMutable* readPDC(const char* filename, const bool headersOnly,std::ostream* errorStream,ParticlesDataMutable* reuse){
 
     unique_ptr<istream> input(io::unzip(filename));
     if(!*input){
@@ -87,8 +89,12 @@ ParticlesDataMutable* readPDC(const char* filename, const bool headersOnly,std::
 
     BIGEND::swap(header.numParticles);
     BIGEND::swap(header.numAttrs);
+    if(header.numParticles<0){
+        if(errorStream) *errorStream << "Partio: PDC has invalid particle count " << header.numParticles << std::endl;
+        return 0;
+    }
 
-    ParticlesDataMutable* simple = headersOnly ? new ParticleHeaders: create();
+    ParticlesDataMutable* simple = headersOnly ? new ParticleHeaders: createForRead(reuse);
     simple->addParticles(header.numParticles);
 
     for(int attrIndex = 0; attrIndex < header.numAttrs; attrIndex++){
@@ -106,12 +112,12 @@ ParticlesDataMutable* readPDC(const char* filename, const bool headersOnly,std::
 
         // if headersOnly, skip
         if(headersOnly){
-            input->seekg((int)input->tellg() + header.numParticles*sizeof(double)*attr.count);
+            input->seekg((std::streamoff)input->tellg() + header.numParticles*sizeof(double)*attr.count);
             continue;
         }
         else{
             double tmp[3];
-            for(int partIndex = 0; partIndex < simple->numParticles(); partIndex++){
+            for(int64_t partIndex = 0; partIndex < simple->numParticles(); partIndex++){
                 for(int dim = 0; dim < attr.count; dim++){
                     read<BIGEND>(*input, tmp[dim]);
                     simple->dataWrite<float>(attr, partIndex)[dim] = (float)tmp[dim];
@@ -124,6 +130,10 @@ ParticlesDataMutable* readPDC(const char* filename, const bool headersOnly,std::
 }
 
 bool writePDC(const char* filename,const ParticlesData& p,const bool compressed,std::ostream* errorStream){
+    if(p.numParticles()>INT_MAX){
+        if(errorStream) *errorStream << "Partio: PDC can not store more than " << INT_MAX << " particles" << endl;
+        return false;
+    }
     unique_ptr<ostream> output(io::write(filename, compressed));
     if(!*output){
         if(errorStream) *errorStream << "Partio Unable to open file " << filename << endl;
@@ -155,7 +165,7 @@ bool writePDC(const char* filename,const ParticlesData& p,const bool compressed,
         write<BIGEND>(*output, (int)(count+2));
 
         // write data
-        for(int partIndex = 0; partIndex < p.numParticles(); partIndex++){
+        for(int64_t partIndex = 0; partIndex < p.numParticles(); partIndex++){
             const float* data = p.data<float>(attr, partIndex);
             for(int dim = 0; dim < count; dim++){
                 write<BIGEND>(*output, (double)data[dim]);
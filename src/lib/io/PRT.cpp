@@ -43,6 +43,7 @@ Modifications from: github user: redpawfx (redpawFX@gmail.com)  and Luma Picture
 #ifdef PARTIO_USE_ZLIB
 #include "../Partio.h"
 #include "io.h"
+#include "readers.h"
 #include "PartioEndian.h"
 #include "../core/ParticleHeaders.h"
 
@@ -142,7 +143,7 @@ static bool write_buffer(std::ostream& os, z_stream& z, char* out_buf, void* p,
 
 
 
-ParticlesDataMutable* readPRT(const char* filename,const bool headersOnly,std::ostream* errorStream)
+ParticlesDataMutable* readPRT(const char* filename,const bool headersOnly,std::ostream* errorStream,ParticlesDataMutable* reuse)
 {
     std::unique_ptr<std::istream> input(io::read(filename));
     if (!*input) {
@@ -153,7 +154,7 @@ ParticlesDataMutable* readPRT(const char* filename,const bool headersOnly,std::o
     // Use simple particle since we don't have optimized storage.
     ParticlesDataMutable* simple=0;
     if (headersOnly) simple=new ParticleHeaders;
-    else simple=create();
+    else simple=createForRead(reuse);
 
     FileHeadder header;
     input->read((char*)&header,sizeof(FileHeadder));
@@ -174,7 +175,7 @@ ParticlesDataMutable* readPRT(const char* filename,const bool headersOnly,std::o
     read<LITEND>(*input,channels);		// number of channel
     read<LITEND>(*input,channelsize);	// size of channel
 
-    simple->addParticles((int)header.numParticles);
+    simple->addParticles(static_cast<int64_t>(header.numParticles));
 
     std::vector<Channel> chans;
     std::vector<ParticleAttribute> attrs;
@@ -244,7 +245,7 @@ ParticlesDataMutable* readPRT(const char* filename,const bool headersOnly,std::o
     
     char* prt_buf = new char[particleSize];
 
-    for (unsigned int particleIndex=0;particleIndex<(unsigned int )simple->numParticles();particleIndex++) {
+    for (int64_t particleIndex=0;particleIndex<simple->numParticles();particleIndex++) {
         // Read the particle from the file, and decompress it into a single particle-sized buffer.
         read_buffer(*input, z, (char*)in_buf, prt_buf, particleSize, errorStream);
         
@@ -343,7 +344,7 @@ ParticlesDataMutable* readPRT(const char* filename,const bool headersOnly,std::o
 bool writePRT(const char* filename,const ParticlesData& p,const bool /*compressed*/,std::ostream* errorStream)
 {
 	/// Krakatoa pukes on 0 particle files for some reason so don't export at all....
-    int numParts = p.numParticles();
+    int64_t numParts = p.numParticles();
     if (numParts)
     {
         std::unique_ptr<std::ostream> output(
@@ -402,7 +403,7 @@ bool writePRT(const char* filename,const ParticlesData& p,const bool /*compresse
         }
 
         char out_buf[OUT_BUFSIZE+10];
-        for (int particleIndex=0;particleIndex<p.numParticles();particleIndex++) {
+        for (int64_t particleIndex=0;particleIndex<p.numParticles();particleIndex++) {
             for (unsigned int attrIndex=0;attrIndex<attrs.size();attrIndex++) {
                 if (attrs[attrIndex].type==Partio::INT) {
                     const int* data=p.data<int>(attrs[attrIndex],particleIndex);
@@ -432,7 +433,7 @@ bool writePRT(const char* filename,const ParticlesData& p,const bool /*compresse
 
 
 namespace Partio{
-ParticlesDataMutable* readPRT(const char* filename,const bool headersOnly, std::ostream* error)
+ParticlesDataMutable* readPRT(const char* filename,const bool headersOnly, std::ostream* error,ParticlesDataMutable* reuse)
 {
     std::cerr<<"PRT not supported on windows"<<std::endl;
     return 0;
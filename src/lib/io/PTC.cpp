@@ -38,6 +38,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
 #include "../core/ParticleHeaders.h"
 #include "PartioEndian.h"
 #include "io.h"
+#include "readers.h"
 
 #include <cmath>
 #include <cfloat>
@@ -75,7 +76,7 @@ bool ParseSpec(const string& spec,string& typeName,string& name)
     return true;
 }
 
-ParticlesDataMutable* readPTC(const char* filename,const bool headersOnly,std::ostream* errorStream)
+ParticlesDataMutable* readPTC(const char* filename,const bool headersOnly,std::ostream* errorStream,ParticlesDataMutable* reuse)
 {
     unique_ptr<istream> input(io::unzip(filename));
     if(!*input){
@@ -128,8 +129,8 @@ ParticlesDataMutable* readPTC(const char* filename,const bool headersOnly,std::o
     // Allocate a simple particle with the appropriate number of points
     ParticlesDataMutable* simple=0;
     if(headersOnly) simple=new ParticleHeaders;
-    else simple=create();
-    simple->addParticles((int)nPoints);
+    else simple=createForRead(reuse);
+    simple->addParticles(static_cast<int64_t>(nPoints));
 
     // PTC files always have something for these items, so allocate the data
     vector<ParticleAttribute> attrHandles;
@@ -191,7 +192,7 @@ ParticlesDataMutable* readPTC(const char* filename,const bool headersOnly,std::o
     // more weird input attributes
     if(version>=1) for(int i=0;i<2;i++) read<LITEND>(*input,dummy);
 
-    for(int pointIndex=0;pointIndex<nPoints;pointIndex++){
+    for(int64_t pointIndex=0;pointIndex<nPoints;pointIndex++){
         float* pos=simple->dataWrite<float>(positionHandle,pointIndex);
         read<LITEND>(*input,pos[0],pos[1],pos[2]);
 
@@ -259,7 +260,7 @@ bool writePTC(const char* filename,const ParticlesData& p,const bool compressed,
 
     // compute bounding box
     float boxmin[3]={FLT_MAX,FLT_MAX,FLT_MAX},boxmax[3]={-FLT_MAX,-FLT_MAX,-FLT_MAX};
-    for(int i=0;i<p.numParticles();i++){
+    for(int64_t i=0;i<p.numParticles();i++){
         const float* pos=p.data<float>(positionHandle,i);
         for(int k=0;k<3;k++){
             boxmin[k]=min(pos[k],boxmin[k]);
@@ -317,7 +318,7 @@ bool writePTC(const char* filename,const ParticlesData& p,const bool compressed,
         output->write(specs[i].c_str(),specs[i].length());
     }
 
-    for(int pointIndex=0;pointIndex<p.numParticles();pointIndex++){
+    for(int64_t pointIndex=0;pointIndex<p.numParticles();pointIndex++){
         // write position
         const float* pos=p.data<float>(positionHandle,pointIndex);
         write<LITEND>(*output,pos[0],pos[1],pos[2]);
@@ -38,6 +38,7 @@ Some code for this format  was helped along  by referring to an implementation b
 #include "../Partio.h"
 #include "../core/ParticleHeaders.h"
 #include "io.h"
+#include "readers.h"
 
 #include <sstream>
 
@@ -48,7 +49,7 @@ using namespace std;
 
 // TODO: convert this to use iterators like the rest of the readers/writers
 
-ParticlesDataMutable* readPTS(const char* filename,const bool headersOnly,std::ostream* errorStream)
+ParticlesDataMutable* readPTS(const char* filename,const bool headersOnly,std::ostream* errorStream,ParticlesDataMutable* reuse)
 {
     unique_ptr<istream> input(io::unzip(filename));
     if (!*input) {
@@ -58,7 +59,7 @@ ParticlesDataMutable* readPTS(const char* filename,const bool headersOnly,std::o
 
     ParticlesDataMutable* simple=0;
     if (headersOnly) simple=new ParticleHeaders;
-    else simple=create();
+    else simple=createForRead(reuse);
 
     // read NPoints and NPointAttrib
     string word;
@@ -158,7 +159,7 @@ ParticlesDataMutable* readPTS(const char* filename,const bool headersOnly,std::o
 
     input->seekg(0,ios::beg);
 
-    unsigned int num=0;
+    uint64_t num=0;
     simple->addParticles(num);
     if (headersOnly) return simple; // escape before we try to touch data
 
@@ -176,7 +177,7 @@ ParticlesDataMutable* readPTS(const char* filename,const bool headersOnly,std::o
 
     // we have to read line by line, because data is not  clean and consistent so we skip any lines that dont' conform
 
-    for (unsigned int particleIndex=0;input->good();)
+    for (uint64_t particleIndex=0;input->good();)
     {
         string token = "";
         char line[1024];
@@ -208,7 +209,7 @@ ParticlesDataMutable* readPTS(const char* filename,const bool headersOnly,std::o
 					int* data=simple->dataWrite<int>(attrs[attrIndex],particleIndex);
 					if (attrs[attrIndex].name == "id")
 					{
-						data[0]=particleIndex;
+						data[0]=(int)particleIndex;
 					}
 					else
 					{
@@ -279,7 +280,7 @@ bool writePTS(const char* filename,const ParticlesData& p,const bool compressed)
     *output<<"NUMBER_OF_PARTICLES: "<<p.numParticles()<<endl;
     *output<<"BEGIN DATA"<<endl;
 
-    for(int particleIndex=0;particleIndex<p.numParticles();particleIndex++){
+    for(int64_t particleIndex=0;particleIndex<p.numParticles();particleIndex++){
         for(unsigned int attrIndex=0;attrIndex<attrs.size();attrIndex++){
             if(attrs[attrIndex].type==Partio::INT || attrs[attrIndex].type==Partio::INDEXEDSTR){
                 const int* data=p.data<int>(attrs[attrIndex],particleIndex);
@@ -36,13 +36,14 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
 #include <iostream>
 #include "../core/Mutex.h"
 #include "../Partio.h"
+#include "../core/ParticleSimple.h"
 #include "readers.h"
 
 namespace Partio{
 using namespace std;
 
 // reader and writer code
-typedef ParticlesDataMutable* (*READER_FUNCTION)(const char*,const bool,std::ostream*);
+typedef ParticlesDataMutable* (*READER_FUNCTION)(const char*,const bool,std::ostream*,ParticlesDataMutable*);
 typedef bool (*WRITER_FUNCTION)(const char*,const ParticlesData&,const bool,std::ostream*);
 
 PartioMutex initializationMutex;
@@ -144,7 +145,44 @@ read(const char* c_filename,bool verbose,std::ostream& errorStream)
         errorStream<<"Partio: No reader defined for extension "<<extension<<endl;
         return 0;
     }
-    return (*i->second)(c_filename,false,verbose ? &errorStream : 0);
+    return (*i->second)(c_filename,false,verbose ? &errorStream : 0,0);
+}
+
+ParticlesDataMutable*
+createForRead(ParticlesDataMutable* reuse)
+{
+    ParticlesSimple* simple=new ParticlesSimple;
+    if(reuse) static_cast<ParticlesSimple*>(reuse)->lendRecycled(*simple);
+    return simple;
+}
+
+bool
+readInto(const char* c_filename,ParticlesDataMutable& existing,bool verbose,std::ostream& errorStream)
+{
+    ParticlesSimple* target=dynamic_cast<ParticlesSimple*>(&existing);
+    if(!target){
+        errorStream<<"Partio: readInto requires a particle set from create() or read(), or a ParticlesStatic"<<endl;
+        return false;
+    }
+    string filename(c_filename);
+    string extension;
+    bool endsWithGz;
+    if(!extensionIgnoringGz(filename,extension,endsWithGz,errorStream)) return false;
+    map<string,READER_FUNCTION>::iterator i=readers().find(extension);
+    if(i==readers().end()){
+        errorStream<<"Partio: No reader defined for extension "<<extension<<endl;
+        return false;
+    }
+    // The reader fills a new set from the spare columns of existing, which is only replaced once it succeeded
+    ParticlesDataMutable* result=(*i->second)(c_filename,false,verbose ? &errorStream : 0,target);
+    if(!result) return false;
+    ParticlesSimple* simple=static_cast<ParticlesSimple*>(result);
+    target->swap(*simple);
+    // spares this file left unclaimed are freed, the columns of the frame it replaced are the next spares
+    target->freeRecycled();
+    simple->recycleInto(*target);
+    simple->release();
+    return true;
 }
 
 ParticlesInfo*
@@ -159,7 +197,7 @@ readHeaders(const char* c_filename,bool verbose,std::ostream& errorStream)
         errorStream<<"Partio: No reader defined for extension "<<extension<<endl;
         return 0;
     }
-    return (*i->second)(c_filename,true,verbose ? &errorStream : 0);
+    return (*i->second)(c_filename,true,verbose ? &errorStream : 0,0);
 }
 
 void
@@ -36,18 +36,22 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
 #define _READERS_h_
 
 namespace Partio{
-ParticlesDataMutable* readBGEO(	const char* filename,const bool headersOnly,std::ostream* errorStream);
-ParticlesDataMutable* readGEO(	const char* filename,const bool headersOnly,std::ostream* errorStream);
-ParticlesDataMutable* readPDB(	const char* filename,const bool headersOnly,std::ostream* errorStream);
-ParticlesDataMutable* readPDB32(const char* filename,const bool headersOnly,std::ostream* errorStream);
-ParticlesDataMutable* readPDB64(const char* filename,const bool headersOnly,std::ostream* errorStream);
-ParticlesDataMutable* readPDA(	const char* filename,const bool headersOnly,std::ostream* errorStream);
-ParticlesDataMutable* readMC(	const char* filename,const bool headersOnly,std::ostream* errorStream);
-ParticlesDataMutable* readPTC(	const char* filename,const bool headersOnly,std::ostream* errorStream);
-ParticlesDataMutable* readPDC(	const char* filename,const bool headersOnly,std::ostream* errorStream);
-ParticlesDataMutable* readPRT(	const char* filename,const bool headersOnly,std::ostream* errorStream);
-ParticlesDataMutable* readBIN(	const char* filename,const bool headersOnly,std::ostream* errorStream);
-ParticlesDataMutable* readPTS(  const char* filename,const bool headersOnly,std::ostream* errorStream);
+//! Creates the particle set a reader fills. When reuse is non-null it is the set readInto
+//! replaces once the read succeeded, whose spare attribute columns are handed to the new set.
+ParticlesDataMutable* createForRead(ParticlesDataMutable* reuse);
+
+ParticlesDataMutable* readBGEO(	const char* filename,const bool headersOnly,std::ostream* errorStream,ParticlesDataMutable* reuse);
+ParticlesDataMutable* readGEO(	const char* filename,const bool headersOnly,std::ostream* errorStream,ParticlesDataMutable* reuse);
+ParticlesDataMutable* readPDB(	const char* filename,const bool headersOnly,std::ostream* errorStream,ParticlesDataMutable* reuse);
+ParticlesDataMutable* readPDB32(const char* filename,const bool headersOnly,std::ostream* errorStream,ParticlesDataMutable* reuse);
+ParticlesDataMutable* readPDB64(const char* filename,const bool headersOnly,std::ostream* errorStream,ParticlesDataMutable* reuse);
+ParticlesDataMutable* readPDA(	const char* filename,const bool headersOnly,std::ostream* errorStream,ParticlesDataMutable* reuse);
+ParticlesDataMutable* readMC(	const char* filename,const bool headersOnly,std::ostream* errorStream,ParticlesDataMutable* reuse);
+ParticlesDataMutable* readPTC(	const char* filename,const bool headersOnly,std::ostream* errorStream,ParticlesDataMutable* reuse);
+ParticlesDataMutable* readPDC(	const char* filename,const bool headersOnly,std::ostream* errorStream,ParticlesDataMutable* reuse);
+ParticlesDataMutable* readPRT(	const char* filename,const bool headersOnly,std::ostream* errorStream,ParticlesDataMutable* reuse);
+ParticlesDataMutable* readBIN(	const char* filename,const bool headersOnly,std::ostream* errorStream,ParticlesDataMutable* reuse);
+ParticlesDataMutable* readPTS(  const char* filename,const bool headersOnly,std::ostream* errorStream,ParticlesDataMutable* reuse);
 
 bool writeBGEO(const char* filename,const ParticlesData& p,const bool compressed,std::ostream* errorStream);
 bool writeGEO(const char* filename,const ParticlesData& p,const bool compressed,std::ostream* errorStream);
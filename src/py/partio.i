@@ -67,11 +67,29 @@ struct fixedFloatArray
     };
 };
 
+// Converts a neighbor graph into the tuple (offsets,indices,distancesSquared) of lists
+PyObject* neighborGraphTuple(const NeighborGraph& graph)
+{
+    PyObject* offsetList=PyList_New(graph.offsets.size());
+    for(size_t i=0;i<graph.offsets.size();i++)
+        PyList_SetItem(offsetList,i,PyLong_FromLongLong(graph.offsets[i]));
+    PyObject* indexList=PyList_New(graph.indices.size());
+    PyObject* distanceList=PyList_New(graph.indices.size());
+    for(size_t i=0;i<graph.indices.size();i++){
+        PyList_SetItem(indexList,i,PyLong_FromLongLong((long long)graph.indices[i]));
+        PyList_SetItem(distanceList,i,PyFloat_FromDouble(graph.distancesSquared[i]));
+    }
+    return Py_BuildValue("(NNN)",offsetList,indexList,distanceList);
+}
+
 %}
 
 // Particle Types
 enum ParticleAttributeType {NONE=0,VECTOR=1,FLOAT=2,INT=3,INDEXEDSTR=4};
 
+// Neighbor query index types
+enum class IndexType {KdTree,HashGrid,KdTreeInPlace};
+
 
 %feature("docstring","A handle for operating on attribbutes of a particle set");
 class ParticleAttribute
@@ -109,14 +127,23 @@ public:
 
 
 %typemap(in) uint64_t {
-	$1 = (uint64_t) PyLong_AsLong($input);
+	$1 = (uint64_t) PyLong_AsUnsignedLongLong($input);
 }
 %typemap(out) uint64_t {
-	$result = PyLong_FromLong(
-            (long)$1);
+	$result = PyLong_FromUnsignedLongLong(
+            (unsigned long long)$1);
 }
 %apply uint64_t { ParticleIndex };
 
+%typemap(in) int64_t {
+	$1 = (int64_t) PyLong_AsLongLong($input);
+}
+%typemap(out) int64_t {
+	$result = PyLong_FromLongLong(
+            (long long)$1);
+}
+%apply int64_t { const int64_t };
+
 %typemap(in) fixedFloatArray
 {
     int i;
@@ -159,7 +186,7 @@ class ParticlesInfo
 public:
     %feature("autodoc");
     %feature("docstring","Returns the number of particles in the set");
-    virtual int numParticles() const=0;
+    virtual int64_t numParticles() const=0;
 
     %feature("autodoc");
     %feature("docstring","Returns the number of particles in the set");
@@ -185,8 +212,61 @@ class ParticlesData:public ParticlesInfo
     %feature("autodoc");
     %feature("docstring","Looks up a given fixed indexed string given the index, returns -1 if not found");
     int lookupFixedIndexedStr(const FixedAttribute& attribute,const char* str) const=0;
+
+    %feature("autodoc");
+    %feature("docstring","Writes the KdTree built by sort() to filename for loadIndex(). If\n"
+       "sourceFile is given its size and modification time are recorded");
+    bool saveIndex(const char* filename,const char* sourceFile=0) const;
 };
 
+%unrefobject AttributeIndex "$this->release();"
+%feature("autodoc");
+%feature("docstring","Neighbor queries over weighted float attributes, made by ParticlesData.attributeIndex()");
+class AttributeIndex
+{
+public:
+    %feature("autodoc");
+    %feature("docstring","Returns the number of axes of the index");
+    virtual int dimension() const=0;
+};
+
+%extend AttributeIndex {
+    %feature("autodoc");
+    %feature("docstring","Searches for the N nearest points to the query within maxRadius in the\n"
+        "weighted space. Returns a list of (index,distanceSquared) tuples");
+    PyObject* findNPoints(fixedFloatArray query,int nPoints,float maxRadius)
+    {
+        if(query.count!=$self->dimension()){
+            PyErr_SetString(PyExc_ValueError,"Need query to have one float per axis");
+            return NULL;
+        }
+        std::vector<ParticleIndex> points;
+        std::vector<float> pointDistancesSquared;
+        $self->findNPoints(query.f,nPoints,maxRadius,points,pointDistancesSquared);
+        PyObject* list=PyList_New(points.size());
+        for(unsigned int i=0;i<points.size();i++)
+            PyList_SetItem(list,i,Py_BuildValue("(Lf)",(long long)points[i],pointDistancesSquared[i]));
+        return list;
+    }
+
+    %feature("autodoc");
+    %feature("docstring","Returns the indices of all particles whose values are inside the box\n"
+        "between bboxMin and bboxMax, given in attribute units");
+    PyObject* findPoints(fixedFloatArray bboxMin,fixedFloatArray bboxMax)
+    {
+        if(bboxMin.count!=$self->dimension() || bboxMax.count!=$self->dimension()){
+            PyErr_SetString(PyExc_ValueError,"Need bboxMin and bboxMax to have one float per axis");
+            return NULL;
+        }
+        std::vector<ParticleIndex> points;
+        $self->findPoints(bboxMin.f,bboxMax.f,points);
+        PyObject* list=PyList_New(points.size());
+        for(unsigned int i=0;i<points.size();i++)
+            PyList_SetItem(list,i,PyLong_FromLongLong((long long)points[i]));
+        return list;
+    }
+}
+
 %rename(ParticleIteratorFalse) ParticleIterator<false>;
 %rename(ParticleIteratorTrue) ParticleIterator<true>;
 class ParticleIterator<true>
@@ -222,6 +302,29 @@ public:
        "attribute in the file with name 'position'");
     virtual void sort()=0;
 
+    %feature("autodoc");
+    %feature("docstring","Prepares data for neighbor searches by building the given index,\n"
+       "partio.IndexType_KdTree, partio.IndexType_HashGrid or partio.IndexType_KdTreeInPlace\n"
+       "(which reads positions without copying them, so they must not change until the next\n"
+       "sort). cellSize sets the hash grid's\n"
+       "cell size and is picked from the particle density when zero");
+    virtual void sort(const IndexType type,const float cellSize=0);
+
+    %feature("autodoc");
+    %feature("docstring","Uses an index written by saveIndex() instead of sorting. Fails if it\n"
+       "was saved for a different number of particles or sourceFile changed since");
+    bool loadIndex(const char* filename,const char* sourceFile=0);
+
+    %feature("autodoc");
+    %feature("docstring","Stores per subtree sums of attr in the KdTree so sumInBox adds up\n"
+       "whole subtrees. Call again after changing attr");
+    bool augmentIndex(const ParticleAttribute& attr);
+
+    %feature("autodoc");
+    %feature("docstring","Stores each particle's radius from the single component attr (such as\n"
+       "radius or pscale) in the KdTree for findOverlapping");
+    bool setIndexRadius(const ParticleAttribute& attr);
+
     %feature("autodoc");
     %feature("docstring","Adds a new attribute of given name, type and count. If type is\n"
         "partio.VECTOR, then count must be 3");
@@ -240,7 +343,7 @@ public:
 
     %feature("autodoc");
     %feature("docstring","Adds count particles and returns the offset to the first one");
-    virtual ParticleIterator<false> addParticles(const int count)=0;
+    virtual ParticleIterator<false> addParticles(const int64_t count)=0;
 };
 
 
@@ -270,6 +373,196 @@ public:
         return list;
     }
 
+    %feature("autodoc");
+    %feature("docstring","Like findNPoints, but the farthest point returned may be up to (1+epsilon)\n"
+        "times farther than the exact one. If maxVisited is positive the search stops after\n"
+        "that many leaf buckets of the KdTree.");
+    PyObject* findNPointsApprox(fixedFloatArray center,int nPoints,float maxRadius,float epsilon,int maxVisited=0)
+    {
+        if(center.count!=3){
+            fprintf(stderr,"Need center to be a 3 tuple of floats\n");
+            return NULL;
+        }
+        std::vector<ParticleIndex> points(nPoints>0 ? nPoints : 0);
+        std::vector<float> pointDistancesSquared(points.size());
+        float finalRadius2;
+        int found=points.empty() ? 0 : $self->findNPointsApprox(center.f,nPoints,maxRadius,epsilon,maxVisited,
+            &points[0],&pointDistancesSquared[0],&finalRadius2);
+
+        PyObject* list=PyList_New(found);
+        for(int i=0;i<found;i++)
+            PyList_SetItem(list,i,Py_BuildValue("(Lf)",(long long)points[i],pointDistancesSquared[i]));
+        return list;
+    }
+
+    %feature("autodoc");
+    %feature("docstring","Returns (index,distanceSquared) tuples for all points within radius\n"
+        "of the center location, ordered by distance if sorted is True.");
+    PyObject* findPointsInRadius(fixedFloatArray center,float radius,bool sorted=false)
+    {
+        if(center.count!=3){
+            fprintf(stderr,"Need center to be a 3 tuple of floats\n");
+            return NULL;
+        }
+        std::vector<ParticleIndex> points;
+        std::vector<float> pointDistancesSquared;
+        $self->findPointsInRadius(center.f,radius,points,pointDistancesSquared,sorted);
+
+        PyObject* list=PyList_New(points.size());
+        for(unsigned int i=0;i<points.size();i++){
+            PyObject* tuple=Py_BuildValue("(Lf)",(long long)points[i],pointDistancesSquared[i]);
+            PyList_SetItem(list,i,tuple); // tuple reference is stolen, so no decref needed
+        }
+        return list;
+    }
+
+    %feature("autodoc");
+    %feature("docstring","Searches for the N nearest points to each query position in a\n"
+        "sequence of 3 tuples, in parallel. Returns the tuple (indices,distancesSquared,counts)\n"
+        "where query q's results start at q*nPoints in the flat indices and distance lists.");
+    PyObject* findNPointsBatch(PyObject* queries,int nPoints,float maxRadius)
+    {
+        if(!PySequence_Check(queries) || nPoints<0){
+            PyErr_SetString(PyExc_TypeError,"Expecting a sequence of 3 tuples and a non-negative count");
+            return NULL;
+        }
+        Py_ssize_t nQueries=PySequence_Length(queries);
+        std::vector<float> positions(3*nQueries);
+        for(Py_ssize_t q=0;q<nQueries;q++){
+            PyObject* o=PySequence_GetItem(queries,q);
+            bool ok=o && PySequence_Check(o) && PySequence_Length(o)==3;
+            for(int c=0;ok && c<3;c++){
+                PyObject* v=PySequence_GetItem(o,c);
+                positions[3*q+c]=PyFloat_AsDouble(v);
+                Py_XDECREF(v);
+                ok=!PyErr_Occurred();
+            }
+            Py_XDECREF(o);
+            if(!ok){
+                if(!PyErr_Occurred()) PyErr_SetString(PyExc_ValueError,"Expecting a sequence of 3 tuples of floats");
+                return NULL;
+            }
+        }
+
+        std::vector<ParticleIndex> indices(nQueries*nPoints+1);
+        std::vector<float> distancesSquared(nQueries*nPoints+1);
+        std::vector<int> counts(nQueries+1,0);
+        $self->findNPointsBatch(positions.empty() ? 0 : &positions[0],nQueries,nPoints,maxRadius,
+            &indices[0],&distancesSquared[0],&counts[0]);
+
+        PyObject* indexList=PyList_New(nQueries*nPoints);
+        PyObject* distanceList=PyList_New(nQueries*nPoints);
+        PyObject* countList=PyList_New(nQueries);
+        for(Py_ssize_t q=0;q<nQueries;q++){
+            for(int i=0;i<nPoints;i++){
+                bool found=i<counts[q];
+                PyList_SetItem(indexList,q*nPoints+i,PyLong_FromLongLong(found ? (long long)indices[q*nPoints+i] : -1));
+                PyList_SetItem(distanceList,q*nPoints+i,PyFloat_FromDouble(found ? distancesSquared[q*nPoints+i] : 0.));
+            }
+            PyList_SetItem(countList,q,PyLong_FromLongLong(counts[q]));
+        }
+        return Py_BuildValue("(NNN)",indexList,distanceList,countList);
+    }
+
+    %feature("autodoc");
+    %feature("docstring","Finds the nPoints nearest neighbors of every particle within maxRadius.\n"
+        "Returns the tuple (offsets,indices,distancesSquared) where particle i's neighbors\n"
+        "are indices[offsets[i]:offsets[i+1]], nearest first. Must call sort() first.");
+    PyObject* neighborGraph(int nPoints,float maxRadius,bool includeSelf=false)
+    {
+        NeighborGraph graph;
+        buildNeighborGraph(*$self,nPoints,maxRadius,graph,includeSelf);
+        return neighborGraphTuple(graph);
+    }
+
+    %feature("autodoc");
+    %feature("docstring","Finds all neighbors of every particle within radius. Returns the tuple\n"
+        "(offsets,indices,distancesSquared) where particle i's neighbors are\n"
+        "indices[offsets[i]:offsets[i+1]], nearest first. Must call sort() first.");
+    PyObject* radiusNeighborGraph(float radius,bool includeSelf=false)
+    {
+        NeighborGraph graph;
+        buildNeighborGraph(*$self,radius,graph,includeSelf);
+        return neighborGraphTuple(graph);
+    }
+
+    %feature("autodoc");
+    %feature("docstring","Finds the nPoints nearest particles of other within maxRadius for every\n"
+        "particle of this set. Returns the tuple (offsets,indices,distancesSquared) where\n"
+        "particle i's neighbors are other's indices[offsets[i]:offsets[i+1]], nearest first.\n"
+        "Must call sort() on other first.");
+    PyObject* nearestJoin(const ParticlesData* other,int nPoints,float maxRadius)
+    {
+        NeighborGraph graph;
+        Partio::nearestJoin(*$self,*other,nPoints,maxRadius,graph);
+        return neighborGraphTuple(graph);
+    }
+
+    %feature("autodoc");
+    %feature("docstring","Returns the sorted indices of an evenly spread subset of the particles, one\n"
+        "per cell of size spacing, or with poisson set, no two closer than spacing");
+    PyObject* downsample(float spacing,bool poisson=false)
+    {
+        std::vector<ParticleIndex> points;
+        if(!Partio::downsample(*$self,poisson ? DownsampleMode::PoissonDisk : DownsampleMode::Voxel,spacing,points)){
+            PyErr_SetString(PyExc_ValueError,"Cannot downsample with this spacing");
+            return NULL;
+        }
+        PyObject* list=PyList_New(points.size());
+        for(size_t i=0;i<points.size();i++) PyList_SetItem(list,i,PyLong_FromLongLong((long long)points[i]));
+        return list;
+    }
+
+    %feature("autodoc");
+    %feature("docstring","Builds an AttributeIndex over the named float attributes, with an optional\n"
+        "sequence of per axis weights. Returns None if it cannot be built");
+    %newobject attributeIndex;
+    AttributeIndex* attributeIndex(PyObject* names,PyObject* weights=0)
+    {
+        if(!PySequence_Check(names)){
+            PyErr_SetString(PyExc_TypeError,"Expecting a sequence of attribute names");
+            return NULL;
+        }
+        std::vector<ParticleAttribute> attributes(PySequence_Length(names));
+        for(size_t a=0;a<attributes.size();a++){
+            PyObject* o=PySequence_GetItem(names,a);
+            std::string name;
+            if(o && PyBytes_Check(o)) name=PyBytes_AsString(o);
+            else if(o && PyUnicode_Check(o)){
+                PyObject* utf8=PyUnicode_AsUTF8String(o);
+                if(utf8) name=PyBytes_AsString(utf8);
+                Py_XDECREF(utf8);
+            }
+            Py_XDECREF(o);
+            bool found=!name.empty() && $self->attributeInfo(name.c_str(),attributes[a]);
+            if(!found){
+                PyErr_SetString(PyExc_ValueError,"Expecting names of existing attributes");
+                return NULL;
+            }
+        }
+        std::vector<float> axisWeights;
+        if(weights && weights!=Py_None){
+            if(!PySequence_Check(weights)){
+                PyErr_SetString(PyExc_TypeError,"Expecting a sequence of weights");
+                return NULL;
+            }
+            axisWeights.resize(PySequence_Length(weights));
+            for(size_t i=0;i<axisWeights.size();i++){
+                PyObject* o=PySequence_GetItem(weights,i);
+                axisWeights[i]=PyFloat_AsDouble(o);
+                Py_XDECREF(o);
+                if(PyErr_Occurred()) return NULL;
+            }
+            int dimension=0;
+            for(size_t a=0;a<attributes.size();a++) dimension+=attributes[a].count;
+            if(int(axisWeights.size())!=dimension){
+                PyErr_SetString(PyExc_ValueError,"Expecting one weight per attribute component");
+                return NULL;
+            }
+        }
+        return createAttributeIndex(*$self,attributes,axisWeights.empty() ? 0 : &axisWeights[0]);
+    }
+
     %feature("autodoc");
     %feature("docstring","Returns the indices of all points within the bounding\n"
         "box defined by the two cube corners bboxMin and bboxMax");
@@ -287,8 +580,147 @@ public:
         // build the python return type
         PyObject* list=PyList_New(points.size());
         for(unsigned int i=0;i<points.size();i++){
-            PyList_SetItem(list,i,PyInt_FromLong(points[i])); // tuple reference is stolen, so no decref needed
+            PyList_SetItem(list,i,PyLong_FromLongLong((long long)points[i])); // tuple reference is stolen, so no decref needed
+        }
+        return list;
+    }
+
+    %feature("autodoc");
+    %feature("docstring","Returns the indices of all points inside the convex volume bounded by a\n"
+        "sequence of (a,b,c,d) planes, where a*x+b*y+c*z+d>=0 is inside");
+    PyObject* findPointsInFrustum(PyObject* planes)
+    {
+        if(!PySequence_Check(planes)){
+            PyErr_SetString(PyExc_TypeError,"Expecting a sequence of 4 tuples");
+            return NULL;
+        }
+        Py_ssize_t nPlanes=PySequence_Length(planes);
+        std::vector<float> values(4*nPlanes);
+        for(Py_ssize_t p=0;p<nPlanes;p++){
+            PyObject* o=PySequence_GetItem(planes,p);
+            bool ok=o && PySequence_Check(o) && PySequence_Length(o)==4;
+            for(int c=0;ok && c<4;c++){
+                PyObject* v=PySequence_GetItem(o,c);
+                values[4*p+c]=PyFloat_AsDouble(v);
+                Py_XDECREF(v);
+                ok=!PyErr_Occurred();
+            }
+            Py_XDECREF(o);
+            if(!ok){
+                if(!PyErr_Occurred()) PyErr_SetString(PyExc_TypeError,"Expecting a sequence of 4 tuples");
+                return NULL;
+            }
+        }
+        std::vector<ParticleIndex> points;
+        $self->findPointsInFrustum(values.empty() ? 0 : &values[0],int(nPlanes),points);
+        PyObject* list=PyList_New(points.size());
+        for(unsigned int i=0;i<points.size();i++) PyList_SetItem(list,i,PyLong_FromLongLong((long long)points[i]));
+        return list;
+    }
+
+    %feature("autodoc");
+    %feature("docstring","Returns the indices of all points whose sphere, of the radius given\n"
+        "to setIndexRadius, overlaps the bounding box from bboxMin to bboxMax");
+    PyObject* findOverlapping(fixedFloatArray bboxMin,fixedFloatArray bboxMax)
+    {
+        if(bboxMin.count!=3 || bboxMax.count!=3){
+            fprintf(stderr,"Need bboxMin and bboxMax to be a 3 tuple of floats\n");
+            return NULL;
+        }
+        std::vector<ParticleIndex> points;
+        $self->findOverlapping(bboxMin.f,bboxMax.f,points);
+        PyObject* list=PyList_New(points.size());
+        for(unsigned int i=0;i<points.size();i++) PyList_SetItem(list,i,PyLong_FromLongLong((long long)points[i]));
+        return list;
+    }
+
+    %feature("autodoc");
+    %feature("docstring","Returns the indices of all points whose sphere, of the radius given\n"
+        "to setIndexRadius, overlaps the sphere of radius around center");
+    PyObject* findOverlappingInRadius(fixedFloatArray center,float radius)
+    {
+        if(center.count!=3){
+            fprintf(stderr,"Need center to be a 3 tuple of floats\n");
+            return NULL;
         }
+        std::vector<ParticleIndex> points;
+        $self->findOverlappingInRadius(center.f,radius,points);
+        PyObject* list=PyList_New(points.size());
+        for(unsigned int i=0;i<points.size();i++) PyList_SetItem(list,i,PyLong_FromLongLong((long long)points[i]));
+        return list;
+    }
+
+    %feature("autodoc");
+    %feature("docstring","Returns the number of points within the bounding box\n"
+        "defined by the two cube corners bboxMin and bboxMax");
+    int64_t countInBox(fixedFloatArray bboxMin,fixedFloatArray bboxMax)
+    {
+        if(bboxMin.count!=3 || bboxMax.count!=3){
+            fprintf(stderr,"Need bboxMin and bboxMax to be a 3 tuple of floats\n");
+            return 0;
+        }
+        return $self->countInBox(bboxMin.f,bboxMax.f);
+    }
+
+    %feature("autodoc");
+    %feature("docstring","Returns the number of points within radius of center");
+    int64_t countInRadius(fixedFloatArray center,float radius)
+    {
+        if(center.count!=3){
+            fprintf(stderr,"Need center to be a 3 tuple of floats\n");
+            return 0;
+        }
+        return $self->countInRadius(center.f,radius);
+    }
+
+    %feature("autodoc");
+    %feature("docstring","Returns (count,sums) for the points within the bounding box, where\n"
+        "sums is a tuple of the sums of each component of attr");
+    PyObject* sumInBox(const ParticleAttribute& attr,fixedFloatArray bboxMin,fixedFloatArray bboxMax)
+    {
+        if(bboxMin.count!=3 || bboxMax.count!=3){
+            fprintf(stderr,"Need bboxMin and bboxMax to be a 3 tuple of floats\n");
+            return NULL;
+        }
+        std::vector<double> sums(attr.count);
+        int64_t count=$self->sumInBox(attr,bboxMin.f,bboxMax.f,sums.empty() ? 0 : &sums[0]);
+        PyObject* sumsTuple=PyTuple_New(sums.size());
+        for(unsigned int i=0;i<sums.size();i++) PyTuple_SetItem(sumsTuple,i,PyFloat_FromDouble(sums[i]));
+        PyObject* result=PyTuple_New(2);
+        PyTuple_SetItem(result,0,PyLong_FromLongLong(count));
+        PyTuple_SetItem(result,1,sumsTuple);
+        return result;
+    }
+
+    %feature("autodoc");
+    %feature("docstring","Returns the indices of all points within radius of the ray from origin\n"
+        "along direction, up to length away from origin");
+    PyObject* findPointsAlongRay(fixedFloatArray origin,fixedFloatArray direction,float radius,float length)
+    {
+        if(origin.count!=3 || direction.count!=3){
+            fprintf(stderr,"Need origin and direction to be a 3 tuple of floats\n");
+            return NULL;
+        }
+        std::vector<ParticleIndex> points;
+        $self->findPointsAlongRay(origin.f,direction.f,radius,length,points);
+        PyObject* list=PyList_New(points.size());
+        for(unsigned int i=0;i<points.size();i++) PyList_SetItem(list,i,PyLong_FromLongLong((long long)points[i]));
+        return list;
+    }
+
+    %feature("autodoc");
+    %feature("docstring","Returns the indices of all points inside the box around center that extends\n"
+        "halfExtents[i] both ways along axis i, given as 9 floats for three orthonormal axes");
+    PyObject* findPointsInOrientedBox(fixedFloatArray center,fixedFloatArray axes,fixedFloatArray halfExtents)
+    {
+        if(center.count!=3 || axes.count!=9 || halfExtents.count!=3){
+            fprintf(stderr,"Need center and halfExtents to be 3 tuples and axes a 9 tuple of floats\n");
+            return NULL;
+        }
+        std::vector<ParticleIndex> points;
+        $self->findPointsInOrientedBox(center.f,axes.f,halfExtents.f,points);
+        PyObject* list=PyList_New(points.size());
+        for(unsigned int i=0;i<points.size();i++) PyList_SetItem(list,i,PyLong_FromLongLong((long long)points[i]));
         return list;
     }
 
@@ -533,6 +965,10 @@ ParticlesDataMutable* create();
 %newobject read;
 ParticlesDataMutable* read(const char* filename,bool verbose=true,std::ostream& error=std::cerr);
 
+%feature("autodoc");
+%feature("docstring","Reads a particle set from disk into an existing particle set, reusing its storage");
+bool readInto(const char* filename,ParticlesDataMutable& existing,bool verbose=true,std::ostream& error=std::cerr);
+
 %inline %{
     template<class T> PyObject* readHelper(T* ptr,std::stringstream& ss){
         PyObject* tuple=PyTuple_New(2);
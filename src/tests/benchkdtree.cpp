@@ -0,0 +1,221 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+
+// Speed/recall of approximate nearest neighbor searches against exact ones,
+// and speed of seeded searches over a sequence of moving frames.
+// Usage: benchkdtree [particle file or point count] [queries] [neighbors]
+// Without a file, uniformly random points are generated.
+// Seeded searches pay off when the particle order is spatially coherent, since
+// the seeds' positions are read in particle order.
+
+#include <Partio.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+double seconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+float randomUnit()
+{
+    return rand() / (RAND_MAX + 1.f);
+}
+
+struct Point
+{
+    float p[3];
+    // index of the point's cell in a 32x32x32 grid over the unit cube
+    int cell() const { return (int(p[0] * 32) * 32 + int(p[1] * 32)) * 32 + int(p[2] * 32); }
+};
+}
+
+int main(int argc, char* argv[])
+{
+    const char* source = argc > 1 ? argv[1] : "1000000";
+    const int nQueries = argc > 2 ? atoi(argv[2]) : 100000;
+    const int nPoints = argc > 3 ? atoi(argv[3]) : 16;
+
+    Partio::ParticlesDataMutable* particles = 0;
+    char* end = 0;
+    long long count = strtoll(source, &end, 10);
+    if (*end == 0 && count > 0) {
+        particles = Partio::create();
+        Partio::ParticleAttribute position = particles->addAttribute("position", Partio::VECTOR, 3);
+        particles->addParticles(count);
+        srand(1);
+        std::vector<Point> points(count);
+        for (long long i = 0; i < count; i++)
+            for (int c = 0; c < 3; c++) points[i].p[c] = randomUnit();
+        // store them cell by cell, as simulations often keep nearby particles together
+        std::sort(points.begin(), points.end(), [](const Point& a, const Point& b) { return a.cell() < b.cell(); });
+        for (long long i = 0; i < count; i++) std::copy(points[i].p, points[i].p + 3, particles->dataWrite<float>(position, i));
+    } else {
+        particles = Partio::read(source);
+        if (!particles) return 1;
+    }
+    Partio::ParticleAttribute position;
+    if (!particles->attributeInfo("position", position) || !particles->numParticles()) {
+        std::cerr << "benchkdtree: no particle positions in " << source << std::endl;
+        return 1;
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    particles->sort();
+    std::cout << particles->numParticles() << " particles, sorted in " << seconds(start) << "s\n";
+
+    // queries near the particles, like lookups during shading
+    std::vector<float> queries(3 * nQueries);
+    srand(2);
+    for (int q = 0; q < nQueries; q++) {
+        const float* p = particles->data<float>(position, rand() % particles->numParticles());
+        for (int c = 0; c < 3; c++) queries[3 * q + c] = p[c] + (randomUnit() - .5f) * 1e-3f;
+    }
+
+    std::vector<Partio::ParticleIndex> exact(nQueries * nPoints), found(nPoints);
+    std::vector<float> exactDistances(nQueries * nPoints), foundDistances(nPoints);
+    std::vector<int> exactCounts(nQueries);
+    float finalRadius2;
+    start = std::chrono::steady_clock::now();
+    for (int q = 0; q < nQueries; q++)
+        exactCounts[q] = particles->findNPoints(&queries[3 * q], nPoints, 1e10f, &exact[q * nPoints],
+                                                &exactDistances[q * nPoints], &finalRadius2);
+    const double exactTime = seconds(start);
+    for (int q = 0; q < nQueries; q++) std::sort(&exact[q * nPoints], &exact[q * nPoints] + exactCounts[q]);
+    printf("%8s %10s %12s %10s %8s %12s\n", "epsilon", "maxVisited", "queries/s", "speedup", "recall", "distRatio");
+    printf("%8s %10s %12.0f %10.2f %8.4f %12.4f\n", "exact", "-", nQueries / exactTime, 1., 1., 1.);
+
+    const float epsilons[] = {0.f, .1f, .25f, .5f, 1.f, 2.f};
+    const int maxVisiteds[] = {0, 16, 4, 1};
+    for (size_t v = 0; v < sizeof(maxVisiteds) / sizeof(maxVisiteds[0]); v++) {
+        for (size_t e = 0; e < sizeof(epsilons) / sizeof(epsilons[0]); e++) {
+            if (epsilons[e] == 0 && maxVisiteds[v] == 0) continue;
+            // recall: fraction of the exact neighbors returned, distRatio: mean
+            // ratio of the farthest returned distance to the exact one
+            long long hits = 0, total = 0;
+            double ratios = 0;
+            double elapsed = 0;
+            for (int q = 0; q < nQueries; q++) {
+                start = std::chrono::steady_clock::now();
+                int n = particles->findNPointsApprox(&queries[3 * q], nPoints, 1e10f, epsilons[e], maxVisiteds[v],
+                                                     &found[0], &foundDistances[0], &finalRadius2);
+                elapsed += seconds(start);
+                const Partio::ParticleIndex* row = &exact[q * nPoints];
+                for (int i = 0; i < n; i++) hits += std::binary_search(row, row + exactCounts[q], found[i]);
+                total += exactCounts[q];
+                float farthest = n ? *std::max_element(&foundDistances[0], &foundDistances[0] + n) : 0;
+                float exactFarthest = *std::max_element(&exactDistances[q * nPoints],
+                                                        &exactDistances[q * nPoints] + exactCounts[q]);
+                ratios += exactFarthest > 0 ? std::sqrt(farthest / exactFarthest) : 1.;
+            }
+            printf("%8.2f %10d %12.0f %10.2f %8.4f %12.4f\n", epsilons[e], maxVisiteds[v], nQueries / elapsed,
+                   exactTime / elapsed, double(hits) / total, ratios / nQueries);
+        }
+    }
+
+    // moving sequence: each frame the particles drift and are sorted again, then
+    // the first particles look up their neighbors from scratch, or seeded with
+    // their neighbors from the previous frame
+    const int nFrames = 5;
+    const int64_t nMoving = std::min<int64_t>(nQueries, particles->numParticles());
+    float bboxMin[3] = {1e30f, 1e30f, 1e30f}, bboxMax[3] = {-1e30f, -1e30f, -1e30f};
+    for (int64_t i = 0; i < particles->numParticles(); i++) {
+        const float* p = particles->data<float>(position, i);
+        for (int c = 0; c < 3; c++) {
+            bboxMin[c] = std::min(bboxMin[c], p[c]);
+            bboxMax[c] = std::max(bboxMax[c], p[c]);
+        }
+    }
+    float step = 0;
+    for (int c = 0; c < 3; c++) step = std::max(step, (bboxMax[c] - bboxMin[c]) * 1e-3f);
+    std::vector<float> velocities(3 * particles->numParticles());
+    srand(3);
+    for (size_t i = 0; i < velocities.size(); i++) velocities[i] = (randomUnit() - .5f) * step;
+
+    std::vector<Partio::ParticleIndex> plain(nMoving * nPoints), seeded(nMoving * nPoints);
+    std::vector<float> plainDistances(nMoving * nPoints), seededDistances(nMoving * nPoints);
+    std::vector<int> plainCounts(nMoving), seededCounts(nMoving);
+    printf("\n%8s %12s %12s %10s %10s\n", "frame", "batch/s", "seeded/s", "speedup", "mismatch");
+    for (int frame = 0; frame < nFrames; frame++) {
+        if (frame > 0) {
+            for (int64_t i = 0; i < particles->numParticles(); i++) {
+                float* p = particles->dataWrite<float>(position, i);
+                for (int c = 0; c < 3; c++) p[c] += velocities[3 * i + c];
+            }
+            particles->sort();
+        }
+        std::vector<float> moving(3 * nMoving);
+        for (int64_t i = 0; i < nMoving; i++) {
+            const float* p = particles->data<float>(position, i);
+            for (int c = 0; c < 3; c++) moving[3 * i + c] = p[c];
+        }
+
+        start = std::chrono::steady_clock::now();
+        particles->findNPointsBatch(&moving[0], nMoving, nPoints, 1e10f, &plain[0], &plainDistances[0], &plainCounts[0]);
+        const double plainTime = seconds(start);
+        if (frame == 0) {
+            seeded = plain;
+            seededDistances = plainDistances;
+            seededCounts = plainCounts;
+            continue;
+        }
+        start = std::chrono::steady_clock::now();
+        particles->findNPointsSeeded(&moving[0], nMoving, nPoints, 1e10f, &seeded[0], &seededCounts[0], &seeded[0],
+                                     &seededDistances[0], &seededCounts[0]);
+        const double seededTime = seconds(start);
+
+        // rows may differ in tied neighbors, but not in their distances
+        long long mismatches = 0;
+        for (int64_t q = 0; q < nMoving; q++) {
+            float* a = &plainDistances[q * nPoints];
+            float* b = &seededDistances[q * nPoints];
+            std::sort(a, a + plainCounts[q]);
+            std::sort(b, b + seededCounts[q]);
+            mismatches += plainCounts[q] != seededCounts[q] || !std::equal(a, a + plainCounts[q], b);
+        }
+        printf("%8d %12.0f %12.0f %10.2f %10lld\n", frame, nMoving / plainTime, nMoving / seededTime,
+               plainTime / seededTime, mismatches);
+    }
+
+    particles->release();
+    return 0;
+}
@@ -0,0 +1,115 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+#include <gtest/gtest.h>
+#include <Partio.h>
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+TEST(DownsampleTest, modes)
+{
+    Partio::ParticlesDataMutable* p = Partio::create();
+    Partio::ParticleAttribute posAttr = p->addAttribute("position", Partio::VECTOR, 3);
+    const int n = 8000;
+    p->addParticles(n);
+    srand(5);
+    for (int i = 0; i < n; i++) {
+        float* pos = p->dataWrite<float>(posAttr, i);
+        for (int c = 0; c < 3; c++) pos[c] = (rand() % 1000) / 1000.f;
+    }
+
+    // voxels keep the particle nearest each occupied cell's center
+    const float spacing = .1f;
+    std::vector<uint64_t> kept;
+    ASSERT_TRUE(Partio::downsample(*p, Partio::DownsampleMode::Voxel, spacing, kept));
+    std::vector<int> cellKept(1000, -1);
+    std::vector<float> cellBest(1000, 1e10f);
+    for (int i = 0; i < n; i++) {
+        const float* pos = p->data<float>(posAttr, i);
+        int cell = 0;
+        float d = 0;
+        for (int c = 2; c >= 0; c--) {
+            const int coord = std::min(9, int(pos[c] / spacing));
+            cell = cell * 10 + coord;
+            d += (pos[c] - (coord + .5f) * spacing) * (pos[c] - (coord + .5f) * spacing);
+        }
+        if (d < cellBest[cell]) {
+            cellBest[cell] = d;
+            cellKept[cell] = i;
+        }
+    }
+    std::vector<uint64_t> expected;
+    for (int cell = 0; cell < 1000; cell++)
+        if (cellKept[cell] >= 0) expected.push_back(cellKept[cell]);
+    std::sort(expected.begin(), expected.end());
+    ASSERT_TRUE(kept == expected);
+
+    // poisson disk samples are spacing apart and cover every particle
+    ASSERT_TRUE(Partio::downsample(*p, Partio::DownsampleMode::PoissonDisk, spacing, kept));
+    ASSERT_TRUE(kept.size() > 100 && std::is_sorted(kept.begin(), kept.end()));
+    std::vector<float> keptPos;
+    for (size_t i = 0; i < kept.size(); i++) {
+        const float* pos = p->data<float>(posAttr, kept[i]);
+        keptPos.insert(keptPos.end(), pos, pos + 3);
+    }
+    for (int i = 0; i < n; i++) {
+        const float* pos = p->data<float>(posAttr, i);
+        float nearest = 1e10f;
+        for (size_t j = 0; j < kept.size(); j++) {
+            if (kept[j] == (uint64_t)i) continue;
+            float d = 0;
+            for (int c = 0; c < 3; c++) d += (pos[c] - keptPos[3 * j + c]) * (pos[c] - keptPos[3 * j + c]);
+            nearest = std::min(nearest, d);
+        }
+        const bool isKept = std::binary_search(kept.begin(), kept.end(), (uint64_t)i);
+        ASSERT_TRUE(isKept == (nearest >= spacing * spacing));
+    }
+    std::vector<uint64_t> again;
+    Partio::downsample(*p, Partio::DownsampleMode::PoissonDisk, spacing, again);
+    ASSERT_TRUE(again == kept);
+
+    for (int mode = 0; mode < 2; mode++) {
+        ASSERT_TRUE(Partio::downsampleToCount(*p, mode ? Partio::DownsampleMode::PoissonDisk : Partio::DownsampleMode::Voxel, 500, kept));
+        ASSERT_TRUE(kept.size() >= 450 && kept.size() <= 550);
+    }
+    ASSERT_TRUE(!Partio::downsample(*p, Partio::DownsampleMode::Voxel, 1e-9f, kept));
+    p->release();
+}
+
+int main(int argc, char* argv[])
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,150 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+#include <gtest/gtest.h>
+#include <Partio.h>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+TEST(InterpolateTest, kernels)
+{
+    Partio::ParticlesDataMutable* p = Partio::create();
+    Partio::ParticleAttribute posAttr = p->addAttribute("position", Partio::VECTOR, 3);
+    Partio::ParticleAttribute colorAttr = p->addAttribute("color", Partio::VECTOR, 3);
+    Partio::ParticleAttribute massAttr = p->addAttribute("mass", Partio::FLOAT, 1);
+    const int n = 3000;
+    p->addParticles(n);
+    srand(7);
+    for (int i = 0; i < n; i++) {
+        float* pos = p->dataWrite<float>(posAttr, i);
+        float* color = p->dataWrite<float>(colorAttr, i);
+        for (int c = 0; c < 3; c++) {
+            pos[c] = (rand() % 1000) / 1000.f;
+            color[c] = (rand() % 100) / 100.f;
+        }
+        *p->dataWrite<float>(massAttr, i) = 1 + (rand() % 10) / 10.f;
+    }
+    // refused up front instead of every query finding nothing
+    const float unsortedQuery[3] = {.5f, .5f, .5f};
+    float unsortedValue[3];
+    ASSERT_TRUE(!Partio::interpolate(*p, unsortedQuery, 1, {colorAttr}, Partio::SphKernel::Poly6, .15f, unsortedValue));
+    p->sort();
+
+    const int nQueries = 200;
+    std::vector<float> queries(3 * nQueries);
+    for (int q = 0; q < 3 * nQueries; q++) queries[q] = (rand() % 1200) / 1000.f - .1f;
+    queries[0] = queries[1] = queries[2] = 5;  // out of reach
+    std::vector<Partio::ParticleAttribute> attrs;
+    attrs.push_back(colorAttr);
+    attrs.push_back(massAttr);
+    const float radius = .15f;
+    const double pi = 3.14159265358979;
+    const Partio::SphKernel kernels[] = {Partio::SphKernel::CubicSpline, Partio::SphKernel::Poly6,
+                                         Partio::SphKernel::WendlandC2};
+    std::vector<float> values(4 * nQueries), normalized(4 * nQueries), density(nQueries);
+    for (int k = 0; k < 3; k++) {
+        ASSERT_TRUE(Partio::interpolate(*p, &queries[0], nQueries, attrs, kernels[k], radius, &values[0], &massAttr,
+                                        false, &density[0]));
+        ASSERT_TRUE(Partio::interpolate(*p, &queries[0], nQueries, attrs, kernels[k], radius, &normalized[0]));
+        // the unnormalized sums are the kernel's normalized shape over the particles in reach
+        for (int q = 0; q < nQueries; q++) {
+            double sums[4] = {0, 0, 0, 0}, plain[4] = {0, 0, 0, 0}, weightSum = 0, plainSum = 0;
+            for (int i = 0; i < n; i++) {
+                const float* pos = p->data<float>(posAttr, i);
+                double d2 = 0;
+                for (int c = 0; c < 3; c++) d2 += (pos[c] - queries[3 * q + c]) * (pos[c] - queries[3 * q + c]);
+                const double r = std::sqrt(d2) / radius;
+                if (r >= 1) continue;
+                double w;
+                if (k == 0) w = 8 / pi * (r <= .5 ? 1 - 6 * r * r + 6 * r * r * r : 2 * std::pow(1 - r, 3));
+                else if (k == 1) w = 315 / (64 * pi) * std::pow(1 - r * r, 3);
+                else w = 21 / (2 * pi) * std::pow(1 - r, 4) * (1 + 4 * r);
+                w /= radius * radius * radius;
+                const float* color = p->data<float>(colorAttr, i);
+                const float mass = *p->data<float>(massAttr, i);
+                for (int c = 0; c < 4; c++) {
+                    const double value = c < 3 ? color[c] : mass;
+                    sums[c] += w * mass * value;
+                    plain[c] += w * value;
+                }
+                weightSum += w * mass;
+                plainSum += w;
+            }
+            ASSERT_TRUE(std::fabs(density[q] - weightSum) <= 1e-3 * (1 + weightSum));
+            for (int c = 0; c < 4; c++) {
+                ASSERT_TRUE(std::fabs(values[4 * q + c] - sums[c]) <= 1e-3 * (1 + sums[c]));
+                const double expected = plainSum > 0 ? plain[c] / plainSum : 0;
+                ASSERT_TRUE(std::fabs(normalized[4 * q + c] - expected) <= 1e-4);
+            }
+        }
+        ASSERT_TRUE(values[0] == 0 && normalized[3] == 0 && density[0] == 0);
+    }
+
+    // particles on a lattice with their cell's volume add up to 1 away from the edges
+    Partio::ParticlesDataMutable* lattice = Partio::create();
+    Partio::ParticleAttribute latticePos = lattice->addAttribute("position", Partio::VECTOR, 3);
+    Partio::ParticleAttribute latticeVolume = lattice->addAttribute("volume", Partio::FLOAT, 1);
+    const int side = 20;
+    const float spacing = .05f;
+    lattice->addParticles(side * side * side);
+    for (int i = 0; i < side * side * side; i++) {
+        float* pos = lattice->dataWrite<float>(latticePos, i);
+        pos[0] = (i % side) * spacing;
+        pos[1] = (i / side % side) * spacing;
+        pos[2] = (i / side / side) * spacing;
+        *lattice->dataWrite<float>(latticeVolume, i) = spacing * spacing * spacing;
+    }
+    lattice->sort();
+    const float center[3] = {.48f, .51f, .5f};
+    std::vector<Partio::ParticleAttribute> none;
+    for (int k = 0; k < 3; k++) {
+        float total = 0;
+        ASSERT_TRUE(Partio::interpolate(*lattice, center, 1, none, kernels[k], 4 * spacing, 0, &latticeVolume, false,
+                                        &total));
+        ASSERT_TRUE(std::fabs(total - 1) < .02f);
+    }
+    lattice->release();
+
+    Partio::ParticleAttribute idAttr = p->addAttribute("id", Partio::INT, 1);
+    attrs.push_back(idAttr);
+    ASSERT_TRUE(!Partio::interpolate(*p, &queries[0], nQueries, attrs, kernels[0], radius, &values[0]));
+    p->release();
+}
+
+int main(int argc, char* argv[])
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
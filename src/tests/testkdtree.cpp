@@ -39,7 +39,17 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
 #include <cmath>
 #include <stdexcept>
 #include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
 #define GRIDN 9
+#define LARGEN 1500000
 
 
 #define TESTASSERT(x)\
@@ -72,8 +82,742 @@ Partio::ParticlesDataMutable* makeData()
     return &foo;
 }
 
+// Large enough to go through the parallel partition and subtree builds,
+// and quantized so that many coordinates are equal
+Partio::ParticlesDataMutable* makeLargeData(Partio::ParticlesDataMutable* foo)
+{
+    Partio::ParticleAttribute positionAttr=foo->addAttribute("position",Partio::VECTOR,3);
+    foo->addAttribute("id",Partio::INT,1);
+    foo->addParticles(LARGEN);
+    srand(1);
+    for (int i = 0; i < LARGEN; i++) {
+        float* pos = foo->dataWrite<float>(positionAttr, i);
+        for (int c = 0; c < 3; c++) pos[c] = (rand() % 1000) / 1000.f;
+    }
+    std::cout << "Building large tree ...\n";
+    foo->sort();
+    std::cout << "Done\n";
+    return foo;
+}
+
+void testLargeLookups(Partio::ParticlesDataMutable* foo)
+{
+    Partio::ParticleAttribute posAttr;
+    TESTASSERT (foo->attributeInfo("position", posAttr));
+    for (int q = 0; q < 10; q++) {
+        float point[3] = {q * .1f, 1.f - q * .1f, .05f + q * .09f};
+        std::vector<uint64_t> indices;
+        std::vector<float> dists;
+        foo->findNPoints(point, 8, 1.f, indices, dists);
+        TESTASSERT (indices.size() == 8);
+
+        std::vector<float> expected;
+        for (int i = 0; i < LARGEN; i++) {
+            const float* pos = foo->data<float>(posAttr, i);
+            float d = 0;
+            for (int c = 0; c < 3; c++) d += (pos[c] - point[c]) * (pos[c] - point[c]);
+            expected.push_back(d);
+        }
+        std::partial_sort(expected.begin(), expected.begin() + 8, expected.end());
+        std::sort(dists.begin(), dists.end());
+        for (int i = 0; i < 8; i++) TESTASSERT (dists[i] == expected[i]);
+        for (size_t i = 0; i < indices.size(); i++) {
+            const float* pos = foo->data<float>(posAttr, indices[i]);
+            float d = 0;
+            for (int c = 0; c < 3; c++) d += (pos[c] - point[c]) * (pos[c] - point[c]);
+            TESTASSERT (d <= expected[7]);
+        }
+
+        // approximate searches stay within their bound, capped ones still return points
+        uint64_t approxIndices[8];
+        float approxDists[8], finalRadius2;
+        int found = foo->findNPointsApprox(point, 8, 1.f, .5f, 0, approxIndices, approxDists, &finalRadius2);
+        TESTASSERT (found == 8);
+        for (int i = 0; i < found; i++) TESTASSERT (approxDists[i] <= expected[7] * 1.5f * 1.5f);
+        found = foo->findNPointsApprox(point, 8, 1.f, 0.f, 0, approxIndices, approxDists, &finalRadius2);
+        TESTASSERT (found == 8 && *std::max_element(approxDists, approxDists + 8) == expected[7]);
+        found = foo->findNPointsApprox(point, 8, 1.f, 0.f, 1, approxIndices, approxDists, &finalRadius2);
+        TESTASSERT (found > 0 && found <= 8);
+
+        float bmin[3] = {point[0] - .05f, point[1] - .05f, point[2] - .05f};
+        float bmax[3] = {point[0] + .05f, point[1] + .05f, point[2] + .05f};
+        std::vector<uint64_t> inBox;
+        foo->findPoints(bmin, bmax, inBox);
+        size_t expectedInBox = 0;
+        for (int i = 0; i < LARGEN; i++) {
+            const float* pos = foo->data<float>(posAttr, i);
+            bool inside = true;
+            for (int c = 0; c < 3; c++) inside = inside && pos[c] >= bmin[c] && pos[c] <= bmax[c];
+            if (inside) expectedInBox++;
+        }
+        TESTASSERT (inBox.size() == expectedInBox);
+
+        std::vector<uint64_t> inRadius;
+        std::vector<float> radiusDists;
+        foo->findPointsInRadius(point, .03f, inRadius, radiusDists, true);
+        size_t expectedInRadius = 0;
+        for (int i = 0; i < LARGEN; i++) {
+            const float* pos = foo->data<float>(posAttr, i);
+            float d = 0;
+            for (int c = 0; c < 3; c++) d += (pos[c] - point[c]) * (pos[c] - point[c]);
+            if (d <= .03f * .03f) expectedInRadius++;
+        }
+        TESTASSERT (inRadius.size() == expectedInRadius);
+        TESTASSERT (radiusDists.size() == inRadius.size());
+        for (size_t i = 1; i < radiusDists.size(); i++) TESTASSERT (radiusDists[i - 1] <= radiusDists[i]);
+        for (size_t i = 0; i < inBox.size(); i++) {
+            const float* pos = foo->data<float>(posAttr, inBox[i]);
+            for (int c = 0; c < 3; c++) TESTASSERT (pos[c] >= bmin[c] && pos[c] <= bmax[c]);
+        }
+    }
+    std::cout << "Test passed\n";
+
+    std::cout << "Testing aggregate lookups ...\n";
+    for (int pass = 0; pass < 2; pass++) {
+        // sums are gathered point by point, then from the augmented index where there is one
+        if (pass == 1 && !foo->augmentIndex(posAttr)) break;
+        for (int q = 0; q < 5; q++) {
+            const float center[3] = {.2f + q * .15f, .7f - q * .1f, .5f};
+            const float bmin[3] = {center[0] - .2f, center[1] - .1f, center[2] - .3f};
+            const float bmax[3] = {center[0] + .1f, center[1] + .2f, center[2] + .15f};
+            int64_t expectedInBox = 0, expectedInRadius = 0;
+            double expectedSums[3] = {0, 0, 0};
+            for (int i = 0; i < LARGEN; i++) {
+                const float* pos = foo->data<float>(posAttr, i);
+                bool inside = true;
+                float d = 0;
+                for (int c = 0; c < 3; c++) {
+                    inside = inside && pos[c] >= bmin[c] && pos[c] <= bmax[c];
+                    d += (pos[c] - center[c]) * (pos[c] - center[c]);
+                }
+                if (inside) {
+                    expectedInBox++;
+                    for (int c = 0; c < 3; c++) expectedSums[c] += pos[c];
+                }
+                if (d <= .25f * .25f) expectedInRadius++;
+            }
+            TESTASSERT (foo->countInBox(bmin, bmax) == expectedInBox);
+            TESTASSERT (foo->countInRadius(center, .25f) == expectedInRadius);
+            double sums[3];
+            TESTASSERT (foo->sumInBox(posAttr, bmin, bmax, sums) == expectedInBox);
+            for (int c = 0; c < 3; c++) TESTASSERT (std::fabs(sums[c] - expectedSums[c]) <= 1e-6 * expectedInBox);
+        }
+    }
+    std::cout << "Test passed\n";
+
+    std::cout << "Testing overlap lookups ...\n";
+    Partio::ParticleAttribute radiusAttr = foo->addAttribute("radius", Partio::FLOAT, 1);
+    srand(3);
+    for (int i = 0; i < LARGEN; i++)
+        *foo->dataWrite<float>(radiusAttr, i) = (rand() % 100) * (i % 50 ? .0002f : .002f);
+    if (foo->setIndexRadius(radiusAttr)) {
+        for (int q = 0; q < 5; q++) {
+            const float center[3] = {.3f + q * .1f, .6f - q * .05f, .4f + q * .08f};
+            const float bmin[3] = {center[0] - .04f, center[1] - .02f, center[2] - .03f};
+            const float bmax[3] = {center[0] + .02f, center[1] + .03f, center[2] + .01f};
+            std::vector<uint64_t> inBox, inSphere, expectedBox, expectedSphere;
+            foo->findOverlapping(bmin, bmax, inBox);
+            foo->findOverlappingInRadius(center, .03f, inSphere);
+            for (int i = 0; i < LARGEN; i++) {
+                const float* pos = foo->data<float>(posAttr, i);
+                const float r = *foo->data<float>(radiusAttr, i);
+                float boxDistance = 0, centerDistance = 0;
+                for (int c = 0; c < 3; c++) {
+                    float d = std::max(std::max(bmin[c] - pos[c], pos[c] - bmax[c]), 0.f);
+                    boxDistance += d * d;
+                    centerDistance += (pos[c] - center[c]) * (pos[c] - center[c]);
+                }
+                if (std::sqrt(boxDistance) <= r) expectedBox.push_back(i);
+                if (std::max(std::sqrt(centerDistance) - .03f, 0.f) <= r) expectedSphere.push_back(i);
+            }
+            std::sort(inBox.begin(), inBox.end());
+            std::sort(inSphere.begin(), inSphere.end());
+            TESTASSERT (inBox == expectedBox);
+            TESTASSERT (inSphere == expectedSphere);
+        }
+    }
+    std::cout << "Test passed\n";
+
+    std::cout << "Testing region lookups ...\n";
+    for (int q = 0; q < 5; q++) {
+        const float apex[3] = {.1f + q * .15f, .5f, .8f - q * .1f};
+        // a pyramid opening along +x from apex, cut off .3 further
+        const float planes[20] = {
+            .5f, 1, 0, -(.5f * apex[0] + apex[1]),
+            .5f, -1, 0, -(.5f * apex[0] - apex[1]),
+            .5f, 0, 1, -(.5f * apex[0] + apex[2]),
+            .5f, 0, -1, -(.5f * apex[0] - apex[2]),
+            -1, 0, 0, apex[0] + .3f};
+        const float direction[3] = {1, .3f, -.2f};
+        const float norm = std::sqrt(1 + .3f * .3f + .2f * .2f);
+        const float unit[3] = {direction[0] / norm, direction[1] / norm, direction[2] / norm};
+        const float cosine = std::cos(.5f), sine = std::sin(.5f);
+        const float axes[9] = {cosine, sine, 0, -sine, cosine, 0, 0, 0, 1};
+        const float halfExtents[3] = {.1f, .03f, .05f};
+
+        std::vector<uint64_t> inFrustum, alongRay, inBox;
+        foo->findPointsInFrustum(planes, 5, inFrustum);
+        foo->findPointsAlongRay(apex, direction, .02f, .5f, alongRay);
+        foo->findPointsInOrientedBox(apex, axes, halfExtents, inBox);
+
+        std::vector<uint64_t> expectedFrustum, expectedRay, expectedBox;
+        for (int i = 0; i < LARGEN; i++) {
+            const float* pos = foo->data<float>(posAttr, i);
+            bool inside = true;
+            for (int p = 0; p < 5; p++)
+                inside = inside && planes[4 * p] * pos[0] + planes[4 * p + 1] * pos[1] + planes[4 * p + 2] * pos[2] + planes[4 * p + 3] >= 0;
+            if (inside) expectedFrustum.push_back(i);
+
+            float offset[3], t = 0, d = 0;
+            for (int c = 0; c < 3; c++) {
+                offset[c] = pos[c] - apex[c];
+                t += offset[c] * unit[c];
+            }
+            t = std::min(std::max(t, 0.f), .5f);
+            for (int c = 0; c < 3; c++) d += (offset[c] - t * unit[c]) * (offset[c] - t * unit[c]);
+            if (d <= .02f * .02f) expectedRay.push_back(i);
+
+            inside = true;
+            for (int a = 0; a < 3; a++) {
+                const float* u = axes + 3 * a;
+                float centerOffset = u[0] * apex[0] + u[1] * apex[1] + u[2] * apex[2];
+                inside = inside && std::fabs(u[0] * pos[0] + u[1] * pos[1] + u[2] * pos[2] - centerOffset) <= halfExtents[a];
+            }
+            if (inside) expectedBox.push_back(i);
+        }
+        std::sort(inFrustum.begin(), inFrustum.end());
+        std::sort(alongRay.begin(), alongRay.end());
+        std::sort(inBox.begin(), inBox.end());
+        TESTASSERT (!expectedFrustum.empty() && inFrustum == expectedFrustum);
+        TESTASSERT (!expectedRay.empty() && alongRay == expectedRay);
+        TESTASSERT (!expectedBox.empty() && inBox == expectedBox);
+    }
+    std::cout << "Test passed\n";
+
+    std::cout << "Testing batched lookups ...\n";
+    const int nQueries = 5000, k = 6;
+    std::vector<float> queries(3 * nQueries);
+    for (int i = 0; i < 3 * nQueries; i++) queries[i] = (rand() % 1000) / 1000.f;
+    std::vector<uint64_t> batchIndices(nQueries * k);
+    std::vector<float> batchDists(nQueries * k);
+    std::vector<int> batchCounts(nQueries, -1);
+    for (int sortQueries = 0; sortQueries < 2; sortQueries++) {
+        foo->findNPointsBatch(&queries[0], nQueries, k, .02f, &batchIndices[0], &batchDists[0], &batchCounts[0], sortQueries);
+        for (int q = 0; q < nQueries; q++) {
+            std::vector<uint64_t> indices;
+            std::vector<float> dists;
+            foo->findNPoints(&queries[3 * q], k, .02f, indices, dists);
+            TESTASSERT (batchCounts[q] == (int)indices.size());
+            std::vector<uint64_t> batch(batchIndices.begin() + q * k, batchIndices.begin() + q * k + batchCounts[q]);
+            std::sort(batch.begin(), batch.end());
+            std::sort(indices.begin(), indices.end());
+            TESTASSERT (batch == indices);
+        }
+    }
+    // move the queries a little and refine the last result in place from itself,
+    // with a few rows of duplicate or invalid seeds
+    for (int i = 0; i < 3 * nQueries; i++) queries[i] += ((rand() % 11) - 5) * 1e-3f;
+    batchIndices[1] = batchIndices[0];
+    batchIndices[k] = foo->numParticles() + 5;
+    foo->findNPointsSeeded(&queries[0], nQueries, k, .02f, &batchIndices[0], &batchCounts[0],
+                           &batchIndices[0], &batchDists[0], &batchCounts[0]);
+    for (int q = 0; q < nQueries; q++) {
+        std::vector<uint64_t> indices;
+        std::vector<float> dists;
+        foo->findNPoints(&queries[3 * q], k, .02f, indices, dists);
+        TESTASSERT (batchCounts[q] == (int)indices.size());
+        std::vector<float> seeded(batchDists.begin() + q * k, batchDists.begin() + q * k + batchCounts[q]);
+        std::sort(seeded.begin(), seeded.end());
+        std::sort(dists.begin(), dists.end());
+        TESTASSERT (seeded == dists);
+    }
+    std::vector<int64_t> offsets;
+    std::vector<uint64_t> radiusIndices;
+    std::vector<float> radiusDists;
+    foo->findPointsInRadiusBatch(&queries[0], nQueries, .01f, offsets, radiusIndices, radiusDists, true);
+    TESTASSERT (offsets.size() == nQueries + 1 && offsets[nQueries] == (int64_t)radiusIndices.size());
+    for (int q = 0; q < nQueries; q++) {
+        std::vector<uint64_t> indices;
+        std::vector<float> dists;
+        foo->findPointsInRadius(&queries[3 * q], .01f, indices, dists, true);
+        TESTASSERT (std::vector<float>(radiusDists.begin() + offsets[q], radiusDists.begin() + offsets[q + 1]) == dists);
+    }
+    std::cout << "Test passed\n";
+}
+
+void testNeighborGraph(Partio::ParticlesDataMutable* foo)
+{
+    std::cout << "Testing neighbor graphs ...\n";
+    Partio::ParticleAttribute posAttr;
+    TESTASSERT (foo->attributeInfo("position", posAttr));
+    const int64_t n = foo->numParticles();
+
+    Partio::NeighborGraph graph;
+    Partio::buildNeighborGraph(*foo, 6, .3f, graph);
+    TESTASSERT (graph.numNodes() == n);
+    for (int64_t i = 0; i < n; i++) {
+        std::vector<uint64_t> indices;
+        std::vector<float> dists;
+        foo->findNPoints(foo->data<float>(posAttr, i), 7, .3f, indices, dists);
+        std::sort(dists.begin(), dists.end());
+        TESTASSERT (graph.numNeighbors(i) == 6 && dists[0] == 0);
+        for (int64_t j = graph.offsets[i]; j < graph.offsets[i + 1]; j++) {
+            TESTASSERT (graph.indices[j] != (uint64_t)i);
+            TESTASSERT (graph.distancesSquared[j] == dists[j - graph.offsets[i] + 1]);
+        }
+    }
+
+    Partio::buildNeighborGraph(*foo, .13f, graph);
+    TESTASSERT (graph.numNodes() == n && graph.numNeighbors(0) == 3);
+    for (int64_t i = 0; i < n; i++) {
+        std::vector<uint64_t> indices;
+        std::vector<float> dists;
+        foo->findPointsInRadius(foo->data<float>(posAttr, i), .13f, indices, dists);
+        TESTASSERT (graph.numNeighbors(i) == (int64_t)indices.size() - 1);
+        for (int64_t j = graph.offsets[i]; j < graph.offsets[i + 1]; j++) {
+            uint64_t other = graph.indices[j];
+            TESTASSERT (other != (uint64_t)i);
+            TESTASSERT (std::find(graph.indices.begin() + graph.offsets[other], graph.indices.begin() + graph.offsets[other + 1], (uint64_t)i)
+                != graph.indices.begin() + graph.offsets[other + 1]);
+        }
+    }
+
+    // rows match the radius queries exactly, ordered by distance
+    Partio::ParticlesDataMutable* cloud = Partio::create();
+    Partio::ParticleAttribute cloudPos = cloud->addAttribute("position", Partio::VECTOR, 3);
+    cloud->addParticles(3000);
+    srand(8);
+    for (int i = 0; i < 3000; i++) {
+        float* p = cloud->dataWrite<float>(cloudPos, i);
+        for (int c = 0; c < 3; c++) p[c] = (rand() % 200) / 200.f;
+    }
+    cloud->sort();
+    Partio::buildNeighborGraph(*cloud, .06f, graph, true);
+    TESTASSERT (graph.numNodes() == 3000);
+    for (int64_t i = 0; i < 3000; i++) {
+        std::vector<uint64_t> indices;
+        std::vector<float> dists;
+        cloud->findPointsInRadius(cloud->data<float>(cloudPos, i), .06f, indices, dists);
+        std::sort(indices.begin(), indices.end());
+        std::vector<uint64_t> row(graph.indices.begin() + graph.offsets[i], graph.indices.begin() + graph.offsets[i + 1]);
+        TESTASSERT (std::is_sorted(graph.distancesSquared.begin() + graph.offsets[i],
+                                   graph.distancesSquared.begin() + graph.offsets[i + 1]));
+        std::sort(row.begin(), row.end());
+        TESTASSERT (row == indices);
+    }
+    cloud->release();
+
+    // join a shifted copy of a few particles against the whole set
+    Partio::ParticlesDataMutable* other = Partio::create();
+    Partio::ParticleAttribute otherPos = other->addAttribute("position", Partio::VECTOR, 3);
+    other->addParticles(40);
+    for (int i = 0; i < 40; i++) {
+        const float* p = foo->data<float>(posAttr, (i * 37) % n);
+        float* q = other->dataWrite<float>(otherPos, i);
+        for (int c = 0; c < 3; c++) q[c] = p[c] + .01f * (c + 1);
+    }
+    Partio::nearestJoin(*other, *foo, 4, .3f, graph);
+    TESTASSERT (graph.numNodes() == 40);
+    for (int i = 0; i < 40; i++) {
+        const float* q = other->data<float>(otherPos, i);
+        std::vector<uint64_t> indices;
+        std::vector<float> dists;
+        foo->findNPoints(q, 4, .3f, indices, dists);
+        std::sort(dists.begin(), dists.end());
+        TESTASSERT (graph.numNeighbors(i) == (int64_t)dists.size());
+        for (int64_t j = graph.offsets[i]; j < graph.offsets[i + 1]; j++) {
+            const float* p = foo->data<float>(posAttr, graph.indices[j]);
+            const float d = (p[0] - q[0]) * (p[0] - q[0]) + (p[1] - q[1]) * (p[1] - q[1]) + (p[2] - q[2]) * (p[2] - q[2]);
+            TESTASSERT (graph.distancesSquared[j] == dists[j - graph.offsets[i]] && graph.distancesSquared[j] == d);
+        }
+    }
+    other->release();
+    std::cout << "Test passed\n";
+}
+
+void testAttributeIndex(const Partio::ParticlesData* foo)
+{
+    std::cout << "Testing attribute index ...\n";
+    Partio::ParticlesDataMutable* p = Partio::clone(*foo);
+    Partio::ParticleAttribute posAttr, idAttr;
+    TESTASSERT (p->attributeInfo("position", posAttr) && p->attributeInfo("id", idAttr));
+    Partio::ParticleAttribute speedAttr = p->addAttribute("speed", Partio::FLOAT, 1);
+    const int64_t n = p->numParticles();
+    for (int64_t i = 0; i < n; i++) p->dataWrite<float>(speedAttr, i)[0] = (i * 7 % 11) / 11.f;
+
+    std::vector<Partio::ParticleAttribute> attrs = {idAttr};
+    TESTASSERT (!Partio::createAttributeIndex(*p, attrs));
+    attrs = {posAttr, speedAttr};
+    const float weights[4] = {1, 1, 1, 2};
+    Partio::AttributeIndex* index = Partio::createAttributeIndex(*p, attrs, weights);
+    TESTASSERT (index && index->dimension() == 4);
+
+    // compare against weighted brute force distances
+    const float query[4] = {.5f, .4f, .3f, .2f};
+    std::vector<float> all;
+    for (int64_t i = 0; i < n; i++) {
+        const float* pos = p->data<float>(posAttr, i);
+        const float speed = p->data<float>(speedAttr, i)[0];
+        float d = 0;
+        for (int c = 0; c < 3; c++) d += (pos[c] - query[c]) * (pos[c] - query[c]);
+        d += 4 * (speed - query[3]) * (speed - query[3]);
+        all.push_back(d);
+    }
+    std::vector<uint64_t> indices;
+    std::vector<float> dists;
+    index->findNPoints(query, 10, 1.f, indices, dists);
+    TESTASSERT (indices.size() == 10);
+    std::vector<float> sortedAll(all);
+    std::sort(sortedAll.begin(), sortedAll.end());
+    std::vector<float> sortedDists(dists);
+    std::sort(sortedDists.begin(), sortedDists.end());
+    for (int i = 0; i < 10; i++) {
+        TESTASSERT (all[indices[i]] == dists[i]);
+        TESTASSERT (sortedDists[i] == sortedAll[i]);
+    }
+
+    // boxes are given in attribute units
+    const float bboxMin[4] = {.2f, .2f, .2f, .5f}, bboxMax[4] = {.6f, .6f, .6f, 1.f};
+    indices.clear();
+    index->findPoints(bboxMin, bboxMax, indices);
+    int64_t inside = 0;
+    for (int64_t i = 0; i < n; i++) {
+        const float* pos = p->data<float>(posAttr, i);
+        const float speed = p->data<float>(speedAttr, i)[0];
+        bool in = speed >= bboxMin[3] && speed <= bboxMax[3];
+        for (int c = 0; c < 3; c++) in = in && pos[c] >= bboxMin[c] && pos[c] <= bboxMax[c];
+        if (in) {
+            inside++;
+            TESTASSERT (std::find(indices.begin(), indices.end(), (uint64_t)i) != indices.end());
+        }
+    }
+    TESTASSERT (inside > 0 && (int64_t)indices.size() == inside);
+    index->release();
+    p->release();
+    std::cout << "Test passed\n";
+}
+
+// Stops the search after limit points
+struct CountVisitor : public Partio::PointVisitor
+{
+    CountVisitor(float radiusSquared, size_t limit) : radiusSquared(radiusSquared), limit(limit), count(0) {}
+    bool visit(const Partio::ParticleIndex, const float distanceSquared)
+    {
+        TESTASSERT (distanceSquared <= radiusSquared);
+        return ++count < limit;
+    }
+    float radiusSquared;
+    size_t limit, count;
+};
+
+// Particles added after sort() must be found without sorting again,
+// both before and after they are merged into the index
+void testAppendedLookups(Partio::ParticlesDataMutable* foo)
+{
+    std::cout << "Testing lookups while adding particles ...\n";
+    Partio::ParticleAttribute posAttr;
+    TESTASSERT (foo->attributeInfo("position", posAttr));
+    srand(2);
+    for (int batch = 0; batch < 40; batch++) {
+        int64_t first = foo->numParticles();
+        foo->addParticles(100 + batch * 37);
+        for (int64_t i = first; i < foo->numParticles(); i++) {
+            float* pos = foo->dataWrite<float>(posAttr, i);
+            for (int c = 0; c < 3; c++) pos[c] = (rand() % 1000) / 1000.f;
+        }
+
+        float point[3] = {(rand() % 1000) / 1000.f, (rand() % 1000) / 1000.f, (rand() % 1000) / 1000.f};
+        std::vector<float> expected;
+        size_t expectedInRadius = 0, expectedInBox = 0;
+        for (int64_t i = 0; i < foo->numParticles(); i++) {
+            const float* pos = foo->data<float>(posAttr, i);
+            float d = 0;
+            bool inside = true;
+            for (int c = 0; c < 3; c++) {
+                d += (pos[c] - point[c]) * (pos[c] - point[c]);
+                inside = inside && pos[c] >= point[c] - .1f && pos[c] <= point[c] + .1f;
+            }
+            expected.push_back(d);
+            if (d <= .1f * .1f) expectedInRadius++;
+            if (inside) expectedInBox++;
+        }
+        std::partial_sort(expected.begin(), expected.begin() + 5, expected.end());
+
+        std::vector<uint64_t> indices;
+        std::vector<float> dists;
+        foo->findNPoints(point, 5, 1.f, indices, dists);
+        TESTASSERT (indices.size() == 5);
+        std::sort(dists.begin(), dists.end());
+        for (int i = 0; i < 5; i++) TESTASSERT (dists[i] == expected[i]);
+
+        indices.clear();
+        dists.clear();
+        foo->findPointsInRadius(point, .1f, indices, dists, true);
+        TESTASSERT (indices.size() == expectedInRadius);
+        for (size_t i = 1; i < dists.size(); i++) TESTASSERT (dists[i - 1] <= dists[i]);
+        std::sort(indices.begin(), indices.end());
+        TESTASSERT (std::unique(indices.begin(), indices.end()) == indices.end());
+
+        float bmin[3] = {point[0] - .1f, point[1] - .1f, point[2] - .1f};
+        float bmax[3] = {point[0] + .1f, point[1] + .1f, point[2] + .1f};
+        indices.clear();
+        foo->findPoints(bmin, bmax, indices);
+        TESTASSERT (indices.size() == expectedInBox);
+
+        // visitors see the same points and stop when asked to
+        size_t visited = 0;
+        TESTASSERT (foo->forEachInBox(bmin, bmax, [&](uint64_t i, float) {
+            const float* pos = foo->data<float>(posAttr, i);
+            for (int c = 0; c < 3; c++) TESTASSERT (pos[c] >= bmin[c] && pos[c] <= bmax[c]);
+            visited++;
+            return true;
+        }));
+        TESTASSERT (visited == expectedInBox);
+        CountVisitor counter(.1f * .1f, 3);
+        TESTASSERT (foo->forEachInRadius(point, .1f, counter) == (expectedInRadius < 3));
+        TESTASSERT (counter.count == std::min<size_t>(expectedInRadius, 3));
+        counter.limit = expectedInRadius + 1;
+        counter.count = 0;
+        TESTASSERT (foo->forEachInRadius(point, .1f, counter));
+        TESTASSERT (counter.count == expectedInRadius);
+    }
+    std::cout << "Test passed\n";
+}
+
+// An index saved next to a particle file must be picked up by readCached
+// and answer queries like the index it was saved from
+void testSavedIndex(Partio::ParticlesDataMutable* foo)
+{
+    std::cout << "Testing saved index ...\n";
+    Partio::write("testkdtree.bgeo", *foo);
+    TESTASSERT (foo->saveIndex("testkdtree.bgeo.kdtree", "testkdtree.bgeo"));
+
+    Partio::ParticlesData* cached = Partio::readCached("testkdtree.bgeo", true);
+    TESTASSERT (cached && cached->numParticles() == foo->numParticles());
+    srand(3);
+    for (int q = 0; q < 100; q++) {
+        float point[3] = {(rand() % 1000) / 1000.f, (rand() % 1000) / 1000.f, (rand() % 1000) / 1000.f};
+        std::vector<uint64_t> indices, cachedIndices;
+        std::vector<float> dists, cachedDists;
+        foo->findNPoints(point, 7, 1.f, indices, dists);
+        cached->findNPoints(point, 7, 1.f, cachedIndices, cachedDists);
+        std::sort(dists.begin(), dists.end());
+        std::sort(cachedDists.begin(), cachedDists.end());
+        TESTASSERT (dists == cachedDists);
+
+        indices.clear();
+        cachedIndices.clear();
+        foo->findPointsInRadius(point, .08f, indices, dists);
+        cached->findPointsInRadius(point, .08f, cachedIndices, cachedDists);
+        std::sort(indices.begin(), indices.end());
+        std::sort(cachedIndices.begin(), cachedIndices.end());
+        TESTASSERT (indices == cachedIndices);
+    }
+    cached->release();
+
+    // the index only fits the particles it was saved for
+    Partio::ParticlesDataMutable* copy = Partio::read("testkdtree.bgeo");
+    TESTASSERT (!copy->loadIndex("testkdtree.bgeo"));
+
+    // corrupt files are rejected: the first tree's header follows the file
+    // header and its run's first particle, and its ids follow its coordinates
+    std::ifstream in("testkdtree.bgeo.kdtree", std::ios::binary);
+    const std::string saved((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+    const size_t treeAt = 48 + 8;
+    int64_t treeSize;
+    memcpy(&treeSize, &saved[treeAt + 8], sizeof(treeSize));
+    const size_t coordBytes = (4 * (treeSize + 32) + 7) / 8 * 8;
+    for (int corruption = 0; corruption < 2; corruption++) {
+        std::string bad = saved;
+        if (corruption == 0) {
+            const int64_t hugeSize = int64_t(1) << 62;
+            memcpy(&bad[treeAt + 8], &hugeSize, sizeof(hugeSize));
+        } else {
+            const uint32_t badId = uint32_t(treeSize);
+            memcpy(&bad[treeAt + 48 + 3 * coordBytes], &badId, sizeof(badId));
+        }
+        std::ofstream out("testkdtree.bgeo.bad", std::ios::binary);
+        out.write(bad.data(), bad.size());
+        out.close();
+        TESTASSERT (!copy->loadIndex("testkdtree.bgeo.bad"));
+    }
+    remove("testkdtree.bgeo.bad");
+    copy->addParticle();
+    TESTASSERT (!copy->loadIndex("testkdtree.bgeo.kdtree"));
+    copy->release();
+
+    remove("testkdtree.bgeo");
+    remove("testkdtree.bgeo.kdtree");
+    std::cout << "Test passed\n";
+}
+
+// Re-sorting while other threads query must not disturb their results
+void testConcurrentSort(Partio::ParticlesDataMutable* foo)
+{
+    std::cout << "Testing sort during queries ...\n";
+    const float point[3] = {0.51f, 0.52f, 0.53f};
+    std::vector<uint64_t> expected;
+    std::vector<float> expectedDists;
+    foo->findPointsInRadius(point, 0.2f, expected, expectedDists);
+    TESTASSERT (expected.size() > 5);
+    std::atomic<bool> done(false);
+    std::atomic<int> failures(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 3; t++) {
+        threads.push_back(std::thread([&]() {
+            while (!done) {
+                std::vector<uint64_t> indices;
+                std::vector<float> dists;
+                foo->findNPoints(point, 5, 0.15f, indices, dists);
+                if (indices.size() != 5) failures++;
+                indices.clear();
+                foo->findPointsInRadius(point, 0.2f, indices, dists);
+                if (indices.size() != expected.size()) failures++;
+                // seeded queries read the positions the published index was built from
+                uint64_t seeded[5];
+                float seededDists[5];
+                int count = 1;
+                seeded[0] = expected[0];
+                foo->findNPointsSeeded(point, 1, 5, 0.15f, seeded, &count, seeded, seededDists, &count);
+                if (count != 5) failures++;
+            }
+        }));
+    }
+    // several threads sort at once, each publishing its own index
+    std::vector<std::thread> sorters;
+    for (int t = 0; t < 3; t++) {
+        sorters.push_back(std::thread([&, t]() {
+            for (int i = 0; i < 100; i++)
+                foo->sort((i + t) % 2 ? Partio::IndexType::HashGrid : Partio::IndexType::KdTree);
+        }));
+    }
+    for (size_t t = 0; t < sorters.size(); t++) sorters[t].join();
+    done = true;
+    for (size_t t = 0; t < threads.size(); t++) threads[t].join();
+    TESTASSERT (failures == 0);
+    std::cout << "Test passed\n";
+}
+
+void testConcurrentIndexUpdates(Partio::ParticlesDataMutable* foo)
+{
+    std::cout << "Testing augmentIndex and setIndexRadius during queries ...\n";
+    Partio::ParticleAttribute posAttr;
+    TESTASSERT (foo->attributeInfo("position", posAttr));
+    Partio::ParticleAttribute radiusAttr = foo->addAttribute("overlapRadius", Partio::FLOAT, 1);
+    for (int i = 0; i < foo->numParticles(); i++) *foo->dataWrite<float>(radiusAttr, i) = (i % 7) * .01f;
+    foo->sort();
+    const float bmin[3] = {0.2f, 0.3f, 0.25f}, bmax[3] = {0.7f, 0.6f, 0.8f};
+    double expectedSums[3];
+    const int64_t expected = foo->sumInBox(posAttr, bmin, bmax, expectedSums);
+    TESTASSERT (expected > 5);
+    TESTASSERT (foo->setIndexRadius(radiusAttr));
+    std::vector<uint64_t> expectedOverlapping;
+    foo->findOverlapping(bmin, bmax, expectedOverlapping);
+    TESTASSERT ((int64_t)expectedOverlapping.size() > expected);
+    std::atomic<bool> done(false);
+    std::atomic<int> failures(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 3; t++) {
+        threads.push_back(std::thread([&]() {
+            while (!done) {
+                double sums[3];
+                if (foo->sumInBox(posAttr, bmin, bmax, sums) != expected) failures++;
+                for (int c = 0; c < 3; c++)
+                    if (std::fabs(sums[c] - expectedSums[c]) > 1e-6 * expected) failures++;
+                std::vector<uint64_t> overlapping;
+                foo->findOverlapping(bmin, bmax, overlapping);
+                if (overlapping.size() != expectedOverlapping.size()) failures++;
+            }
+        }));
+    }
+    // each call publishes a new index, the queries keep reading the one they loaded
+    std::vector<std::thread> augmenters;
+    for (int t = 0; t < 2; t++) {
+        augmenters.push_back(std::thread([&]() {
+            for (int i = 0; i < 50; i++)
+                if (!foo->augmentIndex(posAttr) || !foo->setIndexRadius(radiusAttr)) failures++;
+        }));
+    }
+    for (size_t t = 0; t < augmenters.size(); t++) augmenters[t].join();
+    done = true;
+    for (size_t t = 0; t < threads.size(); t++) threads[t].join();
+    TESTASSERT (failures == 0);
+    std::cout << "Test passed\n";
+}
+
+// Adds particles while other threads query. Each addition publishes a new
+// index, so queries keep finding the sorted particles while the appended ones
+// are merged, indexed and moved by the set growing.
+void testConcurrentAppends(Partio::ParticlesDataMutable* foo)
+{
+    std::cout << "Testing adding particles during queries ...\n";
+    Partio::ParticleAttribute posAttr;
+    TESTASSERT (foo->attributeInfo("position", posAttr));
+    const uint64_t sorted = foo->numParticles();
+    const float point[3] = {0.51f, 0.52f, 0.53f};
+    const float bmin[3] = {0.2f, 0.3f, 0.25f}, bmax[3] = {0.7f, 0.6f, 0.8f};
+    std::vector<uint64_t> expected;
+    foo->findPoints(bmin, bmax, expected);
+    std::sort(expected.begin(), expected.end());
+    TESTASSERT (expected.size() > 5);
+
+    // queries may see added particles before their positions are set, the
+    // lock only keeps them from reading the positions while they are written
+    std::mutex positions;
+    std::atomic<bool> done(false);
+    std::atomic<int> failures(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 3; t++) {
+        threads.push_back(std::thread([&]() {
+            while (!done) {
+                {
+                    std::lock_guard<std::mutex> lock(positions);
+                    std::vector<uint64_t> indices;
+                    foo->findPoints(bmin, bmax, indices);
+                    std::sort(indices.begin(), indices.end());
+                    if (!std::includes(indices.begin(), indices.end(), expected.begin(), expected.end())) failures++;
+                    if (std::lower_bound(indices.begin(), indices.end(), sorted) - indices.begin()
+                        != (std::ptrdiff_t)expected.size()) failures++;
+                    std::vector<float> dists;
+                    indices.clear();
+                    foo->findNPoints(point, 5, 0.15f, indices, dists);
+                    if (indices.size() != 5) failures++;
+                }
+                std::this_thread::yield();
+            }
+        }));
+    }
+    srand(3);
+    for (int batch = 0; batch < 300; batch++) {
+        int64_t first = foo->numParticles();
+        if (batch % 4) foo->addParticle();
+        else foo->addParticles(20 + batch * 5);
+        std::lock_guard<std::mutex> lock(positions);
+        for (int64_t i = first; i < foo->numParticles(); i++) {
+            float* pos = foo->dataWrite<float>(posAttr, i);
+            pos[0] = 2 + (rand() % 1000) / 1000.f;
+            pos[1] = pos[2] = (rand() % 1000) / 1000.f;
+        }
+    }
+    done = true;
+    for (size_t t = 0; t < threads.size(); t++) threads[t].join();
+    TESTASSERT (failures == 0);
+
+    // the points added last are read in place, the others from the copies
+    const float addedMin[3] = {1.5f, -1.f, -1.f}, addedMax[3] = {3.5f, 2.f, 2.f};
+    std::vector<uint64_t> indices;
+    foo->findPoints(addedMin, addedMax, indices);
+    std::sort(indices.begin(), indices.end());
+    TESTASSERT (indices.size() == foo->numParticles() - sorted && indices[0] == sorted);
+    std::cout << "Test passed\n";
+}
+
 int main(int argc,char *argv[])
 {
+    // make sure the threaded build paths run even on small machines
+    setenv("PARTIO_NUM_THREADS", "4", 0);
+
     Partio::ParticlesDataMutable* foo=makeData();
     Partio::ParticleAttribute posAttr;
     TESTASSERT (foo->attributeInfo("position", posAttr));
@@ -128,6 +872,62 @@ int main(int argc,char *argv[])
 
         std::cout << "Test passed\n";
     }
+    testNeighborGraph(foo);
+    testAttributeIndex(foo);
+    testConcurrentSort(foo);
+    testConcurrentIndexUpdates(foo);
+    foo->sort();
+
+    testAppendedLookups(foo);
+    testSavedIndex(foo);
+    foo->release();
+
+    foo=makeData();
+    foo->sort(Partio::IndexType::HashGrid);
+    testAppendedLookups(foo);
+    foo->release();
+
+    foo=makeData();
+    testConcurrentAppends(foo);
+    foo->release();
+
+    foo=makeData();
+    foo->sort(Partio::IndexType::HashGrid);
+    testConcurrentAppends(foo);
+    foo->release();
+
+    // growing the set moves the position column an in-place tree reads
+    foo=makeData();
+    foo->sort(Partio::IndexType::KdTreeInPlace);
+    testAppendedLookups(foo);
+    foo->release();
+
+    std::cout << "Testing large tree ...\n";
+    foo=makeLargeData(Partio::create());
+    testLargeLookups(foo);
+    foo->release();
+
+    std::cout << "Testing large in-place tree ...\n";
+    foo=makeLargeData(Partio::create());
+    foo->sort(Partio::IndexType::KdTreeInPlace);
+    testLargeLookups(foo);
+    foo->release();
+
+    std::cout << "Testing large interleaved tree ...\n";
+    foo=makeLargeData(Partio::createInterleave());
+    testLargeLookups(foo);
+    foo->release();
+
+    std::cout << "Testing large hash grid ...\n";
+    foo=makeLargeData(Partio::create());
+    foo->sort(Partio::IndexType::HashGrid);
+    testLargeLookups(foo);
+    foo->release();
+
+    std::cout << "Testing large interleaved hash grid with small cells ...\n";
+    foo=makeLargeData(Partio::createInterleave());
+    foo->sort(Partio::IndexType::HashGrid, .003f);
+    testLargeLookups(foo);
     foo->release();
 
     return 0;
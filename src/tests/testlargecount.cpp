@@ -0,0 +1,219 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+#include <gtest/gtest.h>
+#include <Partio.h>
+#include <algorithm>
+#include <cstdio>
+#include <sstream>
+#include <string>
+#ifdef _WIN32
+#include <process.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace Partio;
+
+// file in the test temporary directory named after the running test and process
+static std::string tempPath(const char* suffix)
+{
+    std::ostringstream path;
+    path<<testing::TempDir()<<"partio-largecount-"<<testing::UnitTest::GetInstance()->current_test_info()->name()
+        <<"-"<<getpid()<<suffix;
+    return path.str();
+}
+
+// Counts past both the signed and unsigned 32-bit range. No attributes are
+// added so the containers never have to allocate storage for them.
+static const int64_t largeCount=(int64_t(1)<<32)+(int64_t(1)<<31);
+
+// Counts just past the signed 32-bit range for the tests that store data, which
+// are skipped on machines without the memory to hold it.
+static const int64_t dataCount=(int64_t(1)<<31)+(int64_t(1)<<20);
+
+static uint64_t physicalMemory()
+{
+#ifdef _WIN32
+    MEMORYSTATUSEX status;
+    status.dwLength=sizeof(status);
+    GlobalMemoryStatusEx(&status);
+    return status.ullTotalPhys;
+#else
+    return uint64_t(sysconf(_SC_PHYS_PAGES))*uint64_t(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+#define SKIP_WITHOUT_MEMORY(bytes) \
+    if(physicalMemory()<uint64_t(bytes)) GTEST_SKIP()<<"needs "<<(uint64_t(bytes)>>30)<<" GB of memory"
+
+TEST(PartioLargeCount, simple)
+{
+    ParticlesDataMutable* p=create();
+    ParticlesDataMutable::iterator it=p->addParticles(largeCount);
+    ASSERT_TRUE(it.valid());
+    EXPECT_EQ(0u, it.index);
+    EXPECT_EQ(largeCount, p->numParticles());
+
+    ParticleIndex index=p->addParticle();
+    EXPECT_EQ(ParticleIndex(largeCount), index);
+    EXPECT_EQ(largeCount+1, p->numParticles());
+
+    it=p->addParticles(10);
+    EXPECT_EQ(size_t(largeCount+1), it.index);
+    EXPECT_EQ(largeCount+11, p->numParticles());
+
+    ParticlesDataMutable::iterator end=p->setupIterator(largeCount+10);
+    EXPECT_EQ(size_t(largeCount+10), end.index);
+    p->release();
+}
+
+TEST(PartioLargeCount, interleave)
+{
+    ParticlesDataMutable* p=createInterleave();
+    p->addParticles(largeCount);
+    EXPECT_EQ(largeCount, p->numParticles());
+    EXPECT_EQ(ParticleIndex(largeCount), p->addParticle());
+    p->release();
+}
+
+TEST(PartioLargeCount, writeRejectsThirtyTwoBitFormats)
+{
+    ParticlesDataMutable* p=create();
+    p->addParticles(largeCount);
+    std::ostringstream errors;
+    const std::string filename=tempPath(".bgeo");
+    write(filename.c_str(),*p,false,true,errors);
+    EXPECT_NE(std::string::npos, errors.str().find("can not store"));
+    // the refusal comes before the file is opened
+    FILE* file=fopen(filename.c_str(),"rb");
+    EXPECT_EQ(0, file);
+    if(file){
+        fclose(file);
+        remove(filename.c_str());
+    }
+    p->release();
+}
+
+static void checkAttributeData(ParticlesDataMutable* p)
+{
+    ParticleAttribute id=p->addAttribute("id",INT,1);
+    p->addParticles(dataCount);
+    const ParticleIndex indices[5]={0,(ParticleIndex(1)<<31)-1,ParticleIndex(1)<<31,(ParticleIndex(1)<<31)+1,
+        ParticleIndex(dataCount-1)};
+    for(int i=0;i<5;i++) p->dataWrite<int>(id,indices[i])[0]=i+1;
+    for(int i=0;i<5;i++) EXPECT_EQ(i+1, p->data<int>(id,indices[i])[0]);
+    int values[5]={0,0,0,0,0};
+    p->data(id,5,indices,true,values);
+    for(int i=0;i<5;i++) EXPECT_EQ(i+1, values[i]);
+    p->release();
+}
+
+TEST(PartioLargeCount, attributeData)
+{
+    SKIP_WITHOUT_MEMORY(dataCount*sizeof(int)+(int64_t(1)<<30));
+    checkAttributeData(create());
+    checkAttributeData(createInterleave());
+}
+
+TEST(PartioLargeCount, iterator)
+{
+    SKIP_WITHOUT_MEMORY(dataCount*sizeof(int)+(int64_t(1)<<30));
+    ParticlesDataMutable* p=create();
+    ParticleAttribute id=p->addAttribute("id",INT,1);
+    p->addParticles(dataCount);
+
+    ParticleAccessor idAccess(id);
+    ParticlesDataMutable::iterator it=p->begin();
+    it.addAccessor(idAccess);
+    for(;it!=p->end();++it) idAccess.data<int>(it)=static_cast<int>(it.index>>1);
+
+    const ParticlesData& constP=*p;
+    int64_t visited=0,mismatched=0;
+    ParticlesData::const_iterator cit=constP.setupConstIterator(int64_t(1)<<31);
+    cit.addAccessor(idAccess);
+    for(;cit!=constP.end();++cit){
+        if(idAccess.data<int>(cit)!=static_cast<int>(cit.index>>1)) mismatched++;
+        visited++;
+    }
+    EXPECT_EQ(dataCount-(int64_t(1)<<31), visited);
+    EXPECT_EQ(0, mismatched);
+    EXPECT_EQ(static_cast<int>((dataCount-1)>>1), p->data<int>(id,dataCount-1)[0]);
+    p->release();
+}
+
+TEST(PartioLargeCount, kdtree)
+{
+    // the position column plus the tree's copy of the points, its ids and the build's scratch
+    SKIP_WITHOUT_MEMORY(dataCount*56+(int64_t(1)<<30));
+    ParticlesDataMutable* p=create();
+    ParticleAttribute position=p->addAttribute("position",VECTOR,3);
+    p->addParticles(dataCount);
+
+    // particles on a 2048x2048 grid of unit cells, one layer of it per z
+    ParticleAccessor positionAccess(position);
+    ParticlesDataMutable::iterator it=p->begin();
+    it.addAccessor(positionAccess);
+    for(;it!=p->end();++it){
+        Data<float,3>& X=positionAccess.data<Data<float,3> >(it);
+        X[0]=float(it.index%2048);
+        X[1]=float((it.index/2048)%2048);
+        X[2]=float(it.index/(2048*2048));
+    }
+    p->sort();
+
+    // the particle at (5,0,512), whose layer is the last one and only partly filled
+    const ParticleIndex target=(ParticleIndex(1)<<31)+5;
+    const float center[3]={5.f,0.f,512.f};
+    const float bboxMin[3]={4.5f,-.5f,511.5f},bboxMax[3]={5.5f,.5f,512.5f};
+    std::vector<ParticleIndex> points;
+    p->findPoints(bboxMin,bboxMax,points);
+    ASSERT_EQ(1u, points.size());
+    EXPECT_EQ(target, points[0]);
+
+    std::vector<float> distances;
+    p->findNPoints(center,6,1.2f,points,distances);
+    ASSERT_EQ(5u, points.size());
+    std::sort(points.begin(),points.end());
+    const ParticleIndex expected[5]={target-2048*2048,target-1,target,target+1,target+2048};
+    for(int i=0;i<5;i++) EXPECT_EQ(expected[i], points[i]);
+    p->release();
+}
+
+int main(int argc, char* argv[])
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,133 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+#include <gtest/gtest.h>
+#include <Partio.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+// Adds up how many times a selection covers each particle
+static void coverSelection(const Partio::LodOctree& octree, const std::vector<int64_t>& nodes,
+                    const std::vector<uint64_t>& particles, std::vector<int>& covered)
+{
+    for (size_t i = 0; i < nodes.size(); i++)
+        for (int64_t j = octree.pointBegins[nodes[i]]; j < octree.pointEnds[nodes[i]]; j++) covered[octree.points[j]]++;
+    for (size_t i = 0; i < particles.size(); i++) covered[particles[i]]++;
+}
+
+TEST(LodOctreeTest, buildAndSelect)
+{
+    Partio::ParticlesDataMutable* p = Partio::create();
+    Partio::ParticleAttribute posAttr = p->addAttribute("position", Partio::VECTOR, 3);
+    Partio::ParticleAttribute radiusAttr = p->addAttribute("radius", Partio::FLOAT, 1);
+    Partio::ParticleAttribute colorAttr = p->addAttribute("Cd", Partio::VECTOR, 3);
+    Partio::ParticleAttribute materialAttr = p->addAttribute("material", Partio::INDEXEDSTR, 1);
+    const int rock = p->registerIndexedStr(materialAttr, "rock");
+    const int sand = p->registerIndexedStr(materialAttr, "sand");
+    const int n = 20000;
+    p->addParticles(n);
+    srand(4);
+    double weight = 0, red = 0;
+    for (int i = 0; i < n; i++) {
+        float* pos = p->dataWrite<float>(posAttr, i);
+        for (int c = 0; c < 3; c++) pos[c] = (rand() % 1000) / 1000.f;
+        const float r = .001f * (1 + rand() % 4);
+        p->dataWrite<float>(radiusAttr, i)[0] = r;
+        float* color = p->dataWrite<float>(colorAttr, i);
+        for (int c = 0; c < 3; c++) color[c] = pos[c] * (c + 1);
+        p->dataWrite<int>(materialAttr, i)[0] = i % 3 ? sand : rock;
+        weight += r * r;
+        red += r * r * color[0];
+    }
+
+    std::vector<Partio::ParticleAttribute> attrs = {colorAttr, materialAttr};
+    Partio::LodOctree octree;
+    ASSERT_TRUE(Partio::buildLodOctree(*p, attrs, octree, &radiusAttr, 16));
+    ASSERT_TRUE(octree.numNodes() > 1 && octree.count(0) == n && octree.numValues == 3 && octree.numTokens == 1);
+    ASSERT_TRUE(std::abs(octree.values[0] - red / weight) < 1e-4);
+    ASSERT_TRUE(octree.tokens[0] == sand);
+    for (int64_t i = 0; i < octree.numNodes(); i++) {
+        if (octree.childCounts[i]) {
+            // children split their parent's particles in order
+            const int64_t first = octree.firstChild[i], last = first + octree.childCounts[i] - 1;
+            ASSERT_TRUE(first > i && octree.pointBegins[first] == octree.pointBegins[i] && octree.pointEnds[last] == octree.pointEnds[i]);
+            for (int64_t c = first; c < last; c++) ASSERT_TRUE(octree.pointEnds[c] == octree.pointBegins[c + 1]);
+        } else ASSERT_TRUE(octree.count(i) <= 16);
+        double mean[3] = {0, 0, 0};
+        for (int64_t j = octree.pointBegins[i]; j < octree.pointEnds[i]; j++) {
+            const float* pos = p->data<float>(posAttr, octree.points[j]);
+            for (int c = 0; c < 3; c++) mean[c] += pos[c] / octree.count(i);
+        }
+        for (int c = 0; c < 3; c++) ASSERT_TRUE(std::abs(mean[c] - octree.centers[3 * i + c]) < 1e-4);
+        for (int64_t j = octree.pointBegins[i]; j < octree.pointEnds[i]; j++) {
+            const float* pos = p->data<float>(posAttr, octree.points[j]);
+            float d = 0;
+            for (int c = 0; c < 3; c++) d += (pos[c] - octree.centers[3 * i + c]) * (pos[c] - octree.centers[3 * i + c]);
+            ASSERT_TRUE(std::sqrt(d) + p->data<float>(radiusAttr, octree.points[j])[0] <= octree.radii[i] * 1.0001f);
+        }
+    }
+
+    // every selection covers each particle exactly once
+    std::vector<int64_t> nodes;
+    std::vector<uint64_t> particles;
+    const int64_t budgets[] = {1, 100, 1000, n};
+    for (int b = 0; b < 4; b++) {
+        octree.selectByBudget(budgets[b], nodes, particles);
+        ASSERT_TRUE((int64_t)(nodes.size() + particles.size()) <= budgets[b]);
+        ASSERT_TRUE((int64_t)(nodes.size() + particles.size()) > (b == 3 ? n - 1 : budgets[b] / 2));
+        std::vector<int> covered(n, 0);
+        coverSelection(octree, nodes, particles, covered);
+        ASSERT_TRUE(std::count(covered.begin(), covered.end(), 1) == n);
+    }
+    const float eye[3] = {.5f, .5f, -1.f};
+    const float errors[] = {1e6f, 5.f, 0.f};
+    size_t sizes[3];
+    for (int e = 0; e < 3; e++) {
+        octree.selectByError(eye, 100.f, errors[e], nodes, particles);
+        std::vector<int> covered(n, 0);
+        coverSelection(octree, nodes, particles, covered);
+        ASSERT_TRUE(std::count(covered.begin(), covered.end(), 1) == n);
+        sizes[e] = nodes.size() + particles.size();
+    }
+    ASSERT_TRUE(sizes[0] == 1 && sizes[1] > 1 && sizes[1] < (size_t)n && sizes[2] == (size_t)n);
+    p->release();
+}
+
+int main(int argc, char* argv[])
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
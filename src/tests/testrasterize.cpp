@@ -0,0 +1,143 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+#include <gtest/gtest.h>
+#include <Partio.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+// weight of the voxel at coord for a particle at grid coordinate g
+static float splatWeight(Partio::SplatKernel kernel, float g, int coord)
+{
+    const float base = std::floor(g), t = g - base;
+    if (kernel == Partio::SplatKernel::Nearest) return int(std::floor(g + .5f)) == coord;
+    if (kernel == Partio::SplatKernel::Trilinear) return coord == base ? 1 - t : coord == base + 1 ? t : 0;
+    const float s = 1 - t;
+    if (coord == base - 1) return s * s * s / 6;
+    if (coord == base) return (3 * t * t * t - 6 * t * t + 4) / 6;
+    if (coord == base + 1) return (3 * s * s * s - 6 * s * s + 4) / 6;
+    return coord == base + 2 ? t * t * t / 6 : 0;
+}
+
+TEST(RasterizeTest, kernelsAndReductions)
+{
+    Partio::ParticlesDataMutable* p = Partio::create();
+    Partio::ParticleAttribute posAttr = p->addAttribute("position", Partio::VECTOR, 3);
+    Partio::ParticleAttribute tempAttr = p->addAttribute("temperature", Partio::VECTOR, 2);
+    const int n = 5000;
+    p->addParticles(n);
+    srand(6);
+    for (int i = 0; i < n; i++) {
+        float* pos = p->dataWrite<float>(posAttr, i);
+        for (int c = 0; c < 3; c++) pos[c] = (rand() % 1400) / 1000.f - .2f;
+        float* temp = p->dataWrite<float>(tempAttr, i);
+        temp[0] = (rand() % 100) / 10.f;
+        temp[1] = -temp[0];
+    }
+
+    // a grid of several tiles, partly covering the particles
+    Partio::VoxelGrid grid = {{-.1f, 0.f, .05f}, .03f, {40, 37, 21}};
+    const int64_t numVoxels = grid.numVoxels();
+    const Partio::SplatKernel kernels[] = {Partio::SplatKernel::Nearest, Partio::SplatKernel::Trilinear,
+                                           Partio::SplatKernel::Cubic};
+    const Partio::SplatReduce reduces[] = {Partio::SplatReduce::Sum, Partio::SplatReduce::Mean,
+                                           Partio::SplatReduce::Max};
+    std::vector<float> values(2 * numVoxels);
+    for (int k = 0; k < 3; k++) {
+        // brute force sums, weights and maxima of every voxel
+        std::vector<double> sums(2 * numVoxels, 0), weights(numVoxels, 0), maxima(2 * numVoxels, -1e10);
+        for (int i = 0; i < n; i++) {
+            const float* pos = p->data<float>(posAttr, i);
+            const float* temp = p->data<float>(tempAttr, i);
+            float g[3];
+            for (int c = 0; c < 3; c++) g[c] = (pos[c] - grid.origin[c]) / grid.voxelSize - .5f;
+            for (int64_t v = 0; v < numVoxels; v++) {
+                const int coords[3] = {int(v % 40), int(v / 40 % 37), int(v / 40 / 37)};
+                float w = 1;
+                for (int c = 0; c < 3; c++) w *= splatWeight(kernels[k], g[c], coords[c]);
+                if (w <= 0) continue;
+                weights[v] += w;
+                for (int c = 0; c < 2; c++) {
+                    sums[2 * v + c] += w * temp[c];
+                    maxima[2 * v + c] = std::max(maxima[2 * v + c], double(temp[c]));
+                }
+            }
+        }
+        for (int r = 0; r < 3; r++) {
+            ASSERT_TRUE(Partio::rasterize(*p, &tempAttr, grid, kernels[k], reduces[r], &values[0]));
+            for (int64_t v = 0; v < 2 * numVoxels; v++) {
+                double expected = 0;
+                if (weights[v / 2] > 0) {
+                    if (reduces[r] == Partio::SplatReduce::Sum) expected = sums[v];
+                    else if (reduces[r] == Partio::SplatReduce::Mean) expected = sums[v] / weights[v / 2];
+                    else expected = maxima[v];
+                }
+                ASSERT_TRUE(std::fabs(values[v] - expected) <= 1e-4 * (1 + std::fabs(expected)));
+            }
+        }
+    }
+
+    // every kernel spreads a particle's unit density over the voxels around it
+    std::vector<float> density(numVoxels);
+    Partio::ParticlesDataMutable* single = Partio::create();
+    Partio::ParticleAttribute singlePos = single->addAttribute("position", Partio::VECTOR, 3);
+    single->addParticles(1);
+    const float center[3] = {.4f, .51f, .33f};
+    std::copy(center, center + 3, single->dataWrite<float>(singlePos, 0));
+    for (int k = 0; k < 3; k++) {
+        ASSERT_TRUE(Partio::rasterize(*single, 0, grid, kernels[k], Partio::SplatReduce::Sum, &density[0]));
+        double total = 0;
+        int touched = 0;
+        for (int64_t v = 0; v < numVoxels; v++) {
+            total += density[v];
+            touched += density[v] > 0;
+        }
+        ASSERT_TRUE(std::fabs(total - 1) < 1e-5);
+        ASSERT_TRUE(touched == (k == 0 ? 1 : k == 1 ? 8 : 64));
+    }
+    single->release();
+
+    Partio::ParticleAttribute idAttr = p->addAttribute("id", Partio::INT, 1);
+    ASSERT_TRUE(!Partio::rasterize(*p, &idAttr, grid, Partio::SplatKernel::Nearest, Partio::SplatReduce::Sum,
+                                   &density[0]));
+    p->release();
+}
+
+int main(int argc, char* argv[])
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
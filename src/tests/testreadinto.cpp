@@ -0,0 +1,211 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+#include <gtest/gtest.h>
+#include <Partio.h>
+#include <algorithm>
+#include <cstdio>
+#include <sstream>
+#include <string>
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace Partio;
+
+// file in the test temporary directory named after the running test and process
+static std::string tempPath(const char* suffix)
+{
+    std::ostringstream path;
+    path<<testing::TempDir()<<"partio-readinto-"<<testing::UnitTest::GetInstance()->current_test_info()->name()
+        <<"-"<<getpid()<<suffix;
+    return path.str();
+}
+
+static ParticlesDataMutable* makeFrame(int numParticles,float offset,bool withLife)
+{
+    ParticlesDataMutable* p=create();
+    ParticleAttribute position=p->addAttribute("position",VECTOR,3);
+    ParticleAttribute life;
+    if(withLife) life=p->addAttribute("life",FLOAT,1);
+    ParticleAttribute state=p->addAttribute("state",INDEXEDSTR,1);
+    int alive=p->registerIndexedStr(state,"alive");
+    int dead=p->registerIndexedStr(state,"dead");
+    for(int i=0;i<numParticles;i++){
+        ParticleIndex index=p->addParticle();
+        float* pos=p->dataWrite<float>(position,index);
+        pos[0]=offset+i;pos[1]=offset;pos[2]=-offset;
+        if(withLife) p->dataWrite<float>(life,index)[0]=offset*i;
+        p->dataWrite<int>(state,index)[0]=i%2 ? dead : alive;
+    }
+    return p;
+}
+
+static void writeFrame(const char* filename,int numParticles,float offset,bool withLife)
+{
+    ParticlesDataMutable* p=makeFrame(numParticles,offset,withLife);
+    write(filename,*p);
+    p->release();
+}
+
+static void checkFrame(const ParticlesData& p,int numParticles,float offset,bool withLife)
+{
+    ASSERT_EQ(numParticles,p.numParticles());
+    ASSERT_EQ(withLife ? 3 : 2,p.numAttributes());
+    ParticleAttribute position,life,state;
+    ASSERT_TRUE(p.attributeInfo("position",position));
+    ASSERT_EQ(withLife,p.attributeInfo("life",life));
+    ASSERT_TRUE(p.attributeInfo("state",state));
+    const std::vector<std::string>& strs=p.indexedStrs(state);
+    ASSERT_EQ(2u,strs.size());
+    for(int i=0;i<numParticles;i++){
+        const float* pos=p.data<float>(position,i);
+        EXPECT_EQ(offset+i,pos[0]);
+        EXPECT_EQ(offset,pos[1]);
+        EXPECT_EQ(-offset,pos[2]);
+        if(withLife){
+            EXPECT_EQ(offset*i,p.data<float>(life,i)[0]);
+        }
+        EXPECT_EQ(i%2 ? "dead" : "alive",strs[p.data<int>(state,i)[0]]);
+    }
+}
+
+TEST(PartioReadInto, reusesColumns)
+{
+    const std::string first=tempPath(".1.bgeo"),second=tempPath(".2.bgeo"),third=tempPath(".3.bgeo");
+    writeFrame(first.c_str(),100,1.f,true);
+    writeFrame(second.c_str(),80,2.f,true);
+    writeFrame(third.c_str(),90,3.f,true);
+
+    ParticlesDataMutable* p=create();
+    ASSERT_TRUE(readInto(first.c_str(),*p));
+    checkFrame(*p,100,1.f,true);
+    ParticleAttribute position,state;
+    p->attributeInfo("position",position);
+    p->attributeInfo("state",state);
+    const float* column=p->data<float>(position,0);
+    const std::string* strs=&p->indexedStrs(state)[0];
+
+    // frames alternate between two sets of columns and string tables
+    ASSERT_TRUE(readInto(second.c_str(),*p));
+    checkFrame(*p,80,2.f,true);
+    ASSERT_TRUE(readInto(third.c_str(),*p));
+    checkFrame(*p,90,3.f,true);
+    p->attributeInfo("position",position);
+    p->attributeInfo("state",state);
+    EXPECT_EQ(column,p->data<float>(position,0));
+    EXPECT_EQ(strs,&p->indexedStrs(state)[0]);
+    p->release();
+    remove(first.c_str());
+    remove(second.c_str());
+    remove(third.c_str());
+}
+
+TEST(PartioReadInto, changedStrings)
+{
+    const std::string first=tempPath(".1.bgeo"),second=tempPath(".2.bgeo");
+    writeFrame(first.c_str(),10,1.f,true);
+    ParticlesDataMutable* frame=create();
+    ParticleAttribute position=frame->addAttribute("position",VECTOR,3);
+    ParticleAttribute state=frame->addAttribute("state",INDEXEDSTR,1);
+    const char* names[3]={"alive","gone","new"};
+    frame->addParticles(3);
+    for(int i=0;i<3;i++) std::fill_n(frame->dataWrite<float>(position,i),3,0.f);
+    for(int i=0;i<3;i++) frame->dataWrite<int>(state,i)[0]=frame->registerIndexedStr(state,names[i]);
+    write(second.c_str(),*frame);
+    frame->release();
+
+    // the recycled tables only match the next file's strings in part
+    ParticlesDataMutable* p=create();
+    for(int pass=0;pass<2;pass++){
+        ASSERT_TRUE(readInto(first.c_str(),*p));
+        checkFrame(*p,10,1.f,true);
+        ASSERT_TRUE(readInto(second.c_str(),*p));
+        ASSERT_TRUE(p->attributeInfo("state",state));
+        const std::vector<std::string>& strs=p->indexedStrs(state);
+        ASSERT_EQ(3u,strs.size());
+        for(int i=0;i<3;i++){
+            EXPECT_EQ(names[i],strs[p->data<int>(state,i)[0]]);
+            EXPECT_EQ(i,p->lookupIndexedStr(state,names[i]));
+        }
+        EXPECT_EQ(-1,p->lookupIndexedStr(state,"dead"));
+    }
+    p->release();
+    remove(first.c_str());
+    remove(second.c_str());
+}
+
+TEST(PartioReadInto, schemaChange)
+{
+    const std::string first=tempPath(".1.bgeo"),second=tempPath(".2.bgeo");
+    writeFrame(first.c_str(),10,1.f,true);
+    writeFrame(second.c_str(),200,2.f,false);
+
+    ParticlesDataMutable* p=read(first.c_str());
+    ASSERT_TRUE(p);
+    ASSERT_TRUE(readInto(second.c_str(),*p));
+    checkFrame(*p,200,2.f,false);
+    ASSERT_TRUE(readInto(first.c_str(),*p));
+    checkFrame(*p,10,1.f,true);
+    p->release();
+    remove(first.c_str());
+    remove(second.c_str());
+}
+
+TEST(PartioReadInto, failure)
+{
+    const std::string first=tempPath(".1.bgeo");
+    writeFrame(first.c_str(),10,1.f,true);
+    ParticlesDataMutable* p=create();
+    ASSERT_TRUE(readInto(first.c_str(),*p));
+    std::ostringstream errors;
+    EXPECT_FALSE(readInto(tempPath("-missing.bgeo").c_str(),*p,true,errors));
+    checkFrame(*p,10,1.f,true);
+    EXPECT_FALSE(readInto(tempPath(".unknown").c_str(),*p,true,errors));
+    checkFrame(*p,10,1.f,true);
+    p->release();
+
+    ParticlesDataMutable* interleaved=createInterleave();
+    EXPECT_FALSE(readInto(first.c_str(),*interleaved,true,errors));
+    interleaved->release();
+    remove(first.c_str());
+}
+
+int main(int argc, char* argv[])
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,224 @@
+/*
+PARTIO SOFTWARE
+Copyright 2010 Disney Enterprises, Inc. All rights reserved
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+* Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in
+the documentation and/or other materials provided with the
+distribution.
+
+* The names "Disney", "Walt Disney Pictures", "Walt Disney Animation
+Studios" or the names of its contributors may NOT be used to
+endorse or promote products derived from this software without
+specific prior written permission from Walt Disney Pictures.
+
+Disclaimer: THIS SOFTWARE IS PROVIDED BY WALT DISNEY PICTURES AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING,
+BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE, NONINFRINGEMENT AND TITLE ARE DISCLAIMED.
+IN NO EVENT SHALL WALT DISNEY PICTURES, THE COPYRIGHT HOLDER OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND BASED ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGES.
+*/
+
+#include <gtest/gtest.h>
+#include <Partio.h>
+#include <PartioStatic.h>
+#include <cstdio>
+#include <sstream>
+#include <string>
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace Partio;
+
+// file in the test temporary directory named after the running test and process
+static std::string tempPath(const char* suffix)
+{
+    std::ostringstream path;
+    path<<testing::TempDir()<<"partio-static-"<<testing::UnitTest::GetInstance()->current_test_info()->name()
+        <<"-"<<getpid()<<suffix;
+    return path.str();
+}
+
+typedef ParticlesStatic<StaticAttr::Position,StaticAttr::Velocity,StaticAttr::Id,StaticAttr::Radius> Schema;
+
+static_assert(Schema::stride()==32,"position+velocity+id+radius record is 32 bytes");
+static_assert(Schema::offset<StaticAttr::Position>()==0,"position is first");
+static_assert(Schema::offset<StaticAttr::Id>()==24,"id follows position and velocity");
+static_assert(Schema::offset<StaticAttr::Radius>()==28,"radius is last");
+
+Schema* makeData(int n)
+{
+    Schema* p=new Schema;
+    p->addParticles(n);
+    for(int i=0;i<n;i++){
+        float* pos=p->get<StaticAttr::Position>(i);
+        float* vel=p->get<StaticAttr::Velocity>(i);
+        pos[0]=i;pos[1]=2*i;pos[2]=3*i;
+        vel[0]=-i;vel[1]=0;vel[2]=1;
+        p->get<StaticAttr::Id>(i)[0]=100+i;
+        p->get<StaticAttr::Radius>(i)[0]=.5f*i;
+    }
+    return p;
+}
+
+TEST(StaticTest, schema)
+{
+    Schema* p=makeData(0);
+    ASSERT_EQ(4, p->numAttributes());
+    ParticleAttribute attr;
+    ASSERT_TRUE(p->attributeInfo("velocity",attr));
+    EXPECT_EQ(VECTOR, attr.type);
+    EXPECT_EQ(3, attr.count);
+    EXPECT_EQ(1, attr.attributeIndex);
+    ASSERT_TRUE(p->attributeInfo("id",attr));
+    EXPECT_EQ(INT, attr.type);
+    EXPECT_EQ(p->attribute<StaticAttr::Id>().attributeIndex, attr.attributeIndex);
+
+    // re-adding a schema attribute returns the existing handle, a mismatching one fails
+    ParticleAttribute same=p->addAttribute("radius",FLOAT,1);
+    EXPECT_EQ(3, same.attributeIndex);
+    ParticleAttribute bad=p->addAttribute("radius",VECTOR,3);
+    EXPECT_EQ(-1, bad.attributeIndex);
+    ASSERT_EQ(4, p->numAttributes());
+    p->release();
+}
+
+TEST(StaticTest, genericAccess)
+{
+    Schema* p=makeData(100);
+    ASSERT_EQ(100, p->numParticles());
+    const ParticleAttribute& posAttr=p->attribute<StaticAttr::Position>();
+    const ParticleAttribute& idAttr=p->attribute<StaticAttr::Id>();
+    for(int i=0;i<100;i++){
+        EXPECT_EQ(p->get<StaticAttr::Position>(i), p->data<float>(posAttr,i));
+        EXPECT_EQ(100+i, p->data<int>(idAttr,i)[0]);
+    }
+
+    ParticlesData::const_iterator it=static_cast<const ParticlesData*>(p)->begin();
+    ParticleAccessor radiusAccess(p->attribute<StaticAttr::Radius>());
+    it.addAccessor(radiusAccess);
+    int i=0;
+    for(;it!=static_cast<const ParticlesData*>(p)->end();++it,++i)
+        EXPECT_EQ(.5f*i, radiusAccess.data<float>(it));
+    EXPECT_EQ(100, i);
+    p->release();
+}
+
+TEST(StaticTest, extraAttributes)
+{
+    Schema* p=makeData(10);
+    ParticleAttribute life=p->addAttribute("life",FLOAT,2);
+    ASSERT_EQ(4, life.attributeIndex);
+    for(int i=0;i<10;i++) p->dataWrite<float>(life,i)[1]=i;
+    p->addParticles(1000);
+    for(int i=0;i<10;i++){
+        EXPECT_EQ(i, p->data<float>(life,i)[1]);
+        EXPECT_EQ(100+i, p->get<StaticAttr::Id>(i)[0]);
+    }
+    p->release();
+}
+
+TEST(StaticTest, readWrite)
+{
+    Schema* p=makeData(50);
+    FixedAttribute frame=p->addFixedAttribute("frame",INT,1);
+    p->fixedDataWrite<int>(frame)[0]=7;
+    const std::string filename=tempPath(".bgeo");
+    Partio::write(filename.c_str(),*p);
+    p->release();
+
+    ParticlesDataMutable* read=Partio::read(filename.c_str());
+    remove(filename.c_str());
+    ASSERT_TRUE(read);
+    ASSERT_EQ(50, read->numParticles());
+
+    // load the file into an empty static set through the generic interface
+    Schema* loaded=new Schema;
+    Partio::merge(*loaded,*read);
+    read->release();
+    ASSERT_EQ(50, loaded->numParticles());
+    ASSERT_EQ(4, loaded->numAttributes());
+    FixedAttribute loadedFrame;
+    ASSERT_TRUE(loaded->fixedAttributeInfo("frame",loadedFrame));
+    EXPECT_EQ(7, loaded->fixedData<int>(loadedFrame)[0]);
+    for(int i=0;i<50;i++){
+        EXPECT_EQ(3.f*i, loaded->get<StaticAttr::Position>(i)[2]);
+        EXPECT_EQ(100+i, loaded->get<StaticAttr::Id>(i)[0]);
+        EXPECT_EQ(.5f*i, loaded->get<StaticAttr::Radius>(i)[0]);
+    }
+    loaded->release();
+}
+
+TEST(StaticTest, readInto)
+{
+    // a file with an attribute the schema lacks, a string one, and no velocity
+    ParticlesDataMutable* file=Partio::create();
+    ParticleAttribute pos=file->addAttribute("position",VECTOR,3);
+    ParticleAttribute id=file->addAttribute("id",INT,1);
+    ParticleAttribute mass=file->addAttribute("mass",FLOAT,1);
+    ParticleAttribute state=file->addAttribute("state",INDEXEDSTR,1);
+    int tokens[2]={file->registerIndexedStr(state,"alive"),file->registerIndexedStr(state,"dead")};
+    file->addParticles(20);
+    for(int i=0;i<20;i++){
+        float* p=file->dataWrite<float>(pos,i);
+        p[0]=i;p[1]=-i;p[2]=.5f;
+        file->dataWrite<int>(id,i)[0]=7*i;
+        file->dataWrite<float>(mass,i)[0]=2.f*i;
+        file->dataWrite<int>(state,i)[0]=tokens[i%2];
+    }
+    const std::string filename=tempPath(".bgeo");
+    Partio::write(filename.c_str(),*file);
+    file->release();
+
+    Schema* p=makeData(100);
+    p->addAttribute("life",FLOAT,2);
+    ASSERT_TRUE(Partio::readInto(filename.c_str(),*p));
+    ASSERT_EQ(20, p->numParticles());
+    ASSERT_EQ(6, p->numAttributes());
+    ParticleAttribute attr;
+    EXPECT_FALSE(p->attributeInfo("life",attr));
+    ParticleAttribute loadedMass,loadedState;
+    ASSERT_TRUE(p->attributeInfo("mass",loadedMass));
+    ASSERT_TRUE(p->attributeInfo("state",loadedState));
+    EXPECT_EQ(2u, p->indexedStrs(loadedState).size());
+    for(int i=0;i<20;i++){
+        EXPECT_EQ(float(i), p->get<StaticAttr::Position>(i)[0]);
+        EXPECT_EQ(float(-i), p->get<StaticAttr::Position>(i)[1]);
+        EXPECT_EQ(7*i, p->get<StaticAttr::Id>(i)[0]);
+        // schema attributes missing from the file are zeroed
+        EXPECT_EQ(0.f, p->get<StaticAttr::Velocity>(i)[0]);
+        EXPECT_EQ(0.f, p->get<StaticAttr::Radius>(i)[0]);
+        EXPECT_EQ(2.f*i, p->data<float>(loadedMass,i)[0]);
+        EXPECT_EQ(i%2 ? "dead" : "alive", p->indexedStrs(loadedState)[p->data<int>(loadedState,i)[0]]);
+    }
+
+    // a failed read leaves the set as it was
+    remove(filename.c_str());
+    EXPECT_FALSE(Partio::readInto(filename.c_str(),*p,false));
+    EXPECT_EQ(20, p->numParticles());
+    EXPECT_EQ(7*19, p->get<StaticAttr::Id>(19)[0]);
+    p->release();
+}
+
+int main(int argc, char* argv[])
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
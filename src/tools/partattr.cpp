@@ -47,7 +47,7 @@ int main(int argc,char *argv[])
         std::cerr<<"Usage is: "<<argv[0]<<" <filename> <attrname> [numParticles (default " << MAXPARTICLES << ")\n";
         return 1;
     }
-    int maxParticles = (argc == 4) ? atoi(argv[3]) : MAXPARTICLES;
+    int64_t maxParticles = (argc == 4) ? atoll(argv[3]) : MAXPARTICLES;
     std::string attrName = argv[2];
     Partio::ParticlesDataMutable* p=Partio::read(argv[1]);
     if (!p) {
@@ -60,20 +60,20 @@ int main(int argc,char *argv[])
     maxParticles = std::min(maxParticles, p->numParticles());
 
     if (attrhandle.type == Partio::INT) {
-        for(int i = 0; i < maxParticles; i++){
+        for(int64_t i = 0; i < maxParticles; i++){
             const int* data = p->data<int>(attrhandle,i);
             std::cout << attrName << "[" << i << "]=" << data[0] << std::endl;
         }
     }
     else if (attrhandle.type == Partio::INDEXEDSTR){
         const std::vector<std::string>& indexedStrs = p->indexedStrs(attrhandle);
-        for(int i = 0; i < std::min(maxParticles, p->numParticles());i++){
+        for(int64_t i = 0; i < std::min(maxParticles, p->numParticles());i++){
             const int index = p->data<int>(attrhandle,i)[0];
             std::cout << attrName << "[" << i << "]='" << indexedStrs[index]<<"'\n";
        }
     }
     else {
-        for(int i = 0; i < std::min(maxParticles, p->numParticles());i++){
+        for(int64_t i = 0; i < std::min(maxParticles, p->numParticles());i++){
             const float* data = p->data<float>(attrhandle,i);
             std::cout << attrName << "[" << i << "]=(";
             for(int j = 0; j < attrhandle.count; j++) {
@@ -47,7 +47,7 @@ void help()
     std::cerr << "  -h/--help   : Print this help message\n";
 }
 
-void printParticle(int particleIndex, Partio::ParticlesDataMutable* p, size_t widest)
+void printParticle(int64_t particleIndex, Partio::ParticlesDataMutable* p, size_t widest)
 {
     std::cout << "---------------------------" << std::endl;
     std::cout << "Particle " << particleIndex << ":" << std::endl;
@@ -139,7 +139,7 @@ int main(int argc, char* argv[])
     widest++;
 
     if (printAllParticles) {
-        for (int i = 0; i < p->numParticles(); ++i)
+        for (int64_t i = 0; i < p->numParticles(); ++i)
             printParticle(i, p, widest);
     } else if (!particleIndices.empty()) {
         for (int i : particleIndices)
@@ -121,7 +121,7 @@ static void drawParticles()
                 }
                 else
                 {
-                    for (int i=0;i<particles->numParticles();i++)
+                    for (int64_t i=0;i<particles->numParticles();i++)
                     {
                         const float* pos=particles->data<float>(positionAttr,i);
                         bmin=bmin.min(Vec3(pos));
@@ -201,7 +201,7 @@ static void drawParticles()
     sprintf(fovString,"FOV:%i",(int)fov);
     renderBitmapString(5,20,0,GLUT_BITMAP_HELVETICA_18,fovString);
     char pointCountString[50];
-    sprintf(pointCountString,"PointCount:%i",particles->numParticles());
+    sprintf(pointCountString,"PointCount:%lld",(long long)particles->numParticles());
     renderBitmapString(5,40,0,GLUT_BITMAP_HELVETICA_18,pointCountString);
 
     char frameNumString[50];
@@ -244,7 +244,7 @@ static void drawParticles()
             {
                 const float* alpha=particles->data<float>(alphaAttr,0);
                 float * rgba = (float *) malloc(particles->numParticles()*sizeof(float)*4);
-                for (int i=0;i<particles->numParticles();i++)
+                for (int64_t i=0;i<particles->numParticles();i++)
                 {
                     rgba[i*3] = rgb[i*3];
                     rgba[(i*3)+1] = rgb[(i*3)+1];
@@ -267,7 +267,7 @@ static void drawParticles()
             {
                 rgba = (float *) malloc(particles->numParticles()*sizeof(float)*4);
                 alpha=particles->data<float>(alphaAttr,0);
-                for (int i=0;i<particles->numParticles();i++)
+                for (int64_t i=0;i<particles->numParticles();i++)
                 {
                     rgba[i*4] = colorR+brightness;
                     rgba[(i*4)+1] = colorG+brightness;
@@ -279,7 +279,7 @@ static void drawParticles()
             else
             {
                 rgba = (float *) malloc(particles->numParticles()*sizeof(float)*3);
-                for (int i=0;i<particles->numParticles()*3;i++)
+                for (int64_t i=0;i<particles->numParticles()*3;i++)
                 {
                     rgba[i] = colorR+brightness;
                 }
@@ -299,7 +299,7 @@ static void drawParticles()
     if(connectivity){
         //std::cerr<<"drawing connect"<<std::endl;
         glBegin(GL_LINES);
-        for(int i=0;i<connectivity->numParticles();i++){
+        for(int64_t i=0;i<connectivity->numParticles();i++){
             int v1=connectivity->data<int>(attr1,i)[0];
             int v2=connectivity->data<int>(attr2,i)[0];
             //std::cerr<<"v1 "<<v1<<" v2 "<<v2<<std::endl;